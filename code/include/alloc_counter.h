@@ -0,0 +1,9 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- Heap allocation counter -----------------------
+// Counts malloc/calloc/realloc calls made anywhere in the firmware. Enabled
+// with -D ALLOC_COUNTER together with the matching -Wl,--wrap linker flags
+// in platformio.ini; otherwise allocCount() always returns 0.
+
+uint32_t allocCount();
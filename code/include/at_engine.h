@@ -0,0 +1,86 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- AT command engine -----------------------
+// Line-oriented driver for the SIM7600. A command completes as soon as a
+// final result code arrives (OK / ERROR / +CME ERROR), the data prompt the
+// caller asked for ("DOWNLOAD", ">"), or the URC named as its final line
+// (e.g. "+HTTPACTION:"). Unmatched unsolicited lines go to URC handlers.
+
+#define AT_REPLY_MAX        1024    // collected response text per command
+#define AT_LINE_MAX         256     // longest single line from the modem
+#define AT_MAX_URC_HANDLERS 16
+
+// Default per-command timeouts
+#define AT_TIMEOUT_SHORT_MS   1000
+#define AT_TIMEOUT_HTTP_MS    30000
+#define AT_TIMEOUT_NET_MS     15000
+
+enum AtResult : uint8_t {
+  AT_PENDING = 0,
+  AT_OK,
+  AT_ERROR,
+  AT_CME_ERROR,
+  AT_PROMPT,      // modem is waiting for payload bytes
+  AT_TIMEOUT,
+  AT_BUSY,        // another command is still in flight
+  AT_ABORTED,     // refused by the gate hook, nothing was sent
+};
+
+struct AtReply {
+  AtResult    result;
+  int         cmeCode;      // +CME ERROR: <n>, -1 if none
+  uint32_t    elapsedMs;    // from command write to completion
+  const char* text;         // response lines joined by '\n', NUL-terminated
+  size_t      len;
+};
+
+typedef void (*AtUrcHandler)(const char* line);
+typedef void (*AtIdleHook)();
+typedef void (*AtDoneHook)(const char* cmd, const AtReply& reply);
+typedef bool (*AtGateHook)(const char* cmd);
+
+void atBegin(Stream& port);
+
+// Non-blocking API: start a command, then call atPoll() until it stops
+// returning AT_PENDING. finalLine, if given, is the line prefix that ends
+// the command (a URC after OK, or a data prompt instead of OK).
+AtResult atStart(const char* cmd, uint32_t timeoutMs, const char* finalLine = nullptr);
+AtResult atStartData(const uint8_t* data, size_t len, uint32_t timeoutMs, const char* finalLine = nullptr);
+AtResult atPoll();
+const AtReply& atReply();
+bool atBusy();
+
+// Blocking helpers built on the non-blocking API. The idle hook runs while
+// waiting so the rest of the firmware keeps being serviced.
+AtResult atCommand(const char* cmd, uint32_t timeoutMs = AT_TIMEOUT_SHORT_MS, const char* finalLine = nullptr);
+AtResult atSendData(const char* data, size_t len, uint32_t timeoutMs = AT_TIMEOUT_SHORT_MS, const char* finalLine = nullptr);
+void atSetIdleHook(AtIdleHook hook);
+
+// Called with the command line (or "<n data bytes>") as each command
+// completes, for latency accounting.
+void atSetDoneHook(AtDoneHook hook);
+
+// Asked before each command line (not data) is written; returning false
+// ends the command with AT_ABORTED instead. Commands are only refused
+// between exchanges, never while the modem waits for data.
+void atSetGateHook(AtGateHook hook);
+
+// Route unsolicited lines starting with prefix to handler.
+bool atOnUrc(const char* prefix, AtUrcHandler handler);
+
+// Send the next `lines` non-empty lines to handler regardless of content,
+// for URCs followed by raw data (e.g. MQTT topic/payload). The handler may
+// call this again to keep capturing.
+void atCaptureLines(AtUrcHandler handler, uint8_t lines);
+
+// Drain the UART and dispatch URCs while no command is in flight.
+void atService();
+
+// Total time spent with a command in flight since boot.
+uint32_t atBusyMsTotal();
+
+// Part of that spent inside atCommand()/atSendData() waiting for the modem.
+uint32_t atBlockedMsTotal();
+
+const char* atResultName(AtResult r);
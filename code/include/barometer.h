@@ -0,0 +1,61 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- BMP390 altitude -----------------------
+// The BMP390 samples pressure + temperature at 50 Hz into its FIFO and
+// pulls INT low at the watermark; baroPoll() drains the whole batch in a few
+// burst reads and runs the samples through two IIR altitude filters. The
+// fast one catches sudden drops (falls, a flight of stairs), the slow one
+// tracks floor changes against a reference that follows weather drift.
+// While the wearer is still, the sensor sleeps and only wakes for one batch
+// every BARO_IDLE_PERIOD_MS. The filters count samples, so each wake
+// restarts them from its first sample and moves the floor reference there:
+// only continuous sampling reports floors, and pressure that changed while
+// the wearer was still is taken as weather.
+
+#define BARO_I2C_ADDR         0x76      // SDO tied to GND
+#define BARO_INT_PIN          D8        // open-drain, active low: see baroBegin()
+#define BARO_RATE_HZ          50
+#define BARO_WATERMARK        25        // frames per interrupt (0.5 s)
+#define BARO_IDLE_PERIOD_MS   30000
+#define BARO_POLL_MS          2000      // fallback drain if an edge is missed
+
+#define BARO_DROP_CM          80        // fast altitude lost within the window
+#define BARO_DROP_WINDOW_MS   1000
+#define BARO_FLOOR_CM         250       // most of a storey (~3 m)
+#define BARO_FAST_SHIFT       2         // fast IIR: alpha = 1/4
+#define BARO_SLOW_SHIFT       7         // slow IIR: alpha = 1/128 (~2.5 s)
+#define BARO_DRIFT_SAMPLES    30000     // reference follows drift over ~10 min of sampling
+
+enum BaroEventType : uint8_t {
+  BARO_DROP = 0,
+  BARO_FLOOR_UP,
+  BARO_FLOOR_DOWN,
+};
+
+struct BaroEvent {
+  BaroEventType type;
+  int32_t       deltaCm;   // altitude change that triggered it
+};
+
+struct BaroStats {
+  uint32_t transactions;   // I2C transfers since boot
+  uint32_t samples;
+};
+
+// Returns false if no BMP390 answers.
+bool baroBegin();
+
+// Continuous sampling while moving; duty-cycled batches otherwise.
+void baroSetContinuous(bool continuous);
+
+// Drains the FIFO when due. Cheap otherwise.
+void baroPoll();
+
+// Returns true and fills ev while events are pending.
+bool baroEvent(BaroEvent& ev);
+
+// Slow-filtered altitude relative to the first sample, cm.
+int32_t baroAltitudeCm();
+
+const BaroStats& baroStats();
@@ -0,0 +1,38 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- SOS buttons -----------------------
+// Edges are captured by GPIO interrupts with an esp_timer timestamp and
+// pushed into a lock-free ring, so presses are never lost while the loop is
+// blocked on the modem. buttonsPoll() debounces the edges and turns them
+// into events; it is cheap enough to call from the AT engine idle hook.
+
+#define BUTTON_COUNT          2
+#define BUTTON_EDGE_QUEUE     32        // power of two
+#define BUTTON_DEBOUNCE_US    30000
+#define BUTTON_LONG_US        1500000   // held this long -> BTN_LONG
+#define BUTTON_DOUBLE_US      400000    // second press within this -> BTN_DOUBLE
+
+enum ButtonEventType : uint8_t {
+  BTN_PRESS = 0,    // debounced press edge, reported immediately
+  BTN_SHORT,        // single press, released, no second press followed
+  BTN_DOUBLE,
+  BTN_LONG,         // fires while still held
+};
+
+struct ButtonEvent {
+  uint8_t         button;     // 0 = A, 1 = B
+  ButtonEventType type;
+  int64_t         edgeUs;     // esp_timer time of the press edge
+};
+
+void buttonsBegin(uint8_t pinA, uint8_t pinB);
+
+// Returns true and fills ev while events are pending.
+bool buttonsPoll(ButtonEvent& ev);
+
+// A button is held, or a gesture is still being decided.
+bool buttonsBusy();
+
+// Edges lost because the ISR ring was full.
+uint32_t buttonsDroppedEdges();
@@ -0,0 +1,73 @@
+#pragma once
+#include <Arduino.h>
+#include "vibration.h"
+
+// ----------------------- Remote commands -----------------------
+// A command body comes with a telemetry response (the fallback) or as an
+// MQTT push. It holds one command object or {"commands":[...]}:
+//   {"id":"c1","command":"vibrate","pattern":"pulse"}    alert (default), pulse, tap, double
+//   {"id":"c2","command":"stop"}
+//   {"id":"c3","command":"locate"}                       fix and upload now
+//   {"id":"c4","command":"set_rate","period_s":30}       0 = back to the motion schedule
+//   {"id":"c5","command":"set_thresholds","free_fall_mg":350,"impact_mg":3000}
+// The parser pulls the body in one chunk at a time as it goes. ArduinoJson
+// keeps only the fields above (a filter document) in a fixed arena, so a
+// long or hostile body costs parse time, not RAM. Every command is
+// acknowledged by its ID, on the channel it came in on.
+
+#define COMMAND_MAX          8        // per body; the rest come again unacknowledged
+#define COMMAND_ID_MAX       24       // [A-Za-z0-9_.:-], including the NUL
+#define COMMAND_ARENA_BYTES  4096     // parsed document
+#define COMMAND_FILTER_BYTES 1536     // filter document, built once
+#define COMMAND_NESTING      4        // {"commands":[{...}]} is three deep
+#define COMMAND_RECENT       8        // IDs remembered so a redelivery runs once
+
+enum CommandType : uint8_t {
+  COMMAND_UNKNOWN = 0,
+  COMMAND_VIBRATE,
+  COMMAND_STOP,
+  COMMAND_LOCATE,
+  COMMAND_SET_RATE,
+  COMMAND_SET_THRESHOLDS,
+};
+
+struct Command {
+  CommandType       type;
+  bool              valid;        // arguments present and in range
+  char              id[COMMAND_ID_MAX];   // "" if none (or not a usable ID)
+  const VibPattern* pattern;      // VIBRATE
+  uint32_t          periodS;      // SET_RATE
+  uint16_t          freeFallMg;   // SET_THRESHOLDS, 0 = keep
+  uint16_t          impactMg;
+};
+
+struct CommandBatch {
+  Command items[COMMAND_MAX];
+  uint8_t count;
+};
+
+struct CommandStats {
+  uint32_t bodies;        // bodies parsed
+  uint32_t commands;
+  uint32_t rejected;      // bodies that were not valid JSON or did not fit
+  uint32_t arenaPeak;     // most of the arena any document used, since boot
+};
+
+// Hands out the next piece of the body: returns its length with chunk
+// pointing at it, 0 at the end or on a read error.
+typedef size_t (*CommandSource)(void* ctx, const char*& chunk);
+
+// Parses a body pulled from source. False if it was not valid JSON, was
+// cut short or did not fit; out is then empty and nothing should run.
+bool commandParse(CommandSource source, void* ctx, CommandBatch& out);
+bool commandParseText(const char* text, size_t len, CommandBatch& out);
+
+// True if id ran recently (delivered again: ack it, don't run it). An ID
+// is recorded only once its command has run, so one that failed runs again
+// when it is redelivered.
+bool commandSeen(const char* id);
+void commandRecord(const char* id);
+
+const char* commandTypeName(CommandType t);
+const CommandStats& commandStats();
+void commandResetStats();
@@ -0,0 +1,55 @@
+#pragma once
+#include <Arduino.h>
+#include "at_engine.h"
+
+// ----------------------- Diagnostics -----------------------
+// Fixed-size counters and log2 histograms for the hot paths: AT command
+// latency per command, loop iteration time, time blocked on the modem,
+// heap, HTTP outcomes, boot milestones and GNSS fix timing. Recording is a
+// few adds; the record is only formatted when printed ("diag" on the serial
+// console) or uploaded, after which the interval counters start over.
+
+#define DIAG_BUCKETS          20        // bucket b holds values in [2^(b-1), 2^b)
+#define DIAG_AT_KINDS         16        // distinct commands tracked; the last is "other"
+#define DIAG_AT_NAME_MAX      16
+#define DIAG_UPLOAD_MS        3600000
+#define DIAG_RECORD_MAX       2048
+
+enum DiagCounter : uint8_t {
+  DIAG_HTTP_OK = 0,
+  DIAG_HTTP_FAIL,
+  DIAG_FIX_OK,
+  DIAG_FIX_NONE,
+  DIAG_MQTT_COMMANDS,
+  DIAG_COUNTER_COUNT,
+};
+
+struct DiagHistogram {
+  uint16_t bins[DIAG_BUCKETS];    // saturating
+  uint32_t count;
+  uint32_t max;
+};
+
+void diagBegin();
+
+void diagHistAdd(DiagHistogram& h, uint32_t value);
+
+// AtDoneHook for atSetDoneHook()
+void diagAtDone(const char* cmd, const AtReply& reply);
+
+void diagLoop(uint32_t us);
+void diagCount(DiagCounter c);
+
+// Call after each fix attempt; the first success sets time-to-first-fix.
+void diagFix(bool ok);
+
+// Samples free / minimum free / largest free block.
+void diagSampleHeap();
+
+// Compact JSON of everything since the last diagReset(), in a static
+// buffer; len is 0 if it did not fit.
+const char* diagRecord(size_t& len);
+void diagReset();
+
+// Reads the serial console; "diag" prints the record, "diag reset" clears it.
+void diagSerialService();
@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ----------------------- Energy accounting -----------------------
+// Time spent in each power state, multiplied by a nominal current, gives a
+// mAh estimate per subsystem. The firmware feeds it measured durations (the
+// native simulator the same ones on its virtual clock). Currents are
+// datasheet-typical figures at 3.8 V, not measurements of this board.
+
+enum EnergyRail : uint8_t {
+  ENERGY_CPU_ACTIVE = 0,
+  ENERGY_CPU_SLEEP,       // ESP32-C3 light sleep
+  ENERGY_MODEM_BUSY,      // SIM7600 with a command / transfer in flight
+  ENERGY_MODEM_IDLE,      // registered, paging per (e)DRX cycle
+  ENERGY_GNSS,
+  ENERGY_VIBRATION,
+  ENERGY_RAIL_COUNT,
+};
+
+struct EnergyModel {
+  uint32_t ms[ENERGY_RAIL_COUNT];
+};
+
+// Nominal current per rail, mA
+extern const float ENERGY_RAIL_MA[ENERGY_RAIL_COUNT];
+
+void energyReset(EnergyModel& m);
+void energyAdd(EnergyModel& m, EnergyRail rail, uint32_t ms);
+
+float energyMah(const EnergyModel& m, EnergyRail rail);
+
+// Average draw over elapsedMs, mAh per hour (= mA)
+float energyMahPerHour(const EnergyModel& m, EnergyRail rail, uint32_t elapsedMs);
+
+const char* energyRailName(EnergyRail rail);
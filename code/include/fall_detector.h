@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ----------------------- Fall detection -----------------------
+// Streaming detector for the free-fall -> impact -> stillness sequence.
+// Works on squared acceleration magnitude in integer milli-g, so there is
+// no sqrt or float per sample. The last FALL_RING samples are kept in a
+// ring buffer and copied out shortly after the impact as a snapshot for
+// the event. No Arduino dependency.
+
+#define FALL_RING              256      // samples kept for the snapshot
+#define FALL_FREE_FALL_MG      400      // |a| below this is free fall
+#define FALL_FREE_FALL_MIN_MS  60       // ~18 cm drop
+#define FALL_IMPACT_MG         2500
+#define FALL_IMPACT_WINDOW_MS  500      // impact must follow free fall within this
+#define FALL_POST_IMPACT_MS    500      // samples after the impact kept in the snapshot
+#define FALL_SETTLE_MS         1000     // ignored after the impact (bounces, rolling)
+#define FALL_STILL_MS          2000     // must then lie still this long
+#define FALL_STILL_BAND_MG     200      // |a| within 1 g +/- this counts as still
+#define FALL_FREE_FALL_MG_MIN  100      // accepted for remote thresholds
+#define FALL_FREE_FALL_MG_MAX  900
+#define FALL_IMPACT_MG_MIN     1200
+#define FALL_IMPACT_MG_MAX     7500     // lowered to the sensor's full scale by fallBegin()
+#define FALL_IMPACT_HEADROOM_MG 250     // under full scale: a hit along one axis clips there
+
+struct AccelSample {
+  int16_t x, y, z;        // milli-g
+};
+
+struct FallEvent {
+  uint32_t impactSample;  // sample index of the impact peak
+  uint16_t peakMg;
+  uint16_t freeFallMs;
+};
+
+// fullScaleMg is the accelerometer's configured range; impact thresholds
+// the clipped samples could never reach are refused.
+void fallBegin(uint16_t rateHz, uint16_t fullScaleMg);
+
+// Replaces the free-fall and/or impact threshold (FALL_FREE_FALL_MG and
+// FALL_IMPACT_MG until then); 0 keeps one. False, with nothing changed, if
+// a value is out of range, the impact one above fallImpactMaxMg().
+bool fallSetThresholds(uint16_t freeFallMg, uint16_t impactMg);
+uint16_t fallImpactMaxMg();
+
+// Feed a block of consecutive samples at the configured rate.
+void fallFeed(const AccelSample* samples, size_t n);
+
+// Returns true once per confirmed fall.
+bool fallPoll(FallEvent& ev);
+
+// Samples around the last confirmed fall, oldest first. Stays valid until
+// the next impact.
+size_t fallSnapshot(const AccelSample*& out);
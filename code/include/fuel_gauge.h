@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- Battery fuel gauge -----------------------
+// Samples the battery divider a few times a minute instead of every loop.
+// Each sample averages FUEL_OVERSAMPLE ADC reads (min and max dropped),
+// adds back the sag expected while the modem or motor is drawing current,
+// and goes through an IIR filter before the Li-ion discharge curve maps it
+// to percent. The result is cached; fuelReportDue() only hands it out for
+// upload when it moved by FUEL_REPORT_STEP or more.
+
+#define FUEL_DIVIDER_RATIO    11.0f
+#define FUEL_SAMPLE_MS        20000
+#define FUEL_OVERSAMPLE       16
+#define FUEL_FILTER_SHIFT     2         // IIR alpha = 1/4
+#define FUEL_MODEM_SAG_MV     80        // SIM7600 transmitting
+#define FUEL_VIB_SAG_MV       40        // vibration motor on
+#define FUEL_REPORT_STEP      2         // percent
+
+// Loads active while a sample is taken
+#define FUEL_LOAD_MODEM       0x01
+#define FUEL_LOAD_VIBRATION   0x02
+
+struct FuelStats {
+  uint32_t adcReads;
+  uint32_t samples;
+  uint32_t reports;       // percentages uploaded
+  uint8_t  jitterPct;     // largest step between consecutive estimates
+};
+
+void fuelBegin(uint8_t pin);
+
+// Takes a sample when FUEL_SAMPLE_MS has passed. loads is FUEL_LOAD_* bits.
+void fuelService(uint8_t loads);
+
+// Cached estimate; -1 before the first sample.
+int fuelPercent();
+uint16_t fuelMillivolts();
+
+// True (and the percentage) if it changed enough to be worth uploading.
+// The caller confirms with fuelReported() once the upload succeeded.
+bool fuelReportDue(int& pct);
+void fuelReported(int pct);
+
+const FuelStats& fuelStats();
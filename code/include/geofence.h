@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ----------------------- Geofences -----------------------
+// Circles and polygons evaluated on-device against every fix, so enter and
+// exit events go out as soon as they happen. Coordinates stay in the 1e-7
+// degree integers the GNSS parser produces and all tests are integer-only.
+// A coarse grid over the fences' combined bounding box maps each cell to a
+// bitmask of fences overlapping it; a fix only runs the exact test on
+// fences in its cell whose own bounding box contains it. No Arduino
+// dependency, so the same code runs off-device.
+//
+// Fences arrive as ';'-terminated text records (see geofenceParseLine()):
+//   V,<version>;
+//   C,<name>,<latE7>,<lonE7>,<radius m>;
+//   P,<name>,<vertex count>;     followed by that many  <latE7>,<lonE7>;
+
+#define GEOFENCE_MAX          32        // one bit per fence in the grid masks
+#define GEOFENCE_VERTEX_MAX   512       // shared by all polygons
+#define GEOFENCE_NAME_MAX     24        // including the terminating NUL
+#define GEOFENCE_GRID         8         // cells per side
+#define GEOFENCE_SPAN_MAX_E7  100000000 // 10 deg; keeps the cross products in int64
+
+enum GeofenceShape : uint8_t {
+  GEOFENCE_CIRCLE = 0,
+  GEOFENCE_POLYGON,
+};
+
+struct Geofence {
+  GeofenceShape shape;
+  bool     inside;
+  char     name[GEOFENCE_NAME_MAX];
+  int32_t  minLat, maxLat, minLon, maxLon;   // bounding box, 1e-7 deg
+  // Circle: centre, radius in latitude units and cos(lat) in Q16
+  int32_t  latE7, lonE7;
+  int64_t  radiusE7Sq;
+  int32_t  cosQ16;
+  // Polygon: vertices [first, first + count) of the shared pool
+  uint16_t first, count;
+};
+
+struct GeofenceSet {
+  uint32_t version;
+  uint8_t  count;
+  uint16_t vertexCount;
+  bool     primed;                  // inside flags valid (first fix seen)
+  Geofence fences[GEOFENCE_MAX];
+  int32_t  vertLat[GEOFENCE_VERTEX_MAX];
+  int32_t  vertLon[GEOFENCE_VERTEX_MAX];
+
+  // Grid index, rebuilt by geofenceBuildIndex()
+  int32_t  gridMinLat, gridMinLon;
+  int32_t  cellLat, cellLon;        // cell size, 1e-7 deg
+  uint32_t cells[GEOFENCE_GRID * GEOFENCE_GRID];
+
+  // Line parser state for a polygon in progress
+  uint16_t pendingVertices;
+};
+
+struct GeofenceEvent {
+  uint8_t     fence;
+  bool        entered;
+  const char* name;
+};
+
+void geofenceClear(GeofenceSet& set);
+
+bool geofenceAddCircle(GeofenceSet& set, const char* name, int32_t latE7, int32_t lonE7, uint32_t radiusM);
+
+// Starts a polygon; its vertices follow through geofenceAddVertex().
+bool geofenceBeginPolygon(GeofenceSet& set, const char* name, uint16_t vertices);
+bool geofenceAddVertex(GeofenceSet& set, int32_t latE7, int32_t lonE7);
+
+// Feeds one record of the text format (without the ';'). False on a
+// malformed line or when a limit is hit; the set is then incomplete.
+bool geofenceParseLine(GeofenceSet& set, const char* line, size_t len);
+
+// Must run after the last fence was added; drops an unfinished polygon.
+void geofenceBuildIndex(GeofenceSet& set);
+
+// Exact containment test for one fence, no index involved.
+bool geofenceContains(const GeofenceSet& set, uint8_t fence, int32_t latE7, int32_t lonE7);
+
+// Keeps the inside flags of fences that exist (by name) in both sets, so a
+// reload does not repeat or lose transitions. Call after geofenceBuildIndex().
+void geofenceCarryState(GeofenceSet& to, const GeofenceSet& from);
+
+// Updates the inside flags for a fix and writes up to max transitions to
+// out. The first fix after a load only primes the flags.
+uint8_t geofenceEvaluate(GeofenceSet& set, int32_t latE7, int32_t lonE7, GeofenceEvent* out, uint8_t max);
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ----------------------- GNSS fix parsing -----------------------
+// Single-pass parser for SIM7600 "+CGPSINFO:" data. Works directly on a
+// character span (no copies, no heap, no floats) so it can run on the
+// modem's reply buffer and be reused off-device.
+//
+//   +CGPSINFO: <lat>,<N/S>,<lon>,<E/W>,<ddmmyy>,<hhmmss.s>,<alt>,<speed>,<course>
+//   lat = ddmm.mmmmmm, lon = dddmm.mmmmmm, alt in m, speed in knots
+
+#define GNSS_HAS_ALT     0x01
+#define GNSS_HAS_SPEED   0x02
+#define GNSS_HAS_COURSE  0x04
+
+struct GnssFix {
+  int32_t  latE7;        // degrees * 1e7, south negative
+  int32_t  lonE7;        // degrees * 1e7, west negative
+  int32_t  altCm;        // metres above MSL * 100
+  uint32_t speedCmS;     // ground speed, cm/s
+  uint16_t courseCdeg;   // course over ground, degrees * 100
+  uint8_t  day, month, year;          // year is 2-digit (00..99 -> 2000..2099)
+  uint8_t  hour, minute, second;
+  uint16_t millis;
+  uint8_t  flags;        // GNSS_HAS_*
+};
+
+enum GnssParseResult : uint8_t {
+  GNSS_OK = 0,
+  GNSS_NO_FIX,           // well-formed line with empty fields
+  GNSS_MALFORMED,        // corrupt, truncated or out-of-range data
+};
+
+// s may include the "+CGPSINFO:" prefix and a trailing CR/LF. out is only
+// written on GNSS_OK.
+GnssParseResult gnssParseCgpsinfo(const char* s, size_t len, GnssFix& out);
+
+// Seconds since 1970-01-01 UTC for the fix's date and time.
+uint32_t gnssUnixTime(const GnssFix& fix);
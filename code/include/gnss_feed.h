@@ -0,0 +1,42 @@
+#pragma once
+#include <Arduino.h>
+#include "gnss.h"
+
+// ----------------------- GNSS auto-report feed -----------------------
+// Instead of polling AT+CGPSINFO every cycle, the modem pushes a
+// "+CGPSINFO:" line once per upload period (AT+CGPSINFO=<secs>). Lines come
+// in through the AT engine's URC table, also while other commands are in
+// flight, and are parsed on arrival, so the cycle reads the newest fix from
+// RAM. Reporting is armed shortly before a cycle so each report lands just
+// ahead of the next one; it is re-armed when the period changes, GNSS
+// comes back on or the two drift apart. A poll is only sent when no usable
+// report is at hand.
+
+#define GNSS_FEED_LEAD_MS        500      // report this long before the cycle
+#define GNSS_FEED_SLACK_MS       1500     // older than lead + slack: realign
+#define GNSS_FEED_MAX_S          255      // longest interval the modem takes
+
+struct GnssFeedStats {
+  uint32_t reports;       // auto-report lines received
+  uint32_t fixes;         // ... that carried a fix
+  uint32_t reportBytes;   // UART bytes those lines took
+  uint32_t polls;         // fallback AT+CGPSINFO round trips
+  uint32_t pollMs;        // time spent in them
+  uint32_t lastAgeMs;     // age of the fix handed out last
+  uint32_t firstFixMs;    // millis() of the first fix, 0 = none yet
+};
+
+void gnssFeedBegin();
+
+// Arms, realigns or stops reporting; call every loop with the time left
+// to the next cycle.
+void gnssFeedService(bool gnssOn, uint32_t periodMs, uint32_t msToNextCycle);
+
+// Caps the idle time so the loop is awake to arm reporting on time.
+uint32_t gnssFeedSleepMs(uint32_t msToNextCycle);
+
+// Newest fix from the feed, or from a poll when the feed has nothing
+// recent. A recent report without a fix means no fix, without polling.
+bool gnssFeedFix(GnssFix& fix);
+
+const GnssFeedStats& gnssFeedStats();
@@ -0,0 +1,26 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- Hardware abstraction -----------------------
+// The board calls the firmware makes outside the I2C sensor drivers and the
+// light-sleep code: modem UART, GPIO, PWM and ADC. hal_arduino.cpp maps them
+// onto the ESP32 Arduino core; the native environment (native/) backs them
+// with simulated pins and a SIM7600 model. Time stays on millis() and
+// esp_timer_get_time(), which the native build drives from a virtual clock.
+
+// Opens the SIM7600 UART (UART0, default pins).
+Stream& halModemBegin(uint32_t baud);
+
+// ----------------------- GPIO -----------------------
+void halPinInput(uint8_t pin, bool pullup);
+int  halPinRead(uint8_t pin);
+// mode is RISING / FALLING / CHANGE, as for attachInterrupt()
+void halPinInterrupt(uint8_t pin, void (*isr)(), int mode);
+
+// ----------------------- PWM -----------------------
+void halPwmBegin(uint8_t pin, uint8_t channel, uint32_t freqHz, uint8_t bits);
+void halPwmWrite(uint8_t channel, uint32_t duty);
+
+// ----------------------- ADC -----------------------
+void halAdcBegin(uint8_t bits);
+uint32_t halAdcMillivolts(uint8_t pin);
@@ -0,0 +1,42 @@
+#pragma once
+#include <Arduino.h>
+#include "fall_detector.h"
+
+// ----------------------- LSM6DSL acquisition -----------------------
+// Accel + gyro run at IMU_RATE_HZ into the sensor's hardware FIFO. The
+// FIFO watermark raises INT1; imuPoll() then drains it in burst reads at
+// 400 kHz and hands the samples to the consumer as one contiguous block,
+// so the CPU and the bus wake a few times per second instead of per sample.
+
+#define IMU_I2C_ADDR     0x6A       // SDO/SA0 tied to GND
+#define IMU_I2C_HZ       400000
+#define IMU_SDA_PIN      D4
+#define IMU_SCL_PIN      D5
+#define IMU_INT1_PIN     D2
+#define IMU_RATE_HZ      104
+#define IMU_FULL_SCALE_MG 4000      // +/-4 g accelerometer range
+#define IMU_WATERMARK    26         // sample sets per interrupt (~250 ms)
+#define IMU_BLOCK_MAX    64         // samples per handler call at most
+#define IMU_POLL_MS      1000       // fallback drain if an edge is missed
+
+struct ImuSample {
+  AccelSample accel;      // milli-g, +/-4 g range
+  int16_t     gx, gy, gz; // 0.01 dps, +/-250 dps range
+};
+
+typedef void (*ImuBlockHandler)(const ImuSample* samples, size_t n);
+
+struct ImuStats {
+  uint32_t samples;       // sample sets delivered
+  uint32_t busUs;         // time spent in I2C transfers
+  uint32_t wakeups;       // FIFO drains
+  uint32_t overruns;      // FIFO filled up before it was drained
+};
+
+// Returns false if no LSM6DSL answers.
+bool imuBegin(ImuBlockHandler handler);
+
+// Drains the FIFO when the watermark interrupt has fired. Cheap otherwise.
+void imuPoll();
+
+const ImuStats& imuStats();
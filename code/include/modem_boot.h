@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- Modem boot sequencer -----------------------
+// Brings the SIM7600 up on its readiness signals instead of fixed delays:
+// "AT" probes until the modem answers (or "RDY" arrives), then the SIM
+// (+CPIN: READY), network registration (+CEREG) and the data link. GNSS
+// is started as soon as the modem answers, so it searches while the modem
+// registers; without a fix by the time the link is up it gets AGPS data
+// (AT+CAGPS). A failed AT+NETOPEN is retried with doubling back-off; the
+// sequence only finishes once the link is open. Each step is one short
+// exchange per modemBootService() call, so the loop keeps serving buttons
+// throughout.
+
+#define MODEM_BOOT_PROBE_MS        500      // between "AT" probes
+#define MODEM_BOOT_PROBE_TIMEOUT   300
+#define MODEM_BOOT_POLL_MS         1000     // +CPIN / +CEREG queries
+#define MODEM_BOOT_REG_TIMEOUT_MS  60000    // give up waiting and try the link anyway
+#define MODEM_BOOT_DATA_RETRY_MS   2000     // first AT+NETOPEN retry, doubling
+#define MODEM_BOOT_RETRY_MAX_MS    60000
+
+struct ModemBootStats {
+  uint32_t answeredMs;    // millis() of each milestone, 0 = not reached
+  uint32_t simMs;
+  uint32_t registeredMs;
+  uint32_t dataMs;        // data link open: ready for telemetry
+  uint32_t gnssStartMs;
+  uint32_t ttffMs;        // first fix after gnssStartMs, 0 = none yet
+  bool     modemWasOn;    // answered without a power-up ("RDY")
+  bool     gnssHot;       // engine kept running or hot-started
+  bool     agps;          // assistance data injected
+  uint16_t dataFailures;  // AT+NETOPEN attempts that did not open the link
+};
+
+void modemBootBegin();
+
+// Runs the next step when due; true once the data link is up.
+bool modemBootService();
+bool modemBootDone();
+
+// SIM ready and registration over, only the data link missing: texts can
+// go out while AT+NETOPEN is retried.
+bool modemBootTextReady();
+
+// Time until the next step is due, for the idle wait.
+uint32_t modemBootWaitMs();
+
+const ModemBootStats& modemBootStats();
@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+#include "diag.h"
+
+// ----------------------- Modem transaction scheduler -----------------------
+// The SIM7600 serves one exchange at a time, so work is ranked by class:
+// SOS > fall > command ack > GPS > battery > background (outbox replay,
+// geofence sync, diagnostics, MQTT reconnect). Work is requested when it
+// becomes due and runs as a transaction. A transaction of a lower class is
+// deferred while anything more urgent is waiting. If it is already running,
+// the AT gate refuses its next command, so it unwinds as on an error and is
+// retried later. Nothing is cut short once it is committed (an HTTP action
+// has been sent, or an MQTT exchange started), so the server never sees
+// half a request twice.
+
+enum ModemPrio : uint8_t {
+  MODEM_PRIO_SOS = 0,
+  MODEM_PRIO_FALL,
+  MODEM_PRIO_ACK,
+  MODEM_PRIO_GPS,
+  MODEM_PRIO_BATTERY,
+  MODEM_PRIO_BACKGROUND,
+  MODEM_PRIO_COUNT,
+  MODEM_PRIO_NONE = MODEM_PRIO_COUNT,
+};
+
+struct ModemClassStats {
+  uint32_t      requests;
+  uint32_t      delivered;
+  uint32_t      preempted;    // transactions of this class cut short
+  DiagHistogram waitMs;       // request -> its transaction starts
+  DiagHistogram totalMs;      // request -> delivered
+};
+
+// Installs the AT gate hook.
+void modemSchedBegin();
+
+// Work of class p is waiting since sinceMs (millis()). A class already
+// waiting keeps its earlier time.
+void modemRequest(ModemPrio p, uint32_t sinceMs);
+
+// Most urgent class waiting, MODEM_PRIO_NONE if none.
+ModemPrio modemUrgent();
+
+// Starts a transaction of class p; false (defer it) if something more
+// urgent is waiting. Less urgent work already waiting counts as started.
+bool modemAcquire(ModemPrio p);
+
+// From here until modemRelease() the transaction is not preempted.
+void modemCommit();
+
+// Ends the transaction. modemPreempted() tells whether it was cut short.
+void modemRelease();
+bool modemPreempted();
+
+// Work of class p was delivered, in whatever transaction carried it (for an
+// SOS, a text to a guardian counts).
+void modemDelivered(ModemPrio p);
+
+// Work of class p stopped waiting without being delivered (e.g. moved to
+// the outbox); it is not counted.
+void modemDropped(ModemPrio p);
+
+const char* modemPrioName(ModemPrio p);
+const ModemClassStats& modemClassStats(ModemPrio p);
+void modemSchedResetStats();
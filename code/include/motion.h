@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+#include "fall_detector.h"
+
+// ----------------------- Motion-gated reporting -----------------------
+// The BNO08x stability classifier decides whether the wearer is still or
+// moving, and motionPeriodMs() turns that (plus GNSS speed) into the
+// fix-and-upload period: minutes while still, tighter while moving so
+// consecutive points stay roughly MOTION_SPACING_CM apart. Without an IMU
+// the state stays MOTION_UNKNOWN and the fixed schedule is used.
+//
+// The same sensor streams raw acceleration at MOTION_ACCEL_HZ to a consumer
+// (the fall detector) in blocks.
+
+#define MOTION_STILL_HOLD_MS     60000    // still this long before stretching
+#define MOTION_STILL_PERIOD_MS   300000
+#define MOTION_FIXED_PERIOD_MS   10000    // no IMU: previous fixed schedule
+#define MOTION_MIN_PERIOD_MS     5000
+#define MOTION_MAX_PERIOD_MS     60000
+#define MOTION_SPACING_CM        5000     // target distance between points
+#define MOTION_REPORT_US         500000   // classifier report interval
+#define MOTION_ACCEL_HZ          100
+#define MOTION_ACCEL_FULL_SCALE_MG 8000   // BNO08x accelerometer, +/-8 g
+#define MOTION_ACCEL_BLOCK       32       // samples handed over per call at most
+
+enum MotionState : uint8_t {
+  MOTION_UNKNOWN = 0,
+  MOTION_STILL,
+  MOTION_MOVING,
+};
+
+typedef void (*MotionAccelHandler)(const AccelSample* samples, size_t n);
+
+// Returns false (and leaves the state MOTION_UNKNOWN) if no BNO08x answers.
+bool motionBegin(MotionAccelHandler onAccel = nullptr);
+
+// Drains sensor reports. Cheap enough for the AT engine idle hook.
+void motionPoll();
+
+// True once after a still -> moving transition, when a fix should be taken
+// and sent immediately.
+bool motionStartedMoving();
+
+MotionState motionState();
+const char* motionStateName(MotionState s);
+
+// speedCmS is the last GNSS ground speed, 0 if unknown.
+uint32_t motionPeriodMs(MotionState s, uint32_t speedCmS);
@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- MQTT command channel -----------------------
+// Long-lived MQTT session over the SIM7600's own stack (AT+CMQTT*). The
+// server publishes commands to tripcharm/<imei>/cmd and the device answers
+// on tripcharm/<imei>/ack, so commands arrive without HTTP polling. The
+// modem sends keepalive pings itself; a lost connection is retried with
+// exponential backoff from mqttService().
+
+#ifndef MQTT_BROKER_URL
+#define MQTT_BROKER_URL        "tcp://ma8w.ddns.net:1883"
+#endif
+#define MQTT_KEEPALIVE_S       60
+#define MQTT_BACKOFF_MIN_MS    2000
+#define MQTT_BACKOFF_MAX_MS    300000
+#define MQTT_PAYLOAD_MAX       256
+#define MQTT_RX_QUEUE          4
+
+struct MqttMessage {
+  char     payload[MQTT_PAYLOAD_MAX];
+  uint16_t len;
+  uint32_t rxMs;       // millis() when the payload arrived
+};
+
+void mqttBegin();
+
+// (Re)connects when due. Call from loop(), not from the AT idle hook.
+void mqttService();
+bool mqttConnected();
+
+// Pops the next received command payload.
+bool mqttPoll(MqttMessage& msg);
+
+// Publishes a JSON body to the ack topic (QoS 1).
+bool mqttPublishAck(const char* json, size_t len);
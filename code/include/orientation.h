@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+// ----------------------- Orientation -----------------------
+// Keeps the latest rotation quaternion from the IMU and derives Euler
+// angles only when someone asks for them. All math is single precision
+// (the ESP32-C3 has no FPU, and soft double is several times slower) with
+// polynomial atan2/asin approximations:
+//   fastAtan2  |error| < 1.2e-5 rad
+//   fastAsin   |error| < 7.0e-5 rad
+// so Euler angles are within 1.2e-4 rad (~0.007 deg) of the libm double
+// result.
+
+struct Quat {
+  float w, x, y, z;
+};
+
+struct Euler {
+  float yaw, pitch, roll;   // radians
+};
+
+// Cheap: stores the sample and marks the Euler angles stale.
+void orientationUpdate(float w, float x, float y, float z, uint8_t accuracy);
+
+bool orientationValid();
+uint8_t orientationAccuracy();    // sensor calibration status, 0..3
+const Quat& orientationQuat();
+
+// Converts on the first call after an update, cached afterwards.
+const Euler& orientationEuler();
+
+float fastAtan2(float y, float x);
+float fastAsin(float x);
@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include "gnss.h"
+
+// ----------------------- Store-and-forward outbox -----------------------
+// Persistent ring of fixed-size records in a preallocated LittleFS file.
+// Each slot carries a sequence number and a CRC32, so a write torn by power
+// loss reads back as an empty slot and the ring is rebuilt on boot by
+// scanning sequence numbers. Records are replayed SOS-first, then oldest
+// first, and acknowledged one by one once the server has accepted them.
+
+#define OUTBOX_PATH         "/outbox.bin"
+#define OUTBOX_SLOTS        128
+#define OUTBOX_SLOT_SIZE    64
+#define OUTBOX_PAYLOAD_MAX  44
+#define OUTBOX_MAGIC        0x4F42      // "OB"
+
+enum OutboxType : uint8_t {
+  OUTBOX_EVENT = 1,
+  OUTBOX_FIX,
+  OUTBOX_BATTERY,
+};
+
+enum OutboxPriority : uint8_t {
+  OUTBOX_PRIO_SOS = 0,     // drained first
+  OUTBOX_PRIO_NORMAL,
+  OUTBOX_PRIO_LOW,
+};
+
+struct OutboxRecord {
+  uint16_t magic;
+  uint8_t  type;           // OutboxType
+  uint8_t  priority;       // OutboxPriority
+  uint32_t seq;
+  uint32_t utc;            // unix seconds, 0 if the clock was unknown
+  uint8_t  len;
+  uint8_t  reserved[3];
+  uint8_t  payload[OUTBOX_PAYLOAD_MAX];
+  uint32_t crc;            // CRC32 of all preceding bytes
+};
+static_assert(sizeof(OutboxRecord) == OUTBOX_SLOT_SIZE, "outbox slot layout");
+
+bool outboxBegin();
+
+// id != 0 is kept after the text, so a replay carries the same event ID
+bool outboxPushEvent(const char* type, uint32_t utc, uint8_t priority = OUTBOX_PRIO_SOS, uint32_t id = 0);
+bool outboxPushFix(const GnssFix& fix, uint32_t utc);
+bool outboxPushBattery(uint8_t pct, uint32_t utc);
+
+uint16_t outboxCount();
+bool outboxHasSos();
+
+// Copies up to max records in replay order without removing them.
+uint8_t outboxPeek(OutboxRecord* out, uint8_t max);
+
+// Marks the record with this sequence number as delivered.
+void outboxAck(uint32_t seq);
+
+// Payload accessors for replay
+const char* outboxEventType(const OutboxRecord& rec);
+uint32_t outboxEventId(const OutboxRecord& rec);   // 0 if none
+bool outboxFix(const OutboxRecord& rec, GnssFix& fix);
@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include "energy.h"
+
+// ----------------------- Power manager -----------------------
+// Between events the ESP32-C3 goes into light sleep instead of spinning in
+// delay(). Button, IMU and barometer interrupt pins and UART0 (modem URCs)
+// wake it, as does a timer bounded by POWER_SLEEP_MAX_MS so the sensor
+// fallback polls keep running. On the modem side, eDRX is requested after
+// registration and GNSS is switched off between fixes once the upload
+// period is long enough for a hot start to pay off. Time spent in each
+// state is fed into the energy model.
+
+#define POWER_SLEEP_MAX_MS        1000      // IMU_POLL_MS fallback stays on time
+#define POWER_SLEEP_MIN_MS        20        // not worth the entry/exit below this
+#define POWER_IDLE_MS             100       // awake wait when sleep is not allowed
+#define POWER_UART_WAKE_EDGES     3         // swallows the leading "\r\n" of a URC
+#define POWER_URC_AWAKE_MS        500       // awake after a UART wake for the rest
+#define POWER_WAKE_PINS_MAX       4
+
+// eDRX cycle (3GPP 27.007 bit string): "0010" = 20.48 s, a push command
+// waits at most one cycle
+#define POWER_EDRX_CYCLE          "0010"
+// PSM makes the device unreachable for MQTT pushes between uploads, so it
+// is only negotiated when explicitly enabled
+#define POWER_USE_PSM             0
+#define POWER_PSM_TAU             "00100001"  // T3412: 1 h
+#define POWER_PSM_ACTIVE          "00000101"  // T3324: 10 s
+
+#define POWER_GNSS_DUTY_MIN_MS    60000     // shorter periods keep GNSS on
+#define POWER_GNSS_WARMUP_MS      15000     // hot start this long before a fix is due
+
+// modemStream is the SIM7600 UART; unread bytes there keep the CPU awake.
+void powerBegin(Stream& modemStream);
+
+// Wakes light sleep while pin is at wakeLevel. interruptMode is the mode
+// the pin's halPinInterrupt() used; it is restored after each sleep.
+void powerAddWakePin(uint8_t pin, uint8_t wakeLevel, int interruptMode);
+
+// Requests eDRX (and PSM if enabled) and logs what the network granted.
+void powerModemLowPower();
+
+// Starts GNSS and tracks its on time from here. An engine that is already
+// running is kept; a modem that stayed powered still holds its ephemeris
+// and gets a hot start. Returns false for a cold start, which is worth
+// assistance data once the network is up.
+bool powerGnssBegin(bool modemWasOn);
+
+// Turns GNSS back on ahead of the next fix, or at once if urgent.
+void powerGnssService(uint32_t msToNextCycle, uint32_t periodMs, bool urgent);
+
+// A fix was taken; GNSS goes off until the next warm-up if the period allows.
+void powerGnssFixTaken(uint32_t periodMs);
+bool powerGnssOn();
+
+// Waits up to maxMs, in light sleep when allowSleep, otherwise awake.
+void powerIdle(uint32_t maxMs, bool allowSleep);
+
+// Accumulated since powerBegin(); call powerAccount() before reading.
+void powerAccount();
+const EnergyModel& powerEnergy();
+uint32_t powerElapsedMs();
@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include "gnss.h"
+#include "diag.h"
+
+// ----------------------- SOS alert -----------------------
+// An SOS goes out on two channels: the HTTP event (telemetry POST or
+// outbox replay) and a text message to each guardian. The text uses the
+// last fix the loop cached, so it never waits on GNSS, and it needs no
+// data bearer, which is what fails first in weak coverage. Every SOS event
+// of one alert carries the same ID, so the server folds repeats and both
+// channels into one alert. The first confirmation from either channel ends
+// the retries: failed texts are not sent again, and pending HTTP events go
+// with the regular cycle instead of being retried at once.
+
+// The guardians' numbers (E.164, one text each) are not kept in the source:
+// the build sets them, e.g. -D SOS_GUARDIANS={\"+447700900123\"}
+#ifndef SOS_GUARDIANS
+#error "SOS_GUARDIANS is not set; add it to the build flags (see README)"
+#endif
+
+#define SOS_GUARDIANS_MAX      4
+#define SOS_SMS_MAX            160                  // one GSM 7-bit segment
+#define SOS_SMS_TIMEOUT_MS     60000                // AT+CMGS to +CMGS
+#define SOS_SMS_RETRY_MS       20000
+#define SOS_SMS_TRIES          3                    // per guardian, while unconfirmed
+#define SOS_ALERT_MAX_MS       600000               // a later press opens a new alert
+
+enum SosChannel : uint8_t {
+  SOS_CHANNEL_HTTP = 0,
+  SOS_CHANNEL_SMS,
+  SOS_CHANNEL_COUNT,
+};
+
+struct SosAlertStats {
+  uint32_t      alerts;
+  uint32_t      smsSent;
+  uint32_t      smsFailed;
+  uint32_t      first[SOS_CHANNEL_COUNT];       // alerts this channel confirmed first
+  DiagHistogram latencyMs[SOS_CHANNEL_COUNT];   // press -> channel confirmed
+};
+
+// A press at edgeUs (esp_timer time). Opens an alert unless one is still
+// open, and returns its ID for the event. An alert stays open until the
+// server has it and every guardian got a first try, or SOS_ALERT_MAX_MS.
+uint32_t sosAlertRaise(const char* event, int64_t edgeUs, uint32_t utc);
+
+// Latest fix, for the text
+void sosAlertNoteFix(const GnssFix& fix);
+
+// Sends the next text that is due, if any, as an SOS modem transaction.
+void sosAlertService();
+
+// All SOS events of the open alert reached the server.
+void sosAlertHttpDelivered();
+
+// The open alert has been confirmed on some channel.
+bool sosAlertConfirmed();
+
+const char* sosChannelName(SosChannel c);
+const SosAlertStats& sosAlertStats();
+void sosAlertResetStats();
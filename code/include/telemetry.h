@@ -0,0 +1,98 @@
+#pragma once
+#include <Arduino.h>
+#include "gnss.h"
+#include "outbox.h"
+#include "geofence.h"
+#include "commands.h"
+#include "fall_detector.h"
+
+// ----------------------- Combined telemetry -----------------------
+// One HTTP POST per reporting period carrying GPS, battery and queued
+// events. The response body holds any pending commands (commands.h), which
+// are acknowledged by ID in a later POST. The SIM7600 HTTP session stays
+// initialised between cycles and is only rebuilt on failure.
+
+#define SERVER_BASE_URL       "http://ma8w.ddns.net:3000"
+#define TELEMETRY_URL         SERVER_BASE_URL "/api/upload/telemetry"
+#define TELEMETRY_TRACK_URL   SERVER_BASE_URL "/api/upload/track"
+#define TELEMETRY_GEOFENCE_URL SERVER_BASE_URL "/api/download/geofencing-data/device"
+#define TELEMETRY_DIAG_URL    SERVER_BASE_URL "/api/upload/diagnostics"
+#define TELEMETRY_FALL_URL    SERVER_BASE_URL "/api/upload/fall"
+#define TELEMETRY_MAX_EVENTS  8
+#define TELEMETRY_MAX_ACKS    8
+#define TELEMETRY_JSON_MAX    1280
+#define TELEMETRY_BATCH_MAX   32     // outbox records per replay POST
+#define TELEMETRY_TRACK_MAX   1024   // encoded replay body (track_codec.h)
+#define TELEMETRY_READ_CHUNK  512    // HTTPREAD size, fits AT_REPLY_MAX with framing
+#define TELEMETRY_CMD_CHUNK   240    // command body HTTPREAD size: one AT line, never split
+#define TELEMETRY_FALL_VERSION 1
+#define TELEMETRY_FALL_HEADER 15     // 'F' 'S' <version> <event id> <rate> <peak> <free fall> <count>
+#define TELEMETRY_FALL_MAX    (TELEMETRY_FALL_HEADER + FALL_RING * 6)
+
+struct TelemetryEvent {
+  const char* type;
+  uint32_t    id;         // sent as "id" so the server can drop repeats; 0 = none
+  uint8_t     priority;   // OUTBOX_PRIO_*; only OUTBOX_PRIO_SOS starts a cycle at once
+};
+
+struct TelemetryStats {
+  uint32_t airtimeMs;     // modem busy time for the last cycle
+  uint16_t bytesUp;
+  uint16_t bytesDown;
+  int      httpStatus;    // -1 if the request never completed
+};
+
+// Event types must be string literals (or otherwise outlive the upload).
+// When the queue is full an SOS event replaces the oldest other one not
+// already in a POST being sent; false if there is none (or it is not an
+// SOS), and the caller has to keep the event some other way.
+bool telemetryQueueEvent(const char* type, uint32_t id = 0, uint8_t priority = OUTBOX_PRIO_NORMAL);
+bool telemetryEventsPending();
+bool telemetrySosEventsPending();
+
+// True while an event with this type string (the pointer, not the text) is
+// queued or in the POST being sent, so its buffer can't be reused yet.
+bool telemetryEventQueued(const char* type);
+
+// Removes up to max queued events (e.g. to persist them after a failed
+// POST) and returns how many were taken.
+uint8_t telemetryTakeEvents(TelemetryEvent* out, uint8_t max);
+
+// Acknowledges a command from a telemetry response in the next POST, with
+// its status ("done", "invalid", "unknown"). False if the queue is full;
+// the server then hands the command out again.
+bool telemetryAckCommand(const char* id, const char* status);
+
+// Sends one combined POST (fix may be nullptr, battPct < 0 leaves the
+// battery out) and parses the commands in the response into commands as it
+// is read. False on failure, in which case queued events and acks are kept
+// for the next attempt.
+bool telemetrySend(const GnssFix* fix, int battPct, CommandBatch& commands);
+
+// Replays outbox records in one POST using the compact track encoding.
+// Returns how many of the first n records were accepted by the server (0
+// on failure).
+uint8_t telemetrySendBatch(const OutboxRecord* recs, uint8_t n);
+
+// Downloads the geofences into set unless the server still has
+// haveVersion. changed tells whether set now holds a new version; on
+// failure set may be partly filled and must not be used.
+bool telemetryFetchGeofences(GeofenceSet& set, uint32_t haveVersion, bool& changed);
+
+// Copies the accelerometer samples around a fall into the upload buffer,
+// replacing one not sent yet. The server attaches them to the event queued
+// with the same eventId. Little-endian: header fields, then x, y, z per
+// sample as int16 milli-g.
+void telemetryQueueFallSnapshot(uint32_t eventId, const FallEvent& ev, uint16_t rateHz,
+                                const AccelSample* samples, size_t n);
+bool telemetryFallSnapshotPending();
+
+// Posts the queued snapshot. True once the server accepted it (or there
+// was none); it stays queued otherwise.
+bool telemetrySendFallSnapshot();
+
+// Posts a diagnostics record (diag.h). True once the server accepted it.
+bool telemetrySendDiagnostics(const char* record, size_t len);
+
+const TelemetryStats& telemetryLastStats();
+void telemetryCloseSession();
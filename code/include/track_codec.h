@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ----------------------- Compact track encoding -----------------------
+// Versioned binary format for batches of fixes, battery samples and events.
+// Integers are LEB128 varints; sequence numbers, timestamps and positions
+// are zigzag deltas against the previous record, so a slow-moving track
+// costs a few bytes per fix instead of ~120 bytes of JSON. No Arduino
+// dependency, so the same code decodes uploads off-device.
+//
+//   header : 'T' 'C' <version>
+//   record : <tag = type | flags << 4> <dseq> <dutc> <body>
+//     FIX     : <dlat> <dlon> [<dalt>] [<speed>] [<course>]   (per flags)
+//     BATTERY : <pct byte>
+//     EVENT   : <len> <bytes> [<id>]                       (per flags)
+//
+// Version 2 added the event ID; version 1 streams still decode.
+
+#define TRACK_VERSION     2
+#define TRACK_HEADER_LEN  3
+#define TRACK_EVENT_MAX   44      // including the terminating NUL
+
+enum TrackType : uint8_t {
+  TRACK_FIX = 1,
+  TRACK_BATTERY,
+  TRACK_EVENT,
+};
+
+#define TRACK_EVENT_HAS_ID  0x01   // event flag: eventId follows the text
+
+struct TrackRecord {
+  uint8_t  type;          // TrackType
+  uint8_t  flags;         // GNSS_HAS_* for fixes, TRACK_EVENT_* for events
+  uint32_t seq;
+  uint32_t utc;
+  int32_t  latE7, lonE7, altCm;
+  uint32_t speedCmS;
+  uint16_t courseCdeg;
+  uint8_t  pct;
+  char     event[TRACK_EVENT_MAX];
+  uint32_t eventId;       // with TRACK_EVENT_HAS_ID, e.g. an SOS alert
+};
+
+// Delta state for one stream; encoder and decoder use the same layout.
+struct TrackState {
+  uint32_t seq, utc;
+  int32_t  latE7, lonE7, altCm;
+};
+
+struct TrackEncoder {
+  uint8_t*   buf;
+  size_t     cap;
+  size_t     len;
+  TrackState prev;
+};
+
+struct TrackDecoder {
+  const uint8_t* buf;
+  size_t         len;
+  size_t         pos;
+  TrackState     prev;
+};
+
+enum TrackResult : uint8_t {
+  TRACK_OK = 0,
+  TRACK_END,              // no more records
+  TRACK_BAD_VERSION,
+  TRACK_MALFORMED,        // truncated, unknown type or out-of-range value
+};
+
+// Writes the header. Returns false if cap is too small for it.
+bool trackEncodeBegin(TrackEncoder& enc, uint8_t* buf, size_t cap);
+
+// Appends one record. Returns false, leaving the buffer unchanged, if it
+// does not fit.
+bool trackEncode(TrackEncoder& enc, const TrackRecord& rec);
+
+TrackResult trackDecodeBegin(TrackDecoder& dec, const uint8_t* buf, size_t len);
+TrackResult trackDecodeNext(TrackDecoder& dec, TrackRecord& out);
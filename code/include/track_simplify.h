@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "gnss.h"
+
+// ----------------------- Track simplification -----------------------
+// Online Douglas-Peucker ("opening window"): fixes since the last kept
+// point are buffered, and as long as every one of them lies within the
+// tolerance of the straight line from that point to the newest fix, none
+// of them is needed. When a fix breaks the line, the previous one becomes
+// a kept point and the window restarts there. Fixes inside the dead-band
+// around the newest accepted fix are dropped first, so GPS jitter while
+// standing still never opens a window. Kept points reconstruct the track
+// within roughly tolerance + dead-band. No Arduino dependency.
+
+#define TRACK_SIMPLIFY_WINDOW     32        // buffered fixes; a full window forces a kept point
+#define TRACK_TOLERANCE_CM        1500      // default line deviation allowed
+#define TRACK_DEADBAND_CM         1000      // default jitter radius while still
+
+struct TrackSimplifyStats {
+  uint32_t in;
+  uint32_t kept;
+  uint32_t deadband;      // dropped as jitter
+};
+
+struct TrackSimplifier {
+  uint32_t toleranceCm;
+  uint32_t deadbandCm;
+  float    cmPerE7Lon;    // longitude scale at the anchor latitude
+  bool     haveAnchor;
+  GnssFix  anchor;        // last kept point
+  GnssFix  window[TRACK_SIMPLIFY_WINDOW];
+  uint8_t  count;         // fixes after the anchor; the last one is the open end
+  TrackSimplifyStats stats;
+};
+
+void trackSimplifyBegin(TrackSimplifier& s, uint32_t toleranceCm = TRACK_TOLERANCE_CM,
+                        uint32_t deadbandCm = TRACK_DEADBAND_CM);
+
+// Adds a fix. Returns true and fills out when a point has to be kept; at
+// most one per call, and it is always older than fix (except the first).
+bool trackSimplifyPush(TrackSimplifier& s, const GnssFix& fix, GnssFix& out);
+
+// Emits the open end of the window (e.g. before an upload) so the track
+// reaches the latest position. Returns false if there is nothing new.
+bool trackSimplifyFlush(TrackSimplifier& s, GnssFix& out);
+
+// Distance from p to the segment a-b, cm (local flat-earth approximation).
+uint32_t trackSegmentDistanceCm(const GnssFix& a, const GnssFix& b, const GnssFix& p);
@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+
+// ----------------------- Haptic pattern engine -----------------------
+// Patterns play in the background from an esp_timer tick that updates the
+// LEDC duty, so loop() keeps running while the motor is on. Starting a new
+// pattern replaces the current one; vibStop() cancels immediately.
+
+// Vibration PWM config (ESP32C3 LEDC)
+#define VIB_PWM_CH      0
+#define VIB_PWM_FREQ    2000
+#define VIB_PWM_BITS    8
+#define VIB_DUTY        80      // 0..255 steady strength
+#define VIB_RAMP_MS     400     // soft-start to reduce inrush
+#define VIB_TAP_DUTY    220     // for 200ms tap
+#define VIB_TAP_RAMP    60
+#define VIB_TICK_MS     10      // duty update period while a pattern plays
+
+// Ramp linearly from the previous step's duty to `duty` over rampMs, then
+// hold it for holdMs.
+struct VibStep {
+  uint8_t  duty;
+  uint16_t rampMs;
+  uint32_t holdMs;
+};
+
+struct VibPattern {
+  const VibStep* steps;
+  uint8_t        count;
+  uint8_t        repeats;     // total plays, >= 1
+};
+
+extern const VibPattern VIB_PATTERN_TAP;         // button feedback
+extern const VibPattern VIB_PATTERN_DOUBLE_TAP;
+extern const VibPattern VIB_PATTERN_ALERT;       // remote "vibrate" command
+extern const VibPattern VIB_PATTERN_PULSE;       // repeated on/off alert
+
+void vibBegin(uint8_t pin);
+void vibPlay(const VibPattern& pattern);
+void vibStop();
+bool vibActive();
+
+// Timing model used by the engine: duty at t ms into the pattern. done is
+// set once t is past the end. Pure function, no hardware access.
+uint8_t vibDutyAt(const VibPattern& pattern, uint32_t t, bool& done);
@@ -0,0 +1,30 @@
+#pragma once
+// BNO08x stand-in: only the stability classifier, driven by the scenario's
+// "motion" actions. Absent unless the scenario sets a motion state at t=0.
+#include <Arduino.h>
+
+#define SH2_ACCELEROMETER         0x01
+#define SH2_STABILITY_CLASSIFIER  0x13
+
+typedef uint8_t sh2_SensorId_t;
+
+struct sh2_SensorValue_t {
+  uint8_t sensorId;
+  union {
+    struct { uint8_t classification; } stabilityClassifier;
+    struct { float x, y, z; } accelerometer;
+  } un;
+};
+
+class Adafruit_BNO08x {
+ public:
+  explicit Adafruit_BNO08x(int8_t) {}
+  bool begin_I2C();
+  bool enableReport(sh2_SensorId_t id, uint32_t intervalUs = 10000);
+  bool wasReset() { return false; }
+  bool getSensorEvent(sh2_SensorValue_t* value);
+
+ private:
+  uint32_t intervalUs = 0;
+  uint64_t nextUs = 0;
+};
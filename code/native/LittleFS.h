@@ -0,0 +1,29 @@
+#pragma once
+// LittleFS on a host directory (a fresh one per run unless SIM_FLASH_DIR is
+// set), or in RAM for tests that cut the power (sim.h).
+#include <Arduino.h>
+
+class File {
+ public:
+  File(FILE* f = nullptr, int ramFile = -1) : fp(f), ram(ramFile) {}
+  operator bool() const { return fp != nullptr || ram >= 0; }
+  size_t size();
+  bool seek(uint32_t pos);
+  size_t write(const uint8_t* buf, size_t len);
+  size_t read(uint8_t* buf, size_t len);
+  void flush();
+  void close();
+
+ private:
+  FILE*    fp;
+  int      ram;
+  uint32_t pos = 0;
+};
+
+class LittleFSFS {
+ public:
+  bool begin(bool formatOnFail = false);
+  File open(const char* path, const char* mode);
+};
+
+extern LittleFSFS LittleFS;
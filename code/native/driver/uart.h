@@ -0,0 +1,5 @@
+#pragma once
+typedef int esp_err_t;
+typedef enum { UART_NUM_0 = 0 } uart_port_t;
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart, int edges);
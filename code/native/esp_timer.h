@@ -0,0 +1,22 @@
+#pragma once
+// esp_timer on the simulator clock; callbacks run from delay() / sleep.
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef int esp_err_t;
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef struct {
+  esp_timer_cb_t callback;
+  void*          arg;
+  int            dispatch_method;
+  const char*    name;
+  bool           skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+int64_t   esp_timer_get_time();
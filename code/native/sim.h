@@ -0,0 +1,121 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <Arduino.h>
+
+// ----------------------- Native simulator -----------------------
+// Virtual clock, pins and a SIM7600/GNSS model behind the Arduino and
+// ESP-IDF shims in this directory, so the unmodified firmware (setup() and
+// loop()) runs on the host against a scripted scenario. Time only moves in
+// delay(), light sleep and the AT engine's waits; code itself takes none.
+
+// ----------------------- Clock and events -----------------------
+typedef void (*SimEventFn)(void* arg);
+
+uint64_t simNowUs();
+
+// Runs events (scheduled callbacks, esp_timers) in time order up to us.
+void simRunUntil(uint64_t us);
+
+// Time of the next scheduled event or esp_timer expiry; UINT64_MAX if none.
+uint64_t simNextEventUs();
+
+bool simAt(uint64_t us, SimEventFn fn, void* arg);
+
+// ----------------------- Board -----------------------
+#define SIM_PINS              32
+
+// External level on a pin; runs its interrupt handler on a matching edge.
+void simSetPin(uint8_t pin, int level);
+
+// Battery voltage at the cell, before the divider
+void simSetBatteryMv(uint32_t mv);
+
+// Duty last written to an LEDC channel
+uint32_t simPwmDuty(uint8_t channel);
+
+// First non-zero PWM duty since the last call to simHapticReset(); 0 if none.
+uint64_t simHapticOnUs();
+void simHapticReset();
+
+// Stability classifier value reported by the BNO08x stand-in (SH-2 codes);
+// -1 means no sensor fitted.
+void simSetMotionClass(int cls);
+
+// Altitude at the BMP390 stand-in, cm above sea level, sampled into its
+// FIFO at the configured rate while it is in normal mode; NAN (the default)
+// means no sensor fitted.
+void simSetAltitudeCm(float cm);
+
+// Console lines the firmware printed are passed here (without line ending).
+typedef void (*SimLogHook)(const char* line);
+void simSetLogHook(SimLogHook hook, bool echo);
+
+// Text typed on the serial console, followed by a newline
+void simConsoleInput(const char* text);
+
+// ----------------------- Flash -----------------------
+// LittleFS in RAM instead of a host directory, emptied by each call. Files
+// stay across simFlashPowerCut(bytes): the next write is torn after that
+// many more bytes and everything after it is lost until the power is back,
+// so a test can reboot a store in-process and check what survived.
+void simFlashRam();
+void simFlashPowerCut(uint32_t bytes);
+void simFlashPowerBack();
+uint32_t simFlashWritten();             // bytes written since simFlashRam()
+
+// ----------------------- SIM7600 -----------------------
+Stream& simModem();
+uint64_t simModemNextByteUs();          // next byte due on the UART, UINT64_MAX if none
+
+// Modem powers up bootMs after t=0; earlier input is ignored.
+void simModemBoot(uint32_t bootMs);
+
+void simNetUp(bool up);                 // data bearer; texts follow simSmsUp()
+void simSmsUp(bool up);
+void simSmsStall(uint32_t n);           // next n AT+CMGS open text entry but never show ">"
+void simNetRttMs(uint32_t ms);
+void simHttpStatus(int status);         // 0 = server decides
+
+void simGnssPosition(double lat, double lon);
+void simGnssMove(double speedMs, double courseDeg);
+void simGnssSky(bool visible);
+
+// Server side: a command handed out with every telemetry response until
+// its ID is acked, a command pushed over MQTT, and geofence records (new
+// version each call)
+void simServerCommand(const char* json);
+void simMqttPush(const char* json);
+void simServerGeofences(const char* records);
+
+// The next n telemetry responses come back mangled (flipped or random
+// bytes, cut short, deep nesting, oversized fields, too many commands)
+void simServerFuzz(uint32_t n);
+
+// A press the SOS latency is measured for; settled when an upload carrying
+// an SOS event gets a 2xx response, and separately when a text is submitted
+void simSosPressed(uint64_t us);
+
+struct SimStats {
+  uint32_t uartTx, uartRx;              // bytes ESP -> modem, modem -> ESP
+  uint32_t httpRequests, httpFailed;
+  uint32_t httpBodyUp, httpBodyDown;
+  uint32_t mqttRx, mqttTx, mqttDropped; // messages
+  uint32_t mqttBytesUp, mqttBytesDown;
+  uint32_t airUp, airDown;              // payload plus estimated protocol overhead
+  uint32_t gnssFixes, gnssStarts;
+  uint32_t smsSent, smsFailed;
+  uint32_t smsCancelled;                // text entry ended with ESC
+  uint32_t smsGarbled;                  // AT commands swallowed into a text
+  uint32_t sosDelivered, smsDelivered, firstDelivered;
+  uint32_t sosLatencyMs[64];            // press -> server
+  uint32_t smsLatencyMs[64];            // press -> text
+  uint32_t firstLatencyMs[64];          // press -> whichever came first
+  uint32_t sosPending;                  // presses the server never got
+  uint32_t commandsAcked, commandsPending, commandsFuzzed;   // telemetry commands, fuzzed responses
+  uint32_t trackRecords, trackFixes, trackMalformed;         // replayed batches the server decoded
+  uint32_t fallSnapshots;
+  uint32_t telemetryMalformed;          // POSTs the server could not parse (400)
+};
+
+const SimStats& simStats();
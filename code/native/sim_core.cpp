@@ -0,0 +1,662 @@
+#include "sim.h"
+#include "hal.h"
+#include "fuel_gauge.h"
+#include "barometer.h"
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include <Wire.h>
+#include <LittleFS.h>
+#include <Adafruit_BNO08x.h>
+#include <stdarg.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+// ----------------------- Clock and events -----------------------
+#define SIM_EVENTS_MAX   512
+#define SIM_TIMERS_MAX   8
+
+struct SimEvent {
+  uint64_t   us;
+  SimEventFn fn;
+  void*      arg;
+};
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void*          arg;
+  uint64_t       periodUs;      // 0 = one-shot
+  uint64_t       dueUs;
+  bool           armed;
+};
+
+static uint64_t  nowUs = 0;
+static SimEvent  events[SIM_EVENTS_MAX];
+static uint16_t  eventCount = 0;
+static esp_timer timers[SIM_TIMERS_MAX];
+static uint8_t   timerCount = 0;
+
+uint64_t simNowUs() {
+  return nowUs;
+}
+
+bool simAt(uint64_t us, SimEventFn fn, void* arg) {
+  if (eventCount >= SIM_EVENTS_MAX) return false;
+  events[eventCount++] = { us, fn, arg };
+  return true;
+}
+
+uint64_t simNextEventUs() {
+  uint64_t next = UINT64_MAX;
+  for (uint16_t i = 0; i < eventCount; i++) {
+    if (events[i].us < next) next = events[i].us;
+  }
+  for (uint8_t i = 0; i < timerCount; i++) {
+    if (timers[i].armed && timers[i].dueUs < next) next = timers[i].dueUs;
+  }
+  return next;
+}
+
+// Runs the earliest event due by limit; false if there is none
+static bool runNext(uint64_t limit) {
+  int ev = -1, tm = -1;
+  uint64_t best = limit + 1;
+  for (uint16_t i = 0; i < eventCount; i++) {
+    if (events[i].us < best) { best = events[i].us; ev = i; }
+  }
+  for (uint8_t i = 0; i < timerCount; i++) {
+    if (timers[i].armed && timers[i].dueUs < best) { best = timers[i].dueUs; tm = i; ev = -1; }
+  }
+  if (ev < 0 && tm < 0) return false;
+  if (best > nowUs) nowUs = best;
+
+  if (tm >= 0) {
+    esp_timer& t = timers[tm];
+    if (t.periodUs) t.dueUs += t.periodUs;
+    else t.armed = false;
+    t.callback(t.arg);
+  } else {
+    SimEvent e = events[ev];
+    events[ev] = events[--eventCount];
+    e.fn(e.arg);
+  }
+  return true;
+}
+
+void simRunUntil(uint64_t us) {
+  while (runNext(us)) {}
+  if (us > nowUs) nowUs = us;
+}
+
+unsigned long millis() {
+  return (unsigned long)(nowUs / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)nowUs;
+}
+
+void delay(unsigned long ms) {
+  simRunUntil(nowUs + (uint64_t)ms * 1000);
+}
+
+// ----------------------- esp_timer -----------------------
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+  if (timerCount >= SIM_TIMERS_MAX) return -1;
+  esp_timer& t = timers[timerCount++];
+  t = { args->callback, args->arg, 0, 0, false };
+  *out = &t;
+  return 0;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t periodUs) {
+  t->periodUs = periodUs;
+  t->dueUs = nowUs + periodUs;
+  t->armed = true;
+  return 0;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t timeoutUs) {
+  t->periodUs = 0;
+  t->dueUs = nowUs + timeoutUs;
+  t->armed = true;
+  return 0;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t) {
+  t->armed = false;
+  return 0;
+}
+
+int64_t esp_timer_get_time() {
+  return (int64_t)nowUs;
+}
+
+// ----------------------- GPIO -----------------------
+struct SimPin {
+  bool    driven;         // set by the scenario; otherwise the pull decides
+  uint8_t level;
+  bool    pullup;
+  void    (*isr)();
+  int     mode;           // RISING / FALLING / CHANGE
+  bool    intrEnabled;
+  bool    wake;
+  uint8_t wakeLevel;
+};
+
+static SimPin pins[SIM_PINS];
+
+static int pinLevel(uint8_t pin) {
+  const SimPin& p = pins[pin];
+  if (p.driven) return p.level;
+  return p.pullup ? HIGH : LOW;
+}
+
+void simSetPin(uint8_t pin, int level) {
+  if (pin >= SIM_PINS) return;
+  SimPin& p = pins[pin];
+  int before = pinLevel(pin);
+  p.driven = true;
+  p.level = level;
+  if (before == level || !p.isr || !p.intrEnabled) return;
+  bool rising = level == HIGH;
+  if (p.mode == CHANGE || (p.mode == RISING && rising) || (p.mode == FALLING && !rising)) p.isr();
+}
+
+void halPinInput(uint8_t pin, bool pullup) {
+  if (pin >= SIM_PINS) return;
+  pins[pin].pullup = pullup;
+}
+
+int halPinRead(uint8_t pin) {
+  return pin < SIM_PINS ? pinLevel(pin) : LOW;
+}
+
+void halPinInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  if (pin >= SIM_PINS) return;
+  pins[pin].isr = isr;
+  pins[pin].mode = mode;
+  pins[pin].intrEnabled = true;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t pin) {
+  pins[pin].intrEnabled = true;
+  return 0;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t pin) {
+  pins[pin].intrEnabled = false;
+  return 0;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type) {
+  pins[pin].mode = type;      // POSEDGE / NEGEDGE / ANYEDGE share the Arduino values
+  return 0;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t pin, gpio_int_type_t level) {
+  pins[pin].wake = true;
+  pins[pin].wakeLevel = level == GPIO_INTR_HIGH_LEVEL ? HIGH : LOW;
+  return 0;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t pin) {
+  pins[pin].wake = false;
+  return 0;
+}
+
+// ----------------------- Light sleep -----------------------
+static uint64_t sleepTimerUs = 0;
+static bool     gpioWake = false, uartWake = false;
+static esp_sleep_wakeup_cause_t wakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us) {
+  sleepTimerUs = us;
+  return 0;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup() {
+  gpioWake = true;
+  return 0;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(int) {
+  uartWake = true;
+  return 0;
+}
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t, int) {
+  return 0;
+}
+
+static bool gpioWakePending() {
+  for (uint8_t i = 0; i < SIM_PINS; i++) {
+    if (pins[i].wake && pinLevel(i) == pins[i].wakeLevel) return true;
+  }
+  return false;
+}
+
+// Sleeps through events until the timer expires, a wake pin reaches its
+// level or the modem starts sending
+esp_err_t esp_light_sleep_start() {
+  uint64_t end = nowUs + sleepTimerUs;
+  wakeCause = ESP_SLEEP_WAKEUP_TIMER;
+  while (nowUs < end) {
+    uint64_t next = simNextEventUs();
+    uint64_t uart = uartWake ? simModemNextByteUs() : UINT64_MAX;
+    if (uart < next) next = uart;
+    if (next > end) next = end;
+    simRunUntil(next);
+    if (uartWake && simModem().available()) {
+      wakeCause = ESP_SLEEP_WAKEUP_UART;
+      break;
+    }
+    if (gpioWake && gpioWakePending()) {
+      wakeCause = ESP_SLEEP_WAKEUP_GPIO;
+      break;
+    }
+  }
+  gpioWake = uartWake = false;
+  return 0;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return wakeCause;
+}
+
+// ----------------------- PWM / ADC -----------------------
+static uint32_t pwmDuty[8];
+static uint64_t hapticOnUs = 0;
+static uint32_t batteryMv = 3900;
+static uint32_t adcNoise = 1;
+
+void halPwmBegin(uint8_t, uint8_t, uint32_t, uint8_t) {}
+
+void halPwmWrite(uint8_t channel, uint32_t duty) {
+  if (channel >= 8) return;
+  if (duty && !pwmDuty[channel] && !hapticOnUs) hapticOnUs = nowUs;
+  pwmDuty[channel] = duty;
+}
+
+uint32_t simPwmDuty(uint8_t channel) {
+  return channel < 8 ? pwmDuty[channel] : 0;
+}
+
+uint64_t simHapticOnUs() {
+  return hapticOnUs;
+}
+
+void simHapticReset() {
+  hapticOnUs = 0;
+}
+
+void halAdcBegin(uint8_t) {}
+
+// Divider output with a few mV of deterministic noise
+uint32_t halAdcMillivolts(uint8_t) {
+  adcNoise = adcNoise * 1103515245u + 12345u;
+  int32_t noise = (int32_t)((adcNoise >> 16) % 9) - 4;
+  return (uint32_t)(batteryMv / FUEL_DIVIDER_RATIO) + noise;
+}
+
+void simSetBatteryMv(uint32_t mv) {
+  batteryMv = mv;
+}
+
+Stream& halModemBegin(uint32_t) {
+  return simModem();
+}
+
+// ----------------------- Console -----------------------
+HardwareSerial Serial;
+EspClass       ESP;
+TwoWire        Wire;
+
+static SimLogHook logHook = nullptr;
+static bool       logEcho = true;
+static char       logLine[512];
+static size_t     logLen = 0;
+static char       consoleIn[256];
+static size_t     consoleHead = 0, consoleLen = 0;
+
+void simSetLogHook(SimLogHook hook, bool echo) {
+  logHook = hook;
+  logEcho = echo;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (c == '\r') return 1;
+  if (c == '\n' || logLen == sizeof(logLine) - 1) {
+    logLine[logLen] = '\0';
+    if (logEcho) ::printf("%10.3f  %s\n", nowUs / 1e6, logLine);
+    if (logHook) logHook(logLine);
+    logLen = 0;
+    if (c == '\n') return 1;
+  }
+  logLine[logLen++] = (char)c;
+  return 1;
+}
+
+void simConsoleInput(const char* text) {
+  if (consoleHead == consoleLen) consoleHead = consoleLen = 0;
+  size_t n = strlen(text);
+  if (consoleLen + n + 1 > sizeof(consoleIn)) return;
+  memcpy(consoleIn + consoleLen, text, n);
+  consoleLen += n;
+  consoleIn[consoleLen++] = '\n';
+}
+
+int HardwareSerial::available() {
+  return (int)(consoleLen - consoleHead);
+}
+
+int HardwareSerial::read() {
+  return consoleHead < consoleLen ? consoleIn[consoleHead++] : -1;
+}
+
+int HardwareSerial::peek() {
+  return consoleHead < consoleLen ? consoleIn[consoleHead] : -1;
+}
+
+size_t Print::printf(const char* fmt, ...) {
+  char buf[512];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n <= 0) return 0;
+  return write((const uint8_t*)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+// ----------------------- BNO08x -----------------------
+static int motionClass = -1;
+
+void simSetMotionClass(int cls) {
+  motionClass = cls;
+}
+
+bool Adafruit_BNO08x::begin_I2C() {
+  return motionClass >= 0;
+}
+
+bool Adafruit_BNO08x::enableReport(sh2_SensorId_t id, uint32_t us) {
+  if (id != SH2_STABILITY_CLASSIFIER) return false;   // no accelerometer stream
+  intervalUs = us;
+  nextUs = nowUs + us;
+  return true;
+}
+
+bool Adafruit_BNO08x::getSensorEvent(sh2_SensorValue_t* value) {
+  if (!intervalUs || nowUs < nextUs) return false;
+  nextUs = nowUs + intervalUs;
+  value->sensorId = SH2_STABILITY_CLASSIFIER;
+  value->un.stabilityClassifier.classification = (uint8_t)motionClass;
+  return true;
+}
+
+// ----------------------- BMP390 -----------------------
+// Registers the driver touches, and a FIFO of pressure + temperature
+// frames filled at 50 Hz in normal mode. The calibration makes the
+// compensated pressure raw / 128 Pa at any temperature.
+#define BMP_FRAME_US     20000
+#define BMP_FIFO_BYTES   512
+#define BMP_FRAME_BYTES  7
+#define REG_BMP_FIFO_LEN  0x12
+#define REG_BMP_FIFO_DATA 0x14
+#define REG_BMP_WTM       0x15
+#define REG_BMP_INT_CTRL  0x19
+#define REG_BMP_PWR       0x1B
+#define REG_BMP_CALIB     0x31
+#define REG_BMP_CMD       0x7E
+
+static float    altitudeCm = NAN;
+static bool     bmpNormal = false;
+static uint8_t  bmpReg = 0;
+static uint16_t bmpWatermark = 0;
+static uint8_t  bmpIntCtrl = 0x02;          // reset value: push-pull, active high
+static uint64_t bmpNextFrameUs = 0;
+static uint64_t bmpWakeUs = UINT64_MAX;     // scheduled watermark check
+static uint32_t bmpNoise = 1;
+static std::vector<uint8_t> bmpFifo;
+
+static const uint8_t BMP_CALIB[21] = {
+  0, 0, 0, 0, 0,            // T1, T2, T3: t_lin = 0
+  0x00, 0x60,               // P1 = 16384 + 8192: 1/128 Pa per count
+  0x00, 0x40,               // P2 = 16384: no temperature term
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+void simSetAltitudeCm(float cm) {
+  altitudeCm = cm;
+}
+
+static void bmpSchedule();
+
+// Frames due by now, then the INT level for the watermark
+static void bmpFill() {
+  while (bmpNormal && bmpNextFrameUs <= nowUs) {
+    if (bmpFifo.size() + BMP_FRAME_BYTES <= BMP_FIFO_BYTES) {
+      bmpNoise = bmpNoise * 1103515245u + 12345u;
+      float pa = 101325.0f * powf(1.0f - altitudeCm / 4433000.0f, 1.0f / 0.190295f) +
+                 ((int)((bmpNoise >> 16) % 61) - 30) / 100.0f;     // +/-0.3 Pa, ~2.5 cm
+      uint32_t raw = (uint32_t)lroundf(pa * 128.0f);
+      const uint8_t frame[BMP_FRAME_BYTES] = { 0x94, 0, 0, 0x80, (uint8_t)raw, (uint8_t)(raw >> 8),
+                                               (uint8_t)(raw >> 16) };
+      bmpFifo.insert(bmpFifo.end(), frame, frame + BMP_FRAME_BYTES);
+    }
+    bmpNextFrameUs += BMP_FRAME_US;
+  }
+  bool asserted = bmpWatermark && bmpFifo.size() >= bmpWatermark;
+  bool activeHigh = bmpIntCtrl & 0x02, openDrain = bmpIntCtrl & 0x01;
+  if (asserted) simSetPin(BARO_INT_PIN, activeHigh ? HIGH : LOW);
+  else if (!openDrain) simSetPin(BARO_INT_PIN, activeHigh ? LOW : HIGH);
+  else simSetPin(BARO_INT_PIN, pins[BARO_INT_PIN].pullup ? HIGH : LOW);    // released: the pull decides
+  bmpSchedule();
+}
+
+static void bmpTick(void*) {
+  bmpWakeUs = UINT64_MAX;
+  bmpFill();
+}
+
+// One pending event for the frame that reaches the watermark
+static void bmpSchedule() {
+  if (!bmpNormal || !bmpWatermark || bmpFifo.size() >= bmpWatermark) return;
+  size_t frames = (bmpWatermark - bmpFifo.size() + BMP_FRAME_BYTES - 1) / BMP_FRAME_BYTES;
+  uint64_t due = bmpNextFrameUs + (frames - 1) * BMP_FRAME_US;
+  if (due >= bmpWakeUs) return;
+  if (simAt(due, bmpTick, nullptr)) bmpWakeUs = due;
+}
+
+static void bmpWrite(uint8_t reg, uint8_t value) {
+  bmpFill();
+  if (reg == REG_BMP_CMD && (value == 0xB6 || value == 0xB0)) {     // soft reset, FIFO flush
+    bmpFifo.clear();
+    if (value == 0xB6) {
+      bmpNormal = false;
+      bmpIntCtrl = 0x02;
+    }
+  } else if (reg == REG_BMP_PWR) {
+    bool normal = (value & 0x30) == 0x30;
+    if (normal && !bmpNormal) bmpNextFrameUs = nowUs + BMP_FRAME_US;
+    bmpNormal = normal;
+  } else if (reg == REG_BMP_INT_CTRL) {
+    bmpIntCtrl = value;
+  } else if (reg == REG_BMP_WTM) {
+    bmpWatermark = (bmpWatermark & 0x100) | value;
+  } else if (reg == REG_BMP_WTM + 1) {
+    bmpWatermark = (bmpWatermark & 0xFF) | (value & 0x01) << 8;
+  }
+  bmpFill();
+}
+
+static uint8_t bmpRead(uint8_t reg) {
+  if (reg == 0x00) return 0x60;                                     // chip ID
+  if (reg >= REG_BMP_CALIB && reg < REG_BMP_CALIB + sizeof(BMP_CALIB)) return BMP_CALIB[reg - REG_BMP_CALIB];
+  if (reg == REG_BMP_FIFO_LEN) return (uint8_t)bmpFifo.size();
+  if (reg == REG_BMP_FIFO_LEN + 1) return (uint8_t)(bmpFifo.size() >> 8);
+  return 0;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  addr = address;
+  txLen = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (txLen == sizeof(tx)) return 0;
+  tx[txLen++] = value;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+  if (addr != BARO_I2C_ADDR || isnan(altitudeCm)) return 2;         // address NACK
+  if (txLen) bmpReg = tx[0];
+  for (uint8_t i = 1; i < txLen; i++) bmpWrite(bmpReg + i - 1, tx[i]);
+  return 0;
+}
+
+// The FIFO data register pops; the others auto-increment
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t n) {
+  rxLen = rxPos = 0;
+  if (address != BARO_I2C_ADDR || isnan(altitudeCm)) return 0;
+  bmpFill();
+  for (uint8_t i = 0; i < n; i++) {
+    if (bmpReg == REG_BMP_FIFO_DATA) {
+      rx[i] = bmpFifo.empty() ? 0x80 : bmpFifo.front();
+      if (!bmpFifo.empty()) bmpFifo.erase(bmpFifo.begin());
+    } else {
+      rx[i] = bmpRead(bmpReg + i);
+    }
+  }
+  rxLen = n;
+  bmpFill();
+  return n;
+}
+
+int TwoWire::read() {
+  return rxPos < rxLen ? rx[rxPos++] : -1;
+}
+
+// ----------------------- LittleFS -----------------------
+#define SIM_RAM_FILES   8
+
+struct RamFile {
+  char                 path[64];
+  std::vector<uint8_t> data;
+};
+
+LittleFSFS LittleFS;
+static char     flashDir[256];
+static bool     flashInRam = false;
+static RamFile  ramFiles[SIM_RAM_FILES];
+static uint8_t  ramFileCount = 0;
+static uint64_t flashBudget = UINT64_MAX;   // bytes until the power cut
+static uint32_t flashWritten = 0;
+
+void simFlashRam() {
+  flashInRam = true;
+  for (RamFile& f : ramFiles) f.data.clear();
+  ramFileCount = 0;
+  flashBudget = UINT64_MAX;
+  flashWritten = 0;
+}
+
+void simFlashPowerCut(uint32_t bytes) {
+  flashBudget = bytes;
+}
+
+void simFlashPowerBack() {
+  flashBudget = UINT64_MAX;
+}
+
+uint32_t simFlashWritten() {
+  return flashWritten;
+}
+
+bool LittleFSFS::begin(bool) {
+  if (flashInRam) return true;
+  const char* dir = getenv("SIM_FLASH_DIR");
+  if (dir) {
+    snprintf(flashDir, sizeof(flashDir), "%s", dir);
+    mkdir(flashDir, 0755);
+    return true;
+  }
+  snprintf(flashDir, sizeof(flashDir), "/tmp/tripcharm-flash-XXXXXX");
+  return mkdtemp(flashDir) != nullptr;
+}
+
+static File openRam(const char* path, const char* mode) {
+  int idx = -1;
+  for (uint8_t i = 0; i < ramFileCount; i++) {
+    if (strcmp(ramFiles[i].path, path) == 0) idx = i;
+  }
+  if (strcmp(mode, "w") != 0) return File(nullptr, idx);   // "r" and "r+" need the file
+  if (idx < 0) {
+    if (ramFileCount == SIM_RAM_FILES) return File();
+    idx = ramFileCount++;
+    snprintf(ramFiles[idx].path, sizeof(ramFiles[idx].path), "%s", path);
+  }
+  ramFiles[idx].data.clear();
+  return File(nullptr, idx);
+}
+
+File LittleFSFS::open(const char* path, const char* mode) {
+  if (flashInRam) return openRam(path, mode);
+  char full[320];
+  snprintf(full, sizeof(full), "%s%s", flashDir, path);
+  const char* m = strcmp(mode, "w") == 0 ? "w+b" : strcmp(mode, "r+") == 0 ? "r+b" : "rb";
+  return File(fopen(full, m));
+}
+
+size_t File::size() {
+  if (ram >= 0) return ramFiles[ram].data.size();
+  long pos = ftell(fp);
+  fseek(fp, 0, SEEK_END);
+  long n = ftell(fp);
+  fseek(fp, pos, SEEK_SET);
+  return (size_t)n;
+}
+
+bool File::seek(uint32_t to) {
+  if (ram < 0) return fseek(fp, to, SEEK_SET) == 0;
+  if (to > ramFiles[ram].data.size()) return false;
+  pos = to;
+  return true;
+}
+
+size_t File::write(const uint8_t* buf, size_t len) {
+  // Power cut: this write stops part way, later ones never happen
+  size_t n = len < flashBudget ? len : (size_t)flashBudget;
+  flashBudget -= n;
+  flashWritten += n;
+  if (ram < 0) return fwrite(buf, 1, n, fp);
+  std::vector<uint8_t>& data = ramFiles[ram].data;
+  if (pos + n > data.size()) data.resize(pos + n);
+  memcpy(data.data() + pos, buf, n);
+  pos += n;
+  return n;
+}
+
+size_t File::read(uint8_t* buf, size_t len) {
+  if (ram < 0) return fread(buf, 1, len, fp);
+  const std::vector<uint8_t>& data = ramFiles[ram].data;
+  size_t n = pos < data.size() ? std::min(len, data.size() - pos) : 0;
+  memcpy(buf, data.data() + pos, n);
+  pos += n;
+  return n;
+}
+
+void File::flush() {
+  if (fp) fflush(fp);
+}
+
+void File::close() {
+  if (fp) fclose(fp);
+  fp = nullptr;
+  ram = -1;
+}
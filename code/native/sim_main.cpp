@@ -0,0 +1,318 @@
+// Unit tests (test/test_*) link the simulator too and bring their own main()
+#ifndef PIO_UNIT_TESTING
+#include "sim.h"
+#include "power.h"
+#include "at_engine.h"
+#include "modem_sched.h"
+#include "energy.h"
+#include "commands.h"
+#include <time.h>
+
+// ----------------------- Scenario runner -----------------------
+// Runs the firmware against one scenario file and prints a benchmark
+// summary: cycle time, SOS latency, bytes over the UART and on the air,
+// modelled energy. One scenario per process, as the firmware's state is
+// static.
+//
+//   program [-v] scenario.txt
+//
+// Scenario lines are "<seconds> <action> [args]", '#' starts a comment.
+// Actions at t = 0 apply before setup().
+//   end                          stop here (default: 600 s)
+//   boot <ms>                    modem powers up this long after t = 0
+//   net up|down                  data bearer
+//   sms on|off|stall [n]         text messages; stall: the next n AT+CMGS show no prompt
+//   rtt <ms>                     network round trip
+//   http <status>                force the server's status, 0 = normal
+//   gnss <lat> <lon>             receiver position
+//   move <m/s> <course deg>      position keeps changing
+//   sky on|off                   satellites visible
+//   motion still|moving          BNO08x classifier (fitted if set at t = 0)
+//   press A|B [hold ms]          SOS button
+//   battery <mV>
+//   command <json>               returned with telemetry responses until acked
+//   fuzz <n>                     mangle the next n telemetry responses
+//   mqtt <json>                  pushed on the command topic
+//   geofence <records>           server geofences, e.g. C,home,473769000,85417000,100;
+//   console <text>               typed on the serial console
+
+void setup();
+void loop();
+
+#define SCENARIO_ACTIONS      256
+#define SCENARIO_ARG_MAX      256
+#define SAMPLES_MAX           1024
+#define PRESS_HOLD_MS         120
+
+// Button pins as wired in main.cpp
+#define SIM_BUTTON_A_PIN      D10
+#define SIM_BUTTON_B_PIN      D0
+
+// SH-2 stability classifier codes
+#define CLASS_STABLE          3
+#define CLASS_MOTION          4
+
+struct Action {
+  uint64_t us;
+  char     name[16];
+  char     arg[SCENARIO_ARG_MAX];
+};
+
+static Action   actions[SCENARIO_ACTIONS];
+static uint16_t actionCount = 0;
+static uint64_t endUs = 600ULL * 1000000;
+
+static uint32_t cycleMs[SAMPLES_MAX];
+static uint16_t cycleCount = 0;
+static uint32_t hapticMs[SAMPLES_MAX];
+static uint16_t hapticCount = 0;
+static uint64_t lastPressUs = 0;
+static uint32_t fixAgeMs[SAMPLES_MAX];
+static uint16_t fixAgeCount = 0;
+static long     bootAnsweredMs = -1, bootDataMs = -1, bootTtffMs = -1;
+static uint32_t waitMs[MODEM_PRIO_COUNT][SAMPLES_MAX];
+static uint32_t totalMs[MODEM_PRIO_COUNT][SAMPLES_MAX];
+static uint16_t deliveredCount[MODEM_PRIO_COUNT];
+static uint16_t preemptedCount[MODEM_PRIO_COUNT];
+
+// ----------------------- Actions -----------------------
+static void release(void* arg) {
+  simSetPin((uint8_t)(uintptr_t)arg, HIGH);
+}
+
+static void recordHaptic() {
+  if (!lastPressUs || !simHapticOnUs() || hapticCount >= SAMPLES_MAX) return;
+  hapticMs[hapticCount++] = (simHapticOnUs() - lastPressUs) / 1000;
+  lastPressUs = 0;
+}
+
+static void runAction(void* p) {
+  const Action& a = *(const Action*)p;
+  const char* arg = a.arg;
+  double x = 0, y = 0;
+
+  if (strcmp(a.name, "boot") == 0) {
+    simModemBoot(atoi(arg));
+  } else if (strcmp(a.name, "net") == 0) {
+    simNetUp(strcmp(arg, "down") != 0);
+  } else if (strcmp(a.name, "sms") == 0) {
+    if (strncmp(arg, "stall", 5) == 0) simSmsStall(arg[5] ? atoi(arg + 5) : 1);
+    else simSmsUp(strcmp(arg, "off") != 0);
+  } else if (strcmp(a.name, "rtt") == 0) {
+    simNetRttMs(atoi(arg));
+  } else if (strcmp(a.name, "http") == 0) {
+    simHttpStatus(atoi(arg));
+  } else if (strcmp(a.name, "gnss") == 0 && sscanf(arg, "%lf %lf", &x, &y) == 2) {
+    simGnssPosition(x, y);
+  } else if (strcmp(a.name, "move") == 0 && sscanf(arg, "%lf %lf", &x, &y) == 2) {
+    simGnssMove(x, y);
+  } else if (strcmp(a.name, "sky") == 0) {
+    simGnssSky(strcmp(arg, "off") != 0);
+  } else if (strcmp(a.name, "motion") == 0) {
+    simSetMotionClass(strcmp(arg, "still") == 0 ? CLASS_STABLE : CLASS_MOTION);
+  } else if (strcmp(a.name, "press") == 0) {
+    uint8_t pin = arg[0] == 'B' ? SIM_BUTTON_B_PIN : SIM_BUTTON_A_PIN;
+    int hold = arg[0] && arg[1] ? atoi(arg + 1) : 0;
+    recordHaptic();
+    simHapticReset();
+    lastPressUs = simNowUs();
+    simSosPressed(simNowUs());
+    simSetPin(pin, LOW);
+    simAt(simNowUs() + (uint64_t)(hold > 0 ? hold : PRESS_HOLD_MS) * 1000, release, (void*)(uintptr_t)pin);
+  } else if (strcmp(a.name, "battery") == 0) {
+    simSetBatteryMv(atoi(arg));
+  } else if (strcmp(a.name, "command") == 0) {
+    simServerCommand(arg);
+  } else if (strcmp(a.name, "fuzz") == 0) {
+    simServerFuzz(atoi(arg));
+  } else if (strcmp(a.name, "mqtt") == 0) {
+    simMqttPush(arg);
+  } else if (strcmp(a.name, "geofence") == 0) {
+    simServerGeofences(arg);
+  } else if (strcmp(a.name, "console") == 0) {
+    simConsoleInput(arg);
+  } else {
+    printf("scenario: unknown action '%s'\n", a.name);
+  }
+}
+
+static bool loadScenario(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+  char text[SCENARIO_ARG_MAX + 64];
+  while (fgets(text, sizeof(text), f)) {
+    char* hash = strchr(text, '#');
+    if (hash && (hash == text || hash[-1] == ' ' || hash[-1] == '\t')) *hash = '\0';
+    size_t n = strlen(text);
+    while (n && (text[n - 1] == '\n' || text[n - 1] == '\r' || text[n - 1] == ' ')) text[--n] = '\0';
+
+    double s;
+    int used = 0;
+    char name[16];
+    if (sscanf(text, " %lf %15s %n", &s, name, &used) < 2) continue;
+    uint64_t us = (uint64_t)(s * 1e6);
+    if (strcmp(name, "end") == 0) {
+      endUs = us;
+      continue;
+    }
+    if (actionCount >= SCENARIO_ACTIONS) break;
+    Action& a = actions[actionCount++];
+    a.us = us;
+    snprintf(a.name, sizeof(a.name), "%s", name);
+    snprintf(a.arg, sizeof(a.arg), "%s", used ? text + used : "");
+  }
+  fclose(f);
+  return true;
+}
+
+// ----------------------- Measurements -----------------------
+// "Modem: <class> waited X ms, delivered Y ms after request" or
+// "Modem: <class> preempted by ..."
+static void recordModem(const char* line) {
+  const char* name = line + 7;
+  const char* end = strchr(name, ' ');
+  if (!end) return;
+  uint8_t p = 0;
+  while (p < MODEM_PRIO_COUNT && (strlen(modemPrioName((ModemPrio)p)) != (size_t)(end - name) ||
+                                  strncmp(modemPrioName((ModemPrio)p), name, end - name) != 0)) p++;
+  if (p == MODEM_PRIO_COUNT) return;
+
+  const char* waited = strstr(end, " waited ");
+  const char* after = strstr(end, ", delivered ");
+  if (strncmp(end, " preempted by ", 14) == 0) {
+    preemptedCount[p]++;
+  } else if (waited && after && deliveredCount[p] < SAMPLES_MAX) {
+    waitMs[p][deliveredCount[p]] = strtoul(waited + 8, nullptr, 10);
+    totalMs[p][deliveredCount[p]++] = strtoul(after + 12, nullptr, 10);
+  }
+}
+
+// The firmware's own log lines carry the boot milestones, the cycle time,
+// the age of the fix each cycle used and each class's modem latency
+static void onLog(const char* line) {
+  if (strncmp(line, "Modem: ", 7) == 0) recordModem(line);
+  if (strncmp(line, "Boot: modem ", 12) == 0) {
+    const char* data = strstr(line, "| data ");
+    bootAnsweredMs = strtol(line + 12, nullptr, 10);
+    if (data) bootDataMs = strtol(data + 7, nullptr, 10);
+  } else if (strncmp(line, "Boot: first fix ", 16) == 0) {
+    bootTtffMs = strtol(line + 16, nullptr, 10);
+  }
+  const char* p = strncmp(line, "Telemetry: HTTP", 15) == 0 ? strstr(line, "| cycle ") : nullptr;
+  if (p && cycleCount < SAMPLES_MAX) cycleMs[cycleCount++] = strtoul(p + 8, nullptr, 10);
+  p = strncmp(line, "GNSS:", 5) == 0 ? strstr(line, "| fix age ") : nullptr;
+  if (p && fixAgeCount < SAMPLES_MAX) fixAgeMs[fixAgeCount++] = strtoul(p + 10, nullptr, 10);
+}
+
+static int compareU32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void printDistribution(const char* label, uint32_t* v, size_t n, const char* unit) {
+  if (!n) {
+    printf("%-14s none\n", label);
+    return;
+  }
+  qsort(v, n, sizeof(v[0]), compareU32);
+  printf("%-14s n %-4u  min %lu  p50 %lu  p90 %lu  max %lu %s\n", label, (unsigned)n,
+         (unsigned long)v[0], (unsigned long)v[n / 2], (unsigned long)v[n * 9 / 10],
+         (unsigned long)v[n - 1], unit);
+}
+
+// Sorts a copy: the stats are a snapshot
+static void printLatencies(const char* label, const uint32_t* v, uint32_t count) {
+  uint32_t copy[64];
+  size_t n = count < 64 ? count : 64;
+  memcpy(copy, v, n * sizeof(copy[0]));
+  printDistribution(label, copy, n, "ms");
+}
+
+static void report(const char* path, double wallS) {
+  const SimStats& st = simStats();
+  printf("\n== %s: %.0f s simulated in %.2f s ==\n", path, simNowUs() / 1e6, wallS);
+  printf("%-14s modem answered %ld ms, data link %ld ms, first fix %ld ms after GNSS start (-1 = never)\n",
+         "Boot", bootAnsweredMs, bootDataMs, bootTtffMs);
+  printDistribution("cycle", cycleMs, cycleCount, "ms");
+  printLatencies("SOS -> server", st.sosLatencyMs, st.sosDelivered);
+  if (st.sosPending) printf("%-14s %lu presses never delivered\n", "", (unsigned long)st.sosPending);
+  printLatencies("SOS -> text", st.smsLatencyMs, st.smsDelivered);
+  printLatencies("SOS -> first", st.firstLatencyMs, st.firstDelivered);
+  recordHaptic();
+  printDistribution("SOS -> haptic", hapticMs, hapticCount, "ms");
+  printf("%-14s %lu requests, %lu failed, %lu malformed JSON | body %lu B up, %lu B down\n", "HTTP",
+         (unsigned long)st.httpRequests, (unsigned long)st.httpFailed, (unsigned long)st.telemetryMalformed,
+         (unsigned long)st.httpBodyUp, (unsigned long)st.httpBodyDown);
+  printf("%-14s %lu rx, %lu tx, %lu dropped | %lu B up, %lu B down\n", "MQTT",
+         (unsigned long)st.mqttRx, (unsigned long)st.mqttTx, (unsigned long)st.mqttDropped,
+         (unsigned long)st.mqttBytesUp, (unsigned long)st.mqttBytesDown);
+  printf("%-14s %lu sent, %lu failed, %lu cancelled (ESC), %lu commands swallowed\n", "SMS",
+         (unsigned long)st.smsSent, (unsigned long)st.smsFailed, (unsigned long)st.smsCancelled,
+         (unsigned long)st.smsGarbled);
+  const CommandStats& cmds = commandStats();
+  printf("%-14s %lu bodies, %lu commands, %lu rejected | arena peak %lu of %u B | server %lu acked, "
+         "%lu pending, %lu fuzzed\n", "Commands", (unsigned long)cmds.bodies, (unsigned long)cmds.commands,
+         (unsigned long)cmds.rejected, (unsigned long)cmds.arenaPeak, COMMAND_ARENA_BYTES,
+         (unsigned long)st.commandsAcked, (unsigned long)st.commandsPending, (unsigned long)st.commandsFuzzed);
+  if (st.trackRecords || st.trackMalformed) {
+    printf("%-14s %lu records decoded (%lu fixes), %lu malformed batches\n", "Track",
+           (unsigned long)st.trackRecords, (unsigned long)st.trackFixes, (unsigned long)st.trackMalformed);
+  }
+  if (st.fallSnapshots) printf("%-14s %lu snapshots uploaded\n", "Fall", (unsigned long)st.fallSnapshots);
+  printf("%-14s %lu B up, %lu B down (payload + estimated protocol overhead)\n", "On air",
+         (unsigned long)st.airUp, (unsigned long)st.airDown);
+  printf("%-14s %lu B to modem, %lu B from modem | AT busy %lu ms\n", "UART",
+         (unsigned long)st.uartTx, (unsigned long)st.uartRx, (unsigned long)atBusyMsTotal());
+  printf("%-14s %lu starts, %lu fixes read\n", "GNSS", (unsigned long)st.gnssStarts, (unsigned long)st.gnssFixes);
+  printDistribution("fix age", fixAgeMs, fixAgeCount, "ms");
+  for (uint8_t p = 0; p < MODEM_PRIO_COUNT; p++) {
+    if (!deliveredCount[p]) continue;
+    char label[24];
+    snprintf(label, sizeof(label), "%s wait", modemPrioName((ModemPrio)p));
+    printDistribution(label, waitMs[p], deliveredCount[p], "ms");
+    snprintf(label, sizeof(label), "%s done", modemPrioName((ModemPrio)p));
+    printDistribution(label, totalMs[p], deliveredCount[p], "ms");
+  }
+  printf("%-14s preempted:", "Modem");
+  for (uint8_t p = 0; p < MODEM_PRIO_COUNT; p++) {
+    printf(" %s %u", modemPrioName((ModemPrio)p), preemptedCount[p]);
+  }
+  printf("\n");
+
+  powerAccount();
+  const EnergyModel& energy = powerEnergy();
+  float total = 0;
+  for (uint8_t r = 0; r < ENERGY_RAIL_COUNT; r++) total += energyMahPerHour(energy, (EnergyRail)r, powerElapsedMs());
+  printf("%-14s %.1f mA average (model)\n", "Energy", total);
+}
+
+// ----------------------- Main -----------------------
+int main(int argc, char** argv) {
+  bool verbose = false;
+  const char* path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) verbose = true;
+    else path = argv[i];
+  }
+  if (!path || !loadScenario(path)) {
+    fprintf(stderr, "usage: %s [-v] scenario.txt\n", argv[0]);
+    return 2;
+  }
+  simSetLogHook(onLog, verbose);
+
+  for (uint16_t i = 0; i < actionCount; i++) {
+    if (actions[i].us == 0) runAction(&actions[i]);
+    else simAt(actions[i].us, runAction, &actions[i]);
+  }
+
+  clock_t start = clock();
+  setup();
+  while (simNowUs() < endUs) {
+    uint64_t before = simNowUs();
+    loop();
+    if (simNowUs() == before) delay(1);   // an iteration that never waited still costs time
+  }
+  report(path, (double)(clock() - start) / CLOCKS_PER_SEC);
+  return 0;
+}
+#endif
@@ -0,0 +1,1001 @@
+#include "sim.h"
+#include "track_codec.h"
+#include "telemetry.h"
+#include <time.h>
+
+// ----------------------- Timing -----------------------
+// Typical SIM7600G-H turnaround at 115200 baud; network figures are for a
+// loaded LTE cell and a server one continent away
+#define SIM_BYTE_US             87          // 10 bits at 115200 baud
+#define SIM_CMD_MS              12          // plain command to OK
+#define SIM_HTTP_CMD_MS         25
+#define SIM_HTTP_INIT_MS        120
+#define SIM_CFUN_MS             300
+#define SIM_NETOPEN_MS          1200
+#define SIM_GNSS_CMD_MS         20
+#define SIM_NET_FAIL_MS         8000        // HTTP/MQTT error result with the network down
+#define SIM_SERVER_MS           60          // server processing per request
+#define SIM_RTT_MS              180         // default round trip
+#define SIM_JITTER_PCT          15          // +- on every network delay
+#define SIM_GNSS_COLD_MS        32000
+#define SIM_GNSS_HOT_MS         2000
+#define SIM_EPHEMERIS_MS        7200000     // hot start possible this long after a fix
+#define SIM_GNSS_AGPS_MS        6000        // cold start with assistance data
+#define SIM_CPIN_MS             1000        // RDY to +CPIN: READY
+#define SIM_REGISTER_MS         2500        // SIM ready to registered
+#define SIM_SMS_MS              2500        // text submitted to +CMGS
+
+// ----------------------- Air overhead estimates -----------------------
+#define SIM_HTTP_OVERHEAD_UP    380         // TCP handshake, request line, headers
+#define SIM_HTTP_OVERHEAD_DOWN  260         // status line, headers, TCP
+#define SIM_MQTT_OVERHEAD       60          // fixed header, packet id, TCP/IP
+#define SIM_MQTT_PING_BYTES     84          // PINGREQ + PINGRESP with TCP/IP
+#define SIM_MQTT_KEEPALIVE_S    60
+#define SIM_AGPS_BYTES          3200        // assistance file over HTTPS
+#define SIM_SMS_OVERHEAD        40          // SMS-SUBMIT header and addresses
+
+#define SIM_EPOCH               1792224000  // 2026-10-17 08:00:00 UTC at t = 0
+#define SIM_IMEI                "862636051234567"
+#define SIM_OUT_MAX             65536
+#define SIM_LINE_MAX            512
+#define SIM_BODY_MAX            8192
+#define SIM_DEFERRED            24
+#define SIM_DEFERRED_MAX        640
+#define SIM_COMMANDS_MAX        8           // server command queue
+#define SIM_FUZZ_BODY           6144        // longest fuzzed response
+
+// ----------------------- UART -----------------------
+static char     outBuf[SIM_OUT_MAX];
+static uint64_t outDue[SIM_OUT_MAX];
+static size_t   outHead = 0, outTail = 0;   // free-running, masked on access
+static uint64_t lastOutUs = 0;
+static uint64_t lastInUs = 0;
+static SimStats stats;
+
+static void emitRaw(uint64_t us, const char* text, size_t len) {
+  if (us < lastOutUs) us = lastOutUs;
+  for (size_t i = 0; i < len && outTail - outHead < SIM_OUT_MAX; i++) {
+    us += SIM_BYTE_US;
+    outBuf[outTail % SIM_OUT_MAX] = text[i];
+    outDue[outTail % SIM_OUT_MAX] = us;
+    outTail++;
+  }
+  lastOutUs = us;
+}
+
+// <CR><LF>line<CR><LF> per '\n'-separated line; returns when the last byte is out
+static uint64_t emitLines(uint64_t us, const char* text) {
+  while (*text) {
+    const char* eol = strchr(text, '\n');
+    size_t n = eol ? (size_t)(eol - text) : strlen(text);
+    emitRaw(us, "\r\n", 2);
+    emitRaw(us, text, n);
+    emitRaw(us, "\r\n", 2);
+    text += n + (eol ? 1 : 0);
+  }
+  return lastOutUs;
+}
+
+uint64_t simModemNextByteUs() {
+  return outHead < outTail ? outDue[outHead % SIM_OUT_MAX] : UINT64_MAX;
+}
+
+// ----------------------- Deferred output (URCs) -----------------------
+// What a deferred result confirms for the presses still waiting on it
+enum Settle : uint8_t {
+  SETTLE_NONE = 0,
+  SETTLE_SERVER,          // a 2xx for an upload carrying SOS events
+  SETTLE_TEXT,            // +CMGS for a text
+};
+
+struct Deferred {
+  bool   used;
+  Settle settle;
+  char   text[SIM_DEFERRED_MAX];
+};
+
+struct Press {
+  uint64_t us;
+  bool     server, text;  // settled on that channel
+};
+
+static Deferred deferred[SIM_DEFERRED];
+static Press    sosPress[64];
+static uint8_t  sosPressCount = 0;
+
+static void addLatency(uint32_t* v, uint32_t& n, uint32_t ms) {
+  if (n < 64) v[n] = ms;
+  n++;
+}
+
+static void settleSos(Settle settle, uint64_t deliveredUs) {
+  for (uint8_t i = 0; i < sosPressCount; i++) {
+    Press& p = sosPress[i];
+    uint32_t ms = (deliveredUs - p.us) / 1000;
+    bool first = !p.server && !p.text;
+    if (settle == SETTLE_SERVER && !p.server) {
+      p.server = true;
+      addLatency(stats.sosLatencyMs, stats.sosDelivered, ms);
+    } else if (settle == SETTLE_TEXT && !p.text) {
+      p.text = true;
+      addLatency(stats.smsLatencyMs, stats.smsDelivered, ms);
+    } else {
+      continue;
+    }
+    if (first) addLatency(stats.firstLatencyMs, stats.firstDelivered, ms);
+  }
+}
+
+static void onDeferred(void* arg) {
+  Deferred& d = *(Deferred*)arg;
+  uint64_t done = emitLines(simNowUs(), d.text);
+  if (d.settle != SETTLE_NONE) settleSos(d.settle, done);
+  d.used = false;
+}
+
+static void later(uint32_t ms, const char* text, Settle settle = SETTLE_NONE) {
+  for (uint8_t i = 0; i < SIM_DEFERRED; i++) {
+    Deferred& d = deferred[i];
+    if (d.used) continue;
+    d.used = true;
+    d.settle = settle;
+    snprintf(d.text, sizeof(d.text), "%s", text);
+    simAt(simNowUs() + (uint64_t)ms * 1000, onDeferred, &d);
+    return;
+  }
+}
+
+void simSosPressed(uint64_t us) {
+  if (sosPressCount < 64) sosPress[sosPressCount++] = { us, false, false };
+}
+
+// ----------------------- Network -----------------------
+static bool     netUp = true;
+static bool     smsUp = true;
+static uint32_t smsStalls = 0;     // AT+CMGS left without a prompt
+static uint64_t cpinUs = 0, registerUs = 0;   // from power-up
+static bool     ceregUrc = false;               // AT+CEREG=1
+static uint32_t rttMs = SIM_RTT_MS;
+static int      statusOverride = 0;
+static uint32_t jitterSeed = 12345;
+
+static uint32_t jittered(uint32_t ms) {
+  jitterSeed = jitterSeed * 1103515245u + 12345u;
+  int32_t span = (int32_t)ms * SIM_JITTER_PCT / 100;
+  if (!span) return ms;
+  return ms + ((int32_t)((jitterSeed >> 16) % (2 * span + 1)) - span);
+}
+
+static bool registered() {
+  return netUp && simNowUs() >= registerUs;
+}
+
+static void onRegistered(void*) {
+  if (ceregUrc && registered()) emitLines(simNowUs(), "+CEREG: 1");
+}
+
+void simNetRttMs(uint32_t ms) {
+  rttMs = ms;
+}
+
+void simHttpStatus(int status) {
+  statusOverride = status;
+}
+
+// ----------------------- Server -----------------------
+// Commands are handed out with every telemetry response until the device
+// acks their ID; one without an ID goes out once.
+struct ServerCommand {
+  char json[256];
+  char id[32];
+};
+
+static ServerCommand serverCommands[SIM_COMMANDS_MAX];
+static uint8_t       serverCommandCount = 0;
+static uint32_t      fuzzLeft = 0;
+static uint32_t      fuzzSeed = 4242;
+static char          geofenceRecords[2048];
+static uint32_t      geofenceVersion = 0;
+
+void simServerCommand(const char* json) {
+  if (serverCommandCount == SIM_COMMANDS_MAX) {
+    printf("sim: command queue full, '%s' dropped\n", json);
+    return;
+  }
+  ServerCommand& c = serverCommands[serverCommandCount++];
+  snprintf(c.json, sizeof(c.json), "%s", json);
+  c.id[0] = '\0';
+  const char* p = strstr(json, "\"id\":");
+  if (p && sscanf(p + 5, " \"%31[^\"]\"", c.id) != 1) sscanf(p + 5, " %31[0-9]", c.id);
+  stats.commandsPending = serverCommandCount;
+}
+
+void simServerFuzz(uint32_t responses) {
+  fuzzLeft = responses;
+}
+
+static void dropCommand(uint8_t i) {
+  memmove(&serverCommands[i], &serverCommands[i + 1], (serverCommandCount - i - 1) * sizeof(serverCommands[0]));
+  serverCommandCount--;
+  stats.commandsPending = serverCommandCount;
+}
+
+// Acks look like {"id":"c1","status":"done"} in the POST's "acks" array
+static void takeAcks(const char* body, size_t len) {
+  const char* acks = (const char*)memmem(body, len, "\"acks\":[", 8);
+  if (!acks) return;
+  size_t rest = len - (acks - body);
+  for (uint8_t i = 0; i < serverCommandCount;) {
+    char key[48];
+    int n = snprintf(key, sizeof(key), "{\"id\":\"%s\"", serverCommands[i].id);
+    if (serverCommands[i].id[0] && memmem(acks, rest, key, n)) {
+      stats.commandsAcked++;
+      dropCommand(i);
+    } else {
+      i++;
+    }
+  }
+}
+
+static size_t commandBody(char* out, size_t size) {
+  if (!serverCommandCount) return snprintf(out, size, "{}");
+  if (serverCommandCount == 1) return snprintf(out, size, "%s", serverCommands[0].json);
+  size_t n = snprintf(out, size, "{\"commands\":[");
+  for (uint8_t i = 0; i < serverCommandCount && n < size; i++) {
+    n += snprintf(out + n, size - n, "%s%s", i ? "," : "", serverCommands[i].json);
+  }
+  if (n < size) n += snprintf(out + n, size - n, "]}");
+  return n < size ? n : size - 1;
+}
+
+static uint32_t fuzzRandom(uint32_t below) {
+  fuzzSeed = fuzzSeed * 1103515245u + 12345u;
+  return (fuzzSeed >> 16) % below;
+}
+
+// Breaks a response body in one of the ways a flaky link or a buggy server
+// would. Bytes stay printable: the modem's lines are text.
+static size_t fuzzBody(char* out, size_t n, size_t size) {
+  static const char JSONISH[] = "{}[]\":,0123456789-.eE truefalsnul\\abcdz";
+  switch (fuzzRandom(6)) {
+    case 0:   // flipped bytes
+      for (uint8_t i = 0; i < 4 && n; i++) out[fuzzRandom(n)] = JSONISH[fuzzRandom(sizeof(JSONISH) - 1)];
+      return n;
+    case 1:   // cut short
+      return n > 1 ? fuzzRandom(n) : 0;
+    case 2: { // nested far past any limit
+      size_t depth = size / 2 - 1;
+      for (size_t i = 0; i < depth; i++) out[i] = '[';
+      for (size_t i = 0; i < depth; i++) out[depth + i] = ']';
+      return 2 * depth;
+    }
+    case 3: { // a field the device does not read, longer than its whole arena
+      size_t k = snprintf(out, size, "{\"note\":\"");
+      size_t pad = size - k - 64;
+      memset(out + k, 'x', pad);
+      k += pad;
+      return k + snprintf(out + k, size - k, "\",\"id\":\"f-note\",\"command\":\"stop\"}");
+    }
+    case 4: { // more commands than a body may carry
+      size_t k = snprintf(out, size, "{\"commands\":[");
+      for (uint8_t i = 0; i < 40 && k < size - 64; i++) {
+        k += snprintf(out + k, size - k, "%s{\"id\":\"f%u\",\"command\":\"vibrate\",\"pattern\":\"tap\"}",
+                      i ? "," : "", i);
+      }
+      return k + snprintf(out + k, size - k, "]}");
+    }
+    default:  // noise
+      for (size_t i = 0; i < n; i++) out[i] = JSONISH[fuzzRandom(sizeof(JSONISH) - 1)];
+      return n;
+  }
+}
+
+// The server's express.json() answers a body it can't parse with a 400
+struct JsonScan {
+  const char *p, *end;
+};
+
+static void jsonSpace(JsonScan& j) {
+  while (j.p < j.end && (*j.p == ' ' || *j.p == '\t' || *j.p == '\r' || *j.p == '\n')) j.p++;
+}
+
+static bool jsonString(JsonScan& j) {
+  if (j.p == j.end || *j.p++ != '"') return false;
+  while (j.p < j.end) {
+    unsigned char c = *j.p++;
+    if (c == '"') return true;
+    if (c < 0x20) return false;
+    if (c != '\\') continue;
+    if (j.p == j.end) return false;
+    c = *j.p++;
+    if (c == 'u') {
+      for (int i = 0; i < 4; i++) {
+        if (j.p == j.end || !isxdigit((unsigned char)*j.p++)) return false;
+      }
+    } else if (!strchr("\"\\/bfnrt", c)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+static bool jsonValue(JsonScan& j, int depth) {
+  jsonSpace(j);
+  if (j.p == j.end || depth > 32) return false;
+  char c = *j.p;
+  if (c == '"') return jsonString(j);
+  if (c == '{' || c == '[') {
+    char close = c == '{' ? '}' : ']';
+    j.p++;
+    jsonSpace(j);
+    if (j.p < j.end && *j.p == close) {
+      j.p++;
+      return true;
+    }
+    for (;;) {
+      if (c == '{') {
+        jsonSpace(j);
+        if (!jsonString(j)) return false;
+        jsonSpace(j);
+        if (j.p == j.end || *j.p++ != ':') return false;
+      }
+      if (!jsonValue(j, depth + 1)) return false;
+      jsonSpace(j);
+      if (j.p == j.end) return false;
+      if (*j.p++ == close) return true;
+      if (j.p[-1] != ',') return false;
+    }
+  }
+  static const char* const WORDS[] = { "true", "false", "null" };
+  for (const char* w : WORDS) {
+    size_t n = strlen(w);
+    if ((size_t)(j.end - j.p) >= n && memcmp(j.p, w, n) == 0) {
+      j.p += n;
+      return true;
+    }
+  }
+  const char* start = j.p;
+  if (*j.p == '-') j.p++;
+  while (j.p < j.end && (isdigit((unsigned char)*j.p) || strchr(".eE+-", *j.p))) j.p++;
+  return j.p > start && isdigit((unsigned char)j.p[-1]);
+}
+
+static bool jsonValid(const char* body, size_t len) {
+  JsonScan j = { body, body + len };
+  if (!jsonValue(j, 0)) return false;
+  jsonSpace(j);
+  return j.p == j.end;
+}
+
+static size_t telemetryResponse(const char* body, size_t len, char* out) {
+  takeAcks(body, len);
+  size_t n = commandBody(out, SIM_BODY_MAX);
+  for (uint8_t i = 0; i < serverCommandCount;) {
+    if (!serverCommands[i].id[0]) dropCommand(i);
+    else i++;
+  }
+  if (fuzzLeft) {
+    fuzzLeft--;
+    stats.commandsFuzzed++;
+    n = fuzzBody(out, n, SIM_FUZZ_BODY);
+    out[n] = '\0';
+  }
+  return n;
+}
+
+void simServerGeofences(const char* records) {
+  snprintf(geofenceRecords, sizeof(geofenceRecords), "%s", records);
+  geofenceVersion = SIM_EPOCH + simNowUs() / 1000000;
+}
+
+// Decodes a replayed batch the way the server does: the records before a
+// malformed one are kept, a stream the server cannot read at all is a 400
+static int trackUpload(const char* body, size_t len, char* out, size_t& outLen) {
+  TrackDecoder dec;
+  if (trackDecodeBegin(dec, (const uint8_t*)body, len) != TRACK_OK) {
+    stats.trackMalformed++;
+    return 400;
+  }
+  TrackRecord rec;
+  TrackResult r;
+  while ((r = trackDecodeNext(dec, rec)) == TRACK_OK) {
+    stats.trackRecords++;
+    if (rec.type == TRACK_FIX) stats.trackFixes++;
+  }
+  if (r != TRACK_END) stats.trackMalformed++;
+  outLen = snprintf(out, SIM_BODY_MAX, "{}");
+  return 200;
+}
+
+// Fall snapshot (telemetry.h): header and sample count must agree
+static int fallUpload(const char* body, size_t len, char* out, size_t& outLen) {
+  const uint8_t* b = (const uint8_t*)body;
+  if (len < TELEMETRY_FALL_HEADER || b[0] != 'F' || b[1] != 'S' || b[2] != TELEMETRY_FALL_VERSION ||
+      len != TELEMETRY_FALL_HEADER + (size_t)(b[13] | b[14] << 8) * 6) {
+    return 400;
+  }
+  stats.fallSnapshots++;
+  outLen = snprintf(out, SIM_BODY_MAX, "{}");
+  return 200;
+}
+
+// Same routes and bodies as server/index.js; returns the HTTP status
+static int serve(int method, const char* url, const char* body, size_t bodyLen, char* out, size_t& outLen) {
+  const char* path = strstr(url, "/api/");
+  outLen = 0;
+  out[0] = '\0';
+  if (!path) return 404;
+
+  if (method == 1 && strcmp(path, "/api/upload/telemetry") == 0) {
+    if (!jsonValid(body, bodyLen)) {
+      stats.telemetryMalformed++;
+      return 400;
+    }
+    outLen = telemetryResponse(body, bodyLen, out);
+    return 200;
+  }
+  if (method == 1 && strcmp(path, "/api/upload/track") == 0) {
+    return trackUpload(body, bodyLen, out, outLen);
+  }
+  if (method == 1 && strcmp(path, "/api/upload/fall") == 0) {
+    return fallUpload(body, bodyLen, out, outLen);
+  }
+  if (method == 1 && strcmp(path, "/api/upload/diagnostics") == 0) {
+    outLen = snprintf(out, SIM_BODY_MAX, "{}");
+    return 200;
+  }
+  static const char geofencePath[] = "/api/download/geofencing-data/device";
+  if (method == 0 && strncmp(path, geofencePath, sizeof(geofencePath) - 1) == 0) {
+    const char* since = strstr(path, "since=");
+    bool current = since && strtoul(since + 6, nullptr, 10) == geofenceVersion;
+    outLen = snprintf(out, SIM_BODY_MAX, "V,%lu;\n", (unsigned long)geofenceVersion);
+    if (!current) {
+      // One record per line like the server, whatever the scenario wrote
+      for (const char* p = geofenceRecords; *p && outLen < SIM_BODY_MAX - 2; p++) {
+        out[outLen++] = *p;
+        if (*p == ';') out[outLen++] = '\n';
+      }
+      out[outLen] = '\0';
+    }
+    return 200;
+  }
+  return 404;
+}
+
+// ----------------------- HTTP -----------------------
+static bool   httpInit = false;
+static char   httpUrl[256];
+static char   httpBody[SIM_BODY_MAX];
+static size_t httpBodyLen = 0;
+static char   httpResp[SIM_BODY_MAX];
+static size_t httpRespLen = 0;
+
+static void httpAction(int method) {
+  stats.httpRequests++;
+  if (!netUp) {
+    stats.httpFailed++;
+    char urc[48];
+    snprintf(urc, sizeof(urc), "+HTTPACTION: %d,713,0", method);   // 7xx: modem-side network error
+    later(SIM_NET_FAIL_MS, urc);
+    return;
+  }
+
+  size_t up = method == 1 ? httpBodyLen : 0;
+  int status = serve(method, httpUrl, httpBody, up, httpResp, httpRespLen);
+  if (statusOverride) {
+    status = statusOverride;
+    httpRespLen = 0;
+  }
+  bool ok = status >= 200 && status < 300;
+  if (!ok) stats.httpFailed++;
+  stats.httpBodyUp += up;
+  stats.httpBodyDown += httpRespLen;
+  stats.airUp += up + SIM_HTTP_OVERHEAD_UP;
+  stats.airDown += httpRespLen + SIM_HTTP_OVERHEAD_DOWN;
+
+  // TCP connect plus request / response, each one round trip
+  char urc[48];
+  snprintf(urc, sizeof(urc), "+HTTPACTION: %d,%d,%u", method, status, (unsigned)httpRespLen);
+  bool sos = ok && up && memmem(httpBody, up, "SOS Button", 10) != nullptr;
+  later(jittered(2 * rttMs) + SIM_SERVER_MS, urc, sos ? SETTLE_SERVER : SETTLE_NONE);
+}
+
+static void httpRead(uint64_t at, size_t offset, size_t len) {
+  if (offset > httpRespLen) {
+    emitLines(at, "ERROR");
+    return;
+  }
+  if (len > httpRespLen - offset) len = httpRespLen - offset;
+  char head[40];
+  snprintf(head, sizeof(head), "OK\n+HTTPREAD: DATA,%u", (unsigned)len);
+  emitLines(at, head);
+  emitRaw(at, httpResp + offset, len);
+  emitLines(at, "+HTTPREAD: 0");
+}
+
+// ----------------------- MQTT -----------------------
+static bool     mqttStarted = false, mqttAcquired = false, mqttConnected = false;
+static char     mqttSubTopic[64];
+static char     mqttTopic[64];
+static size_t   mqttPayloadLen = 0;
+static uint64_t mqttUpSinceUs = 0;
+static uint64_t mqttUpTotalUs = 0;
+
+static void mqttDown() {
+  if (mqttConnected) mqttUpTotalUs += simNowUs() - mqttUpSinceUs;
+  mqttConnected = false;
+  mqttSubTopic[0] = '\0';
+}
+
+void simMqttPush(const char* json) {
+  if (!mqttConnected || !mqttSubTopic[0] || !netUp) {
+    stats.mqttDropped++;     // clean session: the broker does not keep it
+    return;
+  }
+  size_t tl = strlen(mqttSubTopic), pl = strlen(json);
+  char urc[SIM_DEFERRED_MAX];
+  snprintf(urc, sizeof(urc),
+           "+CMQTTRXSTART: 0,%u,%u\n+CMQTTRXTOPIC: 0,%u\n%s\n+CMQTTRXPAYLOAD: 0,%u\n%s\n+CMQTTRXEND: 0",
+           (unsigned)tl, (unsigned)pl, (unsigned)tl, mqttSubTopic, (unsigned)pl, json);
+  stats.mqttRx++;
+  stats.mqttBytesDown += tl + pl;
+  stats.airDown += tl + pl + SIM_MQTT_OVERHEAD;
+  later(jittered(rttMs / 2), urc);
+}
+
+// ----------------------- GNSS -----------------------
+static bool     gnssOn = false;
+static bool     sky = true;
+static uint64_t gnssReadyUs = 0;
+static uint64_t lastFixUs = 0;
+static bool     everFixed = false;
+static double   lat = 47.3769, lon = 8.5417;
+static double   speedMs = 0, courseDeg = 0;
+static uint64_t posUs = 0;
+
+static void updatePosition() {
+  double dt = (simNowUs() - posUs) / 1e6;
+  posUs = simNowUs();
+  if (speedMs <= 0) return;
+  double d = speedMs * dt;
+  double c = courseDeg * M_PI / 180;
+  lat += d * cos(c) / 111320.0;
+  lon += d * sin(c) / (111320.0 * cos(lat * M_PI / 180));
+}
+
+void simGnssPosition(double newLat, double newLon) {
+  updatePosition();
+  lat = newLat;
+  lon = newLon;
+}
+
+void simGnssMove(double speed, double course) {
+  updatePosition();
+  speedMs = speed;
+  courseDeg = course;
+}
+
+void simGnssSky(bool visible) {
+  sky = visible;
+}
+
+static void gnssStart() {
+  bool hot = everFixed && simNowUs() - lastFixUs < (uint64_t)SIM_EPHEMERIS_MS * 1000;
+  gnssOn = true;
+  gnssReadyUs = simNowUs() + (uint64_t)(hot ? SIM_GNSS_HOT_MS : SIM_GNSS_COLD_MS) * 1000;
+  stats.gnssStarts++;
+}
+
+static void formatDegMin(char* out, size_t size, double deg, int degDigits) {
+  double a = fabs(deg);
+  int d = (int)a;
+  snprintf(out, size, "%0*d%09.6f", degDigits, d, (a - d) * 60);
+}
+
+static void cgpsinfo(char* out, size_t size) {
+  if (!gnssOn || !sky || simNowUs() < gnssReadyUs) {
+    snprintf(out, size, "+CGPSINFO: ,,,,,,,,");
+    return;
+  }
+  updatePosition();
+  lastFixUs = simNowUs();
+  everFixed = true;
+  stats.gnssFixes++;
+
+  uint64_t ms = simNowUs() / 1000;
+  time_t t = SIM_EPOCH + ms / 1000;
+  struct tm utc;
+  gmtime_r(&t, &utc);
+  char la[24], lo[24];
+  formatDegMin(la, sizeof(la), lat, 2);
+  formatDegMin(lo, sizeof(lo), lon, 3);
+  snprintf(out, size, "+CGPSINFO: %s,%c,%s,%c,%02d%02d%02d,%02d%02d%02d.%d,408.0,%.1f,%.1f",
+           la, lat < 0 ? 'S' : 'N', lo, lon < 0 ? 'W' : 'E',
+           utc.tm_mday, utc.tm_mon + 1, utc.tm_year % 100, utc.tm_hour, utc.tm_min, utc.tm_sec,
+           (int)(ms % 1000) / 100, speedMs * 1.943844, courseDeg);
+}
+
+// AT+CGPSINFO=<secs>: one "+CGPSINFO:" line per interval while the engine
+// runs. A new interval or CGPS=0 bumps the generation, which retires the
+// pending tick.
+static uint32_t reportS = 0;
+static uintptr_t reportGen = 0;
+
+static void reportTick(void* arg) {
+  if ((uintptr_t)arg != reportGen || !reportS || !gnssOn) return;
+  char buf[SIM_DEFERRED_MAX];
+  cgpsinfo(buf, sizeof(buf));
+  emitLines(simNowUs(), buf);
+  simAt(simNowUs() + (uint64_t)reportS * 1000000, reportTick, (void*)reportGen);
+}
+
+static void reportEvery(uint32_t s) {
+  reportS = s;
+  reportGen++;
+  if (s) simAt(simNowUs() + (uint64_t)s * 1000000, reportTick, (void*)reportGen);
+}
+
+// ----------------------- Command interpreter -----------------------
+enum DataTarget : uint8_t {
+  DATA_NONE = 0,
+  DATA_HTTP,
+  DATA_MQTT_SUB,
+  DATA_MQTT_TOPIC,
+  DATA_MQTT_PAYLOAD,
+  DATA_SMS,               // ends with Ctrl-Z, not by length
+};
+
+static bool       echo = true;
+static uint64_t   readyUs = 0;
+static char       line[SIM_LINE_MAX];
+static size_t     lineLen = 0;
+static DataTarget dataTarget = DATA_NONE;
+static char       dataBuf[SIM_BODY_MAX];
+static size_t     dataLen = 0, dataWant = 0;
+static uint64_t   dataFromUs = 0;      // prompt sent; earlier bytes are the command's LF
+
+static bool is(const char* cmd, const char* name) {
+  return strcmp(cmd, name) == 0;
+}
+
+static bool has(const char* cmd, const char* prefix) {
+  return strncmp(cmd, prefix, strlen(prefix)) == 0;
+}
+
+static uint64_t after(uint64_t at, uint32_t ms) {
+  return at + (uint64_t)ms * 1000;
+}
+
+static void expectData(uint64_t at, DataTarget target, size_t len, const char* prompt) {
+  dataTarget = target;
+  dataWant = len < sizeof(dataBuf) ? len : sizeof(dataBuf);
+  dataLen = 0;
+  if (prompt[0] == '>') emitRaw(after(at, SIM_CMD_MS), "\r\n>", 3);
+  else emitLines(after(at, SIM_CMD_MS), prompt);
+  dataFromUs = lastOutUs;
+}
+
+static void onData(uint64_t at) {
+  DataTarget target = dataTarget;
+  dataTarget = DATA_NONE;
+  switch (target) {
+    case DATA_HTTP:
+      memcpy(httpBody, dataBuf, dataLen);
+      httpBodyLen = dataLen;
+      emitLines(after(at, SIM_CMD_MS), "OK");
+      break;
+    case DATA_MQTT_SUB:
+      snprintf(mqttSubTopic, sizeof(mqttSubTopic), "%.*s", (int)dataLen, dataBuf);
+      emitLines(after(at, SIM_CMD_MS), "OK");
+      later(jittered(rttMs), mqttConnected ? "+CMQTTSUB: 0,0" : "+CMQTTSUB: 0,11");
+      if (mqttConnected) stats.airUp += dataLen + SIM_MQTT_OVERHEAD;
+      break;
+    case DATA_MQTT_TOPIC:
+      snprintf(mqttTopic, sizeof(mqttTopic), "%.*s", (int)dataLen, dataBuf);
+      emitLines(after(at, SIM_CMD_MS), "OK");
+      break;
+    case DATA_MQTT_PAYLOAD:
+      mqttPayloadLen = dataLen;
+      emitLines(after(at, SIM_CMD_MS), "OK");
+      break;
+    case DATA_SMS:
+      // Submitted over the signalling channel: needs registration, not data
+      if (smsUp && simNowUs() >= registerUs) {
+        static uint8_t reference = 0;
+        char urc[32];
+        snprintf(urc, sizeof(urc), "+CMGS: %u\nOK", ++reference);
+        stats.smsSent++;
+        stats.airUp += dataLen + SIM_SMS_OVERHEAD;
+        later(jittered(SIM_SMS_MS), urc, SETTLE_TEXT);
+      } else {
+        stats.smsFailed++;
+        later(SIM_NET_FAIL_MS, "+CMS ERROR: 332");
+      }
+      break;
+    case DATA_NONE:
+      break;
+  }
+}
+
+static void onCommand(const char* cmd, uint64_t at) {
+  char buf[SIM_DEFERRED_MAX];
+  int a = 0, b = 0;
+
+  if (is(cmd, "AT")) {
+    emitLines(after(at, SIM_CMD_MS), "OK");
+  } else if (is(cmd, "ATE0") || is(cmd, "ATE1")) {
+    echo = cmd[3] == '1';
+    emitLines(after(at, SIM_CMD_MS), "OK");
+  } else if (is(cmd, "AT+CFUN=1")) {
+    emitLines(after(at, SIM_CFUN_MS), "OK");
+  } else if (is(cmd, "AT+CGSN")) {
+    emitLines(after(at, SIM_CMD_MS), SIM_IMEI "\nOK");
+  } else if (is(cmd, "AT+CPIN?")) {
+    emitLines(after(at, SIM_CMD_MS), simNowUs() >= cpinUs ? "+CPIN: READY\nOK" : "+CME ERROR: 14");
+  } else if (is(cmd, "AT+CEREG=1") || is(cmd, "AT+CEREG=0")) {
+    ceregUrc = cmd[9] == '1';
+    emitLines(after(at, SIM_CMD_MS), "OK");
+    if (ceregUrc && simNowUs() < registerUs) simAt(registerUs, onRegistered, nullptr);
+  } else if (is(cmd, "AT+CEREG?")) {
+    snprintf(buf, sizeof(buf), "+CEREG: %d,%d\nOK", ceregUrc ? 1 : 0, registered() ? 1 : 2);
+    emitLines(after(at, SIM_CMD_MS), buf);
+  } else if (is(cmd, "AT+NETOPEN")) {
+    emitLines(after(at, SIM_CMD_MS), "OK");
+    later(registered() ? SIM_NETOPEN_MS : SIM_NET_FAIL_MS, registered() ? "+NETOPEN: 0" : "+NETOPEN: 1");
+  } else if (is(cmd, "AT+NETCLOSE")) {
+    emitLines(after(at, SIM_CMD_MS), "OK");
+    later(SIM_CMD_MS * 10, "+NETCLOSE: 0");
+  } else if (has(cmd, "AT+CEDRXS=") || has(cmd, "AT+CPSMS=")) {
+    emitLines(after(at, SIM_CMD_MS), "OK");
+  } else if (is(cmd, "AT+CEDRXRDP")) {
+    emitLines(after(at, SIM_CMD_MS), "+CEDRXRDP: 4,\"0010\",\"0010\",\"0011\"\nOK");
+  } else if (is(cmd, "AT+CPSMS?")) {
+    emitLines(after(at, SIM_CMD_MS), "+CPSMS: 1,,,\"00100001\",\"00000101\"\nOK");
+
+  // GNSS
+  } else if (is(cmd, "AT+CGPS=0")) {
+    if (!gnssOn) {
+      emitLines(after(at, SIM_GNSS_CMD_MS), "ERROR");
+    } else {
+      gnssOn = false;
+      reportEvery(0);
+      emitLines(after(at, SIM_GNSS_CMD_MS), "OK");
+      later(500, "+CGPS: 0");
+    }
+  } else if (has(cmd, "AT+CGPS=1") || is(cmd, "AT+CGPSHOT")) {
+    if (gnssOn) {
+      emitLines(after(at, SIM_GNSS_CMD_MS), "ERROR");
+    } else {
+      gnssStart();
+      emitLines(after(at, SIM_GNSS_CMD_MS), "OK");
+    }
+  } else if (is(cmd, "AT+CGPS?")) {
+    emitLines(after(at, SIM_CMD_MS), gnssOn ? "+CGPS: 1,1\nOK" : "+CGPS: 0,1\nOK");
+  } else if (is(cmd, "AT+CAGPS")) {
+    if (!gnssOn || !registered()) {
+      emitLines(after(at, SIM_CMD_MS), "ERROR");
+    } else {
+      // Assistance only helps an engine still searching
+      uint32_t ms = jittered(rttMs * 3);
+      uint64_t assisted = simNowUs() + (uint64_t)(ms + SIM_GNSS_AGPS_MS) * 1000;
+      if (assisted < gnssReadyUs) gnssReadyUs = assisted;
+      stats.airUp += SIM_HTTP_OVERHEAD_UP;
+      stats.airDown += SIM_AGPS_BYTES + SIM_HTTP_OVERHEAD_DOWN;
+      emitLines(after(at, SIM_CMD_MS), "OK");
+      later(ms, "+AGPS: success.");
+    }
+  } else if (is(cmd, "AT+CGPSINFO")) {
+    cgpsinfo(buf, sizeof(buf));
+    strcat(buf, "\nOK");
+    emitLines(after(at, SIM_GNSS_CMD_MS), buf);
+  } else if (sscanf(cmd, "AT+CGPSINFO=%d", &a) == 1 && a >= 0 && a <= 255) {
+    reportEvery(gnssOn ? a : 0);
+    emitLines(after(at, SIM_GNSS_CMD_MS), "OK");
+
+  // SMS
+  } else if (is(cmd, "AT+CMGF=1")) {
+    emitLines(after(at, SIM_CMD_MS), "OK");
+  } else if (has(cmd, "AT+CMGS=\"")) {
+    if (smsStalls) {
+      // In text entry all the same; only ESC or Ctrl-Z gets it out
+      smsStalls--;
+      dataTarget = DATA_SMS;
+      dataWant = sizeof(dataBuf);
+      dataLen = 0;
+      dataFromUs = after(at, SIM_CMD_MS);
+    } else {
+      expectData(at, DATA_SMS, sizeof(dataBuf), ">");
+    }
+
+  // HTTP
+  } else if (is(cmd, "AT+HTTPINIT")) {
+    emitLines(after(at, SIM_HTTP_INIT_MS), httpInit ? "ERROR" : "OK");
+    httpInit = true;
+  } else if (is(cmd, "AT+HTTPTERM")) {
+    emitLines(after(at, SIM_HTTP_CMD_MS), httpInit ? "OK" : "ERROR");
+    httpInit = false;
+  } else if (has(cmd, "AT+HTTPPARA=")) {
+    if (has(cmd, "AT+HTTPPARA=\"URL\",\"")) {
+      snprintf(httpUrl, sizeof(httpUrl), "%s", cmd + 19);
+      char* q = strchr(httpUrl, '"');
+      if (q) *q = '\0';
+    }
+    emitLines(after(at, SIM_HTTP_CMD_MS), httpInit ? "OK" : "ERROR");
+  } else if (sscanf(cmd, "AT+HTTPDATA=%d,%d", &a, &b) == 2) {
+    if (httpInit) expectData(at, DATA_HTTP, a, "DOWNLOAD");
+    else emitLines(after(at, SIM_HTTP_CMD_MS), "ERROR");
+  } else if (sscanf(cmd, "AT+HTTPACTION=%d", &a) == 1) {
+    emitLines(after(at, SIM_HTTP_CMD_MS), httpInit ? "OK" : "ERROR");
+    if (httpInit) httpAction(a);
+  } else if (sscanf(cmd, "AT+HTTPREAD=%d,%d", &a, &b) == 2) {
+    httpRead(after(at, SIM_HTTP_CMD_MS), a, b);
+
+  // MQTT
+  } else if (is(cmd, "AT+CMQTTSTART")) {
+    if (mqttStarted) {
+      emitLines(after(at, SIM_CMD_MS), "ERROR");
+    } else {
+      mqttStarted = true;
+      emitLines(after(at, SIM_CMD_MS), "OK");
+      later(SIM_CMD_MS * 5, "+CMQTTSTART: 0");
+    }
+  } else if (has(cmd, "AT+CMQTTACCQ=")) {
+    emitLines(after(at, SIM_CMD_MS), mqttStarted && !mqttAcquired ? "OK" : "ERROR");
+    if (mqttStarted) mqttAcquired = true;
+  } else if (has(cmd, "AT+CMQTTCONNECT=")) {
+    if (!mqttAcquired || mqttConnected) {
+      emitLines(after(at, SIM_CMD_MS), "ERROR");
+    } else {
+      emitLines(after(at, SIM_CMD_MS), "OK");
+      if (netUp) {
+        mqttConnected = true;
+        mqttUpSinceUs = simNowUs();
+        stats.airUp += 40 + SIM_MQTT_OVERHEAD;
+        later(jittered(2 * rttMs), "+CMQTTCONNECT: 0,0");
+      } else {
+        later(SIM_NET_FAIL_MS, "+CMQTTCONNECT: 0,6");
+      }
+    }
+  } else if (sscanf(cmd, "AT+CMQTTSUB=0,%d", &a) == 1) {
+    expectData(at, DATA_MQTT_SUB, a, ">");
+  } else if (sscanf(cmd, "AT+CMQTTTOPIC=0,%d", &a) == 1) {
+    expectData(at, DATA_MQTT_TOPIC, a, ">");
+  } else if (sscanf(cmd, "AT+CMQTTPAYLOAD=0,%d", &a) == 1) {
+    expectData(at, DATA_MQTT_PAYLOAD, a, ">");
+  } else if (has(cmd, "AT+CMQTTPUB=")) {
+    emitLines(after(at, SIM_CMD_MS), "OK");
+    if (mqttConnected && netUp) {
+      stats.mqttTx++;
+      stats.mqttBytesUp += strlen(mqttTopic) + mqttPayloadLen;
+      stats.airUp += strlen(mqttTopic) + mqttPayloadLen + SIM_MQTT_OVERHEAD;
+      stats.airDown += SIM_MQTT_OVERHEAD;       // PUBACK
+      later(jittered(rttMs), "+CMQTTPUB: 0,0");
+    } else {
+      later(SIM_CMD_MS, "+CMQTTPUB: 0,11");
+    }
+  } else if (has(cmd, "AT+CMQTTDISC=")) {
+    bool was = mqttConnected;
+    mqttDown();
+    emitLines(after(at, SIM_CMD_MS), was ? "OK" : "ERROR");
+    if (was) later(jittered(rttMs), "+CMQTTDISC: 0,0");
+  } else if (has(cmd, "AT+CMQTTREL=")) {
+    emitLines(after(at, SIM_CMD_MS), mqttAcquired && !mqttConnected ? "OK" : "ERROR");
+    if (!mqttConnected) mqttAcquired = false;
+  } else if (is(cmd, "AT+CMQTTSTOP")) {
+    emitLines(after(at, SIM_CMD_MS), mqttStarted && !mqttAcquired ? "OK" : "ERROR");
+    if (mqttStarted && !mqttAcquired) {
+      mqttStarted = false;
+      later(SIM_CMD_MS * 5, "+CMQTTSTOP: 0");
+    }
+  } else {
+    emitLines(after(at, SIM_CMD_MS), "ERROR");
+  }
+}
+
+// One byte from the ESP; `at` is when its stop bit reaches the modem
+static void onByte(uint8_t c, uint64_t at) {
+  if (at < readyUs) return;   // still booting
+  if (dataTarget == DATA_SMS && c == 0x1B) {
+    dataTarget = DATA_NONE;
+    stats.smsCancelled++;
+    emitLines(after(at, SIM_CMD_MS), "OK");
+    return;
+  }
+  if (dataTarget != DATA_NONE) {
+    if (at < dataFromUs && dataLen == 0 && c == '\n') return;
+    if (dataTarget == DATA_SMS && c == '\r') stats.smsGarbled++;    // a command line went into the text
+    if (dataLen < sizeof(dataBuf)) dataBuf[dataLen] = c;
+    dataLen++;
+    if (dataLen >= dataWant || (dataTarget == DATA_SMS && c == 0x1A)) onData(at);
+    return;
+  }
+  if (c == 0x1B) return;      // ESC outside text entry is ignored
+  if (echo) emitRaw(at, (const char*)&c, 1);
+  if (c == '\n') return;
+  if (c == '\r') {
+    line[lineLen] = '\0';
+    if (lineLen) onCommand(line, at);
+    lineLen = 0;
+    return;
+  }
+  if (lineLen < sizeof(line) - 1) line[lineLen++] = c;
+}
+
+// ----------------------- Stream -----------------------
+class SimModemStream : public Stream {
+ public:
+  int available() override {
+    size_t n = 0;
+    while (outHead + n < outTail && outDue[(outHead + n) % SIM_OUT_MAX] <= simNowUs()) n++;
+    return (int)n;
+  }
+
+  int read() override {
+    if (!available()) return -1;
+    stats.uartRx++;
+    return (uint8_t)outBuf[outHead++ % SIM_OUT_MAX];
+  }
+
+  int peek() override {
+    return available() ? (uint8_t)outBuf[outHead % SIM_OUT_MAX] : -1;
+  }
+
+  size_t write(uint8_t c) override {
+    uint64_t at = (lastInUs > simNowUs() ? lastInUs : simNowUs()) + SIM_BYTE_US;
+    lastInUs = at;
+    stats.uartTx++;
+    onByte(c, at);
+    return 1;
+  }
+  using Print::write;
+};
+
+static SimModemStream modemStream;
+
+Stream& simModem() {
+  return modemStream;
+}
+
+// ----------------------- Scenario controls -----------------------
+void simModemBoot(uint32_t bootMs) {
+  readyUs = (uint64_t)bootMs * 1000;
+  cpinUs = bootMs ? readyUs + (uint64_t)SIM_CPIN_MS * 1000 : 0;
+  registerUs = bootMs ? cpinUs + (uint64_t)SIM_REGISTER_MS * 1000 : 0;
+  if (!bootMs) return;
+  later(bootMs, "RDY");
+  later(bootMs + 1000, "+CPIN: READY");
+  later(bootMs + 5000, "SMS DONE");
+  later(bootMs + 5500, "PB DONE");
+}
+
+void simSmsUp(bool up) {
+  smsUp = up;
+}
+
+void simSmsStall(uint32_t n) {
+  smsStalls = n;
+}
+
+void simNetUp(bool up) {
+  if (netUp == up) return;
+  netUp = up;
+  if (ceregUrc && simNowUs() >= registerUs) later(SIM_CMD_MS, up ? "+CEREG: 1" : "+CEREG: 2");
+  if (!up && mqttConnected) {
+    mqttDown();
+    later(1000, "+CMQTTCONNLOST: 0,3");
+  }
+}
+
+const SimStats& simStats() {
+  static SimStats snapshot;
+  snapshot = stats;
+  snapshot.sosPending = 0;
+  for (uint8_t i = 0; i < sosPressCount; i++) snapshot.sosPending += !sosPress[i].server;
+
+  // Keepalive pings while connected
+  uint64_t upUs = mqttUpTotalUs + (mqttConnected ? simNowUs() - mqttUpSinceUs : 0);
+  uint32_t pings = upUs / ((uint64_t)SIM_MQTT_KEEPALIVE_S * 1000000);
+  snapshot.airUp += pings * SIM_MQTT_PING_BYTES / 2;
+  snapshot.airDown += pings * SIM_MQTT_PING_BYTES / 2;
+  return snapshot;
+}
@@ -0,0 +1,70 @@
+#include "alloc_counter.h"
+
+#ifdef ALLOC_COUNTER
+
+static volatile uint32_t allocs = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+}
+
+#ifdef HAL_NATIVE
+#include <new>
+
+// The host's C++ runtime is a shared library, so its operator new reaches
+// malloc without passing the wrapper; count it here instead
+void* operator new(size_t size) {
+  void* p = __wrap_malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+#endif
+
+uint32_t allocCount() {
+  return allocs;
+}
+
+#else
+
+uint32_t allocCount() {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,299 @@
+#include "at_engine.h"
+
+// ----------------------- State -----------------------
+static Stream*      atPort = nullptr;
+static AtIdleHook   idleHook = nullptr;
+static AtDoneHook   doneHook = nullptr;
+static AtGateHook   gateHook = nullptr;
+
+static char         lineBuf[AT_LINE_MAX];
+static size_t       lineLen = 0;
+
+static char         replyBuf[AT_REPLY_MAX];
+static size_t       replyLen = 0;
+static AtReply      reply = { AT_OK, -1, 0, replyBuf, 0 };
+
+static char         pendingCmd[AT_LINE_MAX];   // for echo suppression + logging
+static char         finalLine[32];             // prompt or URC that ends the command
+static bool         pending = false;
+static uint32_t     startMs = 0;
+static uint32_t     timeoutMs = 0;
+static uint32_t     busyMsTotal = 0;
+static uint32_t     blockedMsTotal = 0;
+
+struct UrcEntry {
+  const char*  prefix;
+  AtUrcHandler handler;
+};
+static UrcEntry     urcTable[AT_MAX_URC_HANDLERS];
+static uint8_t      urcCount = 0;
+
+static AtUrcHandler captureHandler = nullptr;
+static uint8_t      captureLines = 0;
+
+// ----------------------- Helpers -----------------------
+static bool startsWith(const char* s, const char* prefix) {
+  while (*prefix) {
+    if (*s++ != *prefix++) return false;
+  }
+  return true;
+}
+
+static bool finalIsPrompt() {
+  return finalLine[0] != '\0' && finalLine[0] != '+';
+}
+
+// "+CGPSINFO: ..." answers "AT+CGPSINFO" even if a URC handler exists for it
+static bool answersPendingCmd(const char* line) {
+  if (line[0] != '+' || !startsWith(pendingCmd, "AT+")) return false;
+  const char* c = pendingCmd + 3;
+  const char* l = line + 1;
+  while (*c && *c != '=' && *c != '?' && *l == *c) { c++; l++; }
+  return (*c == '\0' || *c == '=' || *c == '?') && *l == ':';
+}
+
+static void appendReply(const char* line, size_t n) {
+  if (replyLen && replyLen < AT_REPLY_MAX - 1) replyBuf[replyLen++] = '\n';
+  size_t room = AT_REPLY_MAX - 1 - replyLen;
+  if (n > room) n = room;
+  memcpy(replyBuf + replyLen, line, n);
+  replyLen += n;
+  replyBuf[replyLen] = '\0';
+}
+
+static bool dispatchUrc(const char* line) {
+  for (uint8_t i = 0; i < urcCount; i++) {
+    if (startsWith(line, urcTable[i].prefix)) {
+      urcTable[i].handler(line);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void finish(AtResult r) {
+  pending = false;
+  reply.result = r;
+  reply.elapsedMs = millis() - startMs;
+  reply.len = replyLen;
+  busyMsTotal += reply.elapsedMs;
+
+  Serial.print("> ");
+  Serial.println(pendingCmd);
+  if (replyLen) Serial.println(replyBuf);
+  Serial.printf("[%s %lu ms]\n", atResultName(r), (unsigned long)reply.elapsedMs);
+
+  if (doneHook) doneHook(pendingCmd, reply);
+}
+
+static void handleLine(const char* line, size_t n) {
+  if (n == 0) return;
+
+  if (captureHandler) {
+    AtUrcHandler h = captureHandler;
+    if (--captureLines == 0) captureHandler = nullptr;
+    h(line);
+    return;
+  }
+
+  if (!pending) {
+    if (!dispatchUrc(line)) {
+      Serial.print("URC? ");
+      Serial.println(line);
+    }
+    return;
+  }
+
+  if (strcmp(line, pendingCmd) == 0) return;  // command echo
+
+  if (finalLine[0] && startsWith(line, finalLine)) {
+    appendReply(line, n);
+    finish(finalIsPrompt() ? AT_PROMPT : AT_OK);
+    return;
+  }
+
+  if (strcmp(line, "OK") == 0) {
+    if (finalLine[0] && !finalIsPrompt()) return;    // accepted, the result URC is still to come
+    finish(AT_OK);
+    return;
+  }
+
+  if (strcmp(line, "ERROR") == 0) {
+    finish(AT_ERROR);
+    return;
+  }
+
+  if (startsWith(line, "+CME ERROR:") || startsWith(line, "+CMS ERROR:")) {
+    reply.cmeCode = atoi(line + 11);
+    appendReply(line, n);
+    finish(AT_CME_ERROR);
+    return;
+  }
+
+  if (!answersPendingCmd(line) && dispatchUrc(line)) return;
+
+  appendReply(line, n);
+}
+
+static void pump() {
+  if (!atPort) return;
+
+  while (atPort->available()) {
+    char c = (char)atPort->read();
+    if (c == '\r') continue;
+    if (c == '\n' || lineLen == AT_LINE_MAX - 1) {
+      lineBuf[lineLen] = '\0';
+      handleLine(lineBuf, lineLen);
+      lineLen = 0;
+      if (c == '\n') continue;
+    }
+    lineBuf[lineLen++] = c;
+
+    // "> " data prompt is not newline terminated
+    if (pending && finalLine[0] == '>' && lineLen >= 1 && lineBuf[0] == '>') {
+      lineLen = 0;
+      finish(AT_PROMPT);
+    }
+  }
+}
+
+static void arm(const char* label, uint32_t timeout, const char* final) {
+  strncpy(pendingCmd, label, sizeof(pendingCmd) - 1);
+  pendingCmd[sizeof(pendingCmd) - 1] = '\0';
+  if (final) {
+    strncpy(finalLine, final, sizeof(finalLine) - 1);
+    finalLine[sizeof(finalLine) - 1] = '\0';
+  } else {
+    finalLine[0] = '\0';
+  }
+
+  replyLen = 0;
+  replyBuf[0] = '\0';
+  reply.result = AT_PENDING;
+  reply.cmeCode = -1;
+  reply.len = 0;
+
+  timeoutMs = timeout;
+  startMs = millis();
+  pending = true;
+}
+
+// ----------------------- Public API -----------------------
+void atBegin(Stream& port) {
+  atPort = &port;
+  lineLen = 0;
+  pending = false;
+}
+
+AtResult atStart(const char* cmd, uint32_t timeout, const char* final) {
+  if (pending) return AT_BUSY;
+  pump();  // flush URCs that arrived before this command
+  if (gateHook && !gateHook(cmd)) {
+    replyLen = 0;
+    replyBuf[0] = '\0';
+    reply = { AT_ABORTED, -1, 0, replyBuf, 0 };
+    return AT_ABORTED;
+  }
+  arm(cmd, timeout, final);
+  atPort->print(cmd);
+  atPort->print("\r\n");
+  return AT_PENDING;
+}
+
+AtResult atStartData(const uint8_t* data, size_t len, uint32_t timeout, const char* final) {
+  if (pending) return AT_BUSY;
+  char label[32];
+  snprintf(label, sizeof(label), "<%u data bytes>", (unsigned)len);
+  arm(label, timeout, final);
+  atPort->write(data, len);
+  return AT_PENDING;
+}
+
+AtResult atPoll() {
+  if (!pending) return reply.result;
+  pump();
+  if (pending && millis() - startMs >= timeoutMs) finish(AT_TIMEOUT);
+  return pending ? AT_PENDING : reply.result;
+}
+
+const AtReply& atReply() {
+  return reply;
+}
+
+bool atBusy() {
+  return pending;
+}
+
+static AtResult waitDone() {
+  uint32_t start = millis();
+  AtResult r;
+  while ((r = atPoll()) == AT_PENDING) {
+    if (idleHook) idleHook();
+    delay(1);
+  }
+  blockedMsTotal += millis() - start;
+  return r;
+}
+
+AtResult atCommand(const char* cmd, uint32_t timeout, const char* final) {
+  AtResult r = atStart(cmd, timeout, final);
+  if (r != AT_PENDING) return r;
+  return waitDone();
+}
+
+AtResult atSendData(const char* data, size_t len, uint32_t timeout, const char* final) {
+  AtResult r = atStartData((const uint8_t*)data, len, timeout, final);
+  if (r != AT_PENDING) return r;
+  return waitDone();
+}
+
+void atSetIdleHook(AtIdleHook hook) {
+  idleHook = hook;
+}
+
+void atSetDoneHook(AtDoneHook hook) {
+  doneHook = hook;
+}
+
+void atSetGateHook(AtGateHook hook) {
+  gateHook = hook;
+}
+
+bool atOnUrc(const char* prefix, AtUrcHandler handler) {
+  if (urcCount >= AT_MAX_URC_HANDLERS) return false;
+  urcTable[urcCount].prefix = prefix;
+  urcTable[urcCount].handler = handler;
+  urcCount++;
+  return true;
+}
+
+void atCaptureLines(AtUrcHandler handler, uint8_t lines) {
+  captureHandler = lines ? handler : nullptr;
+  captureLines = lines;
+}
+
+void atService() {
+  if (!pending) pump();
+}
+
+uint32_t atBusyMsTotal() {
+  return busyMsTotal;
+}
+
+uint32_t atBlockedMsTotal() {
+  return blockedMsTotal;
+}
+
+const char* atResultName(AtResult r) {
+  switch (r) {
+    case AT_PENDING:   return "PENDING";
+    case AT_OK:        return "OK";
+    case AT_ERROR:     return "ERROR";
+    case AT_CME_ERROR: return "CME ERROR";
+    case AT_PROMPT:    return "PROMPT";
+    case AT_TIMEOUT:   return "TIMEOUT";
+    case AT_BUSY:      return "BUSY";
+    case AT_ABORTED:   return "ABORTED";
+  }
+  return "?";
+}
@@ -0,0 +1,323 @@
+#include "barometer.h"
+#include <Wire.h>
+#include "hal.h"
+
+// ----------------------- BMP390 registers -----------------------
+#define REG_CHIP_ID        0x00
+#define REG_FIFO_LENGTH    0x12
+#define REG_FIFO_DATA      0x14
+#define REG_FIFO_WTM       0x15
+#define REG_FIFO_CONFIG_1  0x17
+#define REG_FIFO_CONFIG_2  0x18
+#define REG_INT_CTRL       0x19
+#define REG_PWR_CTRL       0x1B
+#define REG_OSR            0x1C
+#define REG_ODR            0x1D
+#define REG_CONFIG         0x1F
+#define REG_CALIB          0x31
+#define REG_CMD            0x7E
+
+#define CHIP_ID_VALUE      0x60
+#define CMD_SOFT_RESET     0xB6
+#define CMD_FIFO_FLUSH     0xB0
+#define PWR_SLEEP          0x03      // press + temp enabled, sleep mode
+#define PWR_NORMAL         0x33
+#define OSR_P4_T1          0x02
+#define ODR_50HZ           0x02
+#define IIR_COEFF_3        0x04
+#define FIFO_PRESS_TEMP    0x19      // fifo_mode | press_en | temp_en
+#define FIFO_FILTERED      0x08      // data_select = filtered
+#define INT_OPEN_DRAIN_WTM 0x09      // int_od | fwtm_en, active low
+
+// FIFO frame headers
+#define FRAME_PRESS_TEMP   0x94
+#define FRAME_TEMP         0x90
+#define FRAME_PRESS        0x84
+#define FRAME_TIME         0xA0
+#define FRAME_EMPTY        0x80
+#define FRAME_CONFIG       0x44
+#define FRAME_CONFIG_ERR   0x48
+
+#define FIFO_BYTES         512
+#define READ_CHUNK         120       // stays inside the Wire buffer
+#define DROP_SLOTS         10        // drop window in 100 ms steps
+
+// ----------------------- State -----------------------
+struct Calib {
+  float t1, t2, t3;
+  float p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11;
+};
+
+static bool       present = false;
+static Calib      cal;
+static float      tLin = 0.0f;
+static volatile bool fifoIrq = false;
+static bool       continuous = true;
+static bool       awake = false;
+static uint32_t   lastDrainMs = 0;
+static uint32_t   nextWakeMs = 0;
+static BaroStats  stats = { 0, 0 };
+static uint8_t    fifo[FIFO_BYTES];
+
+// Altitude filters, cm relative to the first sample
+static bool       haveBase = false;
+static bool       rebase = true;     // next sample restarts the filters
+static float      baseCm = 0.0f;
+static float      fastCm = 0.0f, slowCm = 0.0f, floorRefCm = 0.0f;
+static float      dropWindow[DROP_SLOTS];
+static uint8_t    dropSlot = 0;
+static uint8_t    sinceSlot = 0;
+
+#define EVENT_QUEUE 4
+static BaroEvent  events[EVENT_QUEUE];
+static uint8_t    evHead = 0, evTail = 0;
+
+static void IRAM_ATTR onWatermark() {
+  fifoIrq = true;
+}
+
+// ----------------------- Bus -----------------------
+static bool writeReg(uint8_t reg, uint8_t value) {
+  stats.transactions++;
+  Wire.beginTransmission(BARO_I2C_ADDR);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+static bool readRegs(uint8_t reg, uint8_t* out, size_t n) {
+  stats.transactions++;
+  Wire.beginTransmission(BARO_I2C_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom((uint8_t)BARO_I2C_ADDR, (uint8_t)n) != n) return false;
+  for (size_t i = 0; i < n; i++) out[i] = Wire.read();
+  return true;
+}
+
+// ----------------------- Compensation (datasheet 8.4/8.6) -----------------------
+static float u16(const uint8_t* b) { return (float)(uint16_t)(b[0] | b[1] << 8); }
+static float s16(const uint8_t* b) { return (float)(int16_t)(b[0] | b[1] << 8); }
+static float s8(const uint8_t* b)  { return (float)(int8_t)b[0]; }
+
+static bool readCalib() {
+  uint8_t b[21];
+  if (!readRegs(REG_CALIB, b, sizeof(b))) return false;
+
+  cal.t1  = u16(b + 0) * 256.0f;                        // / 2^-8
+  cal.t2  = u16(b + 2) / 1073741824.0f;                 // / 2^30
+  cal.t3  = s8(b + 4) / 281474976710656.0f;             // / 2^48
+  cal.p1  = (s16(b + 5) - 16384.0f) / 1048576.0f;       // (P1 - 2^14) / 2^20
+  cal.p2  = (s16(b + 7) - 16384.0f) / 536870912.0f;     // (P2 - 2^14) / 2^29
+  cal.p3  = s8(b + 9) / 4294967296.0f;                  // / 2^32
+  cal.p4  = s8(b + 10) / 137438953472.0f;               // / 2^37
+  cal.p5  = u16(b + 11) * 8.0f;                         // / 2^-3
+  cal.p6  = u16(b + 13) / 64.0f;                        // / 2^6
+  cal.p7  = s8(b + 15) / 256.0f;                        // / 2^8
+  cal.p8  = s8(b + 16) / 32768.0f;                      // / 2^15
+  cal.p9  = s16(b + 17) / 281474976710656.0f;           // / 2^48
+  cal.p10 = s8(b + 19) / 281474976710656.0f;            // / 2^48
+  cal.p11 = s8(b + 20) / 36893488147419103232.0f;       // / 2^65
+  return true;
+}
+
+static void compensateTemp(uint32_t raw) {
+  float d = (float)raw - cal.t1;
+  tLin = d * cal.t2 + d * d * cal.t3;
+}
+
+static float compensatePressure(uint32_t raw) {
+  float t = tLin, t2 = t * t, t3 = t2 * t;
+  float up = (float)raw;
+  float out1 = cal.p5 + cal.p6 * t + cal.p7 * t2 + cal.p8 * t3;
+  float out2 = up * (cal.p1 + cal.p2 * t + cal.p3 * t2 + cal.p4 * t3);
+  float out3 = up * up * (cal.p9 + cal.p10 * t) + up * up * up * cal.p11;
+  return out1 + out2 + out3;
+}
+
+// ----------------------- Altitude pipeline -----------------------
+static void emit(BaroEventType type, int32_t deltaCm) {
+  uint8_t next = (evHead + 1) % EVENT_QUEUE;
+  if (next == evTail) return;
+  events[evHead] = { type, deltaCm };
+  evHead = next;
+}
+
+static void addSample(float pa) {
+  stats.samples++;
+  float cm = 4433000.0f * (1.0f - powf(pa / 101325.0f, 0.190295f));
+  if (!haveBase) {
+    haveBase = true;
+    baseCm = cm;
+  }
+  cm -= baseCm;   // keeps the filter state small, so float stays precise
+  if (rebase) {
+    rebase = false;
+    fastCm = slowCm = floorRefCm = cm;
+    for (uint8_t i = 0; i < DROP_SLOTS; i++) dropWindow[i] = cm;
+    sinceSlot = 0;
+  }
+
+  fastCm += (cm - fastCm) / (1 << BARO_FAST_SHIFT);
+  slowCm += (cm - slowCm) / (1 << BARO_SLOW_SHIFT);
+
+  // Sudden drop: fast altitude vs the highest point of the last second
+  if (++sinceSlot >= BARO_RATE_HZ * BARO_DROP_WINDOW_MS / 1000 / DROP_SLOTS) {
+    sinceSlot = 0;
+    dropWindow[dropSlot] = fastCm;
+    dropSlot = (dropSlot + 1) % DROP_SLOTS;
+    float peak = dropWindow[0];
+    for (uint8_t i = 1; i < DROP_SLOTS; i++) if (dropWindow[i] > peak) peak = dropWindow[i];
+    if (peak - fastCm >= BARO_DROP_CM) {
+      emit(BARO_DROP, (int32_t)(fastCm - peak));
+      for (uint8_t i = 0; i < DROP_SLOTS; i++) dropWindow[i] = fastCm;
+    }
+  }
+
+  // Floor change against a reference that slowly absorbs weather drift
+  float diff = slowCm - floorRefCm;
+  if (diff >= BARO_FLOOR_CM || diff <= -BARO_FLOOR_CM) {
+    emit(diff > 0 ? BARO_FLOOR_UP : BARO_FLOOR_DOWN, (int32_t)diff);
+    floorRefCm = slowCm;
+  } else {
+    floorRefCm += diff / BARO_DRIFT_SAMPLES;
+  }
+}
+
+// ----------------------- FIFO -----------------------
+static void parseFifo(const uint8_t* p, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    uint8_t header = p[i++];
+    size_t left = len - i;
+    switch (header) {
+      case FRAME_PRESS_TEMP:
+        if (left < 6) return;
+        compensateTemp(p[i] | p[i + 1] << 8 | (uint32_t)p[i + 2] << 16);
+        addSample(compensatePressure(p[i + 3] | p[i + 4] << 8 | (uint32_t)p[i + 5] << 16));
+        i += 6;
+        break;
+      case FRAME_TEMP:
+        if (left < 3) return;
+        compensateTemp(p[i] | p[i + 1] << 8 | (uint32_t)p[i + 2] << 16);
+        i += 3;
+        break;
+      case FRAME_PRESS:
+        if (left < 3) return;
+        addSample(compensatePressure(p[i] | p[i + 1] << 8 | (uint32_t)p[i + 2] << 16));
+        i += 3;
+        break;
+      case FRAME_TIME:
+        i += 3;
+        break;
+      case FRAME_EMPTY:
+      case FRAME_CONFIG:
+      case FRAME_CONFIG_ERR:
+        i += 1;
+        break;
+      default:
+        return;   // lost sync; the next batch starts on a frame boundary
+    }
+  }
+}
+
+static void drain() {
+  uint8_t lenBuf[2];
+  if (!readRegs(REG_FIFO_LENGTH, lenBuf, 2)) return;
+  size_t len = lenBuf[0] | (lenBuf[1] & 0x01) << 8;
+  if (len > FIFO_BYTES) len = FIFO_BYTES;
+
+  for (size_t off = 0; off < len; off += READ_CHUNK) {
+    size_t n = len - off < READ_CHUNK ? len - off : READ_CHUNK;
+    if (!readRegs(REG_FIFO_DATA, fifo + off, n)) return;
+  }
+  parseFifo(fifo, len);
+}
+
+// Waking discards the FIFO; the gap since the last batch says nothing
+// about drops or floors, so the filters start over
+static void setAwake(bool on) {
+  if (on == awake) return;
+  if (on) {
+    writeReg(REG_CMD, CMD_FIFO_FLUSH);
+    rebase = true;
+  }
+  writeReg(REG_PWR_CTRL, on ? PWR_NORMAL : PWR_SLEEP);
+  awake = on;
+  lastDrainMs = millis();
+}
+
+// ----------------------- Public API -----------------------
+bool baroBegin() {
+  uint8_t id = 0;
+  present = readRegs(REG_CHIP_ID, &id, 1) && id == CHIP_ID_VALUE;
+  if (!present) {
+    Serial.println("Baro: no BMP390");
+    return false;
+  }
+
+  writeReg(REG_CMD, CMD_SOFT_RESET);
+  delay(10);
+  uint16_t watermark = BARO_WATERMARK * 7;   // header + 6 data bytes per frame
+  present = readCalib() &&
+            writeReg(REG_OSR, OSR_P4_T1) &&
+            writeReg(REG_ODR, ODR_50HZ) &&
+            writeReg(REG_CONFIG, IIR_COEFF_3) &&
+            writeReg(REG_FIFO_WTM, watermark & 0xFF) &&
+            writeReg(REG_FIFO_WTM + 1, watermark >> 8) &&
+            writeReg(REG_FIFO_CONFIG_1, FIFO_PRESS_TEMP) &&
+            writeReg(REG_FIFO_CONFIG_2, FIFO_FILTERED) &&
+            writeReg(REG_INT_CTRL, INT_OPEN_DRAIN_WTM);
+  if (!present) {
+    Serial.println("Baro: BMP390 configuration failed");
+    return false;
+  }
+
+  // Every free pin on the XIAO is a strapping pin. GPIO8 only counts when
+  // GPIO9 (BOOT) is held low, and it has to be high then for the download
+  // mode, so INT idles high on the pull-up and the sensor only pulls it low
+  halPinInput(BARO_INT_PIN, true);
+  halPinInterrupt(BARO_INT_PIN, onWatermark, FALLING);
+  setAwake(true);
+  return true;
+}
+
+void baroSetContinuous(bool on) {
+  continuous = on;
+  if (present && on) setAwake(true);
+}
+
+void baroPoll() {
+  if (!present) return;
+
+  if (!awake) {
+    if ((long)(millis() - nextWakeMs) >= 0) setAwake(true);
+    return;
+  }
+  bool due = fifoIrq || halPinRead(BARO_INT_PIN) == LOW;    // level, see imuPoll()
+  if (!due && millis() - lastDrainMs < BARO_POLL_MS) return;
+
+  fifoIrq = false;
+  lastDrainMs = millis();
+  drain();
+
+  if (!continuous) {
+    setAwake(false);
+    nextWakeMs = millis() + BARO_IDLE_PERIOD_MS;
+  }
+}
+
+bool baroEvent(BaroEvent& ev) {
+  if (evTail == evHead) return false;
+  ev = events[evTail];
+  evTail = (evTail + 1) % EVENT_QUEUE;
+  return true;
+}
+
+int32_t baroAltitudeCm() {
+  return (int32_t)slowCm;
+}
+
+const BaroStats& baroStats() {
+  return stats;
+}
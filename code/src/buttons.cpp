@@ -0,0 +1,138 @@
+#include "buttons.h"
+#include "hal.h"
+#include <esp_timer.h>
+
+// ----------------------- ISR edge ring (SPSC) -----------------------
+struct Edge {
+  uint8_t button;
+  uint8_t level;
+  int64_t us;
+};
+
+static Edge              edges[BUTTON_EDGE_QUEUE];
+static volatile uint8_t  edgeHead = 0;     // written by ISR only
+static volatile uint8_t  edgeTail = 0;     // written by consumer only
+static volatile uint32_t droppedEdges = 0;
+
+static uint8_t           pins[BUTTON_COUNT];
+
+static void IRAM_ATTR pushEdge(uint8_t button) {
+  uint8_t head = edgeHead;
+  uint8_t next = (head + 1) & (BUTTON_EDGE_QUEUE - 1);
+  if (next == __atomic_load_n(&edgeTail, __ATOMIC_ACQUIRE)) {
+    droppedEdges++;
+    return;
+  }
+  edges[head].button = button;
+  edges[head].level = halPinRead(pins[button]);
+  edges[head].us = esp_timer_get_time();
+  __atomic_store_n(&edgeHead, next, __ATOMIC_RELEASE);
+}
+
+static void IRAM_ATTR isrA() { pushEdge(0); }
+static void IRAM_ATTR isrB() { pushEdge(1); }
+
+// ----------------------- Debounce + gestures -----------------------
+struct ButtonState {
+  bool    pressed;
+  bool    longFired;
+  uint8_t clicks;
+  int64_t lastEdgeUs;
+  int64_t pressUs;
+  int64_t releaseUs;
+};
+
+static ButtonState state[BUTTON_COUNT];
+
+#define EVENT_QUEUE 8
+static ButtonEvent events[EVENT_QUEUE];
+static uint8_t     evHead = 0, evTail = 0;
+
+static void emit(uint8_t button, ButtonEventType type, int64_t edgeUs) {
+  uint8_t next = (evHead + 1) % EVENT_QUEUE;
+  if (next == evTail) evTail = (evTail + 1) % EVENT_QUEUE;  // keep the newest
+  events[evHead] = { button, type, edgeUs };
+  evHead = next;
+}
+
+static void applyEdge(uint8_t b, bool pressed, int64_t us) {
+  ButtonState& s = state[b];
+  if (pressed == s.pressed) return;
+  if (us - s.lastEdgeUs < BUTTON_DEBOUNCE_US) return;  // bounce
+
+  s.pressed = pressed;
+  s.lastEdgeUs = us;
+
+  if (pressed) {
+    s.pressUs = us;
+    s.longFired = false;
+    emit(b, BTN_PRESS, us);
+  } else if (!s.longFired) {
+    s.releaseUs = us;
+    if (++s.clicks == 2) {
+      s.clicks = 0;
+      emit(b, BTN_DOUBLE, s.pressUs);
+    }
+  }
+}
+
+static void process() {
+  uint8_t head = __atomic_load_n(&edgeHead, __ATOMIC_ACQUIRE);
+  while (edgeTail != head) {
+    const Edge& e = edges[edgeTail];
+    applyEdge(e.button, e.level == LOW, e.us);
+    __atomic_store_n(&edgeTail, (uint8_t)((edgeTail + 1) & (BUTTON_EDGE_QUEUE - 1)), __ATOMIC_RELEASE);
+  }
+
+  int64_t now = esp_timer_get_time();
+  for (uint8_t b = 0; b < BUTTON_COUNT; b++) {
+    ButtonState& s = state[b];
+
+    // Final edge of a bounce burst may have been rejected; resync to the pin
+    bool raw = halPinRead(pins[b]) == LOW;
+    if (raw != s.pressed && now - s.lastEdgeUs >= BUTTON_DEBOUNCE_US) applyEdge(b, raw, now);
+
+    if (s.pressed && !s.longFired && now - s.pressUs >= BUTTON_LONG_US) {
+      s.longFired = true;
+      s.clicks = 0;
+      emit(b, BTN_LONG, s.pressUs);
+    }
+    if (!s.pressed && s.clicks == 1 && now - s.releaseUs >= BUTTON_DOUBLE_US) {
+      s.clicks = 0;
+      emit(b, BTN_SHORT, s.pressUs);
+    }
+  }
+}
+
+// ----------------------- Public API -----------------------
+void buttonsBegin(uint8_t pinA, uint8_t pinB) {
+  pins[0] = pinA;
+  pins[1] = pinB;
+  for (uint8_t b = 0; b < BUTTON_COUNT; b++) {
+    halPinInput(pins[b], true);
+    state[b].pressed = halPinRead(pins[b]) == LOW;
+    state[b].lastEdgeUs = -BUTTON_DEBOUNCE_US;
+  }
+  halPinInterrupt(pinA, isrA, CHANGE);
+  halPinInterrupt(pinB, isrB, CHANGE);
+}
+
+bool buttonsPoll(ButtonEvent& ev) {
+  process();
+  if (evTail == evHead) return false;
+  ev = events[evTail];
+  evTail = (evTail + 1) % EVENT_QUEUE;
+  return true;
+}
+
+bool buttonsBusy() {
+  if (edgeTail != __atomic_load_n(&edgeHead, __ATOMIC_ACQUIRE) || evTail != evHead) return true;
+  for (uint8_t b = 0; b < BUTTON_COUNT; b++) {
+    if (state[b].pressed || state[b].clicks) return true;
+  }
+  return false;
+}
+
+uint32_t buttonsDroppedEdges() {
+  return droppedEdges;
+}
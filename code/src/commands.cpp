@@ -0,0 +1,295 @@
+#include "commands.h"
+#include "motion.h"
+#include "fall_detector.h"
+
+// A filtered command document is a few dozen slots; the default pools are
+// sized for much larger ones
+#define ARDUINOJSON_POOL_CAPACITY 32
+#include <ArduinoJson.h>
+
+// ----------------------- Arena -----------------------
+// Bump allocator over a static buffer, so parsing never touches the heap.
+// Each block has a size header; the last block grows and shrinks in place,
+// which is how ArduinoJson builds strings and trims its pools.
+class Arena : public ArduinoJson::Allocator {
+ public:
+  Arena(uint8_t* buf, size_t size) : buf_(buf), size_(size) {}
+
+  void reset() { used_ = 0; }
+  size_t peak() const { return peak_; }
+
+  void* allocate(size_t n) override {
+    size_t need = HEADER + align(n);
+    if (need > size_ - used_) return nullptr;
+    uint8_t* block = buf_ + used_;
+    setSize(block + HEADER, n);
+    grow(used_ + need);
+    return block + HEADER;
+  }
+
+  void deallocate(void* p) override {
+    if (p && isLast(p)) used_ = (uint8_t*)p - HEADER - buf_;
+  }
+
+  void* reallocate(void* p, size_t n) override {
+    if (!p) return allocate(n);
+    if (isLast(p)) {
+      size_t start = (uint8_t*)p - buf_;
+      if (align(n) > size_ - start) return nullptr;
+      setSize(p, n);
+      used_ = start;
+      grow(start + align(n));
+      return p;
+    }
+    size_t old = sizeOf(p);
+    void* moved = allocate(n);
+    if (moved) memcpy(moved, p, old < n ? old : n);
+    return moved;
+  }
+
+ private:
+  static const size_t HEADER = 8;   // keeps blocks 8-byte aligned
+
+  static size_t align(size_t n) { return (n + 7) & ~(size_t)7; }
+  static size_t sizeOf(const void* p) {
+    uint32_t n;
+    memcpy(&n, (const uint8_t*)p - HEADER, sizeof(n));
+    return n;
+  }
+  static void setSize(void* p, size_t n) {
+    uint32_t v = n;
+    memcpy((uint8_t*)p - HEADER, &v, sizeof(v));
+  }
+  bool isLast(const void* p) const { return (const uint8_t*)p - buf_ + align(sizeOf(p)) == used_; }
+  void grow(size_t used) {
+    used_ = used;
+    if (used_ > peak_) peak_ = used_;
+  }
+
+  uint8_t* buf_;
+  size_t   size_;
+  size_t   used_ = 0;
+  size_t   peak_ = 0;
+};
+
+alignas(8) static uint8_t docBuf[COMMAND_ARENA_BYTES];
+alignas(8) static uint8_t filterBuf[COMMAND_FILTER_BYTES];
+static Arena        docArena(docBuf, sizeof(docBuf));
+static Arena        filterArena(filterBuf, sizeof(filterBuf));
+static CommandStats stats;
+static char         recent[COMMAND_RECENT][COMMAND_ID_MAX];
+static uint8_t      recentNext = 0;
+
+static const char* const TYPE_NAMES[] = {
+  "unknown", "vibrate", "stop", "locate", "set_rate", "set_thresholds",
+};
+
+struct PatternName {
+  const char*       name;
+  const VibPattern* pattern;
+};
+
+static const PatternName PATTERNS[] = {
+  { "alert",  &VIB_PATTERN_ALERT },
+  { "pulse",  &VIB_PATTERN_PULSE },
+  { "tap",    &VIB_PATTERN_TAP },
+  { "double", &VIB_PATTERN_DOUBLE_TAP },
+};
+
+// ----------------------- Reader -----------------------
+// What ArduinoJson reads from: the chunks as the source hands them out
+class SourceReader {
+ public:
+  SourceReader(CommandSource source, void* ctx) : source_(source), ctx_(ctx) {}
+
+  int read() {
+    if (pos_ == len_ && !refill()) return -1;
+    return (uint8_t)chunk_[pos_++];
+  }
+
+  size_t readBytes(char* out, size_t n) {
+    size_t got = 0;
+    while (got < n && (pos_ < len_ || refill())) {
+      size_t k = len_ - pos_ < n - got ? len_ - pos_ : n - got;
+      memcpy(out + got, chunk_ + pos_, k);
+      pos_ += k;
+      got += k;
+    }
+    return got;
+  }
+
+ private:
+  bool refill() {
+    if (done_) return false;
+    len_ = source_(ctx_, chunk_);
+    pos_ = 0;
+    done_ = len_ == 0;
+    return !done_;
+  }
+
+  CommandSource source_;
+  void*         ctx_;
+  const char*   chunk_ = nullptr;
+  size_t        len_ = 0, pos_ = 0;
+  bool          done_ = false;
+};
+
+struct TextSource {
+  const char* text;
+  size_t      len;
+};
+
+static size_t textChunk(void* ctx, const char*& chunk) {
+  TextSource& s = *(TextSource*)ctx;
+  chunk = s.text;
+  size_t n = s.len;
+  s.len = 0;
+  return n;
+}
+
+// ----------------------- Decoding -----------------------
+static const JsonDocument& filter() {
+  static JsonDocument doc(&filterArena);
+  static bool built = false;
+  if (built) return doc;
+  static const char* const FIELDS[] = { "id", "command", "pattern", "period_s", "free_fall_mg", "impact_mg" };
+  for (const char* field : FIELDS) {
+    doc[field] = true;
+    doc["commands"][0][field] = true;
+  }
+  built = true;
+  return doc;
+}
+
+// IDs go back verbatim in the ack JSON, so only plain ones are kept
+static void readId(JsonVariantConst v, char* out) {
+  out[0] = '\0';
+  if (v.is<uint32_t>()) {
+    snprintf(out, COMMAND_ID_MAX, "%lu", (unsigned long)v.as<uint32_t>());
+    return;
+  }
+  const char* id = v.as<const char*>();
+  if (!id) return;
+  size_t n = 0;
+  for (; id[n]; n++) {
+    char c = id[n];
+    bool plain = isalnum((unsigned char)c) || c == '_' || c == '.' || c == ':' || c == '-';
+    if (!plain || n >= COMMAND_ID_MAX - 1) return;
+  }
+  memcpy(out, id, n + 1);
+}
+
+static CommandType typeOf(const char* name) {
+  for (uint8_t t = COMMAND_VIBRATE; t < sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]); t++) {
+    if (strcmp(name, TYPE_NAMES[t]) == 0) return (CommandType)t;
+  }
+  return COMMAND_UNKNOWN;
+}
+
+static void readCommand(JsonVariantConst c, Command& out) {
+  memset(&out, 0, sizeof(out));
+  readId(c["id"], out.id);
+  out.type = typeOf(c["command"] | "");
+  out.valid = true;
+
+  switch (out.type) {
+    case COMMAND_VIBRATE: {
+      const char* name = c["pattern"] | "alert";
+      out.valid = false;
+      for (const PatternName& p : PATTERNS) {
+        if (strcmp(name, p.name) == 0) {
+          out.pattern = p.pattern;
+          out.valid = true;
+        }
+      }
+      break;
+    }
+    case COMMAND_SET_RATE: {
+      JsonVariantConst period = c["period_s"];
+      out.periodS = period.as<uint32_t>();
+      out.valid = period.is<uint32_t>() &&
+                  (out.periodS == 0 || (out.periodS >= MOTION_MIN_PERIOD_MS / 1000 &&
+                                        out.periodS <= MOTION_STILL_PERIOD_MS / 1000));
+      break;
+    }
+    case COMMAND_SET_THRESHOLDS: {
+      // Either may be left out; a value that is there must be in range
+      JsonVariantConst freeFall = c["free_fall_mg"], impact = c["impact_mg"];
+      out.freeFallMg = freeFall.as<uint16_t>();
+      out.impactMg = impact.as<uint16_t>();
+      bool freeFallOk = freeFall.isNull() ||
+                        (freeFall.is<uint16_t>() && out.freeFallMg >= FALL_FREE_FALL_MG_MIN &&
+                         out.freeFallMg <= FALL_FREE_FALL_MG_MAX);
+      bool impactOk = impact.isNull() ||
+                      (impact.is<uint16_t>() && out.impactMg >= FALL_IMPACT_MG_MIN &&
+                       out.impactMg <= FALL_IMPACT_MG_MAX);
+      out.valid = freeFallOk && impactOk && (out.freeFallMg || out.impactMg);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// ----------------------- Public API -----------------------
+bool commandParse(CommandSource source, void* ctx, CommandBatch& out) {
+  out.count = 0;
+  const JsonDocument& fields = filter();
+  docArena.reset();
+  JsonDocument doc(&docArena);
+  SourceReader reader(source, ctx);
+  DeserializationError err = deserializeJson(doc, reader, DeserializationOption::Filter(fields),
+                                             DeserializationOption::NestingLimit(COMMAND_NESTING));
+  if (docArena.peak() > stats.arenaPeak) stats.arenaPeak = docArena.peak();
+  if (err) {
+    stats.rejected++;
+    Serial.printf("Commands: body rejected (%s)\n", err.c_str());
+    return false;
+  }
+
+  stats.bodies++;
+  JsonVariantConst root = doc.as<JsonVariantConst>();
+  if (root["commands"].is<JsonArrayConst>()) {
+    for (JsonVariantConst c : root["commands"].as<JsonArrayConst>()) {
+      if (out.count == COMMAND_MAX) break;
+      readCommand(c, out.items[out.count++]);
+    }
+  } else if (!root["command"].isNull()) {
+    readCommand(root, out.items[out.count++]);
+  }
+  stats.commands += out.count;
+  return true;
+}
+
+bool commandParseText(const char* text, size_t len, CommandBatch& out) {
+  TextSource s = { text, len };
+  return commandParse(textChunk, &s, out);
+}
+
+bool commandSeen(const char* id) {
+  if (!id[0]) return false;
+  for (uint8_t i = 0; i < COMMAND_RECENT; i++) {
+    if (strcmp(recent[i], id) == 0) return true;
+  }
+  return false;
+}
+
+void commandRecord(const char* id) {
+  if (!id[0] || commandSeen(id)) return;
+  snprintf(recent[recentNext], COMMAND_ID_MAX, "%s", id);
+  recentNext = (recentNext + 1) % COMMAND_RECENT;
+}
+
+const char* commandTypeName(CommandType t) {
+  return t < sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]) ? TYPE_NAMES[t] : "?";
+}
+
+const CommandStats& commandStats() {
+  return stats;
+}
+
+void commandResetStats() {
+  uint32_t peak = stats.arenaPeak;
+  memset(&stats, 0, sizeof(stats));
+  stats.arenaPeak = peak;
+}
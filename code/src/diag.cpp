@@ -0,0 +1,228 @@
+#include "diag.h"
+#include "modem_boot.h"
+#include "modem_sched.h"
+#include "sos_alert.h"
+#include "commands.h"
+#include <stdarg.h>
+
+struct AtKind {
+  char          name[DIAG_AT_NAME_MAX];
+  uint16_t      errors;
+  uint16_t      timeouts;
+  DiagHistogram latencyMs;
+};
+
+static AtKind        atKinds[DIAG_AT_KINDS];
+static uint8_t       atKindCount = 0;
+static DiagHistogram loopUs;
+static uint32_t      counters[DIAG_COUNTER_COUNT];
+
+static uint32_t      periodStartMs = 0;
+static uint32_t      busyBase = 0, blockedBase = 0;
+
+static uint32_t      firstFixMs = 0;
+static uint32_t      lastFixMs = 0;
+static uint32_t      heapFree = 0, heapMinFree = 0, heapLargest = 0;
+
+static char          serialLine[32];
+static uint8_t       serialLen = 0;
+
+// ----------------------- Recording -----------------------
+void diagHistAdd(DiagHistogram& h, uint32_t value) {
+  uint8_t b = value ? 32 - __builtin_clz(value) : 0;
+  if (b >= DIAG_BUCKETS) b = DIAG_BUCKETS - 1;
+  if (h.bins[b] != UINT16_MAX) h.bins[b]++;
+  h.count++;
+  if (value > h.max) h.max = value;
+}
+
+// "AT+HTTPACTION=1" -> "HTTPACTION", "<12 data bytes>" -> "data"
+static void kindName(const char* cmd, char* out) {
+  if (cmd[0] == '<') {
+    strcpy(out, "data");
+    return;
+  }
+  if (strncmp(cmd, "AT+", 3) == 0) cmd += 3;
+  else if (strncmp(cmd, "AT", 2) == 0 && cmd[2]) cmd += 2;
+  size_t n = 0;
+  while (cmd[n] && cmd[n] != '=' && cmd[n] != '?' && n < DIAG_AT_NAME_MAX - 1) {
+    out[n] = cmd[n];
+    n++;
+  }
+  out[n] = '\0';
+}
+
+static AtKind& kindFor(const char* cmd) {
+  char name[DIAG_AT_NAME_MAX];
+  kindName(cmd, name);
+  for (uint8_t i = 0; i < atKindCount; i++) {
+    if (strcmp(atKinds[i].name, name) == 0) return atKinds[i];
+  }
+  if (atKindCount < DIAG_AT_KINDS - 1) {
+    AtKind& k = atKinds[atKindCount++];
+    strcpy(k.name, name);
+    return k;
+  }
+  AtKind& other = atKinds[DIAG_AT_KINDS - 1];
+  strcpy(other.name, "other");
+  atKindCount = DIAG_AT_KINDS;
+  return other;
+}
+
+void diagAtDone(const char* cmd, const AtReply& reply) {
+  AtKind& k = kindFor(cmd);
+  diagHistAdd(k.latencyMs, reply.elapsedMs);
+  if (reply.result == AT_TIMEOUT) k.timeouts++;
+  else if (reply.result == AT_ERROR || reply.result == AT_CME_ERROR) k.errors++;
+}
+
+void diagLoop(uint32_t us) {
+  diagHistAdd(loopUs, us);
+}
+
+void diagCount(DiagCounter c) {
+  if (c < DIAG_COUNTER_COUNT) counters[c]++;
+}
+
+void diagFix(bool ok) {
+  diagCount(ok ? DIAG_FIX_OK : DIAG_FIX_NONE);
+  if (!ok) return;
+  lastFixMs = millis();
+  if (!firstFixMs) firstFixMs = lastFixMs ? lastFixMs : 1;
+}
+
+void diagSampleHeap() {
+  heapFree = ESP.getFreeHeap();
+  heapMinFree = ESP.getMinFreeHeap();
+  uint32_t largest = ESP.getMaxAllocHeap();
+  if (!heapLargest || largest < heapLargest) heapLargest = largest;   // worst seen
+}
+
+// ----------------------- Record -----------------------
+static char*  out;
+static size_t outSize, outLen;
+
+static void emit(const char* fmt, ...) {
+  if (outLen >= outSize) return;
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(out + outLen, outSize - outLen, fmt, ap);
+  va_end(ap);
+  if (n > 0) outLen += n;
+  if (outLen >= outSize) outLen = outSize;   // truncated
+}
+
+// Trailing empty buckets are left out
+static void emitHistogram(const DiagHistogram& h) {
+  int last = DIAG_BUCKETS - 1;
+  while (last >= 0 && !h.bins[last]) last--;
+  emit("[");
+  for (int b = 0; b <= last; b++) emit(b ? ",%u" : "%u", h.bins[b]);
+  emit("]");
+}
+
+const char* diagRecord(size_t& len) {
+  static char buf[DIAG_RECORD_MAX];
+  out = buf;
+  outSize = sizeof(buf);
+  outLen = 0;
+  buf[0] = '\0';
+  diagSampleHeap();
+
+  uint32_t now = millis();
+  emit("{\"v\":1,\"up_s\":%lu,\"period_s\":%lu", now / 1000, (now - periodStartMs) / 1000);
+  emit(",\"heap\":[%lu,%lu,%lu]", (unsigned long)heapFree, (unsigned long)heapMinFree, (unsigned long)heapLargest);
+  emit(",\"loop_us\":{\"n\":%lu,\"max\":%lu,\"h\":", (unsigned long)loopUs.count, (unsigned long)loopUs.max);
+  emitHistogram(loopUs);
+  emit("},\"at_busy_ms\":%lu,\"at_blocked_ms\":%lu", (unsigned long)(atBusyMsTotal() - busyBase),
+       (unsigned long)(atBlockedMsTotal() - blockedBase));
+  emit(",\"http\":[%lu,%lu]", (unsigned long)counters[DIAG_HTTP_OK], (unsigned long)counters[DIAG_HTTP_FAIL]);
+  emit(",\"fix\":[%lu,%lu,%ld,%ld]", (unsigned long)counters[DIAG_FIX_OK], (unsigned long)counters[DIAG_FIX_NONE],
+       lastFixMs ? (long)((now - lastFixMs) / 1000) : -1L, firstFixMs ? (long)(firstFixMs / 1000) : -1L);
+  const ModemBootStats& boot = modemBootStats();
+  emit(",\"boot\":[%lu,%lu,%lu,%lu]", (unsigned long)boot.answeredMs, (unsigned long)boot.registeredMs,
+       (unsigned long)boot.dataMs, (unsigned long)boot.ttffMs);
+  // Per modem class: [requests, preempted, worst wait, worst request -> delivered]
+  emit(",\"modem\":{");
+  for (uint8_t p = 0, n = 0; p < MODEM_PRIO_COUNT; p++) {
+    const ModemClassStats& c = modemClassStats((ModemPrio)p);
+    if (!c.requests) continue;
+    emit("%s\"%s\":[%lu,%lu,%lu,%lu]", n++ ? "," : "", modemPrioName((ModemPrio)p), (unsigned long)c.requests,
+         (unsigned long)c.preempted, (unsigned long)c.waitMs.max, (unsigned long)c.totalMs.max);
+  }
+  // SOS: [alerts, texts sent, texts failed, first by HTTP, first by SMS, worst HTTP, worst SMS]
+  const SosAlertStats& sos = sosAlertStats();
+  emit("},\"sos\":[%lu,%lu,%lu,%lu,%lu,%lu,%lu]", (unsigned long)sos.alerts, (unsigned long)sos.smsSent,
+       (unsigned long)sos.smsFailed, (unsigned long)sos.first[SOS_CHANNEL_HTTP],
+       (unsigned long)sos.first[SOS_CHANNEL_SMS], (unsigned long)sos.latencyMs[SOS_CHANNEL_HTTP].max,
+       (unsigned long)sos.latencyMs[SOS_CHANNEL_SMS].max);
+  // Command bodies: [parsed, commands, rejected, most of the parse arena used since boot]
+  const CommandStats& cmds = commandStats();
+  emit(",\"cmds\":[%lu,%lu,%lu,%lu]", (unsigned long)cmds.bodies, (unsigned long)cmds.commands,
+       (unsigned long)cmds.rejected, (unsigned long)cmds.arenaPeak);
+  emit(",\"mqtt_cmds\":%lu,\"at\":{", (unsigned long)counters[DIAG_MQTT_COMMANDS]);
+  for (uint8_t i = 0; i < atKindCount; i++) {
+    const AtKind& k = atKinds[i];
+    if (!k.latencyMs.count) continue;
+    emit("%s\"%s\":[%lu,%u,%u,%lu,", outLen && out[outLen - 1] != '{' ? "," : "", k.name,
+         (unsigned long)k.latencyMs.count, k.errors, k.timeouts, (unsigned long)k.latencyMs.max);
+    emitHistogram(k.latencyMs);
+    emit("]");
+  }
+  emit("}}");
+  if (outLen == outSize) {          // did not fit: never hand out broken JSON
+    buf[0] = '\0';
+    outLen = 0;
+  }
+  len = outLen;
+  return buf;
+}
+
+void diagReset() {
+  for (uint8_t i = 0; i < atKindCount; i++) {
+    AtKind& k = atKinds[i];
+    k.errors = k.timeouts = 0;
+    memset(&k.latencyMs, 0, sizeof(k.latencyMs));
+  }
+  memset(&loopUs, 0, sizeof(loopUs));
+  memset(counters, 0, sizeof(counters));
+  modemSchedResetStats();
+  sosAlertResetStats();
+  commandResetStats();
+  heapLargest = 0;
+  periodStartMs = millis();
+  busyBase = atBusyMsTotal();
+  blockedBase = atBlockedMsTotal();
+}
+
+void diagBegin() {
+  atKindCount = 0;
+  diagReset();
+  diagSampleHeap();
+}
+
+// ----------------------- Serial console -----------------------
+static void handleCommand(const char* cmd) {
+  if (strcmp(cmd, "diag") == 0) {
+    size_t len;
+    const char* record = diagRecord(len);
+    if (len) Serial.println(record);
+  } else if (strcmp(cmd, "diag reset") == 0) {
+    diagReset();
+    Serial.println("diag: reset");
+  }
+}
+
+void diagSerialService() {
+  while (Serial.available()) {
+    char c = (char)Serial.read();
+    if (c == '\r') continue;
+    if (c == '\n') {
+      serialLine[serialLen] = '\0';
+      handleCommand(serialLine);
+      serialLen = 0;
+    } else if (serialLen < sizeof(serialLine) - 1) {
+      serialLine[serialLen++] = c;
+    }
+  }
+}
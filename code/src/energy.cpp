@@ -0,0 +1,41 @@
+#include "energy.h"
+#include <string.h>
+
+const float ENERGY_RAIL_MA[ENERGY_RAIL_COUNT] = {
+  22.0f,    // CPU active, 160 MHz, radios off
+  0.13f,    // CPU light sleep
+  250.0f,   // modem busy (LTE TX/RX bursts averaged)
+  20.0f,    // modem registered, UART awake, eDRX paging
+  30.0f,    // GNSS tracking
+  60.0f,    // vibration motor
+};
+
+void energyReset(EnergyModel& m) {
+  memset(&m, 0, sizeof(m));
+}
+
+void energyAdd(EnergyModel& m, EnergyRail rail, uint32_t ms) {
+  if (rail < ENERGY_RAIL_COUNT) m.ms[rail] += ms;
+}
+
+float energyMah(const EnergyModel& m, EnergyRail rail) {
+  if (rail >= ENERGY_RAIL_COUNT) return 0.0f;
+  return ENERGY_RAIL_MA[rail] * m.ms[rail] / 3600000.0f;
+}
+
+float energyMahPerHour(const EnergyModel& m, EnergyRail rail, uint32_t elapsedMs) {
+  if (!elapsedMs) return 0.0f;
+  return energyMah(m, rail) * 3600000.0f / elapsedMs;
+}
+
+const char* energyRailName(EnergyRail rail) {
+  switch (rail) {
+    case ENERGY_CPU_ACTIVE: return "cpu";
+    case ENERGY_CPU_SLEEP:  return "sleep";
+    case ENERGY_MODEM_BUSY: return "modem-tx";
+    case ENERGY_MODEM_IDLE: return "modem-idle";
+    case ENERGY_GNSS:       return "gnss";
+    case ENERGY_VIBRATION:  return "vib";
+    default:                return "?";
+  }
+}
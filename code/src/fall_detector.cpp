@@ -0,0 +1,152 @@
+#include "fall_detector.h"
+#include <math.h>
+
+static_assert(FALL_POST_IMPACT_MS <= FALL_SETTLE_MS, "snapshot is taken while settling");
+
+#define SQ(v) ((uint32_t)(v) * (uint32_t)(v))
+
+enum Phase : uint8_t {
+  PHASE_IDLE = 0,
+  PHASE_IMPACT_WAIT,      // free fall seen, waiting for the hit
+  PHASE_SETTLE,
+  PHASE_STILL_CHECK,
+};
+
+// ----------------------- State -----------------------
+static uint16_t    rate = 100;
+static uint16_t    impactMaxMg = FALL_IMPACT_MG_MAX;
+static uint32_t    freeFallMinN, impactWindowN, postImpactN, settleN, stillN;
+static uint32_t    freeFallSq = SQ(FALL_FREE_FALL_MG);
+static uint32_t    impactSq = SQ(FALL_IMPACT_MG);
+
+static AccelSample ring[FALL_RING];
+static uint16_t    ringPos = 0;
+static uint32_t    sampleCount = 0;
+
+static AccelSample snapshot[FALL_RING];
+static size_t      snapshotLen = 0;
+static bool        snapshotTaken = false;
+
+static Phase       phase = PHASE_IDLE;
+static uint32_t    phaseStart = 0;       // sample index the phase began at
+static uint32_t    freeFallRun = 0;      // consecutive free-fall samples
+static uint32_t    freeFallLen = 0;      // run that armed the detector
+static uint32_t    impactIdx = 0;
+static uint32_t    peakSq = 0;
+
+static FallEvent   pendingEvent;
+static bool        eventPending = false;
+
+// ----------------------- Helpers -----------------------
+static uint32_t msToSamples(uint32_t ms) {
+  uint32_t n = ms * rate / 1000;
+  return n ? n : 1;
+}
+
+static void takeSnapshot() {
+  uint16_t start = sampleCount < FALL_RING ? 0 : ringPos;
+  snapshotLen = sampleCount < FALL_RING ? sampleCount : FALL_RING;
+  for (size_t i = 0; i < snapshotLen; i++) snapshot[i] = ring[(start + i) % FALL_RING];
+  snapshotTaken = true;
+}
+
+static void step(const AccelSample& s) {
+  ring[ringPos] = s;
+  ringPos = (ringPos + 1) % FALL_RING;
+  uint32_t idx = sampleCount++;
+
+  uint32_t magSq = SQ(s.x) + SQ(s.y) + SQ(s.z);   // < 2^32 for any int16 axes
+  bool freeFall = magSq < freeFallSq;
+
+  if (phase == PHASE_IDLE && !freeFall && freeFallRun >= freeFallMinN) {
+    freeFallLen = freeFallRun;
+    phase = PHASE_IMPACT_WAIT;
+    phaseStart = idx;
+  }
+
+  // The sample that ends the free fall is often the impact itself
+  if (phase == PHASE_IMPACT_WAIT) {
+    if (magSq >= impactSq) {
+      impactIdx = idx;
+      peakSq = magSq;
+      snapshotTaken = false;
+      phase = PHASE_SETTLE;
+      phaseStart = idx;
+    } else if (!freeFall && idx - phaseStart > impactWindowN) {
+      phase = PHASE_IDLE;
+    }
+  } else if (phase == PHASE_SETTLE) {
+    if (magSq > peakSq && idx - impactIdx < postImpactN) {
+      peakSq = magSq;
+      impactIdx = idx;
+    }
+    if (!snapshotTaken && idx - impactIdx >= postImpactN) takeSnapshot();
+    if (idx - phaseStart >= settleN) {
+      phase = PHASE_STILL_CHECK;
+      phaseStart = idx;
+    }
+  } else if (phase == PHASE_STILL_CHECK) {
+    if (magSq < SQ(1000 - FALL_STILL_BAND_MG) || magSq > SQ(1000 + FALL_STILL_BAND_MG)) {
+      phase = PHASE_IDLE;                 // moving again: tripped, not fallen
+    } else if (idx - phaseStart >= stillN) {
+      if (!snapshotTaken) takeSnapshot();
+      pendingEvent.impactSample = impactIdx;
+      pendingEvent.peakMg = (uint16_t)sqrtf((float)peakSq);
+      pendingEvent.freeFallMs = (uint16_t)(freeFallLen * 1000 / rate);
+      eventPending = true;
+      phase = PHASE_IDLE;
+    }
+  }
+
+  freeFallRun = freeFall ? freeFallRun + 1 : 0;
+}
+
+// ----------------------- Public API -----------------------
+void fallBegin(uint16_t rateHz, uint16_t fullScaleMg) {
+  rate = rateHz ? rateHz : 100;
+  impactMaxMg = FALL_IMPACT_MG_MAX;
+  if (fullScaleMg > FALL_IMPACT_HEADROOM_MG && fullScaleMg - FALL_IMPACT_HEADROOM_MG < impactMaxMg) {
+    impactMaxMg = fullScaleMg - FALL_IMPACT_HEADROOM_MG;
+  }
+  if (impactSq > SQ(impactMaxMg)) impactSq = SQ(impactMaxMg);
+  freeFallMinN  = msToSamples(FALL_FREE_FALL_MIN_MS);
+  impactWindowN = msToSamples(FALL_IMPACT_WINDOW_MS);
+  postImpactN   = msToSamples(FALL_POST_IMPACT_MS);
+  settleN       = msToSamples(FALL_SETTLE_MS);
+  stillN        = msToSamples(FALL_STILL_MS);
+
+  ringPos = 0;
+  sampleCount = 0;
+  snapshotLen = 0;
+  phase = PHASE_IDLE;
+  freeFallRun = 0;
+  eventPending = false;
+}
+
+bool fallSetThresholds(uint16_t freeFallMg, uint16_t impactMg) {
+  if (freeFallMg && (freeFallMg < FALL_FREE_FALL_MG_MIN || freeFallMg > FALL_FREE_FALL_MG_MAX)) return false;
+  if (impactMg && (impactMg < FALL_IMPACT_MG_MIN || impactMg > impactMaxMg)) return false;
+  if (freeFallMg) freeFallSq = SQ(freeFallMg);
+  if (impactMg) impactSq = SQ(impactMg);
+  return true;
+}
+
+uint16_t fallImpactMaxMg() {
+  return impactMaxMg;
+}
+
+void fallFeed(const AccelSample* samples, size_t n) {
+  for (size_t i = 0; i < n; i++) step(samples[i]);
+}
+
+bool fallPoll(FallEvent& ev) {
+  if (!eventPending) return false;
+  ev = pendingEvent;
+  eventPending = false;
+  return true;
+}
+
+size_t fallSnapshot(const AccelSample*& out) {
+  out = snapshot;
+  return snapshotLen;
+}
@@ -0,0 +1,109 @@
+#include "fuel_gauge.h"
+#include "hal.h"
+
+// Resting Li-ion cell voltage vs state of charge (typical 1-cell curve)
+struct CurvePoint {
+  uint16_t mv;
+  uint8_t  pct;
+};
+
+static const CurvePoint CURVE[] = {
+  { 4200, 100 }, { 4100, 90 }, { 4000, 80 }, { 3920, 70 }, { 3850, 60 },
+  { 3800, 50 },  { 3750, 40 }, { 3700, 30 }, { 3650, 20 }, { 3550, 10 },
+  { 3450, 5 },   { 3300, 0 },
+};
+#define CURVE_POINTS (sizeof(CURVE) / sizeof(CURVE[0]))
+
+// ----------------------- State -----------------------
+static uint8_t   battPin = 0;
+static uint32_t  lastSampleMs = 0;
+static bool      sampled = false;
+static int32_t   filteredMv = 0;
+static int       percent = -1;
+static int       reportedPct = -1;
+static FuelStats stats = { 0, 0, 0, 0 };
+
+// ----------------------- Helpers -----------------------
+static uint16_t readOversampled() {
+  uint32_t sum = 0, lo = UINT32_MAX, hi = 0;
+  for (uint8_t i = 0; i < FUEL_OVERSAMPLE; i++) {
+    uint32_t mv = halAdcMillivolts(battPin);
+    sum += mv;
+    if (mv < lo) lo = mv;
+    if (mv > hi) hi = mv;
+  }
+  stats.adcReads += FUEL_OVERSAMPLE;
+  return (sum - lo - hi) / (FUEL_OVERSAMPLE - 2);
+}
+
+static int curvePercent(int32_t mv) {
+  if (mv >= CURVE[0].mv) return 100;
+  for (uint8_t i = 1; i < CURVE_POINTS; i++) {
+    if (mv >= CURVE[i].mv) {
+      const CurvePoint& a = CURVE[i];
+      const CurvePoint& b = CURVE[i - 1];
+      return a.pct + (mv - a.mv) * (b.pct - a.pct) / (b.mv - a.mv);
+    }
+  }
+  return 0;
+}
+
+static void sample(uint8_t loads) {
+  int32_t mv = (int32_t)(readOversampled() * FUEL_DIVIDER_RATIO);
+  if (loads & FUEL_LOAD_MODEM)     mv += FUEL_MODEM_SAG_MV;
+  if (loads & FUEL_LOAD_VIBRATION) mv += FUEL_VIB_SAG_MV;
+
+  if (!sampled) {
+    filteredMv = mv;
+    sampled = true;
+  } else {
+    filteredMv += (mv - filteredMv) / (1 << FUEL_FILTER_SHIFT);
+  }
+
+  int pct = curvePercent(filteredMv);
+  if (percent >= 0) {
+    int step = pct > percent ? pct - percent : percent - pct;
+    if (step > stats.jitterPct) stats.jitterPct = step;
+  }
+  percent = pct;
+  stats.samples++;
+}
+
+// ----------------------- Public API -----------------------
+void fuelBegin(uint8_t pin) {
+  battPin = pin;
+  halAdcBegin(12);
+  sample(0);
+  lastSampleMs = millis();
+}
+
+void fuelService(uint8_t loads) {
+  if (millis() - lastSampleMs < FUEL_SAMPLE_MS) return;
+  lastSampleMs = millis();
+  sample(loads);
+}
+
+int fuelPercent() {
+  return percent;
+}
+
+uint16_t fuelMillivolts() {
+  return (uint16_t)filteredMv;
+}
+
+bool fuelReportDue(int& pct) {
+  pct = percent;
+  if (percent < 0) return false;
+  if (reportedPct < 0) return true;
+  int step = percent > reportedPct ? percent - reportedPct : reportedPct - percent;
+  return step >= FUEL_REPORT_STEP;
+}
+
+void fuelReported(int pct) {
+  reportedPct = pct;
+  stats.reports++;
+}
+
+const FuelStats& fuelStats() {
+  return stats;
+}
@@ -0,0 +1,271 @@
+#include "geofence.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define E7_PER_METRE_LAT  (10000000.0 / 111320.0)
+
+static void copyName(char* dst, const char* src, size_t len) {
+  if (len > GEOFENCE_NAME_MAX - 1) len = GEOFENCE_NAME_MAX - 1;
+  memcpy(dst, src, len);
+  dst[len] = '\0';
+}
+
+static bool spanOk(const Geofence& f) {
+  return (int64_t)f.maxLat - f.minLat <= GEOFENCE_SPAN_MAX_E7 &&
+         (int64_t)f.maxLon - f.minLon <= GEOFENCE_SPAN_MAX_E7;
+}
+
+// ----------------------- Building -----------------------
+void geofenceClear(GeofenceSet& set) {
+  memset(&set, 0, sizeof(set));
+}
+
+static Geofence* newFence(GeofenceSet& set, GeofenceShape shape, const char* name, size_t nameLen) {
+  if (set.count >= GEOFENCE_MAX || set.pendingVertices) return nullptr;
+  Geofence& f = set.fences[set.count];
+  memset(&f, 0, sizeof(f));
+  f.shape = shape;
+  copyName(f.name, name, nameLen);
+  return &f;
+}
+
+static bool addCircle(GeofenceSet& set, const char* name, size_t nameLen,
+                      int32_t latE7, int32_t lonE7, uint32_t radiusM) {
+  if (!radiusM) return false;
+  Geofence* f = newFence(set, GEOFENCE_CIRCLE, name, nameLen);
+  if (!f) return false;
+
+  // Longitude differences are scaled by cos(lat) so both axes are in
+  // latitude units; computed once here, not per fix
+  int32_t r = (int32_t)(radiusM * E7_PER_METRE_LAT + 0.5);
+  int32_t cosQ16 = (int32_t)(cos(latE7 * (M_PI / 180.0 / 1e7)) * 65536.0);
+  if (cosQ16 < 1) cosQ16 = 1;
+  int64_t rLon = (int64_t)r * 65536 / cosQ16;
+  if (rLon > GEOFENCE_SPAN_MAX_E7 / 2) return false;
+
+  f->latE7 = latE7;
+  f->lonE7 = lonE7;
+  f->radiusE7Sq = (int64_t)r * r;
+  f->cosQ16 = cosQ16;
+  f->minLat = latE7 - r;
+  f->maxLat = latE7 + r;
+  f->minLon = lonE7 - (int32_t)rLon;
+  f->maxLon = lonE7 + (int32_t)rLon;
+  set.count++;
+  return true;
+}
+
+bool geofenceAddCircle(GeofenceSet& set, const char* name, int32_t latE7, int32_t lonE7, uint32_t radiusM) {
+  return addCircle(set, name, strlen(name), latE7, lonE7, radiusM);
+}
+
+static bool beginPolygon(GeofenceSet& set, const char* name, size_t nameLen, uint16_t vertices) {
+  if (vertices < 3 || set.vertexCount + vertices > GEOFENCE_VERTEX_MAX) return false;
+  Geofence* f = newFence(set, GEOFENCE_POLYGON, name, nameLen);
+  if (!f) return false;
+  f->first = set.vertexCount;
+  f->minLat = f->minLon = INT32_MAX;
+  f->maxLat = f->maxLon = INT32_MIN;
+  set.pendingVertices = vertices;
+  return true;
+}
+
+bool geofenceBeginPolygon(GeofenceSet& set, const char* name, uint16_t vertices) {
+  return beginPolygon(set, name, strlen(name), vertices);
+}
+
+bool geofenceAddVertex(GeofenceSet& set, int32_t latE7, int32_t lonE7) {
+  if (!set.pendingVertices) return false;
+  Geofence& f = set.fences[set.count];
+  set.vertLat[set.vertexCount] = latE7;
+  set.vertLon[set.vertexCount] = lonE7;
+  set.vertexCount++;
+  f.count++;
+  if (latE7 < f.minLat) f.minLat = latE7;
+  if (latE7 > f.maxLat) f.maxLat = latE7;
+  if (lonE7 < f.minLon) f.minLon = lonE7;
+  if (lonE7 > f.maxLon) f.maxLon = lonE7;
+
+  if (--set.pendingVertices) return true;
+  if (!spanOk(f)) {
+    set.vertexCount = f.first;
+    return false;
+  }
+  set.count++;
+  return true;
+}
+
+// ----------------------- Text format -----------------------
+// Splits the next comma-separated field off [*p, end)
+static bool field(const char*& p, const char* end, const char*& start, size_t& len) {
+  if (p > end) return false;
+  start = p;
+  while (p < end && *p != ',') p++;
+  len = p - start;
+  p++;   // past the comma (or one past end)
+  return true;
+}
+
+static bool intField(const char*& p, const char* end, long& out) {
+  const char* start;
+  size_t len;
+  if (!field(p, end, start, len) || !len || len > 15) return false;
+  char buf[16];
+  memcpy(buf, start, len);
+  buf[len] = '\0';
+  char* stop;
+  out = strtol(buf, &stop, 10);
+  return *stop == '\0';
+}
+
+bool geofenceParseLine(GeofenceSet& set, const char* line, size_t len) {
+  while (len && (line[len - 1] == '\r' || line[len - 1] == ' ')) len--;
+  if (!len) return true;
+  const char* p = line;
+  const char* end = line + len;
+  long a, b, c;
+
+  if (set.pendingVertices) {
+    return intField(p, end, a) && intField(p, end, b) && geofenceAddVertex(set, a, b);
+  }
+
+  const char* tag;
+  size_t tagLen;
+  if (!field(p, end, tag, tagLen) || tagLen != 1) return false;
+
+  if (*tag == 'V') {
+    if (!intField(p, end, a)) return false;
+    set.version = (uint32_t)a;
+    return true;
+  }
+
+  const char* name;
+  size_t nameLen;
+  if (!field(p, end, name, nameLen)) return false;
+  if (*tag == 'C') {
+    return intField(p, end, a) && intField(p, end, b) && intField(p, end, c) && c > 0 &&
+           addCircle(set, name, nameLen, a, b, c);
+  }
+  if (*tag == 'P') {
+    return intField(p, end, a) && a > 0 && a <= GEOFENCE_VERTEX_MAX &&
+           beginPolygon(set, name, nameLen, a);
+  }
+  return false;
+}
+
+// ----------------------- Grid index -----------------------
+static int cellOf(int32_t v, int32_t origin, int32_t size) {
+  int64_t d = ((int64_t)v - origin) / size;
+  return d < 0 ? 0 : d >= GEOFENCE_GRID ? GEOFENCE_GRID - 1 : (int)d;
+}
+
+void geofenceBuildIndex(GeofenceSet& set) {
+  if (set.pendingVertices) {
+    set.vertexCount = set.fences[set.count].first;
+    set.pendingVertices = 0;
+  }
+  memset(set.cells, 0, sizeof(set.cells));
+  set.primed = false;
+  for (uint8_t i = 0; i < set.count; i++) set.fences[i].inside = false;
+  if (!set.count) return;
+
+  int32_t minLat = INT32_MAX, maxLat = INT32_MIN, minLon = INT32_MAX, maxLon = INT32_MIN;
+  for (uint8_t i = 0; i < set.count; i++) {
+    const Geofence& f = set.fences[i];
+    if (f.minLat < minLat) minLat = f.minLat;
+    if (f.maxLat > maxLat) maxLat = f.maxLat;
+    if (f.minLon < minLon) minLon = f.minLon;
+    if (f.maxLon > maxLon) maxLon = f.maxLon;
+  }
+  set.gridMinLat = minLat;
+  set.gridMinLon = minLon;
+  set.cellLat = (int32_t)(((int64_t)maxLat - minLat) / GEOFENCE_GRID + 1);
+  set.cellLon = (int32_t)(((int64_t)maxLon - minLon) / GEOFENCE_GRID + 1);
+
+  for (uint8_t i = 0; i < set.count; i++) {
+    const Geofence& f = set.fences[i];
+    int r0 = cellOf(f.minLat, minLat, set.cellLat), r1 = cellOf(f.maxLat, minLat, set.cellLat);
+    int c0 = cellOf(f.minLon, minLon, set.cellLon), c1 = cellOf(f.maxLon, minLon, set.cellLon);
+    for (int r = r0; r <= r1; r++) {
+      for (int c = c0; c <= c1; c++) set.cells[r * GEOFENCE_GRID + c] |= 1u << i;
+    }
+  }
+}
+
+void geofenceCarryState(GeofenceSet& to, const GeofenceSet& from) {
+  if (!from.primed) return;
+  for (uint8_t i = 0; i < to.count; i++) {
+    for (uint8_t j = 0; j < from.count; j++) {
+      if (strcmp(to.fences[i].name, from.fences[j].name) == 0) {
+        to.fences[i].inside = from.fences[j].inside;
+        break;
+      }
+    }
+  }
+  to.primed = true;
+}
+
+// ----------------------- Containment -----------------------
+static bool circleContains(const Geofence& f, int32_t lat, int32_t lon) {
+  int64_t dy = (int64_t)lat - f.latE7;
+  int64_t dx = ((int64_t)lon - f.lonE7) * f.cosQ16 >> 16;
+  return dx * dx + dy * dy <= f.radiusE7Sq;
+}
+
+// Crossing number with exact integer cross products; points on an edge or
+// vertex count as inside. The caller has checked the bounding box, so all
+// differences are within GEOFENCE_SPAN_MAX_E7 and the products fit.
+static bool polygonContains(const GeofenceSet& set, const Geofence& f, int32_t py, int32_t px) {
+  const int32_t* lat = &set.vertLat[f.first];
+  const int32_t* lon = &set.vertLon[f.first];
+  bool inside = false;
+  for (uint16_t i = 0, j = f.count - 1; i < f.count; j = i++) {
+    int32_t yi = lat[i], yj = lat[j], xi = lon[i], xj = lon[j];
+    if ((py < yi && py < yj) || (py > yi && py > yj)) continue;
+
+    int64_t lhs = (int64_t)(xj - xi) * (py - yi);
+    int64_t rhs = (int64_t)(px - xi) * (yj - yi);
+    if (lhs == rhs && px >= (xi < xj ? xi : xj) && px <= (xi < xj ? xj : xi)) return true;
+    if ((yi > py) != (yj > py) && (yj > yi ? lhs > rhs : lhs < rhs)) inside = !inside;
+  }
+  return inside;
+}
+
+static bool inBox(const Geofence& f, int32_t lat, int32_t lon) {
+  return lat >= f.minLat && lat <= f.maxLat && lon >= f.minLon && lon <= f.maxLon;
+}
+
+bool geofenceContains(const GeofenceSet& set, uint8_t fence, int32_t latE7, int32_t lonE7) {
+  if (fence >= set.count) return false;
+  const Geofence& f = set.fences[fence];
+  if (!inBox(f, latE7, lonE7)) return false;
+  return f.shape == GEOFENCE_CIRCLE ? circleContains(f, latE7, lonE7)
+                                    : polygonContains(set, f, latE7, lonE7);
+}
+
+uint8_t geofenceEvaluate(GeofenceSet& set, int32_t latE7, int32_t lonE7, GeofenceEvent* out, uint8_t max) {
+  if (!set.count) return 0;
+
+  uint32_t candidates = 0;
+  int64_t dLat = (int64_t)latE7 - set.gridMinLat;
+  int64_t dLon = (int64_t)lonE7 - set.gridMinLon;
+  if (dLat >= 0 && dLon >= 0 && dLat < (int64_t)set.cellLat * GEOFENCE_GRID &&
+      dLon < (int64_t)set.cellLon * GEOFENCE_GRID) {
+    candidates = set.cells[(dLat / set.cellLat) * GEOFENCE_GRID + dLon / set.cellLon];
+  }
+
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < set.count; i++) {
+    Geofence& f = set.fences[i];
+    bool inside = (candidates & (1u << i)) && geofenceContains(set, i, latE7, lonE7);
+    if (inside == f.inside) continue;
+    if (set.primed) {
+      if (n == max) continue;   // reported on the next fix instead
+      out[n++] = { i, inside, f.name };
+    }
+    f.inside = inside;
+  }
+  set.primed = true;
+  return n;
+}
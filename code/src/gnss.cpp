@@ -0,0 +1,174 @@
+#include "gnss.h"
+#include <string.h>
+
+#define CGPSINFO_FIELDS 9
+
+// ----------------------- Field helpers -----------------------
+// Parses [f, fe) as a decimal number scaled by 10^frac. Extra fraction digits
+// are truncated; anything but digits, one '.', and an optional leading sign
+// (when allowed) is rejected.
+static bool parseFixed(const char* f, const char* fe, uint8_t frac, bool allowSign, int64_t& value) {
+  bool neg = false;
+  if (allowSign && f < fe && (*f == '-' || *f == '+')) {
+    neg = (*f == '-');
+    f++;
+  }
+
+  int64_t v = 0;
+  uint8_t intDigits = 0, fracDigits = 0;
+  bool dot = false;
+  for (; f < fe; f++) {
+    char c = *f;
+    if (c == '.') {
+      if (dot) return false;
+      dot = true;
+      continue;
+    }
+    if (c < '0' || c > '9') return false;
+    if (!dot) {
+      if (++intDigits > 9) return false;
+      v = v * 10 + (c - '0');
+    } else if (fracDigits < frac) {
+      v = v * 10 + (c - '0');
+      fracDigits++;
+    }
+  }
+  if (intDigits == 0) return false;
+  while (fracDigits < frac) {
+    v *= 10;
+    fracDigits++;
+  }
+  value = neg ? -v : v;
+  return true;
+}
+
+// Exactly n digits, nothing else
+static bool parseDigits(const char* f, uint8_t n, uint32_t& value) {
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    if (f[i] < '0' || f[i] > '9') return false;
+    v = v * 10 + (f[i] - '0');
+  }
+  value = v;
+  return true;
+}
+
+// NMEA-style (d)ddmm.mmmmmm -> degrees * 1e7. Degrees come from the integer
+// part / 100, so the parser does not depend on a fixed digit count.
+static bool parseDegMin(const char* f, const char* fe, uint8_t maxDeg, int32_t& e7) {
+  int64_t v;
+  if (!parseFixed(f, fe, 6, false, v)) return false;
+  int64_t deg = v / 100000000LL;
+  int64_t minE6 = v % 100000000LL;
+  if (minE6 >= 60000000LL || deg > maxDeg) return false;
+  if (deg == maxDeg && minE6 != 0) return false;
+  e7 = (int32_t)(deg * 10000000LL + (minE6 + 3) / 6);
+  return true;
+}
+
+// ----------------------- Parser -----------------------
+GnssParseResult gnssParseCgpsinfo(const char* s, size_t len, GnssFix& out) {
+  const char* p = s;
+  const char* end = s + len;
+
+  // Trim trailing line ending / whitespace
+  while (end > p && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) end--;
+
+  static const char prefix[] = "+CGPSINFO:";
+  const size_t prefixLen = sizeof(prefix) - 1;
+  if ((size_t)(end - p) >= prefixLen && memcmp(p, prefix, prefixLen) == 0) p += prefixLen;
+  while (p < end && *p == ' ') p++;
+
+  // Split into exactly nine fields in one scan
+  const char* fs[CGPSINFO_FIELDS];
+  const char* fe[CGPSINFO_FIELDS];
+  uint8_t n = 0;
+  bool allEmpty = true;
+  fs[0] = p;
+  for (; p < end; p++) {
+    if (*p == ',') {
+      if (n == CGPSINFO_FIELDS - 1) return GNSS_MALFORMED;
+      fe[n] = p;
+      if (fe[n] != fs[n]) allEmpty = false;
+      fs[++n] = p + 1;
+    } else if ((unsigned char)*p < 0x20 || (unsigned char)*p > 0x7e) {
+      return GNSS_MALFORMED;
+    }
+  }
+  fe[n] = end;
+  if (fe[n] != fs[n]) allEmpty = false;
+  if (n != CGPSINFO_FIELDS - 1) return GNSS_MALFORMED;
+  if (allEmpty) return GNSS_NO_FIX;
+
+  GnssFix fix;
+  memset(&fix, 0, sizeof(fix));
+
+  // Position
+  if (!parseDegMin(fs[0], fe[0], 90, fix.latE7)) return GNSS_MALFORMED;
+  if (fe[1] - fs[1] != 1 || (*fs[1] != 'N' && *fs[1] != 'S')) return GNSS_MALFORMED;
+  if (*fs[1] == 'S') fix.latE7 = -fix.latE7;
+
+  if (!parseDegMin(fs[2], fe[2], 180, fix.lonE7)) return GNSS_MALFORMED;
+  if (fe[3] - fs[3] != 1 || (*fs[3] != 'E' && *fs[3] != 'W')) return GNSS_MALFORMED;
+  if (*fs[3] == 'W') fix.lonE7 = -fix.lonE7;
+
+  // Date ddmmyy
+  uint32_t dd, mo, yy;
+  if (fe[4] - fs[4] != 6) return GNSS_MALFORMED;
+  if (!parseDigits(fs[4], 2, dd) || !parseDigits(fs[4] + 2, 2, mo) || !parseDigits(fs[4] + 4, 2, yy)) {
+    return GNSS_MALFORMED;
+  }
+  if (dd < 1 || dd > 31 || mo < 1 || mo > 12) return GNSS_MALFORMED;
+  fix.day = dd;
+  fix.month = mo;
+  fix.year = yy;
+
+  // UTC time hhmmss[.sss]
+  int64_t t;
+  const char* dot = (const char*)memchr(fs[5], '.', fe[5] - fs[5]);
+  if ((dot ? dot : fe[5]) - fs[5] != 6 || !parseFixed(fs[5], fe[5], 3, false, t)) return GNSS_MALFORMED;
+  uint32_t hms = (uint32_t)(t / 1000);
+  fix.hour = hms / 10000;
+  fix.minute = (hms / 100) % 100;
+  fix.second = hms % 100;
+  fix.millis = t % 1000;
+  if (fix.hour > 23 || fix.minute > 59 || fix.second > 60) return GNSS_MALFORMED;
+
+  // Optional: altitude (m), speed (knots), course (deg)
+  int64_t v;
+  if (fe[6] != fs[6]) {
+    if (!parseFixed(fs[6], fe[6], 2, true, v) || v < -100000 || v > 10000000) return GNSS_MALFORMED;
+    fix.altCm = (int32_t)v;
+    fix.flags |= GNSS_HAS_ALT;
+  }
+  if (fe[7] != fs[7]) {
+    if (!parseFixed(fs[7], fe[7], 3, false, v) || v > 1000000) return GNSS_MALFORMED;
+    fix.speedCmS = (uint32_t)((v * 514444 + 5000000) / 10000000);  // 1 kn = 51.4444 cm/s
+    fix.flags |= GNSS_HAS_SPEED;
+  }
+  if (fe[8] != fs[8]) {
+    if (!parseFixed(fs[8], fe[8], 2, false, v) || v > 36000) return GNSS_MALFORMED;
+    fix.courseCdeg = (uint16_t)(v % 36000);
+    fix.flags |= GNSS_HAS_COURSE;
+  }
+
+  out = fix;
+  return GNSS_OK;
+}
+
+// ----------------------- Time -----------------------
+// Days since 1970-01-01 for a proleptic Gregorian date (H. Hinnant's
+// days_from_civil).
+static int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d) {
+  y -= m <= 2;
+  int32_t era = y / 400;
+  uint32_t yoe = (uint32_t)(y - era * 400);
+  uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+uint32_t gnssUnixTime(const GnssFix& fix) {
+  int32_t days = daysFromCivil(2000 + fix.year, fix.month, fix.day);
+  return (uint32_t)days * 86400UL + fix.hour * 3600UL + fix.minute * 60UL + fix.second;
+}
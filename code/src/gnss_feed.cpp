@@ -0,0 +1,104 @@
+#include "gnss_feed.h"
+#include "at_engine.h"
+
+// ----------------------- State -----------------------
+static GnssFix       latest;
+static bool          haveFix = false;
+static uint32_t      fixMs = 0;           // when latest arrived
+static uint32_t      reportMs = 0;        // last report, fix or not
+static uint32_t      armMs = 0;
+static uint8_t       armedS = 0;          // interval the modem runs, 0 = off
+static uint8_t       wantS = 0;           // interval for the current period
+static bool          realign = false;
+static GnssFeedStats stats = { 0, 0, 0, 0, 0, 0, 0 };
+
+// ----------------------- Reports -----------------------
+// Returns true if the line carried a fix
+static bool store(const char* line, size_t len) {
+  GnssFix fix;
+  reportMs = millis();
+  if (gnssParseCgpsinfo(line, len, fix) != GNSS_OK) return false;
+  latest = fix;
+  haveFix = true;
+  fixMs = reportMs;
+  if (!stats.firstFixMs) stats.firstFixMs = fixMs ? fixMs : 1;
+  stats.fixes++;
+  return true;
+}
+
+static void onReport(const char* line) {
+  size_t len = strlen(line);
+  stats.reports++;
+  stats.reportBytes += len + 4;   // CR LF on both sides
+  store(line, len);
+}
+
+// A report from the current interval, with room for the cycle running late
+static bool recent(uint32_t sinceMs) {
+  return armedS && millis() - sinceMs <= armedS * 1000UL + GNSS_FEED_LEAD_MS + GNSS_FEED_SLACK_MS;
+}
+
+// Fallback round trip, as before the feed
+static bool poll(GnssFix& fix) {
+  stats.polls++;
+  AtResult r = atCommand("AT+CGPSINFO");
+  stats.pollMs += atReply().elapsedMs;
+  if (r != AT_OK) return false;
+  const char* line = strstr(atReply().text, "+CGPSINFO:");
+  if (!line) return false;
+  const char* eol = strchr(line, '\n');
+  if (!store(line, eol ? (size_t)(eol - line) : strlen(line))) return false;
+  fix = latest;
+  stats.lastAgeMs = 0;
+  return true;
+}
+
+// ----------------------- Public API -----------------------
+void gnssFeedBegin() {
+  atOnUrc("+CGPSINFO:", onReport);
+}
+
+void gnssFeedService(bool gnssOn, uint32_t periodMs, uint32_t msToNextCycle) {
+  if (!gnssOn) {
+    armedS = 0;         // CGPS=0 ends reporting
+    return;
+  }
+  uint32_t s = periodMs / 1000;
+  if (s > GNSS_FEED_MAX_S) s = 0;
+  wantS = s;
+  bool stale = s != armedS || realign;
+  if (!stale || atBusy()) return;
+  // The first report comes one interval after arming, i.e. just before
+  // the cycle after next; until then this cycle polls
+  if (s && msToNextCycle > GNSS_FEED_LEAD_MS) return;
+  if (!s && !armedS) return;
+
+  char cmd[24];
+  snprintf(cmd, sizeof(cmd), "AT+CGPSINFO=%u", (unsigned)s);
+  if (atCommand(cmd) != AT_OK) return;
+  armedS = s;
+  armMs = millis();
+  realign = false;
+}
+
+uint32_t gnssFeedSleepMs(uint32_t msToNextCycle) {
+  bool pending = wantS && (wantS != armedS || realign);
+  if (pending && msToNextCycle > GNSS_FEED_LEAD_MS) return msToNextCycle - GNSS_FEED_LEAD_MS;
+  return msToNextCycle;
+}
+
+bool gnssFeedFix(GnssFix& fix) {
+  if (haveFix && recent(fixMs)) {
+    fix = latest;
+    stats.lastAgeMs = millis() - fixMs;
+    if (stats.lastAgeMs > GNSS_FEED_LEAD_MS + GNSS_FEED_SLACK_MS) realign = true;
+    return true;
+  }
+  if (recent(reportMs)) return false;   // reporting, just no fix
+  if (!recent(armMs)) realign = true;   // reports stopped coming
+  return poll(fix);
+}
+
+const GnssFeedStats& gnssFeedStats() {
+  return stats;
+}
@@ -0,0 +1,44 @@
+#include "hal.h"
+
+#ifndef HAL_NATIVE
+
+static HardwareSerial modemSerial(0);
+
+Stream& halModemBegin(uint32_t baud) {
+  modemSerial.begin(baud, SERIAL_8N1, -1, -1);
+  return modemSerial;
+}
+
+// ----------------------- GPIO -----------------------
+void halPinInput(uint8_t pin, bool pullup) {
+  pinMode(pin, pullup ? INPUT_PULLUP : INPUT);
+}
+
+int IRAM_ATTR halPinRead(uint8_t pin) {
+  return digitalRead(pin);
+}
+
+void halPinInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  attachInterrupt(digitalPinToInterrupt(pin), isr, mode);
+}
+
+// ----------------------- PWM -----------------------
+void halPwmBegin(uint8_t pin, uint8_t channel, uint32_t freqHz, uint8_t bits) {
+  ledcAttachPin(pin, channel);
+  ledcSetup(channel, freqHz, bits);
+}
+
+void halPwmWrite(uint8_t channel, uint32_t duty) {
+  ledcWrite(channel, duty);
+}
+
+// ----------------------- ADC -----------------------
+void halAdcBegin(uint8_t bits) {
+  analogReadResolution(bits);
+}
+
+uint32_t halAdcMillivolts(uint8_t pin) {
+  return analogReadMilliVolts(pin);
+}
+
+#endif
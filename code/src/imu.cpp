@@ -0,0 +1,161 @@
+#include "imu.h"
+#include <Wire.h>
+#include "hal.h"
+#include <esp_timer.h>
+
+// ----------------------- LSM6DSL registers -----------------------
+#define REG_FIFO_CTRL1     0x06
+#define REG_FIFO_CTRL2     0x07
+#define REG_FIFO_CTRL3     0x08
+#define REG_FIFO_CTRL5     0x0A
+#define REG_INT1_CTRL      0x0D
+#define REG_WHO_AM_I       0x0F
+#define REG_CTRL1_XL       0x10
+#define REG_CTRL2_G        0x11
+#define REG_CTRL3_C        0x12
+#define REG_FIFO_STATUS1   0x3A
+#define REG_FIFO_DATA_OUT  0x3E
+
+#define WHO_AM_I_VALUE     0x6A
+#define CTRL3_BDU          0x40
+#define CTRL3_IF_INC       0x04
+#define CTRL3_SW_RESET     0x01
+#define ODR_104HZ          0x40      // ODR_XL / ODR_G / ODR_FIFO = 0100
+#define FS_XL_4G           0x08
+#define FS_G_250DPS        0x00
+#define FIFO_NO_DECIMATION 0x09      // gyro and accel both in the FIFO
+#define FIFO_CONTINUOUS    0x06
+#define INT1_FTH           0x08
+#define STATUS2_OVER_RUN   0x40
+
+#define WORDS_PER_SET      6         // Gx Gy Gz XLx XLy XLz
+#define SETS_PER_READ      10        // 120 bytes, inside the Wire buffer
+
+// ----------------------- State -----------------------
+static bool             present = false;
+static ImuBlockHandler  blockHandler = nullptr;
+static volatile bool    fifoIrq = false;
+static uint32_t         lastDrainMs = 0;
+static ImuStats         stats = { 0, 0, 0, 0 };
+static ImuSample        block[IMU_BLOCK_MAX];
+static size_t           blockLen = 0;
+
+static void IRAM_ATTR onFifoWatermark() {
+  fifoIrq = true;
+}
+
+// ----------------------- Bus -----------------------
+static bool writeReg(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(IMU_I2C_ADDR);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+static bool readRegs(uint8_t reg, uint8_t* out, size_t n) {
+  int64_t start = esp_timer_get_time();
+  Wire.beginTransmission(IMU_I2C_ADDR);
+  Wire.write(reg);
+  bool ok = Wire.endTransmission(false) == 0 &&
+            Wire.requestFrom((uint8_t)IMU_I2C_ADDR, (uint8_t)n) == n;
+  for (size_t i = 0; ok && i < n; i++) out[i] = Wire.read();
+  stats.busUs += esp_timer_get_time() - start;
+  return ok;
+}
+
+static int16_t word(const uint8_t* p) {
+  return (int16_t)(p[0] | p[1] << 8);
+}
+
+// ----------------------- FIFO drain -----------------------
+static void flushBlock() {
+  if (blockLen && blockHandler) blockHandler(block, blockLen);
+  stats.samples += blockLen;
+  blockLen = 0;
+}
+
+static void drain() {
+  uint8_t status[4];   // FIFO_STATUS1..4: unread words, flags, pattern
+  if (!readRegs(REG_FIFO_STATUS1, status, sizeof(status))) return;
+  uint16_t words = status[0] | (status[1] & 0x07) << 8;
+  uint16_t pattern = status[2] | (status[3] & 0x03) << 8;
+  if (status[1] & STATUS2_OVER_RUN) stats.overruns++;
+
+  // Realign on a gyro X word if a previous read stopped mid-set
+  uint8_t buf[SETS_PER_READ * WORDS_PER_SET * 2];
+  if (pattern) {
+    uint16_t skip = WORDS_PER_SET - pattern;
+    if (skip > words || !readRegs(REG_FIFO_DATA_OUT, buf, skip * 2)) return;
+    words -= skip;
+  }
+
+  uint16_t sets = words / WORDS_PER_SET;
+  while (sets) {
+    uint16_t n = sets < SETS_PER_READ ? sets : SETS_PER_READ;
+    if (!readRegs(REG_FIFO_DATA_OUT, buf, n * WORDS_PER_SET * 2)) break;
+    for (uint16_t i = 0; i < n; i++) {
+      const uint8_t* p = buf + i * WORDS_PER_SET * 2;
+      ImuSample& s = block[blockLen++];
+      s.gx = (int32_t)word(p + 0) * 875 / 1000;    // 8.75 mdps/LSB
+      s.gy = (int32_t)word(p + 2) * 875 / 1000;
+      s.gz = (int32_t)word(p + 4) * 875 / 1000;
+      s.accel.x = (int32_t)word(p + 6) * 122 / 1000;   // 0.122 mg/LSB
+      s.accel.y = (int32_t)word(p + 8) * 122 / 1000;
+      s.accel.z = (int32_t)word(p + 10) * 122 / 1000;
+      if (blockLen == IMU_BLOCK_MAX) flushBlock();
+    }
+    sets -= n;
+  }
+  flushBlock();
+}
+
+// ----------------------- Public API -----------------------
+bool imuBegin(ImuBlockHandler handler) {
+  blockHandler = handler;
+  Wire.begin(IMU_SDA_PIN, IMU_SCL_PIN);
+  Wire.setClock(IMU_I2C_HZ);
+
+  uint8_t id = 0;
+  present = readRegs(REG_WHO_AM_I, &id, 1) && id == WHO_AM_I_VALUE;
+  if (!present) {
+    Serial.println("IMU: no LSM6DSL");
+    return false;
+  }
+
+  writeReg(REG_CTRL3_C, CTRL3_SW_RESET);
+  delay(10);
+  uint16_t threshold = IMU_WATERMARK * WORDS_PER_SET;
+  present = writeReg(REG_CTRL3_C, CTRL3_BDU | CTRL3_IF_INC) &&
+            writeReg(REG_CTRL1_XL, ODR_104HZ | FS_XL_4G) &&
+            writeReg(REG_CTRL2_G, ODR_104HZ | FS_G_250DPS) &&
+            writeReg(REG_FIFO_CTRL1, threshold & 0xFF) &&
+            writeReg(REG_FIFO_CTRL2, (threshold >> 8) & 0x07) &&
+            writeReg(REG_FIFO_CTRL3, FIFO_NO_DECIMATION) &&
+            writeReg(REG_FIFO_CTRL5, ODR_104HZ >> 1 | FIFO_CONTINUOUS) &&
+            writeReg(REG_INT1_CTRL, INT1_FTH);
+  if (!present) {
+    Serial.println("IMU: LSM6DSL configuration failed");
+    return false;
+  }
+
+  halPinInput(IMU_INT1_PIN, false);
+  halPinInterrupt(IMU_INT1_PIN, onFifoWatermark, RISING);
+  lastDrainMs = millis();
+  return true;
+}
+
+void imuPoll() {
+  if (!present) return;
+  // INT1 is a level signal: still high means the edge was missed (light sleep)
+  bool due = fifoIrq || halPinRead(IMU_INT1_PIN) == HIGH;
+  if (!due && millis() - lastDrainMs < IMU_POLL_MS) return;
+
+  fifoIrq = false;
+  lastDrainMs = millis();
+  stats.wakeups++;
+  drain();
+}
+
+const ImuStats& imuStats() {
+  return stats;
+}
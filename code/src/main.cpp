@@ -1,4 +1,29 @@
 #include <Arduino.h>
+#include "at_engine.h"
+#include "telemetry.h"
+#include "commands.h"
+#include "gnss.h"
+#include "gnss_feed.h"
+#include "modem_boot.h"
+#include "modem_sched.h"
+#include "sos_alert.h"
+#include "vibration.h"
+#include "buttons.h"
+#include "outbox.h"
+#include "mqtt_link.h"
+#include "motion.h"
+#include "fall_detector.h"
+#include "imu.h"
+#include "barometer.h"
+#include "fuel_gauge.h"
+#include "power.h"
+#include "geofence.h"
+#include "track_codec.h"
+#include "track_simplify.h"
+#include "diag.h"
+#include "hal.h"
+#include <esp_timer.h>
+#include "alloc_counter.h"
 
 // ----------------------- Pins -----------------------
 #define BATT_PIN        D1      // Battery voltage divider input
@@ -6,308 +31,656 @@
 #define BUTTON_B_PIN    D0      // SOS B
 #define VIBRATION_PIN   D3      // vibration motor control
 
-#define DIVIDER_RATIO   11.0f
-#define BATT_MIN_VOLT   3.0f
-#define BATT_MAX_VOLT   4.2f
-
-// Vibration PWM config (ESP32C3 LEDC)
-#define VIB_PWM_CH      0
-#define VIB_PWM_FREQ    2000
-#define VIB_PWM_BITS    8
-#define VIB_DUTY        80      // 0..255 steady strength
-#define VIB_RAMP_MS     400      // soft-start to reduce inrush
-#define VIB_TAP_DUTY    220      // for 200ms tap
-#define VIB_TAP_RAMP    60
-
-// ----------------------- SIM7600 on UART0 ---------------------
-HardwareSerial LTEGNSS(0);  // UART0 for SIM7600
-
-// ----------------------- AT helper ----------------------------
-String sendAT(const String& cmd, uint32_t wait_ms = 500) {
-  LTEGNSS.println(cmd);
-  delay(wait_ms);
-  String response;
-  while (LTEGNSS.available()) response += char(LTEGNSS.read());
-  response.trim();
-  Serial.println("> " + cmd);
-  Serial.println(response);
-  return response;
-}
-
 // ----------------------- GPS helpers --------------------------
-bool getGPSCoords(float &latDec, float &lonDec) {
-  String resp = sendAT("AT+CGPSINFO", 1000);
-  if (resp.indexOf("+CGPSINFO:") == -1 || resp.indexOf(",,,,,,,,") != -1) return false;
+// UTC clock derived from the last GNSS fix; 0 until the first fix
+uint32_t lastFixUnix = 0;
+unsigned long lastFixMs = 0;
 
-  String gpsData = resp.substring(resp.indexOf(":") + 1);
-  gpsData.trim();
+uint32_t utcNow() {
+  if (!lastFixUnix) return 0;
+  return lastFixUnix + (millis() - lastFixMs) / 1000;
+}
 
-  int latEnd = gpsData.indexOf(',');
-  int nsEnd  = gpsData.indexOf(',', latEnd + 1);
-  int lonEnd = gpsData.indexOf(',', nsEnd + 1);
-  int ewEnd  = gpsData.indexOf(',', lonEnd + 1);
+// Time to first fix, once
+void logFirstFix() {
+  static bool logged = false;
+  const ModemBootStats& boot = modemBootStats();
+  if (logged || !boot.ttffMs) return;
+  Serial.printf("Boot: first fix %lu ms after GNSS start\n", (unsigned long)boot.ttffMs);
+  logged = true;
+}
 
-  String lat = gpsData.substring(0, latEnd);
-  String ns  = gpsData.substring(latEnd + 1, nsEnd);
-  String lon = gpsData.substring(nsEnd + 1, lonEnd);
-  String ew  = gpsData.substring(lonEnd + 1, ewEnd);
+// ----------------------- Setup ---------------------------
+unsigned long lastPostMs = 0;
+uint32_t periodMs = MOTION_FIXED_PERIOD_MS;   // fix + upload period, set by motion
+uint32_t lastSpeedCmS = 0;
+const unsigned long EVENT_RETRY_MS = 2000;   // back-off for events after a failed POST
+unsigned long eventRetryMs = 0;
+bool uplinkDown = false;   // the last cycle's POST failed
+// Fixes taken while offline go through the simplifier, so only the points
+// needed to redraw the path reach the outbox
+static TrackSimplifier offlineTrack;
+
+// ----------------------- Buttons ---------------------------
+static const char* const PRESS_EVENTS[BUTTON_COUNT]  = { "SOS Button A Pressed", "SOS Button B Pressed" };
+static const char* const LONG_EVENTS[BUTTON_COUNT]   = { "SOS Button A Long Press", "SOS Button B Long Press" };
+static const char* const DOUBLE_EVENTS[BUTTON_COUNT] = { "SOS Button A Double Press", "SOS Button B Double Press" };
+
+int64_t  sosPendingUs = 0;          // press edge of the oldest not-yet-uploaded SOS
+uint32_t lastPressToVibrateUs = 0;
+uint32_t lastPressToUploadMs = 0;
+uint32_t sosLostId = 0;             // alert with an event neither queued nor stored: HTTP can't confirm it
+
+// SOS and fall events the queue refuses (full of them, or all in the POST
+// being sent) go to the outbox, which holds off the HTTP confirmation
+// until they are replayed. False if the flash took it neither.
+bool queueUrgentEvent(const char* type, uint32_t id) {
+  if (telemetryQueueEvent(type, id, OUTBOX_PRIO_SOS)) return true;
+  bool stored = outboxPushEvent(type, utcNow(), OUTBOX_PRIO_SOS, id);
+  Serial.printf("Event %s (%08lx): queue full, %s\n", type, (unsigned long)id,
+                stored ? "stored in the outbox" : "LOST");
+  return stored;
+}
 
-  if (lat.length() < 3 || lon.length() < 3) return false;
+void queueSosEvent(const char* type, const ButtonEvent& ev) {
+  uint32_t id = sosAlertRaise(type, ev.edgeUs, utcNow());
+  if (id != sosLostId) sosLostId = 0;       // a new alert
+  if (!queueUrgentEvent(type, id)) sosLostId = id;
+}
 
-  float lat_deg = lat.substring(0, 2).toFloat();
-  float lat_min = lat.substring(2).toFloat();
-  latDec = lat_deg + (lat_min / 60.0f);
-  if (ns == "S") latDec = -latDec;
+void handleButton(const ButtonEvent& ev) {
+  char name = 'A' + ev.button;
+  if (ev.type != BTN_SHORT) {
+    modemRequest(MODEM_PRIO_SOS, millis() - (uint32_t)((esp_timer_get_time() - ev.edgeUs) / 1000));
+  }
+  switch (ev.type) {
+    case BTN_PRESS:
+      vibPlay(VIB_PATTERN_TAP);
+      lastPressToVibrateUs = esp_timer_get_time() - ev.edgeUs;
+      queueSosEvent(PRESS_EVENTS[ev.button], ev);
+      if (!sosPendingUs) sosPendingUs = ev.edgeUs;
+      Serial.printf("Button %c pressed (vibrate after %lu us)\n", name, (unsigned long)lastPressToVibrateUs);
+      break;
+    case BTN_LONG:
+      vibPlay(VIB_PATTERN_DOUBLE_TAP);
+      queueSosEvent(LONG_EVENTS[ev.button], ev);
+      Serial.printf("Button %c long press\n", name);
+      break;
+    case BTN_DOUBLE:
+      queueSosEvent(DOUBLE_EVENTS[ev.button], ev);
+      Serial.printf("Button %c double press\n", name);
+      break;
+    case BTN_SHORT:
+      break;
+  }
+}
 
-  float lon_deg = lon.substring(0, 3).toFloat();
-  float lon_min = lon.substring(3).toFloat();
-  lonDec = lon_deg + (lon_min / 60.0f);
-  if (ew == "W") lonDec = -lonDec;
+// ----------------------- Fall detection ---------------------------
+uint64_t fallCpuUs = 0;      // detector time, for the per-sample cost
+uint32_t fallSamples = 0;
 
-  return true;
+// Fed by the LSM6DSL FIFO, or by the BNO08x when that is fitted instead
+void feedFallFromImu(const ImuSample* samples, size_t n) {
+  int64_t start = esp_timer_get_time();
+  for (size_t i = 0; i < n; i++) fallFeed(&samples[i].accel, 1);
+  fallCpuUs += esp_timer_get_time() - start;
+  fallSamples += n;
 }
 
-void uploadGPS(float lat, float lon) {
-  sendAT("AT+HTTPTERM", 300);
-  sendAT("AT+HTTPINIT", 500);
-  sendAT("AT+HTTPPARA=\"CID\",1", 300);
-  sendAT("AT+HTTPPARA=\"URL\",\"http://ma8w.ddns.net:3000/api/upload/gps\"", 300);
-  sendAT("AT+HTTPPARA=\"CONTENT\",\"application/json\"", 300);
-
-  String json = "{\"gps\":{\"lat\":" + String(lat, 6) + ",\"lon\":" + String(lon, 6) + "}}";
-  sendAT("AT+HTTPDATA=" + String(json.length()) + ",10000", 200);
-  LTEGNSS.print(json);
-  delay(400);
-
-  sendAT("AT+HTTPACTION=1", 6000);
-  sendAT("AT+HTTPREAD", 800);
-  sendAT("AT+HTTPTERM", 300);
+void feedFallFromMotion(const AccelSample* samples, size_t n) {
+  int64_t start = esp_timer_get_time();
+  fallFeed(samples, n);
+  fallCpuUs += esp_timer_get_time() - start;
+  fallSamples += n;
 }
 
-// ----------------------- Event uploader -----------------------
-void uploadEvent(const String& type) {
-  sendAT("AT+HTTPTERM", 300);
-  sendAT("AT+HTTPINIT", 500);
-  sendAT("AT+HTTPPARA=\"CID\",1", 300);
-  sendAT("AT+HTTPPARA=\"URL\",\"http://ma8w.ddns.net:3000/api/upload/event\"", 300);
-  sendAT("AT+HTTPPARA=\"CONTENT\",\"application/json\"", 300);
-
-  String json = "{\"type\":\"" + type + "\"}";
-  sendAT("AT+HTTPDATA=" + String(json.length()) + ",10000", 200);
-  LTEGNSS.print(json);
-  delay(400);
-
-  sendAT("AT+HTTPACTION=1", 6000);
-  sendAT("AT+HTTPREAD", 800);
-  sendAT("AT+HTTPTERM", 300);
+// Acquisition cost since the previous report
+void logSensorStats() {
+  static ImuStats  prevImu = { 0, 0, 0, 0 };
+  static BaroStats prevBaro = { 0, 0 };
+  static FuelStats prevFuel = { 0, 0, 0, 0 };
+  static uint32_t  prevMs = 0;
+  uint32_t elapsed = millis() - prevMs;
+  if (!elapsed) return;
+
+  char line[128];
+  const ImuStats& imu = imuStats();
+  if (imu.samples != prevImu.samples) {
+    snprintf(line, sizeof(line), "IMU: %.1f samples/s | bus busy %.2f%% | %.1f wakeups/s | %lu overruns",
+             (imu.samples - prevImu.samples) * 1000.0f / elapsed,
+             (imu.busUs - prevImu.busUs) / (elapsed * 10.0f),
+             (imu.wakeups - prevImu.wakeups) * 1000.0f / elapsed,
+             (unsigned long)imu.overruns);
+    Serial.println(line);
+  }
+  const BaroStats& baro = baroStats();
+  if (baro.samples != prevBaro.samples) {
+    snprintf(line, sizeof(line), "Baro: %.1f samples/s | %.1f I2C transactions/min | altitude %ld cm",
+             (baro.samples - prevBaro.samples) * 1000.0f / elapsed,
+             (baro.transactions - prevBaro.transactions) * 60000.0f / elapsed,
+             (long)baroAltitudeCm());
+    Serial.println(line);
+  }
+  const FuelStats& fuel = fuelStats();
+  snprintf(line, sizeof(line), "Battery: %d%% (%u mV) | %.1f ADC reads/min | jitter %u%% | %.1f uploads/h",
+           fuelPercent(), fuelMillivolts(),
+           (fuel.adcReads - prevFuel.adcReads) * 60000.0f / elapsed,
+           fuel.jitterPct, fuel.reports * 3600000.0f / millis());
+  Serial.println(line);
+  const GnssFeedStats& gnss = gnssFeedStats();
+  snprintf(line, sizeof(line), "GNSS: %lu reports (%lu with fix, %lu B) | %lu polls, %lu ms | fix age %lu ms",
+           (unsigned long)gnss.reports, (unsigned long)gnss.fixes, (unsigned long)gnss.reportBytes,
+           (unsigned long)gnss.polls, (unsigned long)gnss.pollMs, (unsigned long)gnss.lastAgeMs);
+  Serial.println(line);
+
+  // Modelled average draw per subsystem since boot
+  powerAccount();
+  const EnergyModel& energy = powerEnergy();
+  uint32_t up = powerElapsedMs();
+  char eline[192];
+  int n = snprintf(eline, sizeof(eline), "Energy (mAh/h):");
+  float total = 0;
+  for (uint8_t r = 0; r < ENERGY_RAIL_COUNT; r++) {
+    float ma = energyMahPerHour(energy, (EnergyRail)r, up);
+    total += ma;
+    n += snprintf(eline + n, sizeof(eline) - n, " %s %.2f |", energyRailName((EnergyRail)r), ma);
+  }
+  snprintf(eline + n, sizeof(eline) - n, " total %.1f | GNSS %s", total, powerGnssOn() ? "on" : "off");
+  Serial.println(eline);
+
+  prevImu = imu;
+  prevBaro = baro;
+  prevFuel = fuel;
+  prevMs = millis();
 }
 
-// ----------------------- Battery helpers ----------------------
-float readBatteryVoltage() {
-  return (analogReadMilliVolts(BATT_PIN) / 1000.0f) * DIVIDER_RATIO;
+// ----------------------- Geofences ---------------------------
+// Downloaded into a staging set so a failed transfer keeps the old fences
+const unsigned long GEOFENCE_SYNC_MS = 600000;
+static GeofenceSet geofences, geofenceStaging;
+unsigned long lastGeofenceSyncMs = 0;
+bool geofencesSynced = false;
+
+// Event strings must outlive the upload, like the literals used elsewhere.
+// A slot is reused only once its event has left the queue; a crossing the
+// queue can't take goes to the outbox, which keeps its own copy.
+static char geofenceEventText[TELEMETRY_MAX_EVENTS][TRACK_EVENT_MAX];
+
+static char* freeGeofenceSlot() {
+  for (char* slot : geofenceEventText) {
+    if (!telemetryEventQueued(slot)) return slot;
+  }
+  return nullptr;
 }
 
-int batteryPercentLinear() {
-  float v_batt = readBatteryVoltage();
-  float percent = (v_batt - BATT_MIN_VOLT) * 100.0f / (BATT_MAX_VOLT - BATT_MIN_VOLT);
-  if (percent < 0) percent = 0;
-  if (percent > 100) percent = 100;
-  return (int)roundf(percent);
+void checkGeofences(const GnssFix& fix) {
+  GeofenceEvent evs[4];
+  int64_t start = esp_timer_get_time();
+  uint8_t n = geofenceEvaluate(geofences, fix.latE7, fix.lonE7, evs, 4);
+  uint32_t us = esp_timer_get_time() - start;
+  for (uint8_t i = 0; i < n; i++) {
+    char text[TRACK_EVENT_MAX];
+    snprintf(text, sizeof(text), "Geofence %s: %s", evs[i].entered ? "Enter" : "Exit", evs[i].name);
+    char* slot = freeGeofenceSlot();
+    bool queued = false;
+    if (slot) {
+      memcpy(slot, text, sizeof(text));
+      queued = telemetryQueueEvent(slot);
+    }
+    if (!queued) outboxPushEvent(text, utcNow(), OUTBOX_PRIO_NORMAL);
+    Serial.printf("%s (%lu us, %u fences%s)\n", text, (unsigned long)us, geofences.count,
+                  queued ? "" : ", queue full: outbox");
+  }
 }
 
-void uploadBatteryPercentage(int pct) {
-  sendAT("AT+HTTPTERM", 300);
-  sendAT("AT+HTTPINIT", 500);
-  sendAT("AT+HTTPPARA=\"CID\",1", 300);
-  sendAT("AT+HTTPPARA=\"URL\",\"http://ma8w.ddns.net:3000/api/upload/batt-percentage\"", 300);
-  sendAT("AT+HTTPPARA=\"CONTENT\",\"application/json\"", 300);
-
-  String json = "{\"percentage\":" + String(pct) + "}";
-  sendAT("AT+HTTPDATA=" + String(json.length()) + ",10000", 200);
-  LTEGNSS.print(json);
-  delay(400);
-
-  sendAT("AT+HTTPACTION=1", 6000);
-  sendAT("AT+HTTPREAD", 800);
-  sendAT("AT+HTTPTERM", 300);
+void syncGeofences() {
+  if (geofencesSynced && millis() - lastGeofenceSyncMs < GEOFENCE_SYNC_MS) return;
+  if (!modemAcquire(MODEM_PRIO_BACKGROUND)) return;
+  bool changed;
+  bool ok = telemetryFetchGeofences(geofenceStaging, geofences.version, changed);
+  modemRelease();
+  if (!ok) {
+    Serial.println("Geofences: download failed");
+    return;
+  }
+  geofencesSynced = true;
+  lastGeofenceSyncMs = millis();
+  if (!changed) return;
+
+  geofenceCarryState(geofenceStaging, geofences);
+  geofences = geofenceStaging;
+  Serial.printf("Geofences: version %lu, %u fences, %u vertices\n",
+                (unsigned long)geofences.version, geofences.count, geofences.vertexCount);
 }
 
-// ----------------------- Vibration (PWM) ----------------------
-static inline void vibWrite(uint8_t duty) {
-  ledcWrite(VIB_PWM_CH, duty);
+// ----------------------- Barometer ---------------------------
+void handleBaro(const BaroEvent& ev) {
+  static const char* const NAMES[] = { "Sudden Drop", "Floor Up", "Floor Down" };
+  telemetryQueueEvent(NAMES[ev.type]);
+  Serial.printf("Baro: %s (%ld cm)\n", NAMES[ev.type], (long)ev.deltaCm);
 }
 
-void vibrateContinuous_ms(unsigned long total_ms, uint8_t duty = VIB_DUTY, unsigned long ramp_ms = VIB_RAMP_MS) {
-  // soft-start
-  unsigned long t0 = millis();
-  if (ramp_ms > 0 && duty > 0) {
-    while (true) {
-      unsigned long dt = millis() - t0;
-      if (dt >= ramp_ms) break;
-      float frac = (float)dt / (float)ramp_ms;
-      uint8_t d = (uint8_t)(duty * frac);
-      vibWrite(d);
-      delay(10);
-    }
-  }
-  vibWrite(duty);
-  // hold steady
-  unsigned long start = millis();
-  while (millis() - start < total_ms) {
-    delay(50);
-  }
-  // stop
-  vibWrite(0);
+uint16_t fallRateHz = IMU_RATE_HZ;
+
+// Links the event to its snapshot upload; boot time salted with the UTC
+// clock, like the SOS alert IDs
+uint32_t fallEventId() {
+  uint32_t h = 2166136261u;
+  uint64_t parts[2] = { (uint64_t)esp_timer_get_time(), utcNow() };
+  const uint8_t* p = (const uint8_t*)parts;
+  for (size_t i = 0; i < sizeof(parts); i++) h = (h ^ p[i]) * 16777619u;
+  return h ? h : 1;
 }
 
-void vibrate200ms() {
-  vibrateContinuous_ms(200, VIB_TAP_DUTY, VIB_TAP_RAMP);
+void handleFall(const FallEvent& ev) {
+  vibPlay(VIB_PATTERN_DOUBLE_TAP);
+  uint32_t id = fallEventId();
+  queueUrgentEvent("Fall Detected", id);
+  modemRequest(MODEM_PRIO_FALL, millis());
+
+  const AccelSample* snap;
+  size_t n = fallSnapshot(snap);
+  telemetryQueueFallSnapshot(id, ev, fallRateHz, snap, n);
+  char line[128];
+  snprintf(line, sizeof(line), "Fall: peak %u mg after %u ms free fall | %u samples kept | %.2f us/sample",
+           ev.peakMg, ev.freeFallMs, (unsigned)n, fallSamples ? (float)fallCpuUs / fallSamples : 0.0f);
+  Serial.println(line);
 }
 
-// ----------------------- Setup ---------------------------
-unsigned long lastPostMs = 0;
-const unsigned long POST_PERIOD_MS = 10000;
+// Runs from loop() and from the AT engine while it waits on the modem
+void serviceInputs() {
+  ButtonEvent ev;
+  while (buttonsPoll(ev)) handleButton(ev);
+
+  imuPoll();
+  motionPoll();
+  FallEvent fall;
+  while (fallPoll(fall)) handleFall(fall);
+
+  baroPoll();
+  BaroEvent baro;
+  while (baroEvent(baro)) handleBaro(baro);
+
+  // Sampled here too so readings taken mid-transmission get compensated
+  fuelService((atBusy() ? FUEL_LOAD_MODEM : 0) | (vibActive() ? FUEL_LOAD_VIBRATION : 0));
+
+  diagSerialService();
+}
 
 void setup() {
   Serial.begin(115200);
-  delay(2000);
 
-  pinMode(BUTTON_A_PIN, INPUT_PULLUP);
-  pinMode(BUTTON_B_PIN, INPUT_PULLUP);
+  buttonsBegin(BUTTON_A_PIN, BUTTON_B_PIN);
+
+  // PWM + background pattern engine for vibration
+  vibBegin(VIBRATION_PIN);
 
-  // PWM setup for vibration
-  ledcAttachPin(VIBRATION_PIN, VIB_PWM_CH);
-  ledcSetup(VIB_PWM_CH, VIB_PWM_FREQ, VIB_PWM_BITS);
-  vibWrite(0);
+  fuelBegin(BATT_PIN);
+
+  if (imuBegin(feedFallFromImu)) {
+    fallBegin(IMU_RATE_HZ, IMU_FULL_SCALE_MG);
+    motionBegin();
+  } else {
+    fallRateHz = MOTION_ACCEL_HZ;
+    fallBegin(MOTION_ACCEL_HZ, MOTION_ACCEL_FULL_SCALE_MG);
+    motionBegin(feedFallFromMotion);
+  }
+  baroBegin();
 
-  analogReadResolution(12);
+  // Wake sources for light sleep; modes match the drivers' halPinInterrupt()
+  powerAddWakePin(BUTTON_A_PIN, LOW, CHANGE);
+  powerAddWakePin(BUTTON_B_PIN, LOW, CHANGE);
+  powerAddWakePin(IMU_INT1_PIN, HIGH, RISING);
+  powerAddWakePin(BARO_INT_PIN, HIGH, RISING);
 
-  LTEGNSS.begin(115200, SERIAL_8N1, -1, -1);
-  delay(2000);
+  outboxBegin();
+  trackSimplifyBegin(offlineTrack);
+
+  Stream& modem = halModemBegin(115200);   // SIM7600 on UART0
+  atBegin(modem);
+  atSetIdleHook(serviceInputs);   // buttons stay live during modem waits
+  atSetDoneHook(diagAtDone);
+  modemSchedBegin();
+  diagBegin();
+  powerBegin(modem);
 
   Serial.println("=== SIM7600G-H: GPS + Battery + SOS + Vibration (steady) ===");
 
-  sendAT("AT");
-  sendAT("AT+CFUN=1", 800);
-  sendAT("AT+NETCLOSE", 800);
-  delay(300);
-  sendAT("AT+NETOPEN", 3000);
-  delay(300);
-
-  sendAT("AT+CGPS=0", 800);
-  delay(300);
-  sendAT("AT+CGPS=1,2", 800);
-  Serial.println("Waiting for GPS lock...");
+  // The modem is brought up from loop() as it reports ready
+  modemBootBegin();
+  gnssFeedBegin();
 }
 
 // ======================= Command handling =======================
-const unsigned long VIBRATION_ALERT_MS = 1UL * 60UL * 1000UL; // 5 minutes
-
-// ---- Clear commands on server ----
-static void sendClearToServer() {
-  // Close any previous HTTP session
-  sendAT("AT+HTTPTERM", 300);
-
-  // Init HTTP and point to the correct endpoint
-  sendAT("AT+HTTPINIT", 500);
-  sendAT("AT+HTTPPARA=\"CID\",1", 300);
-  sendAT("AT+HTTPPARA=\"URL\",\"http://ma8w.ddns.net:3000/api/upload/command\"", 300);
-  sendAT("AT+HTTPPARA=\"CONTENT\",\"application/json\"", 300);
-
-  // Body: {"command":"clear"}
-  String json = "{\"command\":\"clear\"}";
-  sendAT("AT+HTTPDATA=" + String(json.length()) + ",10000", 200);
-  LTEGNSS.print(json);
-  delay(400);
-
-  // POST + read response + tidy up
-  sendAT("AT+HTTPACTION=1", 6000);  // 1 = POST
-  sendAT("AT+HTTPREAD", 800);
-  sendAT("AT+HTTPTERM", 300);
+// Commands are pushed over MQTT and acknowledged on the ack topic. The
+// telemetry response still carries them as a fallback while MQTT is down;
+// those are acknowledged by ID in the next telemetry POST. Patterns play in
+// the background so the loop keeps reading buttons, battery and sending
+// telemetry.
+uint32_t periodOverrideMs = 0;                   // "set_rate"; 0 = motion schedule
+const unsigned long LOCATE_RETRY_MS = 5000;      // "locate" cycles this often until a fix is up
+const unsigned long LOCATE_TIMEOUT_MS = 120000;
+bool locatePending = false;
+unsigned long locateSinceMs = 0;
+unsigned long locateRetryMs = 0;
+
+// Runs one command and returns its ack status
+const char* runCommand(const Command& c) {
+  if (!c.valid) return "invalid";
+  if (c.type == COMMAND_UNKNOWN) return "unknown";
+  if (commandSeen(c.id)) return "done";     // delivered again: ran already
+
+  switch (c.type) {
+    case COMMAND_VIBRATE:
+      vibPlay(*c.pattern);
+      break;
+    case COMMAND_STOP:
+      vibStop();
+      break;
+    case COMMAND_LOCATE:
+      locatePending = true;
+      locateSinceMs = millis();
+      locateRetryMs = locateSinceMs;
+      break;
+    case COMMAND_SET_RATE:
+      periodOverrideMs = c.periodS * 1000;
+      break;
+    case COMMAND_SET_THRESHOLDS:
+      if (!fallSetThresholds(c.freeFallMg, c.impactMg)) return "invalid";
+      break;
+    default:
+      break;
+  }
+  commandRecord(c.id);     // not before: a command that failed runs again if redelivered
+  return "done";
 }
 
-void checkAndExecuteCommand() {
-  sendAT("AT+HTTPTERM", 300);
-  sendAT("AT+HTTPINIT", 500);
-  sendAT("AT+HTTPPARA=\"CID\",1", 300);
-  sendAT("AT+HTTPPARA=\"URL\",\"http://ma8w.ddns.net:3000/api/download/command\"", 300);
-
-  String actionResp = sendAT("AT+HTTPACTION=0", 6000);
+// Commands from a telemetry response
+void executeCommands(const CommandBatch& batch) {
+  for (uint8_t i = 0; i < batch.count; i++) {
+    const Command& c = batch.items[i];
+    const char* status = runCommand(c);
+    bool queued = telemetryAckCommand(c.id, status);
+    char line[96];
+    snprintf(line, sizeof(line), "Command %s (%s): %s%s", c.id, commandTypeName(c.type), status,
+             queued ? "" : ", not acked");
+    Serial.println(line);
+  }
+}
 
-  int idx = actionResp.indexOf("+HTTPACTION:");
-  if (idx == -1) {
-    Serial.println("No HTTPACTION in response");
-    sendAT("AT+HTTPTERM", 300);
-    return;
+// Acks wait while an SOS or fall is waiting for the modem
+void servicePushedCommands() {
+  static MqttMessage  msg;
+  static CommandBatch batch;
+  while (modemUrgent() >= MODEM_PRIO_ACK && mqttPoll(msg)) {
+    diagCount(DIAG_MQTT_COMMANDS);
+    modemRequest(MODEM_PRIO_ACK, msg.rxMs);
+    commandParseText(msg.payload, msg.len, batch);
+
+    bool delivered = false;
+    for (uint8_t i = 0; i < batch.count; i++) {
+      const Command& c = batch.items[i];
+      const char* status = runCommand(c);
+      uint32_t execMs = millis() - msg.rxMs;
+      if (!c.id[0]) continue;    // nothing to ack it with
+
+      char ack[96];
+      int n = snprintf(ack, sizeof(ack), "{\"id\":\"%s\",\"status\":\"%s\",\"exec_ms\":%lu}",
+                       c.id, status, (unsigned long)execMs);
+      modemAcquire(MODEM_PRIO_ACK);
+      modemCommit();
+      bool acked = mqttPublishAck(ack, n);
+      modemRelease();
+      delivered |= acked;
+      char line[128];
+      snprintf(line, sizeof(line), "MQTT command %s (%s): %s, rx->exec %lu ms, ack %s (%lu ms after rx)", c.id,
+               commandTypeName(c.type), status, (unsigned long)execMs, acked ? "sent" : "failed",
+               (unsigned long)(millis() - msg.rxMs));
+      Serial.println(line);
+    }
+    if (delivered) modemDelivered(MODEM_PRIO_ACK);
+    else modemDropped(MODEM_PRIO_ACK);
   }
-  int comma2 = actionResp.indexOf(',', idx + 13);
-  int comma3 = actionResp.indexOf(',', comma2 + 1);
-  if (comma3 == -1) {
-    Serial.println("Failed to parse HTTPACTION length");
-    sendAT("AT+HTTPTERM", 300);
-    return;
+}
+
+// ======================= Store-and-forward =======================
+const unsigned long GPS_KEEPALIVE_MS = 300000;   // resend a still position this often
+GnssFix lastSentFix;
+unsigned long lastSentFixMs = 0;
+bool haveSentFix = false;
+
+// Live uploads skip fixes that are only jitter around the last one sent
+bool fixWorthSending(const GnssFix& fix) {
+  if (!haveSentFix || millis() - lastSentFixMs >= GPS_KEEPALIVE_MS) return true;
+  return trackSegmentDistanceCm(lastSentFix, lastSentFix, fix) > TRACK_DEADBAND_CM;
+}
+
+// Uplink is back: the open end of the offline track goes out too
+void flushOfflineTrack() {
+  GnssFix end;
+  if (trackSimplifyFlush(offlineTrack, end)) outboxPushFix(end, gnssUnixTime(end));
+  const TrackSimplifyStats& st = offlineTrack.stats;
+  if (st.in) Serial.printf("Track: %lu offline fixes -> %lu kept (%lu jitter)\n", (unsigned long)st.in,
+                           (unsigned long)st.kept, (unsigned long)st.deadband);
+  trackSimplifyBegin(offlineTrack);
+}
+
+// A failed POST moves its data into the flash outbox instead of dropping it
+void persistCycle(const GnssFix* fix, int pct) {
+  static int lastPersistedPct = -1;
+  uint32_t now = utcNow();
+
+  TelemetryEvent pending[TELEMETRY_MAX_EVENTS];
+  uint8_t n = telemetryTakeEvents(pending, TELEMETRY_MAX_EVENTS);
+  for (uint8_t i = 0; i < n; i++) outboxPushEvent(pending[i].type, now, pending[i].priority, pending[i].id);
+
+  GnssFix kept;
+  if (fix && trackSimplifyPush(offlineTrack, *fix, kept)) outboxPushFix(kept, gnssUnixTime(kept));
+  if (pct >= 0 && pct != lastPersistedPct) {
+    outboxPushBattery(pct, now);
+    lastPersistedPct = pct;
   }
-  int len = actionResp.substring(comma3 + 1).toInt();
-  if (len <= 0) {
-    Serial.println("No data to read");
-    sendAT("AT+HTTPTERM", 300);
-    return;
+  Serial.printf("Outbox: %u records waiting\n", outboxCount());
+}
+
+// Uplink works again: drain the outbox in batches, SOS first. Without SOS
+// records this is background work and gives way to anything fresh.
+void replayOutbox() {
+  static OutboxRecord batch[TELEMETRY_BATCH_MAX];
+  if (!outboxCount() || !modemAcquire(outboxHasSos() ? MODEM_PRIO_SOS : MODEM_PRIO_BACKGROUND)) return;
+  while (outboxCount()) {
+    uint8_t n = outboxPeek(batch, TELEMETRY_BATCH_MAX);
+    if (!n) break;
+    uint8_t sent = telemetrySendBatch(batch, n);
+    if (!sent) break;
+    for (uint8_t i = 0; i < sent; i++) outboxAck(batch[i].seq);
+    Serial.printf("Outbox: replayed %u, %u left\n", sent, outboxCount());
   }
+  modemRelease();
+}
 
-  String readCmd = "AT+HTTPREAD=0," + String(len);
-  String readResp = sendAT(readCmd, 2000);
+// Diagnostics record goes up with the first successful cycle of each hour
+void uploadDiagnostics() {
+  static unsigned long lastDiagMs = 0;
+  if (lastDiagMs && millis() - lastDiagMs < DIAG_UPLOAD_MS) return;
 
-  if (readResp.indexOf("\"command\":\"vibrate\"") != -1) {
-    Serial.println("Command received: vibrate (steady)");
-    // CONTINUOUS vibration with soft-start to lower battery stress
-    sendClearToServer();
-    vibrateContinuous_ms(VIBRATION_ALERT_MS, VIB_DUTY, VIB_RAMP_MS);
-    // Optionally clear command on server
+  if (!modemAcquire(MODEM_PRIO_BACKGROUND)) return;
+
+  size_t n;
+  const char* record = diagRecord(n);
+  bool sent = n && telemetrySendDiagnostics(record, n);
+  modemRelease();
+  if (sent) {
+    diagReset();
+    lastDiagMs = millis();
   }
+}
+
+// The samples around a fall follow the event, ahead of the background work
+void uploadFallSnapshot() {
+  if (!telemetryFallSnapshotPending() || !modemAcquire(MODEM_PRIO_BACKGROUND)) return;
+  if (telemetrySendFallSnapshot()) Serial.println("Fall: snapshot uploaded");
+  modemRelease();
+}
 
-  sendAT("AT+HTTPTERM", 300);
+// The text shares the modem with the POST: it goes first while the uplink
+// is failing, otherwise right after the POST that carries the event
+void serviceSosText() {
+  if (uplinkDown || !telemetrySosEventsPending()) sosAlertService();
 }
 
 // ----------------------- Loop ---------------------------
 void loop() {
-  static bool lastA = HIGH, lastB = HIGH;
-  bool curA = digitalRead(BUTTON_A_PIN);
-  bool curB = digitalRead(BUTTON_B_PIN);
-
-  if (lastA == HIGH && curA == LOW) {
-    Serial.println("Button A pressed");
-    vibrate200ms();
-    uploadEvent("SOS Button A Pressed");
+  uint32_t loopStartUs = micros();
+  serviceInputs();
+
+  // Nothing else talks to the modem until it is up; presses are queued.
+  // A text needs no data link, so an SOS goes out while it is retried.
+  bool bootCycle = false;
+  if (!modemBootDone()) {
+    if (!modemBootService()) {
+      if (modemBootTextReady()) sosAlertService();
+      diagLoop(micros() - loopStartUs);
+      powerIdle(modemBootWaitMs(), !buttonsBusy());
+      return;
+    }
+    bootCycle = true;   // first upload as soon as the link is up
+  }
+
+  atService();
+  // The first upload goes ahead of the MQTT connect. Once an MQTT exchange
+  // starts it runs to the end; a half-done CONNECT costs more than the wait.
+  if (!bootCycle && modemAcquire(MODEM_PRIO_BACKGROUND)) {
+    modemCommit();
+    mqttService();
+    modemRelease();
+  }
+  servicePushedCommands();
+
+  // Starting to move gets an immediate fix instead of waiting out the still period
+  bool startedMoving = motionStartedMoving();
+  if (startedMoving) Serial.println("Motion: started moving");
+  periodMs = periodOverrideMs ? periodOverrideMs : motionPeriodMs(motionState(), lastSpeedCmS);
+  baroSetContinuous(motionState() != MOTION_STILL);
+
+  // SOS and fall events go out immediately instead of waiting for the next
+  // period; floors and geofences ride along with the regular cycle. Once a
+  // guardian's text confirmed the alert, a failing uplink is not retried at
+  // once; the events go with the regular cycle.
+  bool sosWaiting = telemetrySosEventsPending() || outboxHasSos();
+  bool eventDue = sosWaiting && (long)(millis() - eventRetryMs) >= 0 &&
+                  (!uplinkDown || !sosAlertConfirmed() || modemUrgent() <= MODEM_PRIO_FALL);
+  // "locate" keeps GNSS up and starts a cycle as soon as there is a fix
+  if (locatePending && millis() - locateSinceMs >= LOCATE_TIMEOUT_MS) {
+    locatePending = false;
+    Serial.println("Locate: no fix, giving up");
   }
-  if (lastB == HIGH && curB == LOW) {
-    Serial.println("Button B pressed");
-    vibrate200ms();
-    uploadEvent("SOS Button B Pressed");
+  bool locateDue = false;
+  if (locatePending && (long)(millis() - locateRetryMs) >= 0) {
+    GnssFix probe;
+    locateDue = gnssFeedFix(probe);
+    if (!locateDue) locateRetryMs = millis() + LOCATE_RETRY_MS;
   }
-  lastA = curA;
-  lastB = curB;
+  uint32_t sinceLast = millis() - lastPostMs;
+  uint32_t toNext = sinceLast < periodMs ? periodMs - sinceLast : 0;
+  powerGnssService(toNext, periodMs, sosWaiting || startedMoving || locatePending);
+  gnssFeedService(powerGnssOn(), periodMs, toNext);
 
-  float v_pin = analogReadMilliVolts(BATT_PIN) / 1000.0f;
-  float v_batt = v_pin * DIVIDER_RATIO;
-  int pct = batteryPercentLinear();
-  Serial.printf("Vpin: %.3f V | Vbatt: %.3f V | %d%%\n", v_pin, v_batt, pct);
+  serviceSosText();
 
-  if (millis() - lastPostMs >= POST_PERIOD_MS) {
+  if (eventDue || locateDue || startedMoving || bootCycle || !toNext) {
+    uint32_t dueMs = (toNext || bootCycle) ? millis() : lastPostMs + periodMs;
     lastPostMs = millis();
-
-    float lat, lon;
-    if (getGPSCoords(lat, lon)) {
-      Serial.printf("Got GPS: %.6f, %.6f\n", lat, lon);
-      uploadGPS(lat, lon);
+    uint32_t allocsBefore = allocCount();
+    bool locating = locatePending;    // a "locate" in this response starts next loop
+
+    GnssFix fix;
+    bool hasFix = gnssFeedFix(fix);
+    diagFix(hasFix);
+    if (hasFix) {
+      lastFixUnix = gnssUnixTime(fix);
+      lastFixMs = millis();
+      sosAlertNoteFix(fix);
+      lastSpeedCmS = (fix.flags & GNSS_HAS_SPEED) ? fix.speedCmS : 0;
+      powerGnssFixTaken(periodMs);
+      logFirstFix();
+      checkGeofences(fix);   // transitions ride along in this POST
+      Serial.printf("Got GPS: %ld, %ld (1e-7 deg)\n", (long)fix.latE7, (long)fix.lonE7);
     } else {
       Serial.println("GPS not ready yet.");
     }
 
-    uploadBatteryPercentage(pct);
-
-    // Poll for command and act if needed
-    checkAndExecuteCommand();
+    // Battery only goes up when the gauge moved enough to matter
+    int pct;
+    bool battDue = fuelReportDue(pct);
+    bool sendFix = hasFix && (locating || fixWorthSending(fix));
+    // Everything waiting rides in this POST, so it runs as the most urgent class
+    modemRequest(MODEM_PRIO_GPS, dueMs);
+    if (battDue) modemRequest(MODEM_PRIO_BATTERY, millis());
+    modemAcquire(modemUrgent());
+    static CommandBatch commands;
+    bool resp = telemetrySend(sendFix ? &fix : nullptr, battDue ? pct : -1, commands);
+    modemRelease();
+    const TelemetryStats& st = telemetryLastStats();
+    char line[160];  // Serial.printf() mallocs for lines over 64 chars
+    snprintf(line, sizeof(line),
+             "Telemetry: HTTP %d | %u B up, %u B down | airtime %lu ms | cycle %lu ms | %lu allocs | %s, every %lu s",
+             st.httpStatus, st.bytesUp, st.bytesDown, (unsigned long)st.airtimeMs,
+             millis() - lastPostMs, (unsigned long)(allocCount() - allocsBefore),
+             motionStateName(motionState()), (unsigned long)(periodMs / 1000));
+    Serial.println(line);
+    logSensorStats();
+
+    if (resp || !modemPreempted()) diagCount(resp ? DIAG_HTTP_OK : DIAG_HTTP_FAIL);
+    if (resp) {
+      uplinkDown = false;
+      modemDelivered(MODEM_PRIO_GPS);
+      if (battDue) {
+        fuelReported(pct);
+        modemDelivered(MODEM_PRIO_BATTERY);
+      }
+      if (sendFix) {
+        lastSentFix = fix;
+        lastSentFixMs = millis();
+        haveSentFix = true;
+      }
+      if (sendFix && locating) {
+        locatePending = false;
+        Serial.printf("Locate: fix sent %lu ms after the command\n", millis() - locateSinceMs);
+      }
+      flushOfflineTrack();
+      executeCommands(commands);
+      replayOutbox();
+      if (!telemetrySosEventsPending() && !outboxHasSos()) {
+        modemDelivered(MODEM_PRIO_SOS);
+        modemDelivered(MODEM_PRIO_FALL);
+        if (!sosLostId) sosAlertHttpDelivered();
+        if (sosPendingUs) {
+          lastPressToUploadMs = (esp_timer_get_time() - sosPendingUs) / 1000;
+          sosPendingUs = 0;
+          Serial.printf("SOS press-to-upload: %lu ms\n", (unsigned long)lastPressToUploadMs);
+        }
+      }
+      serviceSosText();     // ahead of the background work
+      uploadFallSnapshot();
+      syncGeofences();
+      uploadDiagnostics();
+    } else if (!modemPreempted()) {
+      uplinkDown = true;
+      persistCycle(hasFix ? &fix : nullptr, battDue ? pct : -1);
+      modemDropped(MODEM_PRIO_GPS);     // in the outbox now
+      modemDropped(MODEM_PRIO_BATTERY);
+      eventRetryMs = millis() + EVENT_RETRY_MS;
+    }
+    // Preempted cycles sent nothing; the SOS or fall that cut in is due at once
+    if (locating && locatePending) locateRetryMs = millis() + LOCATE_RETRY_MS;
   }
 
-  delay(100);
+  diagLoop(micros() - loopStartUs);
+
+  // Light sleep until the next cycle unless something is still in flight,
+  // such as an SOS or fall that came in during this cycle
+  bool allowSleep = !buttonsBusy() && !sosWaiting && !locatePending && modemUrgent() > MODEM_PRIO_FALL;
+  sinceLast = millis() - lastPostMs;
+  powerIdle(gnssFeedSleepMs(sinceLast < periodMs ? periodMs - sinceLast : 0), allowSleep);
 }
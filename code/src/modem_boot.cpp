@@ -0,0 +1,181 @@
+#include "modem_boot.h"
+#include "at_engine.h"
+#include "power.h"
+#include "mqtt_link.h"
+#include "gnss_feed.h"
+
+enum BootStep : uint8_t {
+  BOOT_PROBE = 0,
+  BOOT_SIM,
+  BOOT_REGISTER,
+  BOOT_DATA,
+  BOOT_DONE,
+};
+
+static BootStep       step = BOOT_PROBE;
+static uint32_t       nextMs = 0;
+static uint16_t       probes = 0;
+static bool           rdySeen = false;
+static bool           simReady = false;
+static bool           registered = false;
+static bool           dataKick = false;    // registered again since the last AT+NETOPEN started
+static ModemBootStats stats;
+
+// ----------------------- URCs -----------------------
+static void onRdy(const char*) {
+  rdySeen = true;
+  nextMs = millis();        // probe right away
+}
+
+static void onCpin(const char* line) {
+  if (strstr(line, "READY")) simReady = true;
+}
+
+// 1 = home, 5 = roaming
+static bool statRegistered(int stat) {
+  return stat == 1 || stat == 5;
+}
+
+// URC form "+CEREG: <stat>[,...]" with AT+CEREG=1
+static void onCereg(const char* line) {
+  registered = statRegistered(atoi(line + 7));
+  if (!registered) return;
+  if (step == BOOT_REGISTER) nextMs = millis();
+  if (step == BOOT_DATA) {
+    // Back on the network: the bearer is worth a try now, not after the back-off
+    if (!stats.registeredMs) stats.registeredMs = millis();
+    dataKick = true;
+    nextMs = millis();
+  }
+}
+
+// "+AGPS: success." once the assistance data is in
+static void onAgps(const char* line) {
+  stats.agps = strstr(line, "success") != nullptr;
+  Serial.printf("Boot: AGPS %s\n", stats.agps ? "injected" : "failed");
+}
+
+// ----------------------- Steps -----------------------
+static void wait(uint32_t ms) {
+  nextMs = millis() + ms;
+}
+
+static void probe() {
+  if (atCommand("AT", MODEM_BOOT_PROBE_TIMEOUT) != AT_OK) {
+    probes++;
+    wait(MODEM_BOOT_PROBE_MS);
+    return;
+  }
+  stats.answeredMs = millis();
+  // Silent probes mean it was still powering up, even if RDY was missed
+  stats.modemWasOn = !rdySeen && !probes;
+  atCommand("ATE0");
+
+  // GNSS needs neither SIM nor network, so it searches during registration
+  stats.gnssStartMs = millis();
+  stats.gnssHot = powerGnssBegin(stats.modemWasOn);
+  step = BOOT_SIM;
+}
+
+static void checkSim() {
+  if (!simReady && atCommand("AT+CPIN?") == AT_OK) onCpin(atReply().text);
+  if (!simReady) {
+    wait(MODEM_BOOT_POLL_MS);
+    return;
+  }
+  stats.simMs = millis();
+  atCommand("AT+CFUN=1", AT_TIMEOUT_NET_MS);
+  atCommand("AT+CEREG=1");    // registration changes arrive as URCs from here
+  step = BOOT_REGISTER;
+}
+
+// Query form "+CEREG: <n>,<stat>"
+static void checkRegistered() {
+  if (!registered && atCommand("AT+CEREG?") == AT_OK) {
+    const char* p = strstr(atReply().text, "+CEREG:");
+    const char* comma = p ? strchr(p, ',') : nullptr;
+    if (comma) registered = statRegistered(atoi(comma + 1));
+  }
+  if (!registered && millis() - stats.simMs < MODEM_BOOT_REG_TIMEOUT_MS) {
+    wait(MODEM_BOOT_POLL_MS);
+    return;
+  }
+  if (registered) stats.registeredMs = millis();
+  else Serial.println("Boot: not registered, opening the data link anyway");
+  step = BOOT_DATA;
+}
+
+static void openData() {
+  dataKick = false;
+  atCommand("AT+NETCLOSE", AT_TIMEOUT_NET_MS, "+NETCLOSE:");
+  if (atCommand("AT+NETOPEN", AT_TIMEOUT_NET_MS, "+NETOPEN:") != AT_OK || !strstr(atReply().text, "+NETOPEN: 0")) {
+    uint8_t shift = stats.dataFailures < 5 ? stats.dataFailures : 5;
+    uint32_t backoff = MODEM_BOOT_DATA_RETRY_MS << shift;
+    if (backoff > MODEM_BOOT_RETRY_MAX_MS) backoff = MODEM_BOOT_RETRY_MAX_MS;
+    if (dataKick) backoff = MODEM_BOOT_DATA_RETRY_MS;    // the network came back during this try
+    stats.dataFailures++;
+    Serial.printf("Boot: data link failed (%u), retrying in %lu ms\n", stats.dataFailures, (unsigned long)backoff);
+    wait(backoff);
+    return;
+  }
+  stats.dataMs = millis();
+  powerModemLowPower();
+  mqttBegin();
+
+  // Still searching: almanac, ephemeris and rough position from the AGNSS
+  // server cut a cold start from tens of seconds to a few. The download
+  // finishes in the background while the first upload goes out.
+  bool agps = !gnssFeedStats().fixes && powerGnssOn() && atCommand("AT+CAGPS") == AT_OK;
+
+  char line[160];
+  snprintf(line, sizeof(line), "Boot: modem %lu ms | SIM %lu ms | registered %lu ms | data %lu ms | GNSS %s%s",
+           (unsigned long)stats.answeredMs, (unsigned long)stats.simMs, (unsigned long)stats.registeredMs,
+           (unsigned long)stats.dataMs, stats.gnssHot ? "hot" : "cold", agps ? ", fetching AGPS" : "");
+  Serial.println(line);
+  step = BOOT_DONE;
+}
+
+// ----------------------- Public API -----------------------
+void modemBootBegin() {
+  atOnUrc("RDY", onRdy);
+  atOnUrc("+CPIN:", onCpin);
+  atOnUrc("+CEREG:", onCereg);
+  atOnUrc("+AGPS:", onAgps);
+  memset(&stats, 0, sizeof(stats));
+  step = BOOT_PROBE;
+  nextMs = millis();
+}
+
+bool modemBootService() {
+  if (step == BOOT_DONE) return true;
+  atService();
+  if ((long)(millis() - nextMs) < 0) return false;
+
+  switch (step) {
+    case BOOT_PROBE:    probe(); break;
+    case BOOT_SIM:      checkSim(); break;
+    case BOOT_REGISTER: checkRegistered(); break;
+    case BOOT_DATA:     openData(); break;
+    case BOOT_DONE:     break;
+  }
+  return step == BOOT_DONE;
+}
+
+bool modemBootDone() {
+  return step == BOOT_DONE;
+}
+
+bool modemBootTextReady() {
+  return step == BOOT_DATA;
+}
+
+uint32_t modemBootWaitMs() {
+  long left = (long)(nextMs - millis());
+  return left > 0 ? (uint32_t)left : 0;
+}
+
+const ModemBootStats& modemBootStats() {
+  uint32_t first = gnssFeedStats().firstFixMs;
+  if (!stats.ttffMs && first && stats.gnssStartMs) stats.ttffMs = first - stats.gnssStartMs;
+  return stats;
+}
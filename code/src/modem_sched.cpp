@@ -0,0 +1,118 @@
+#include "modem_sched.h"
+#include "at_engine.h"
+
+struct ClassState {
+  bool     waiting;
+  bool     started;       // a transaction of this class has begun since the request
+  uint32_t sinceMs;
+  uint32_t waitMs;
+};
+
+static ClassState      classes[MODEM_PRIO_COUNT];
+static ModemClassStats stats[MODEM_PRIO_COUNT];
+static ModemPrio       current = MODEM_PRIO_NONE;
+static bool            committed = false;
+static bool            preempted = false;
+
+static const char* const NAMES[MODEM_PRIO_COUNT + 1] = {
+  "sos", "fall", "ack", "gps", "battery", "background", "none",
+};
+
+// ----------------------- Gate -----------------------
+static bool gate(const char* cmd) {
+  if (current == MODEM_PRIO_NONE || committed) return true;
+  if (preempted) return false;          // unwinding: none of the rest goes out
+  ModemPrio urgent = modemUrgent();
+  if (urgent >= current) return true;
+
+  preempted = true;
+  stats[current].preempted++;
+  char line[96];
+  snprintf(line, sizeof(line), "Modem: %s preempted by %s before %.32s", NAMES[current], NAMES[urgent], cmd);
+  Serial.println(line);
+  return false;
+}
+
+// ----------------------- Public API -----------------------
+void modemSchedBegin() {
+  memset(classes, 0, sizeof(classes));
+  memset(stats, 0, sizeof(stats));
+  current = MODEM_PRIO_NONE;
+  atSetGateHook(gate);
+}
+
+void modemRequest(ModemPrio p, uint32_t sinceMs) {
+  if (p >= MODEM_PRIO_COUNT) return;
+  ClassState& c = classes[p];
+  stats[p].requests++;
+  if (c.waiting) return;
+  c.waiting = true;
+  c.started = false;
+  c.sinceMs = sinceMs;
+}
+
+ModemPrio modemUrgent() {
+  for (uint8_t p = 0; p < MODEM_PRIO_COUNT; p++) {
+    if (classes[p].waiting) return (ModemPrio)p;
+  }
+  return MODEM_PRIO_NONE;
+}
+
+bool modemAcquire(ModemPrio p) {
+  if (modemUrgent() < p) return false;
+  current = p;
+  committed = false;
+  preempted = false;
+  // Less urgent work already waiting goes out in the same transaction
+  for (uint8_t q = p; q < MODEM_PRIO_COUNT; q++) {
+    ClassState& c = classes[q];
+    if (!c.waiting || c.started) continue;
+    c.started = true;
+    c.waitMs = millis() - c.sinceMs;
+    diagHistAdd(stats[q].waitMs, c.waitMs);
+  }
+  return true;
+}
+
+void modemCommit() {
+  committed = true;
+}
+
+void modemRelease() {
+  current = MODEM_PRIO_NONE;
+  committed = false;
+}
+
+bool modemPreempted() {
+  return preempted;
+}
+
+void modemDelivered(ModemPrio p) {
+  if (p >= MODEM_PRIO_COUNT || !classes[p].waiting) return;
+  ClassState& c = classes[p];
+  uint32_t total = millis() - c.sinceMs;
+  c.waiting = false;
+  stats[p].delivered++;
+  diagHistAdd(stats[p].totalMs, total);
+
+  char line[80];
+  snprintf(line, sizeof(line), "Modem: %s waited %lu ms, delivered %lu ms after request", NAMES[p],
+           (unsigned long)(c.started ? c.waitMs : total), (unsigned long)total);
+  Serial.println(line);
+}
+
+void modemDropped(ModemPrio p) {
+  if (p < MODEM_PRIO_COUNT) classes[p].waiting = false;
+}
+
+const char* modemPrioName(ModemPrio p) {
+  return NAMES[p < MODEM_PRIO_COUNT ? p : MODEM_PRIO_COUNT];
+}
+
+const ModemClassStats& modemClassStats(ModemPrio p) {
+  return stats[p < MODEM_PRIO_COUNT ? p : MODEM_PRIO_BACKGROUND];
+}
+
+void modemSchedResetStats() {
+  memset(stats, 0, sizeof(stats));
+}
@@ -0,0 +1,128 @@
+#include "motion.h"
+#include <Adafruit_BNO08x.h>
+
+// SH-2 stability classifier output
+#define STABILITY_UNKNOWN     0
+#define STABILITY_ON_TABLE    1
+#define STABILITY_STATIONARY  2
+#define STABILITY_STABLE      3
+#define STABILITY_MOTION      4
+
+// ----------------------- State -----------------------
+static Adafruit_BNO08x bno08x(-1);
+static bool            imuPresent = false;
+static MotionState     state = MOTION_UNKNOWN;
+static uint32_t        stillSinceMs = 0;
+static bool            stillPending = false;
+static bool            startedMoving = false;
+static MotionAccelHandler accelHandler = nullptr;
+
+static void enableReports() {
+  if (!bno08x.enableReport(SH2_STABILITY_CLASSIFIER, MOTION_REPORT_US)) {
+    Serial.println("Motion: could not enable stability classifier");
+  }
+  if (accelHandler && !bno08x.enableReport(SH2_ACCELEROMETER, 1000000 / MOTION_ACCEL_HZ)) {
+    Serial.println("Motion: could not enable accelerometer");
+  }
+}
+
+static void classify(uint8_t c) {
+  if (c == STABILITY_UNKNOWN) return;
+
+  if (c == STABILITY_MOTION) {
+    stillPending = false;
+    if (state != MOTION_MOVING) {
+      if (state == MOTION_STILL) startedMoving = true;
+      state = MOTION_MOVING;
+    }
+  } else if (state != MOTION_STILL) {
+    // Brief stops (traffic lights, queues) keep the moving schedule
+    if (!stillPending) {
+      stillPending = true;
+      stillSinceMs = millis();
+    } else if (millis() - stillSinceMs >= MOTION_STILL_HOLD_MS) {
+      state = MOTION_STILL;
+      stillPending = false;
+    }
+  }
+}
+
+// m/s^2 -> milli-g
+static int16_t toMg(float a) {
+  float mg = a * (1000.0f / 9.80665f);
+  if (mg > 32767.0f) return 32767;
+  if (mg < -32768.0f) return -32768;
+  return (int16_t)mg;
+}
+
+// ----------------------- Public API -----------------------
+bool motionBegin(MotionAccelHandler onAccel) {
+  accelHandler = onAccel;
+  imuPresent = bno08x.begin_I2C();
+  if (!imuPresent) {
+    Serial.println("Motion: no BNO08x, using fixed schedule");
+    return false;
+  }
+  enableReports();
+  state = MOTION_MOVING;  // stay on the tight schedule until proven still
+  return true;
+}
+
+void motionPoll() {
+  if (!imuPresent) return;
+  if (bno08x.wasReset()) enableReports();
+
+  AccelSample block[MOTION_ACCEL_BLOCK];
+  size_t n = 0;
+  sh2_SensorValue_t value;
+  while (bno08x.getSensorEvent(&value)) {
+    if (value.sensorId == SH2_STABILITY_CLASSIFIER) {
+      classify(value.un.stabilityClassifier.classification);
+    } else if (value.sensorId == SH2_ACCELEROMETER && accelHandler) {
+      block[n++] = { toMg(value.un.accelerometer.x), toMg(value.un.accelerometer.y),
+                     toMg(value.un.accelerometer.z) };
+      if (n == MOTION_ACCEL_BLOCK) {
+        accelHandler(block, n);
+        n = 0;
+      }
+    }
+  }
+  if (n) accelHandler(block, n);
+}
+
+bool motionStartedMoving() {
+  bool started = startedMoving;
+  startedMoving = false;
+  return started;
+}
+
+MotionState motionState() {
+  return state;
+}
+
+const char* motionStateName(MotionState s) {
+  switch (s) {
+    case MOTION_UNKNOWN: return "unknown";
+    case MOTION_STILL:   return "still";
+    case MOTION_MOVING:  return "moving";
+  }
+  return "?";
+}
+
+uint32_t motionPeriodMs(MotionState s, uint32_t speedCmS) {
+  switch (s) {
+    case MOTION_STILL:
+      return MOTION_STILL_PERIOD_MS;
+    case MOTION_MOVING: {
+      uint32_t period = MOTION_MIN_PERIOD_MS;
+      if (speedCmS) {
+        period = (uint32_t)((uint64_t)MOTION_SPACING_CM * 1000 / speedCmS);
+        if (period < MOTION_MIN_PERIOD_MS) period = MOTION_MIN_PERIOD_MS;
+        if (period > MOTION_MAX_PERIOD_MS) period = MOTION_MAX_PERIOD_MS;
+      }
+      return period;
+    }
+    default:
+      return MOTION_FIXED_PERIOD_MS;
+  }
+}
@@ -0,0 +1,201 @@
+#include "mqtt_link.h"
+#include "at_engine.h"
+
+// ----------------------- State -----------------------
+static bool        connected = false;
+static uint32_t    backoffMs = MQTT_BACKOFF_MIN_MS;
+static uint32_t    nextAttemptMs = 0;
+
+static char        clientId[24];
+static char        cmdTopic[48];
+static char        ackTopic[48];
+
+static MqttMessage rxQueue[MQTT_RX_QUEUE];
+static uint8_t     rxHead = 0, rxTail = 0;
+static MqttMessage rxMsg;                 // message being assembled from URCs
+static char        rxTopic[48];
+static int32_t     rxRemaining = 0;       // payload bytes still to come
+static bool        rxOverflow = false;
+
+// ----------------------- Helpers -----------------------
+// "<prefix> 0,<err>" -> true if err == 0
+static bool resultOk(const char* prefix) {
+  const char* p = strstr(atReply().text, prefix);
+  if (!p) return false;
+  const char* comma = strchr(p, ',');
+  return comma && atoi(comma + 1) == 0;
+}
+
+static void scheduleReconnect() {
+  connected = false;
+  nextAttemptMs = millis() + backoffMs;
+  backoffMs = backoffMs * 2 > MQTT_BACKOFF_MAX_MS ? MQTT_BACKOFF_MAX_MS : backoffMs * 2;
+}
+
+// Writes "<cmd>" then the raw bytes once the modem prompts with ">"
+static bool sendWithPrompt(const char* cmd, const char* data, size_t len, const char* finalLine) {
+  if (atCommand(cmd, AT_TIMEOUT_SHORT_MS * 5, ">") != AT_PROMPT) return false;
+  return atSendData(data, len, AT_TIMEOUT_NET_MS, finalLine) == AT_OK;
+}
+
+// ----------------------- Receive URCs -----------------------
+// +CMQTTRXSTART: 0,<topic_len>,<payload_len>
+// +CMQTTRXTOPIC: 0,<len>      <topic line>
+// +CMQTTRXPAYLOAD: 0,<len>    <payload line(s)>
+// +CMQTTRXEND: 0
+static void onRxStart(const char* line) {
+  int client = 0, topicLen = 0, payloadLen = 0;
+  sscanf(line, "+CMQTTRXSTART: %d,%d,%d", &client, &topicLen, &payloadLen);
+  rxMsg.len = 0;
+  rxMsg.payload[0] = '\0';
+  rxMsg.rxMs = millis();
+  rxTopic[0] = '\0';
+  rxOverflow = payloadLen >= MQTT_PAYLOAD_MAX;
+}
+
+static void onTopicLine(const char* line) {
+  strncpy(rxTopic, line, sizeof(rxTopic) - 1);
+  rxTopic[sizeof(rxTopic) - 1] = '\0';
+}
+
+static void onRxTopic(const char*) {
+  atCaptureLines(onTopicLine, 1);
+}
+
+static void onPayloadLine(const char* line) {
+  size_t n = strlen(line);
+  if (!rxOverflow) {
+    size_t room = MQTT_PAYLOAD_MAX - 1 - rxMsg.len;
+    if (rxMsg.len && room) {
+      rxMsg.payload[rxMsg.len++] = '\n';
+      room--;
+    }
+    if (n > room) n = room;
+    memcpy(rxMsg.payload + rxMsg.len, line, n);
+    rxMsg.len += n;
+    rxMsg.payload[rxMsg.len] = '\0';
+  }
+
+  // Payload continues past an embedded CRLF
+  rxRemaining -= strlen(line);
+  if (rxRemaining > 2) {
+    rxRemaining -= 2;
+    atCaptureLines(onPayloadLine, 1);
+  }
+}
+
+static void onRxPayload(const char* line) {
+  int client = 0, len = 0;
+  sscanf(line, "+CMQTTRXPAYLOAD: %d,%d", &client, &len);
+  rxRemaining = len;
+  if (len > 0) atCaptureLines(onPayloadLine, 1);
+}
+
+static void onRxEnd(const char*) {
+  if (rxOverflow || strcmp(rxTopic, cmdTopic) != 0) {
+    Serial.printf("MQTT: dropped message on '%s'\n", rxTopic);
+    return;
+  }
+  uint8_t next = (rxHead + 1) % MQTT_RX_QUEUE;
+  if (next == rxTail) {
+    Serial.println("MQTT: rx queue full");
+    return;
+  }
+  rxQueue[rxHead] = rxMsg;
+  rxHead = next;
+}
+
+static void onConnLost(const char* line) {
+  Serial.println(line);
+  scheduleReconnect();
+}
+
+// ----------------------- Session -----------------------
+static bool connect() {
+  char cmd[128];
+
+  atCommand("AT+CMQTTSTART", AT_TIMEOUT_NET_MS, "+CMQTTSTART:");  // ERROR if already running
+  snprintf(cmd, sizeof(cmd), "AT+CMQTTACCQ=0,\"%s\"", clientId);
+  atCommand(cmd);                                                 // ERROR if already acquired
+
+  snprintf(cmd, sizeof(cmd), "AT+CMQTTCONNECT=0,\"%s\",%d,1", MQTT_BROKER_URL, MQTT_KEEPALIVE_S);
+  if (atCommand(cmd, AT_TIMEOUT_NET_MS, "+CMQTTCONNECT:") != AT_OK) return false;
+  if (!resultOk("+CMQTTCONNECT:")) return false;
+
+  snprintf(cmd, sizeof(cmd), "AT+CMQTTSUB=0,%u,1", (unsigned)strlen(cmdTopic));
+  if (!sendWithPrompt(cmd, cmdTopic, strlen(cmdTopic), "+CMQTTSUB:")) return false;
+  return resultOk("+CMQTTSUB:");
+}
+
+static void teardown() {
+  atCommand("AT+CMQTTDISC=0,60", AT_TIMEOUT_NET_MS, "+CMQTTDISC:");
+  atCommand("AT+CMQTTREL=0");
+  atCommand("AT+CMQTTSTOP", AT_TIMEOUT_NET_MS, "+CMQTTSTOP:");
+}
+
+// ----------------------- Public API -----------------------
+void mqttBegin() {
+  char imei[20] = "unknown";
+  if (atCommand("AT+CGSN") == AT_OK) {
+    const char* t = atReply().text;
+    size_t n = strspn(t, "0123456789");
+    if (n && n < sizeof(imei)) {
+      memcpy(imei, t, n);
+      imei[n] = '\0';
+    }
+  }
+  snprintf(clientId, sizeof(clientId), "tc-%s", imei);
+  snprintf(cmdTopic, sizeof(cmdTopic), "tripcharm/%s/cmd", imei);
+  snprintf(ackTopic, sizeof(ackTopic), "tripcharm/%s/ack", imei);
+
+  atOnUrc("+CMQTTRXSTART:", onRxStart);
+  atOnUrc("+CMQTTRXTOPIC:", onRxTopic);
+  atOnUrc("+CMQTTRXPAYLOAD:", onRxPayload);
+  atOnUrc("+CMQTTRXEND:", onRxEnd);
+  atOnUrc("+CMQTTCONNLOST:", onConnLost);
+  atOnUrc("+CMQTTNONET", onConnLost);
+
+  nextAttemptMs = millis();
+}
+
+void mqttService() {
+  if (connected || (long)(millis() - nextAttemptMs) < 0) return;
+
+  if (connect()) {
+    connected = true;
+    backoffMs = MQTT_BACKOFF_MIN_MS;
+    Serial.printf("MQTT: subscribed to %s\n", cmdTopic);
+  } else {
+    teardown();
+    scheduleReconnect();
+    Serial.printf("MQTT: connect failed, retry in %lu ms\n", (unsigned long)(nextAttemptMs - millis()));
+  }
+}
+
+bool mqttConnected() {
+  return connected;
+}
+
+bool mqttPoll(MqttMessage& msg) {
+  if (rxTail == rxHead) return false;
+  msg = rxQueue[rxTail];
+  rxTail = (rxTail + 1) % MQTT_RX_QUEUE;
+  return true;
+}
+
+bool mqttPublishAck(const char* json, size_t len) {
+  if (!connected) return false;
+  char cmd[40];
+
+  snprintf(cmd, sizeof(cmd), "AT+CMQTTTOPIC=0,%u", (unsigned)strlen(ackTopic));
+  bool ok = sendWithPrompt(cmd, ackTopic, strlen(ackTopic), nullptr);
+
+  snprintf(cmd, sizeof(cmd), "AT+CMQTTPAYLOAD=0,%u", (unsigned)len);
+  ok = ok && sendWithPrompt(cmd, json, len, nullptr);
+
+  ok = ok && atCommand("AT+CMQTTPUB=0,1,60", AT_TIMEOUT_NET_MS, "+CMQTTPUB:") == AT_OK;
+  ok = ok && resultOk("+CMQTTPUB:");
+
+  if (!ok) scheduleReconnect();
+  return ok;
+}
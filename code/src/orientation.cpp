@@ -0,0 +1,70 @@
+#include "orientation.h"
+#include <math.h>
+
+#define PI_F       3.14159265f
+#define HALF_PI_F  1.57079633f
+
+// ----------------------- State -----------------------
+static Quat    quat = { 1.0f, 0.0f, 0.0f, 0.0f };
+static Euler   euler = { 0.0f, 0.0f, 0.0f };
+static uint8_t accuracy = 0;
+static bool    valid = false;
+static bool    eulerStale = true;
+
+// ----------------------- Approximations -----------------------
+// atan(z) for |z| <= 1, Abramowitz & Stegun 4.4.47
+static float atanUnit(float z) {
+  float z2 = z * z;
+  return z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
+}
+
+float fastAtan2(float y, float x) {
+  float ax = fabsf(x), ay = fabsf(y);
+  if (ax == 0.0f && ay == 0.0f) return 0.0f;
+
+  float a = ay <= ax ? atanUnit(ay / ax) : HALF_PI_F - atanUnit(ax / ay);
+  if (x < 0.0f) a = PI_F - a;
+  return y < 0.0f ? -a : a;
+}
+
+// asin(x) = pi/2 - sqrt(1 - x) * p(x) for 0 <= x <= 1, A&S 4.4.45
+float fastAsin(float x) {
+  float ax = fabsf(x);
+  if (ax >= 1.0f) return x < 0.0f ? -HALF_PI_F : HALF_PI_F;
+  float a = HALF_PI_F - sqrtf(1.0f - ax) * (1.5707288f + ax * (-0.2121144f + ax * (0.0742610f + ax * -0.0187293f)));
+  return x < 0.0f ? -a : a;
+}
+
+// ----------------------- Public API -----------------------
+void orientationUpdate(float w, float x, float y, float z, uint8_t acc) {
+  quat = { w, x, y, z };
+  accuracy = acc;
+  valid = true;
+  eulerStale = true;
+}
+
+bool orientationValid() {
+  return valid;
+}
+
+uint8_t orientationAccuracy() {
+  return accuracy;
+}
+
+const Quat& orientationQuat() {
+  return quat;
+}
+
+const Euler& orientationEuler() {
+  if (!eulerStale) return euler;
+
+  const Quat& q = quat;
+  float ww = q.w * q.w, xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  float norm = ww + xx + yy + zz;
+
+  euler.yaw   = fastAtan2(2.0f * (q.x * q.y + q.z * q.w), xx - yy - zz + ww);
+  euler.pitch = norm > 0.0f ? fastAsin(-2.0f * (q.x * q.z - q.y * q.w) / norm) : 0.0f;
+  euler.roll  = fastAtan2(2.0f * (q.y * q.z + q.x * q.w), -xx - yy + zz + ww);
+  eulerStale = false;
+  return euler;
+}
@@ -0,0 +1,235 @@
+#include "outbox.h"
+#include <LittleFS.h>
+
+// ----------------------- State -----------------------
+struct SlotIndex {
+  uint32_t seq;
+  uint8_t  priority;
+  bool     live;
+};
+
+static File      store;
+static bool      ready = false;
+static SlotIndex slots[OUTBOX_SLOTS];
+static uint16_t  liveCount = 0;
+static uint16_t  writeSlot = 0;
+static uint32_t  nextSeq = 1;
+
+// ----------------------- Helpers -----------------------
+static uint32_t crc32(const uint8_t* data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static uint32_t recordCrc(const OutboxRecord& rec) {
+  return crc32((const uint8_t*)&rec, offsetof(OutboxRecord, crc));
+}
+
+static bool writeAt(uint16_t slot, size_t offset, const void* data, size_t len) {
+  if (!store.seek((uint32_t)slot * OUTBOX_SLOT_SIZE + offset)) return false;
+  if (store.write((const uint8_t*)data, len) != len) return false;
+  store.flush();
+  return true;
+}
+
+static bool readSlot(uint16_t slot, OutboxRecord& rec) {
+  if (!store.seek((uint32_t)slot * OUTBOX_SLOT_SIZE)) return false;
+  if (store.read((uint8_t*)&rec, sizeof(rec)) != sizeof(rec)) return false;
+  return rec.magic == OUTBOX_MAGIC && rec.crc == recordCrc(rec);
+}
+
+static bool createStore() {
+  File f = LittleFS.open(OUTBOX_PATH, "w");
+  if (!f) return false;
+  uint8_t zero[OUTBOX_SLOT_SIZE] = {0};
+  for (uint16_t i = 0; i < OUTBOX_SLOTS; i++) {
+    if (f.write(zero, sizeof(zero)) != sizeof(zero)) {
+      f.close();
+      return false;
+    }
+  }
+  f.close();
+  return true;
+}
+
+// ----------------------- Setup -----------------------
+bool outboxBegin() {
+  if (!LittleFS.begin(true)) {  // format on first boot
+    Serial.println("Outbox: LittleFS mount failed");
+    return false;
+  }
+
+  File f = LittleFS.open(OUTBOX_PATH, "r");
+  bool sized = f && f.size() == (size_t)OUTBOX_SLOTS * OUTBOX_SLOT_SIZE;
+  if (f) f.close();
+  if (!sized && !createStore()) return false;
+
+  store = LittleFS.open(OUTBOX_PATH, "r+");
+  if (!store) return false;
+
+  // Rebuild the ring from whatever survived: torn writes fail the CRC
+  uint32_t maxSeq = 0;
+  int32_t  maxSlot = -1;
+  liveCount = 0;
+  for (uint16_t i = 0; i < OUTBOX_SLOTS; i++) {
+    OutboxRecord rec;
+    slots[i].live = readSlot(i, rec);
+    if (!slots[i].live) continue;
+    slots[i].seq = rec.seq;
+    slots[i].priority = rec.priority;
+    liveCount++;
+    if (rec.seq > maxSeq) {
+      maxSeq = rec.seq;
+      maxSlot = i;
+    }
+  }
+  nextSeq = maxSeq + 1;
+  writeSlot = (maxSlot + 1) % OUTBOX_SLOTS;
+  ready = true;
+
+  Serial.printf("Outbox: %u pending records\n", liveCount);
+  return true;
+}
+
+// ----------------------- Push -----------------------
+static bool push(uint8_t type, uint8_t priority, uint32_t utc, const void* payload, uint8_t len) {
+  if (!ready || len > OUTBOX_PAYLOAD_MAX) return false;
+
+  // A free slot if there is one. When full, the oldest record that is not
+  // an SOS makes room, and only a ring of nothing but SOS loses its oldest.
+  int32_t slot = -1;
+  for (uint16_t i = 0; i < OUTBOX_SLOTS && slot < 0; i++) {
+    uint16_t s = (writeSlot + i) % OUTBOX_SLOTS;
+    if (!slots[s].live) slot = s;
+  }
+  if (slot < 0) {
+    for (uint16_t i = 0; i < OUTBOX_SLOTS; i++) {
+      if (slots[i].priority != OUTBOX_PRIO_SOS && (slot < 0 || slots[i].seq < slots[slot].seq)) slot = i;
+    }
+  }
+  if (slot < 0) {
+    slot = 0;
+    for (uint16_t i = 1; i < OUTBOX_SLOTS; i++) {
+      if (slots[i].seq < slots[slot].seq) slot = i;
+    }
+  }
+
+  OutboxRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.magic = OUTBOX_MAGIC;
+  rec.type = type;
+  rec.priority = priority;
+  rec.seq = nextSeq;
+  rec.utc = utc;
+  rec.len = len;
+  memcpy(rec.payload, payload, len);
+  rec.crc = recordCrc(rec);
+
+  if (!writeAt(slot, 0, &rec, sizeof(rec))) return false;
+
+  if (!slots[slot].live) liveCount++;
+  slots[slot] = { nextSeq, priority, true };
+  nextSeq++;
+  writeSlot = (slot + 1) % OUTBOX_SLOTS;
+  return true;
+}
+
+bool outboxPushEvent(const char* type, uint32_t utc, uint8_t priority, uint32_t id) {
+  char buf[OUTBOX_PAYLOAD_MAX];
+  size_t room = sizeof(buf) - 1 - (id ? sizeof(id) : 0);
+  strncpy(buf, type, room);
+  buf[room] = '\0';
+  size_t len = strlen(buf) + 1;
+  if (id) {
+    memcpy(buf + len, &id, sizeof(id));
+    len += sizeof(id);
+  }
+  return push(OUTBOX_EVENT, priority, utc, buf, len);
+}
+
+bool outboxPushFix(const GnssFix& fix, uint32_t utc) {
+  return push(OUTBOX_FIX, OUTBOX_PRIO_NORMAL, utc, &fix, sizeof(fix));
+}
+
+bool outboxPushBattery(uint8_t pct, uint32_t utc) {
+  return push(OUTBOX_BATTERY, OUTBOX_PRIO_LOW, utc, &pct, 1);
+}
+
+// ----------------------- Replay -----------------------
+uint16_t outboxCount() {
+  return liveCount;
+}
+
+bool outboxHasSos() {
+  for (uint16_t i = 0; i < OUTBOX_SLOTS; i++) {
+    if (slots[i].live && slots[i].priority == OUTBOX_PRIO_SOS) return true;
+  }
+  return false;
+}
+
+// Replay order is (priority, seq): SOS first, then oldest first
+static bool before(const SlotIndex& a, const SlotIndex& b) {
+  return a.priority != b.priority ? a.priority < b.priority : a.seq < b.seq;
+}
+
+uint8_t outboxPeek(OutboxRecord* out, uint8_t max) {
+  uint8_t n = 0;
+  SlotIndex last = { 0, 0, false };
+  bool haveLast = false;
+
+  while (n < max) {
+    int32_t best = -1;
+    for (uint16_t i = 0; i < OUTBOX_SLOTS; i++) {
+      if (!slots[i].live) continue;
+      if (haveLast && !before(last, slots[i])) continue;
+      if (best < 0 || before(slots[i], slots[best])) best = i;
+    }
+    if (best < 0) break;
+
+    last = slots[best];
+    haveLast = true;
+    if (readSlot(best, out[n])) {
+      n++;
+    } else {
+      slots[best].live = false;  // went bad on flash since boot
+      liveCount--;
+    }
+  }
+  return n;
+}
+
+void outboxAck(uint32_t seq) {
+  for (uint16_t i = 0; i < OUTBOX_SLOTS; i++) {
+    if (!slots[i].live || slots[i].seq != seq) continue;
+    uint16_t consumed = 0;
+    writeAt(i, offsetof(OutboxRecord, magic), &consumed, sizeof(consumed));
+    slots[i].live = false;
+    liveCount--;
+    return;
+  }
+}
+
+// ----------------------- Payload accessors -----------------------
+const char* outboxEventType(const OutboxRecord& rec) {
+  if (rec.type != OUTBOX_EVENT || rec.len == 0) return "";
+  return (const char*)rec.payload;   // stored NUL-terminated
+}
+
+// "<text>\0<id>": older records end at the NUL
+uint32_t outboxEventId(const OutboxRecord& rec) {
+  if (rec.type != OUTBOX_EVENT) return 0;
+  size_t text = strnlen((const char*)rec.payload, rec.len) + 1;
+  uint32_t id = 0;
+  if (rec.len == text + sizeof(id)) memcpy(&id, rec.payload + text, sizeof(id));
+  return id;
+}
+
+bool outboxFix(const OutboxRecord& rec, GnssFix& fix) {
+  if (rec.type != OUTBOX_FIX || rec.len != sizeof(GnssFix)) return false;
+  memcpy(&fix, rec.payload, sizeof(fix));
+  return true;
+}
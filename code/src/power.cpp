@@ -0,0 +1,167 @@
+#include "power.h"
+#include "at_engine.h"
+#include "vibration.h"
+#include "hal.h"
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <driver/uart.h>
+
+struct WakePin {
+  uint8_t pin;
+  uint8_t level;
+  int     mode;
+};
+
+static WakePin  wakePins[POWER_WAKE_PINS_MAX];
+static uint8_t  wakePinCount = 0;
+
+static Stream*  modem = nullptr;
+static uint32_t awakeUntilMs = 0;       // stay up while a URC burst arrives
+static bool     gnssOn = false;
+
+static EnergyModel energy;
+static uint32_t    beginMs = 0;
+static uint32_t    lastAccountMs = 0;
+static uint32_t    lastAtBusyMs = 0;
+static uint64_t    sleepUs = 0;         // slept since the last powerAccount()
+
+// ----------------------- Light sleep -----------------------
+// A wake pin already at its level would end the sleep at once
+static bool wakePending() {
+  for (uint8_t i = 0; i < wakePinCount; i++) {
+    if (halPinRead(wakePins[i].pin) == wakePins[i].level) return true;
+  }
+  return false;
+}
+
+static void lightSleep(uint32_t ms) {
+  // Level wakeup replaces the pin's edge interrupt type, and a level
+  // interrupt left enabled would fire continuously once awake. The edge
+  // that woke us is therefore not seen by the ISR; the drivers also check
+  // the pin level when polled.
+  for (uint8_t i = 0; i < wakePinCount; i++) {
+    gpio_num_t pin = (gpio_num_t)wakePins[i].pin;
+    gpio_intr_disable(pin);
+    gpio_wakeup_enable(pin, wakePins[i].level ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+  }
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+  uart_set_wakeup_threshold(UART_NUM_0, POWER_UART_WAKE_EDGES);
+  esp_sleep_enable_uart_wakeup(UART_NUM_0);
+
+  Serial.flush();
+  int64_t start = esp_timer_get_time();
+  esp_light_sleep_start();
+  sleepUs += esp_timer_get_time() - start;
+
+  // Bytes arriving during light sleep are lost, so once the modem starts
+  // talking stay awake long enough to receive the rest of it
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UART) awakeUntilMs = millis() + POWER_URC_AWAKE_MS;
+
+  for (uint8_t i = 0; i < wakePinCount; i++) {
+    gpio_num_t pin = (gpio_num_t)wakePins[i].pin;
+    gpio_wakeup_disable(pin);
+    gpio_set_intr_type(pin, (gpio_int_type_t)wakePins[i].mode);
+    gpio_intr_enable(pin);
+  }
+}
+
+// ----------------------- Energy accounting -----------------------
+void powerAccount() {
+  uint32_t now = millis();
+  uint32_t elapsed = now - lastAccountMs;
+  lastAccountMs = now;
+
+  uint32_t slept = sleepUs / 1000;
+  if (slept > elapsed) slept = elapsed;
+  sleepUs = 0;
+  energyAdd(energy, ENERGY_CPU_SLEEP, slept);
+  energyAdd(energy, ENERGY_CPU_ACTIVE, elapsed - slept);
+
+  uint32_t busyTotal = atBusyMsTotal();
+  uint32_t busy = busyTotal - lastAtBusyMs;
+  lastAtBusyMs = busyTotal;
+  if (busy > elapsed) busy = elapsed;
+  energyAdd(energy, ENERGY_MODEM_BUSY, busy);
+  energyAdd(energy, ENERGY_MODEM_IDLE, elapsed - busy);
+
+  if (gnssOn) energyAdd(energy, ENERGY_GNSS, elapsed);
+  if (vibActive()) energyAdd(energy, ENERGY_VIBRATION, elapsed);
+}
+
+// ----------------------- Public API -----------------------
+void powerBegin(Stream& modemStream) {
+  modem = &modemStream;
+  energyReset(energy);
+  beginMs = lastAccountMs = millis();
+  lastAtBusyMs = atBusyMsTotal();
+}
+
+void powerAddWakePin(uint8_t pin, uint8_t wakeLevel, int interruptMode) {
+  if (wakePinCount >= POWER_WAKE_PINS_MAX) return;
+  wakePins[wakePinCount++] = { pin, wakeLevel, interruptMode };
+}
+
+void powerIdle(uint32_t maxMs, bool allowSleep) {
+  if (maxMs > POWER_SLEEP_MAX_MS) maxMs = POWER_SLEEP_MAX_MS;
+  bool quiet = !modem->available() && (long)(millis() - awakeUntilMs) >= 0;
+  if (allowSleep && quiet && maxMs >= POWER_SLEEP_MIN_MS && !atBusy() && !vibActive() && !wakePending()) {
+    lightSleep(maxMs);
+  } else {
+    delay(maxMs < POWER_IDLE_MS ? maxMs : POWER_IDLE_MS);
+  }
+  powerAccount();
+}
+
+void powerModemLowPower() {
+  char cmd[48];
+  snprintf(cmd, sizeof(cmd), "AT+CEDRXS=1,4,\"%s\"", POWER_EDRX_CYCLE);
+  atCommand(cmd);
+#if POWER_USE_PSM
+  snprintf(cmd, sizeof(cmd), "AT+CPSMS=1,,,\"%s\",\"%s\"", POWER_PSM_TAU, POWER_PSM_ACTIVE);
+  atCommand(cmd);
+#endif
+
+  // What the network actually granted, which may differ from the request
+  if (atCommand("AT+CEDRXRDP") == AT_OK) Serial.printf("Power: %s\n", atReply().text);
+#if POWER_USE_PSM
+  if (atCommand("AT+CPSMS?") == AT_OK) Serial.printf("Power: %s\n", atReply().text);
+#endif
+}
+
+bool powerGnssBegin(bool modemWasOn) {
+  if (atCommand("AT+CGPS?") == AT_OK && strstr(atReply().text, "+CGPS: 1")) {
+    gnssOn = true;
+    return true;
+  }
+  // Standalone mode; AT+CAGPS injects assistance data later if needed
+  gnssOn = atCommand(modemWasOn ? "AT+CGPSHOT" : "AT+CGPS=1,1", AT_TIMEOUT_SHORT_MS * 3) == AT_OK;
+  return modemWasOn;
+}
+
+void powerGnssService(uint32_t msToNextCycle, uint32_t periodMs, bool urgent) {
+  if (gnssOn) return;
+  if (!urgent && periodMs >= POWER_GNSS_DUTY_MIN_MS && msToNextCycle > POWER_GNSS_WARMUP_MS) return;
+
+  // Ephemeris from the last fix is still valid, so a hot start is enough
+  gnssOn = atCommand("AT+CGPSHOT", AT_TIMEOUT_SHORT_MS * 3) == AT_OK;
+  if (gnssOn) Serial.println("Power: GNSS hot start");
+}
+
+void powerGnssFixTaken(uint32_t periodMs) {
+  if (!gnssOn || periodMs < POWER_GNSS_DUTY_MIN_MS) return;
+  if (atCommand("AT+CGPS=0", AT_TIMEOUT_SHORT_MS * 3) == AT_OK) gnssOn = false;
+}
+
+bool powerGnssOn() {
+  return gnssOn;
+}
+
+const EnergyModel& powerEnergy() {
+  return energy;
+}
+
+uint32_t powerElapsedMs() {
+  return millis() - beginMs;
+}
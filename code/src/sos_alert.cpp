@@ -0,0 +1,193 @@
+#include "sos_alert.h"
+#include "at_engine.h"
+#include "modem_sched.h"
+#include <esp_timer.h>
+
+static const char* const GUARDIANS[] = SOS_GUARDIANS;
+static const uint8_t     GUARDIAN_COUNT = sizeof(GUARDIANS) / sizeof(GUARDIANS[0]);
+static_assert(GUARDIAN_COUNT <= SOS_GUARDIANS_MAX, "too many SOS guardians");
+
+struct Alert {
+  bool        open;
+  uint32_t    id;
+  const char* event;          // first event of the alert, for the text
+  int64_t     edgeUs;         // first press
+  uint32_t    confirmedMs[SOS_CHANNEL_COUNT];   // press -> confirmed, 0 = not yet
+  uint8_t     tries[SOS_GUARDIANS_MAX];
+  bool        texted[SOS_GUARDIANS_MAX];
+  uint32_t    retryMs;        // millis() of the next try after a failure
+};
+
+static Alert         alert;
+static GnssFix       lastFix;
+static uint32_t      lastFixMs = 0;     // 0 = no fix yet
+static bool          textMode = false;  // AT+CMGF=1 done
+static SosAlertStats stats;
+
+static const char* const CHANNEL_NAMES[SOS_CHANNEL_COUNT] = { "HTTP", "SMS" };
+
+// ----------------------- Alert -----------------------
+// Unique per device without a flash counter: the press time in µs since
+// boot, salted with the UTC clock when there is one
+static uint32_t alertId(int64_t edgeUs, uint32_t utc) {
+  uint32_t h = 2166136261u;
+  uint64_t parts[2] = { (uint64_t)edgeUs, utc };
+  const uint8_t* p = (const uint8_t*)parts;
+  for (size_t i = 0; i < sizeof(parts); i++) h = (h ^ p[i]) * 16777619u;
+  return h ? h : 1;
+}
+
+static bool confirmed() {
+  return alert.confirmedMs[SOS_CHANNEL_HTTP] || alert.confirmedMs[SOS_CHANNEL_SMS];
+}
+
+// The server has it and every guardian got a first try
+static void closeIfDone() {
+  if (!alert.confirmedMs[SOS_CHANNEL_HTTP]) return;
+  for (uint8_t g = 0; g < GUARDIAN_COUNT; g++) {
+    if (!alert.tries[g]) return;
+  }
+  alert.open = false;
+}
+
+static void confirm(SosChannel c, const char* detail) {
+  if (alert.confirmedMs[c]) return;
+  bool first = !confirmed();
+  uint32_t ms = (esp_timer_get_time() - alert.edgeUs) / 1000;
+  alert.confirmedMs[c] = ms ? ms : 1;
+  diagHistAdd(stats.latencyMs[c], ms);
+  if (first) {
+    stats.first[c]++;
+    modemDelivered(MODEM_PRIO_SOS);    // someone has it: no more urgent retries
+  }
+
+  char line[96];
+  snprintf(line, sizeof(line), "SOS: alert %08lx via %s %lu ms after press%s%s", (unsigned long)alert.id,
+           CHANNEL_NAMES[c], (unsigned long)ms, detail, first ? " (first)" : "");
+  Serial.println(line);
+  closeIfDone();
+}
+
+// ----------------------- Text message -----------------------
+static size_t formatText(char* out, size_t size) {
+  size_t n = snprintf(out, size, "SOS %08lx: %s.", (unsigned long)alert.id, alert.event);
+  if (n >= size) return size - 1;
+  if (!lastFixMs) {
+    n += snprintf(out + n, size - n, " No position fix yet.");
+  } else {
+    double lat = lastFix.latE7 / 1e7, lon = lastFix.lonE7 / 1e7;
+    unsigned long ageS = (millis() - lastFixMs) / 1000;
+    n += snprintf(out + n, size - n, " Last fix %lu s ago: https://maps.google.com/?q=%.5f,%.5f", ageS, lat, lon);
+  }
+  return n < size ? n : size - 1;
+}
+
+// A prompt that timed out may still be open, and so may a body that never
+// got its +CMGS: ESC ends text entry, or everything sent next would become
+// part of the message. Outside text entry the modem ignores it.
+static void cancelText() {
+  const char esc = 0x1B;
+  atSendData(&esc, 1);
+}
+
+// Text mode; the body ends with Ctrl-Z. AT_OK once the modem took it,
+// otherwise the step that failed.
+static AtResult sendText(const char* number) {
+  if (!textMode) textMode = atCommand("AT+CMGF=1") == AT_OK;
+  if (!textMode) return atReply().result;
+
+  char cmd[40];
+  snprintf(cmd, sizeof(cmd), "AT+CMGS=\"%s\"", number);
+  AtResult r = atCommand(cmd, AT_TIMEOUT_SHORT_MS * 5, ">");
+  if (r != AT_PROMPT) {
+    cancelText();
+    return r == AT_OK ? AT_ERROR : r;
+  }
+
+  char body[SOS_SMS_MAX + 2];
+  size_t n = formatText(body, SOS_SMS_MAX + 1);
+  body[n++] = 0x1A;
+  r = atSendData(body, n, SOS_SMS_TIMEOUT_MS);
+  if (r == AT_OK && strstr(atReply().text, "+CMGS:")) return AT_OK;
+  cancelText();
+  return r == AT_OK ? AT_ERROR : r;
+}
+
+// First try for everyone, then retries only while nothing confirmed
+static int8_t dueGuardian() {
+  for (uint8_t g = 0; g < GUARDIAN_COUNT; g++) {
+    if (!alert.tries[g]) return g;
+  }
+  if (confirmed() || (long)(millis() - alert.retryMs) < 0) return -1;
+  for (uint8_t g = 0; g < GUARDIAN_COUNT; g++) {
+    if (!alert.texted[g] && alert.tries[g] < SOS_SMS_TRIES) return g;
+  }
+  return -1;
+}
+
+// ----------------------- Public API -----------------------
+uint32_t sosAlertRaise(const char* event, int64_t edgeUs, uint32_t utc) {
+  if (alert.open && edgeUs - alert.edgeUs < (int64_t)SOS_ALERT_MAX_MS * 1000) return alert.id;
+  memset(&alert, 0, sizeof(alert));
+  alert.open = true;
+  alert.id = alertId(edgeUs, utc);
+  alert.event = event;
+  alert.edgeUs = edgeUs;
+  stats.alerts++;
+  return alert.id;
+}
+
+void sosAlertNoteFix(const GnssFix& fix) {
+  lastFix = fix;
+  uint32_t now = millis();
+  lastFixMs = now ? now : 1;
+}
+
+void sosAlertService() {
+  if (!alert.open) return;
+  int8_t g = dueGuardian();
+  if (g < 0) {
+    closeIfDone();
+    return;
+  }
+  if (!modemAcquire(MODEM_PRIO_SOS)) return;
+  AtResult r = sendText(GUARDIANS[g]);
+  bool ok = r == AT_OK;
+  modemRelease();
+
+  alert.tries[g]++;
+  if (ok) {
+    alert.texted[g] = true;
+    stats.smsSent++;
+    char detail[40];
+    snprintf(detail, sizeof(detail), " (%s)", GUARDIANS[g]);
+    if (alert.confirmedMs[SOS_CHANNEL_SMS]) Serial.printf("SOS: text to %s sent\n", GUARDIANS[g]);
+    else confirm(SOS_CHANNEL_SMS, detail);
+  } else {
+    stats.smsFailed++;
+    alert.retryMs = millis() + SOS_SMS_RETRY_MS;
+    Serial.printf("SOS: text to %s failed (%s, try %u)\n", GUARDIANS[g], atResultName(r),
+                  alert.tries[g]);
+  }
+  closeIfDone();
+}
+
+void sosAlertHttpDelivered() {
+  if (alert.open) confirm(SOS_CHANNEL_HTTP, "");
+}
+
+bool sosAlertConfirmed() {
+  return alert.open && confirmed();
+}
+
+const char* sosChannelName(SosChannel c) {
+  return c < SOS_CHANNEL_COUNT ? CHANNEL_NAMES[c] : "?";
+}
+
+const SosAlertStats& sosAlertStats() {
+  return stats;
+}
+
+void sosAlertResetStats() {
+  memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,494 @@
+#include "telemetry.h"
+#include "at_engine.h"
+#include "outbox.h"
+#include "track_codec.h"
+#include "modem_sched.h"
+#include <stdarg.h>
+#include <esp_timer.h>
+
+// ----------------------- State -----------------------
+struct CommandAck {
+  char        id[COMMAND_ID_MAX];
+  const char* status;
+};
+
+static bool           sessionOpen = false;
+static TelemetryEvent events[TELEMETRY_MAX_EVENTS];
+static uint8_t        eventCount = 0;
+static uint8_t        eventsInFlight = 0;      // the first ones, in the POST being sent
+static CommandAck     acks[TELEMETRY_MAX_ACKS];
+static uint8_t        ackCount = 0;
+static TelemetryStats stats = { 0, 0, 0, -1 };
+static char           body[AT_REPLY_MAX];
+static char           json[TELEMETRY_JSON_MAX];
+static size_t         jsonLen = 0;
+static uint8_t        track[TELEMETRY_TRACK_MAX];
+static uint8_t        fallBody[TELEMETRY_FALL_MAX];
+static size_t         fallLen = 0;             // 0 = nothing queued
+
+// ----------------------- Payload formatting -----------------------
+// Appends to the static JSON buffer; false (and nothing appended) on overflow.
+static bool jsonAppend(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(json + jsonLen, sizeof(json) - jsonLen, fmt, args);
+  va_end(args);
+  if (n < 0 || (size_t)n >= sizeof(json) - jsonLen) {
+    json[jsonLen] = '\0';
+    return false;
+  }
+  jsonLen += n;
+  return true;
+}
+
+// A JSON string body: geofence names come from the server and may hold
+// quotes or backslashes
+static bool jsonAppendString(const char* s) {
+  for (; *s; s++) {
+    unsigned char c = *s;
+    bool ok = c == '"' || c == '\\' ? jsonAppend("\\%c", c) : c < 0x20 ? jsonAppend("\\u%04x", c) : jsonAppend("%c", c);
+    if (!ok) return false;
+  }
+  return true;
+}
+
+// Fixed-point degrees * 1e7 -> "-12.3456789" without going through float
+static const char* formatE7(char* buf, int32_t e7) {
+  uint32_t mag = e7 < 0 ? (uint32_t)(-(int64_t)e7) : (uint32_t)e7;
+  snprintf(buf, 16, "%s%lu.%07lu", e7 < 0 ? "-" : "",
+           (unsigned long)(mag / 10000000UL), (unsigned long)(mag % 10000000UL));
+  return buf;
+}
+
+static bool appendGps(const GnssFix& fix) {
+  char lat[16], lon[16];
+  bool ok = jsonAppend(",\"gps\":{\"lat\":%s,\"lon\":%s,\"utc\":\"20%02u-%02u-%02uT%02u:%02u:%02uZ\"",
+                       formatE7(lat, fix.latE7), formatE7(lon, fix.lonE7),
+                       fix.year, fix.month, fix.day, fix.hour, fix.minute, fix.second);
+  if (ok && (fix.flags & GNSS_HAS_ALT))    ok = jsonAppend(",\"alt_cm\":%ld", (long)fix.altCm);
+  if (ok && (fix.flags & GNSS_HAS_SPEED))  ok = jsonAppend(",\"speed_cms\":%lu", (unsigned long)fix.speedCmS);
+  if (ok && (fix.flags & GNSS_HAS_COURSE)) ok = jsonAppend(",\"course_cdeg\":%u", fix.courseCdeg);
+  return ok && jsonAppend("}");
+}
+
+// ----------------------- Event queue -----------------------
+// Events in the request that is out are not touched: the POST drops them
+// from the front once it succeeds, so evicting one would drop another.
+bool telemetryQueueEvent(const char* type, uint32_t id, uint8_t priority) {
+  if (eventCount >= TELEMETRY_MAX_EVENTS) {
+    uint8_t victim = eventsInFlight;
+    while (victim < eventCount && events[victim].priority == OUTBOX_PRIO_SOS) victim++;
+    if (priority != OUTBOX_PRIO_SOS || victim == eventCount) return false;
+    for (uint8_t i = victim + 1; i < eventCount; i++) events[i - 1] = events[i];
+    eventCount--;
+  }
+  events[eventCount++] = { type, id, priority };
+  return true;
+}
+
+bool telemetryEventsPending() {
+  return eventCount > 0;
+}
+
+bool telemetrySosEventsPending() {
+  for (uint8_t i = 0; i < eventCount; i++) {
+    if (events[i].priority == OUTBOX_PRIO_SOS) return true;
+  }
+  return false;
+}
+
+bool telemetryEventQueued(const char* type) {
+  for (uint8_t i = 0; i < eventCount; i++) {
+    if (events[i].type == type) return true;
+  }
+  return false;
+}
+
+uint8_t telemetryTakeEvents(TelemetryEvent* out, uint8_t max) {
+  uint8_t n = eventCount < max ? eventCount : max;
+  for (uint8_t i = 0; i < n; i++) out[i] = events[i];
+  for (uint8_t i = n; i < eventCount; i++) events[i - n] = events[i];
+  eventCount -= n;
+  return n;
+}
+
+bool telemetryAckCommand(const char* id, const char* status) {
+  if (!id[0] || ackCount >= TELEMETRY_MAX_ACKS) return false;
+  snprintf(acks[ackCount].id, sizeof(acks[ackCount].id), "%s", id);
+  acks[ackCount++].status = status;
+  return true;
+}
+
+// ----------------------- HTTP session -----------------------
+static const char* currentUrl = nullptr;
+static const char* currentContent = nullptr;
+
+static bool openSession() {
+  if (sessionOpen) return true;
+
+  atCommand("AT+HTTPTERM");  // may fail if nothing was open
+  if (atCommand("AT+HTTPINIT") != AT_OK) return false;
+  if (atCommand("AT+HTTPPARA=\"CID\",1") != AT_OK) return false;
+
+  currentUrl = nullptr;
+  currentContent = nullptr;
+  sessionOpen = true;
+  return true;
+}
+
+// Only re-sends the URL parameter when switching endpoints
+static bool setUrl(const char* url) {
+  if (url == currentUrl) return true;
+  char cmd[96];
+  snprintf(cmd, sizeof(cmd), "AT+HTTPPARA=\"URL\",\"%s\"", url);
+  if (atCommand(cmd) != AT_OK) return false;
+  currentUrl = url;
+  return true;
+}
+
+static bool setContent(const char* type) {
+  if (type == currentContent) return true;
+  char cmd[64];
+  snprintf(cmd, sizeof(cmd), "AT+HTTPPARA=\"CONTENT\",\"%s\"", type);
+  if (atCommand(cmd) != AT_OK) return false;
+  currentContent = type;
+  return true;
+}
+
+// A preempted exchange never reached the modem, so the session still holds
+static void sessionFailed() {
+  if (atReply().result != AT_ABORTED) sessionOpen = false;
+}
+
+void telemetryCloseSession() {
+  atCommand("AT+HTTPTERM");
+  sessionOpen = false;
+}
+
+// "+HTTPREAD: DATA,<n>\n<body>\n+HTTPREAD: 0" -> <body>, in place
+static const char* findBody(const char* text, size_t& len) {
+  const char* start = strstr(text, "+HTTPREAD: DATA,");
+  if (!start) return nullptr;
+  start = strchr(start, '\n');
+  if (!start) return nullptr;
+  start++;
+
+  const char* end = strstr(start, "\n+HTTPREAD: 0");
+  len = end ? (size_t)(end - start) : strlen(start);
+  return start;
+}
+
+static const char* extractBody(const char* text) {
+  size_t n;
+  const char* start = findBody(text, n);
+  if (!start) return nullptr;
+  if (n > sizeof(body) - 1) n = sizeof(body) - 1;
+  memcpy(body, start, n);
+  body[n] = '\0';
+  return body;
+}
+
+// POSTs payload; returns the response body length, or -1 on failure or a
+// non-2xx status. The body is left on the modem.
+static int postAction(const char* url, const char* contentType, const char* payload, size_t len) {
+  if (!setUrl(url) || !setContent(contentType)) return -1;
+
+  char cmd[40];
+  snprintf(cmd, sizeof(cmd), "AT+HTTPDATA=%u,10000", (unsigned)len);
+  if (atCommand(cmd, AT_TIMEOUT_SHORT_MS, "DOWNLOAD") != AT_PROMPT) return -1;
+  if (atSendData(payload, len, 10000) != AT_OK) return -1;
+  stats.bytesUp = len;
+
+  // Once the request is out it is seen through, or it would be sent twice
+  modemCommit();
+  if (atCommand("AT+HTTPACTION=1", AT_TIMEOUT_HTTP_MS, "+HTTPACTION:") != AT_OK) return -1;
+
+  int method = 0, status = -1, bodyLen = 0;
+  const char* urc = strstr(atReply().text, "+HTTPACTION:");
+  if (!urc || sscanf(urc, "+HTTPACTION: %d,%d,%d", &method, &status, &bodyLen) != 3) return -1;
+  stats.httpStatus = status;
+  stats.bytesDown = 0;
+  if (status < 200 || status >= 300) return -1;
+  return bodyLen > 0 ? bodyLen : 0;
+}
+
+static const char* post(const char* url, const char* contentType, const char* payload, size_t len) {
+  int bodyLen = postAction(url, contentType, payload, len);
+  if (bodyLen < 0) return nullptr;
+  body[0] = '\0';
+  if (bodyLen == 0) return body;
+
+  char cmd[40];
+  snprintf(cmd, sizeof(cmd), "AT+HTTPREAD=0,%d", bodyLen);
+  if (atCommand(cmd, AT_TIMEOUT_SHORT_MS * 2, "+HTTPREAD: 0") != AT_OK) return nullptr;
+  stats.bytesDown = bodyLen;
+  return extractBody(atReply().text);
+}
+
+// The response body for the command parser, one HTTPREAD at a time,
+// handed out straight from the AT reply
+struct BodySource {
+  int  offset, len;
+  bool failed;
+};
+
+static size_t readBodyChunk(void* ctx, const char*& chunk) {
+  BodySource& s = *(BodySource*)ctx;
+  if (s.failed || s.offset >= s.len) return 0;
+  int n = s.len - s.offset < TELEMETRY_CMD_CHUNK ? s.len - s.offset : TELEMETRY_CMD_CHUNK;
+  char cmd[40];
+  snprintf(cmd, sizeof(cmd), "AT+HTTPREAD=%d,%d", s.offset, n);
+  size_t got = 0;
+  chunk = atCommand(cmd, AT_TIMEOUT_SHORT_MS * 2, "+HTTPREAD: 0") == AT_OK ? findBody(atReply().text, got) : nullptr;
+  if (!chunk) {
+    s.failed = true;
+    return 0;
+  }
+  s.offset += n;
+  return got;
+}
+
+// ----------------------- Combined POST -----------------------
+bool telemetrySend(const GnssFix* fix, int battPct, CommandBatch& commands) {
+  uint32_t busyBefore = atBusyMsTotal();
+  uint32_t lastAirtime = stats.airtimeMs;
+  stats.httpStatus = -1;
+  stats.bytesUp = 0;
+  stats.bytesDown = 0;
+
+  // Events that don't fit stay queued for the next cycle
+  uint8_t sent = 0;
+  jsonLen = 0;
+  jsonAppend("{\"airtime_ms\":%lu", (unsigned long)lastAirtime);
+  if (battPct >= 0) jsonAppend(",\"percentage\":%d", battPct);
+  if (fix) appendGps(*fix);
+  if (eventCount) {
+    jsonAppend(",\"events\":[");
+    while (sent < eventCount) {
+      size_t mark = jsonLen;
+      const TelemetryEvent& ev = events[sent];
+      bool ok = jsonAppend("%s{\"type\":\"", sent ? "," : "") && jsonAppendString(ev.type) && jsonAppend("\"") &&
+                (!ev.id || jsonAppend(",\"id\":\"%08lx\"", (unsigned long)ev.id)) && jsonAppend("}");
+      if (!ok || jsonLen > TELEMETRY_JSON_MAX - 64) {
+        jsonLen = mark;
+        json[jsonLen] = '\0';
+        break;
+      }
+      sent++;
+    }
+    jsonAppend("]");
+  }
+  uint8_t acked = 0;
+  if (ackCount) {
+    jsonAppend(",\"acks\":[");
+    while (acked < ackCount) {
+      size_t mark = jsonLen;
+      const CommandAck& ack = acks[acked];
+      if (!jsonAppend("%s{\"id\":\"%s\",\"status\":\"%s\"}", acked ? "," : "", ack.id, ack.status) ||
+          jsonLen > TELEMETRY_JSON_MAX - 16) {
+        jsonLen = mark;
+        json[jsonLen] = '\0';
+        break;
+      }
+      acked++;
+    }
+    jsonAppend("]");
+  }
+  commands.count = 0;
+  if (!jsonAppend("}")) return false;
+
+  bool ok = false;
+  eventsInFlight = sent;
+  if (openSession()) {
+    int bodyLen = postAction(TELEMETRY_URL, "application/json", json, jsonLen);
+    ok = bodyLen >= 0;
+    if (bodyLen > 0) {
+      // The request got through even if the commands can't be read; the
+      // server hands unacknowledged ones out again
+      BodySource source = { 0, bodyLen, false };
+      commandParse(readBodyChunk, &source, commands);
+      stats.bytesDown = source.offset;
+      if (source.failed) sessionFailed();
+    }
+    if (!ok) sessionFailed();  // rebuild the session next cycle
+  }
+
+  eventsInFlight = 0;
+  if (ok) {
+    // Events queued while this request was in flight stay for the next one
+    for (uint8_t i = sent; i < eventCount; i++) events[i - sent] = events[i];
+    eventCount -= sent;
+    for (uint8_t i = acked; i < ackCount; i++) acks[i - acked] = acks[i];
+    ackCount -= acked;
+  }
+
+  stats.airtimeMs = atBusyMsTotal() - busyBefore;
+  return ok;
+}
+
+bool telemetrySendDiagnostics(const char* record, size_t len) {
+  if (!openSession()) return false;
+  if (post(TELEMETRY_DIAG_URL, "application/json", record, len)) return true;
+  sessionFailed();
+  return false;
+}
+
+// ----------------------- Fall snapshot -----------------------
+static uint8_t* putLe(uint8_t* p, uint32_t v, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) *p++ = (uint8_t)(v >> (8 * i));
+  return p;
+}
+
+void telemetryQueueFallSnapshot(uint32_t eventId, const FallEvent& ev, uint16_t rateHz,
+                                const AccelSample* samples, size_t n) {
+  if (n > FALL_RING) n = FALL_RING;
+  uint8_t* p = fallBody;
+  *p++ = 'F';
+  *p++ = 'S';
+  *p++ = TELEMETRY_FALL_VERSION;
+  p = putLe(p, eventId, 4);
+  p = putLe(p, rateHz, 2);
+  p = putLe(p, ev.peakMg, 2);
+  p = putLe(p, ev.freeFallMs, 2);
+  p = putLe(p, (uint32_t)n, 2);
+  for (size_t i = 0; i < n; i++) {
+    p = putLe(p, (uint16_t)samples[i].x, 2);
+    p = putLe(p, (uint16_t)samples[i].y, 2);
+    p = putLe(p, (uint16_t)samples[i].z, 2);
+  }
+  fallLen = p - fallBody;
+}
+
+bool telemetryFallSnapshotPending() {
+  return fallLen != 0;
+}
+
+bool telemetrySendFallSnapshot() {
+  if (!fallLen) return true;
+  if (!openSession()) return false;
+  if (!post(TELEMETRY_FALL_URL, "application/octet-stream", (const char*)fallBody, fallLen)) {
+    sessionFailed();
+    return false;
+  }
+  fallLen = 0;
+  return true;
+}
+
+// ----------------------- Geofence download -----------------------
+static char geofenceUrl[112];
+
+// The AT engine splits replies on newlines and drops empty ones, so where a
+// chunk boundary fell is lost. Records are therefore ';'-terminated and
+// newlines are ignored; a partial record carries over to the next chunk.
+static bool parseGeofenceChunk(GeofenceSet& set, const char* text, char* line, size_t& lineLen, size_t lineMax) {
+  for (const char* p = text; *p; p++) {
+    if (*p == '\n') continue;
+    if (*p == ';') {
+      if (!geofenceParseLine(set, line, lineLen)) return false;
+      lineLen = 0;
+    } else if (lineLen < lineMax) {
+      line[lineLen++] = *p;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool telemetryFetchGeofences(GeofenceSet& set, uint32_t haveVersion, bool& changed) {
+  changed = false;
+  if (!openSession()) return false;
+
+  // Same buffer every time but a different query, so force the URL out
+  snprintf(geofenceUrl, sizeof(geofenceUrl), "%s?since=%lu", TELEMETRY_GEOFENCE_URL, (unsigned long)haveVersion);
+  currentUrl = nullptr;
+  if (!setUrl(geofenceUrl)) return false;
+  if (atCommand("AT+HTTPACTION=0", AT_TIMEOUT_HTTP_MS, "+HTTPACTION:") != AT_OK) {
+    sessionFailed();
+    return false;
+  }
+
+  int method = 0, status = -1, bodyLen = 0;
+  const char* urc = strstr(atReply().text, "+HTTPACTION:");
+  if (!urc || sscanf(urc, "+HTTPACTION: %d,%d,%d", &method, &status, &bodyLen) != 3) return false;
+  if (status < 200 || status >= 300) return false;
+
+  geofenceClear(set);
+  char line[64];
+  size_t lineLen = 0;
+  for (int offset = 0; offset < bodyLen; offset += TELEMETRY_READ_CHUNK) {
+    int n = bodyLen - offset < TELEMETRY_READ_CHUNK ? bodyLen - offset : TELEMETRY_READ_CHUNK;
+    char cmd[40];
+    snprintf(cmd, sizeof(cmd), "AT+HTTPREAD=%d,%d", offset, n);
+    if (atCommand(cmd, AT_TIMEOUT_SHORT_MS * 2, "+HTTPREAD: 0") != AT_OK) return false;
+    const char* text = extractBody(atReply().text);
+    if (!text) return false;
+    if (!parseGeofenceChunk(set, text, line, lineLen, sizeof(line))) return false;
+  }
+
+  if (lineLen) return false;   // body ended mid-record
+  changed = set.version != haveVersion;
+  if (changed) geofenceBuildIndex(set);
+  return true;
+}
+
+const TelemetryStats& telemetryLastStats() {
+  return stats;
+}
+
+// ----------------------- Outbox replay -----------------------
+static bool toTrackRecord(const OutboxRecord& r, TrackRecord& out) {
+  memset(&out, 0, sizeof(out));
+  out.seq = r.seq;
+  out.utc = r.utc;
+  GnssFix fix;
+  switch (r.type) {
+    case OUTBOX_EVENT:
+      out.type = TRACK_EVENT;
+      strncpy(out.event, outboxEventType(r), sizeof(out.event) - 1);
+      out.eventId = outboxEventId(r);
+      if (out.eventId) out.flags = TRACK_EVENT_HAS_ID;
+      return true;
+    case OUTBOX_BATTERY:
+      out.type = TRACK_BATTERY;
+      out.pct = r.payload[0];
+      return true;
+    case OUTBOX_FIX:
+      if (!outboxFix(r, fix)) return false;
+      out.type = TRACK_FIX;
+      out.flags = fix.flags;
+      out.latE7 = fix.latE7;
+      out.lonE7 = fix.lonE7;
+      out.altCm = fix.altCm;
+      out.speedCmS = fix.speedCmS;
+      out.courseCdeg = fix.courseCdeg;
+      return true;
+  }
+  return false;
+}
+
+uint8_t telemetrySendBatch(const OutboxRecord* recs, uint8_t n) {
+  uint32_t busyBefore = atBusyMsTotal();
+  int64_t encodeStartUs = esp_timer_get_time();
+
+  // Unreadable records are still counted as sent so they get acknowledged
+  TrackEncoder enc;
+  trackEncodeBegin(enc, track, sizeof(track));
+  uint8_t included = 0;
+  for (; included < n; included++) {
+    TrackRecord rec;
+    if (toTrackRecord(recs[included], rec) && !trackEncode(enc, rec)) break;
+  }
+  uint32_t encodeUs = esp_timer_get_time() - encodeStartUs;
+
+  const char* resp = nullptr;
+  if (included && openSession()) {
+    resp = post(TELEMETRY_TRACK_URL, "application/octet-stream", (const char*)track, enc.len);
+    if (!resp) sessionFailed();
+  }
+  Serial.printf("Track: %u records in %u B (%lu us to encode)\n",
+                included, (unsigned)enc.len, (unsigned long)encodeUs);
+
+  stats.airtimeMs += atBusyMsTotal() - busyBefore;
+  return resp ? included : 0;
+}
@@ -0,0 +1,184 @@
+#include "track_codec.h"
+#include "gnss.h"
+#include <string.h>
+
+// ----------------------- Varints -----------------------
+static uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+  return (int32_t)((v >> 1) ^ (0u - (v & 1)));
+}
+
+// Wrapping difference, so deltas never overflow
+static int32_t delta(uint32_t cur, uint32_t prev) {
+  return (int32_t)(cur - prev);
+}
+
+static bool putByte(TrackEncoder& enc, uint8_t b) {
+  if (enc.len >= enc.cap) return false;
+  enc.buf[enc.len++] = b;
+  return true;
+}
+
+static bool putVarint(TrackEncoder& enc, uint32_t v) {
+  while (v >= 0x80) {
+    if (!putByte(enc, (uint8_t)(v | 0x80))) return false;
+    v >>= 7;
+  }
+  return putByte(enc, (uint8_t)v);
+}
+
+static bool getByte(TrackDecoder& dec, uint8_t& b) {
+  if (dec.pos >= dec.len) return false;
+  b = dec.buf[dec.pos++];
+  return true;
+}
+
+static bool getVarint(TrackDecoder& dec, uint32_t& v) {
+  v = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    uint8_t b;
+    if (!getByte(dec, b)) return false;
+    if (shift == 28 && b > 0x0F) return false;  // more than 32 bits
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool getDelta(TrackDecoder& dec, uint32_t prev, uint32_t& out) {
+  uint32_t v;
+  if (!getVarint(dec, v)) return false;
+  out = prev + (uint32_t)unzigzag(v);
+  return true;
+}
+
+// ----------------------- Encoder -----------------------
+bool trackEncodeBegin(TrackEncoder& enc, uint8_t* buf, size_t cap) {
+  enc.buf = buf;
+  enc.cap = cap;
+  enc.len = 0;
+  memset(&enc.prev, 0, sizeof(enc.prev));
+  return putByte(enc, 'T') && putByte(enc, 'C') && putByte(enc, TRACK_VERSION);
+}
+
+bool trackEncode(TrackEncoder& enc, const TrackRecord& rec) {
+  size_t mark = enc.len;
+  TrackState next = enc.prev;
+  uint8_t flags = rec.type == TRACK_FIX   ? (rec.flags & 0x0F)
+                : rec.type == TRACK_EVENT ? (rec.flags & TRACK_EVENT_HAS_ID)
+                                          : 0;
+
+  bool ok = putByte(enc, (uint8_t)(rec.type | flags << 4)) &&
+            putVarint(enc, zigzag(delta(rec.seq, next.seq))) &&
+            putVarint(enc, zigzag(delta(rec.utc, next.utc)));
+  next.seq = rec.seq;
+  next.utc = rec.utc;
+
+  switch (rec.type) {
+    case TRACK_FIX:
+      ok = ok && putVarint(enc, zigzag(delta(rec.latE7, next.latE7)))
+              && putVarint(enc, zigzag(delta(rec.lonE7, next.lonE7)));
+      next.latE7 = rec.latE7;
+      next.lonE7 = rec.lonE7;
+      if (flags & GNSS_HAS_ALT) {
+        ok = ok && putVarint(enc, zigzag(delta(rec.altCm, next.altCm)));
+        next.altCm = rec.altCm;
+      }
+      if (flags & GNSS_HAS_SPEED)  ok = ok && putVarint(enc, rec.speedCmS);
+      if (flags & GNSS_HAS_COURSE) ok = ok && putVarint(enc, rec.courseCdeg);
+      break;
+    case TRACK_BATTERY:
+      ok = ok && putByte(enc, rec.pct);
+      break;
+    case TRACK_EVENT: {
+      size_t n = strnlen(rec.event, TRACK_EVENT_MAX - 1);
+      ok = ok && putVarint(enc, n);
+      for (size_t i = 0; ok && i < n; i++) ok = putByte(enc, (uint8_t)rec.event[i]);
+      if (rec.flags & TRACK_EVENT_HAS_ID) ok = ok && putVarint(enc, rec.eventId);
+      break;
+    }
+    default:
+      ok = false;
+  }
+
+  if (!ok) {
+    enc.len = mark;
+    return false;
+  }
+  enc.prev = next;
+  return true;
+}
+
+// ----------------------- Decoder -----------------------
+TrackResult trackDecodeBegin(TrackDecoder& dec, const uint8_t* buf, size_t len) {
+  dec.buf = buf;
+  dec.len = len;
+  dec.pos = TRACK_HEADER_LEN;
+  memset(&dec.prev, 0, sizeof(dec.prev));
+  if (len < TRACK_HEADER_LEN || buf[0] != 'T' || buf[1] != 'C') return TRACK_MALFORMED;
+  if (buf[2] == 0 || buf[2] > TRACK_VERSION) return TRACK_BAD_VERSION;
+  return TRACK_OK;
+}
+
+TrackResult trackDecodeNext(TrackDecoder& dec, TrackRecord& out) {
+  if (dec.pos >= dec.len) return TRACK_END;
+
+  TrackState next = dec.prev;
+  TrackRecord rec;
+  memset(&rec, 0, sizeof(rec));
+
+  uint8_t tag;
+  if (!getByte(dec, tag)) return TRACK_MALFORMED;
+  rec.type = tag & 0x0F;
+  rec.flags = tag >> 4;
+  if (!getDelta(dec, next.seq, rec.seq) || !getDelta(dec, next.utc, rec.utc)) return TRACK_MALFORMED;
+  next.seq = rec.seq;
+  next.utc = rec.utc;
+
+  uint32_t v;
+  switch (rec.type) {
+    case TRACK_FIX:
+      if (rec.flags & ~(GNSS_HAS_ALT | GNSS_HAS_SPEED | GNSS_HAS_COURSE)) return TRACK_MALFORMED;
+      if (!getDelta(dec, next.latE7, v)) return TRACK_MALFORMED;
+      rec.latE7 = (int32_t)v;
+      if (!getDelta(dec, next.lonE7, v)) return TRACK_MALFORMED;
+      rec.lonE7 = (int32_t)v;
+      if (rec.latE7 < -900000000 || rec.latE7 > 900000000 ||
+          rec.lonE7 < -1800000000 || rec.lonE7 > 1800000000) return TRACK_MALFORMED;
+      next.latE7 = rec.latE7;
+      next.lonE7 = rec.lonE7;
+      if (rec.flags & GNSS_HAS_ALT) {
+        if (!getDelta(dec, next.altCm, v)) return TRACK_MALFORMED;
+        rec.altCm = next.altCm = (int32_t)v;
+      }
+      if (rec.flags & GNSS_HAS_SPEED) {
+        if (!getVarint(dec, rec.speedCmS)) return TRACK_MALFORMED;
+      }
+      if (rec.flags & GNSS_HAS_COURSE) {
+        if (!getVarint(dec, v) || v >= 36000) return TRACK_MALFORMED;
+        rec.courseCdeg = (uint16_t)v;
+      }
+      break;
+    case TRACK_BATTERY:
+      if (rec.flags || !getByte(dec, rec.pct) || rec.pct > 100) return TRACK_MALFORMED;
+      break;
+    case TRACK_EVENT:
+      if ((rec.flags & ~TRACK_EVENT_HAS_ID) || !getVarint(dec, v) || v >= TRACK_EVENT_MAX || v > dec.len - dec.pos) {
+        return TRACK_MALFORMED;
+      }
+      memcpy(rec.event, dec.buf + dec.pos, v);
+      rec.event[v] = '\0';
+      dec.pos += v;
+      if ((rec.flags & TRACK_EVENT_HAS_ID) && !getVarint(dec, rec.eventId)) return TRACK_MALFORMED;
+      break;
+    default:
+      return TRACK_MALFORMED;
+  }
+
+  dec.prev = next;
+  out = rec;
+  return TRACK_OK;
+}
@@ -0,0 +1,81 @@
+#include "track_simplify.h"
+#include <math.h>
+#include <string.h>
+
+#define CM_PER_E7_LAT  1.1132f      // 1e-7 deg of latitude
+
+static float lonScale(int32_t latE7) {
+  return CM_PER_E7_LAT * cosf(latE7 * (float)(M_PI / 180.0 / 1e7));
+}
+
+static float segmentDistance(float scale, const GnssFix& a, const GnssFix& b, const GnssFix& p) {
+  float bx = (b.lonE7 - a.lonE7) * scale, by = (b.latE7 - a.latE7) * CM_PER_E7_LAT;
+  float px = (p.lonE7 - a.lonE7) * scale, py = (p.latE7 - a.latE7) * CM_PER_E7_LAT;
+  float len2 = bx * bx + by * by;
+  float t = len2 > 0.0f ? (px * bx + py * by) / len2 : 0.0f;
+  if (t < 0.0f) t = 0.0f;
+  if (t > 1.0f) t = 1.0f;
+  float dx = px - t * bx, dy = py - t * by;
+  return sqrtf(dx * dx + dy * dy);
+}
+
+uint32_t trackSegmentDistanceCm(const GnssFix& a, const GnssFix& b, const GnssFix& p) {
+  return (uint32_t)(segmentDistance(lonScale(a.latE7), a, b, p) + 0.5f);
+}
+
+void trackSimplifyBegin(TrackSimplifier& s, uint32_t toleranceCm, uint32_t deadbandCm) {
+  memset(&s, 0, sizeof(s));
+  s.toleranceCm = toleranceCm;
+  s.deadbandCm = deadbandCm;
+}
+
+static void setAnchor(TrackSimplifier& s, const GnssFix& fix) {
+  s.anchor = fix;
+  s.haveAnchor = true;
+  s.cmPerE7Lon = lonScale(fix.latE7);
+  s.stats.kept++;
+}
+
+// Every fix strictly between the anchor and the candidate end stays close
+// enough to the line anchor -> end
+static bool windowFits(const TrackSimplifier& s, const GnssFix& end) {
+  for (uint8_t i = 0; i < s.count; i++) {
+    if (segmentDistance(s.cmPerE7Lon, s.anchor, end, s.window[i]) > s.toleranceCm) return false;
+  }
+  return true;
+}
+
+bool trackSimplifyPush(TrackSimplifier& s, const GnssFix& fix, GnssFix& out) {
+  s.stats.in++;
+  if (!s.haveAnchor) {
+    setAnchor(s, fix);
+    out = fix;
+    return true;
+  }
+
+  const GnssFix& newest = s.count ? s.window[s.count - 1] : s.anchor;
+  if (segmentDistance(s.cmPerE7Lon, newest, newest, fix) <= s.deadbandCm) {
+    s.stats.deadband++;
+    return false;
+  }
+
+  if (s.count < TRACK_SIMPLIFY_WINDOW && windowFits(s, fix)) {
+    s.window[s.count++] = fix;
+    return false;
+  }
+
+  // The previous end is needed; the window restarts from it
+  out = s.window[s.count - 1];
+  setAnchor(s, out);
+  s.window[0] = fix;
+  s.count = 1;
+  return true;
+}
+
+bool trackSimplifyFlush(TrackSimplifier& s, GnssFix& out) {
+  if (!s.count) return false;
+  out = s.window[s.count - 1];
+  setAnchor(s, out);
+  s.count = 0;
+  return true;
+}
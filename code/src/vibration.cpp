@@ -0,0 +1,114 @@
+#include "vibration.h"
+#include "hal.h"
+#include <esp_timer.h>
+
+// ----------------------- Patterns -----------------------
+static const VibStep tapSteps[] = {
+  { VIB_TAP_DUTY, VIB_TAP_RAMP, 200 - VIB_TAP_RAMP },
+  { 0,            0,            0 },
+};
+
+static const VibStep doubleTapSteps[] = {
+  { VIB_TAP_DUTY, VIB_TAP_RAMP, 120 },
+  { 0,            0,            120 },
+  { VIB_TAP_DUTY, VIB_TAP_RAMP, 120 },
+  { 0,            0,            0 },
+};
+
+static const VibStep alertSteps[] = {
+  { VIB_DUTY, VIB_RAMP_MS, 60UL * 1000UL },
+  { 0,        0,           0 },
+};
+
+static const VibStep pulseSteps[] = {
+  { VIB_DUTY, VIB_RAMP_MS, 600 },
+  { 0,        100,         400 },
+};
+
+#define STEPS(a) a, (uint8_t)(sizeof(a) / sizeof(a[0]))
+
+const VibPattern VIB_PATTERN_TAP        = { STEPS(tapSteps), 1 };
+const VibPattern VIB_PATTERN_DOUBLE_TAP = { STEPS(doubleTapSteps), 1 };
+const VibPattern VIB_PATTERN_ALERT      = { STEPS(alertSteps), 1 };
+const VibPattern VIB_PATTERN_PULSE      = { STEPS(pulseSteps), 30 };
+
+// ----------------------- Timing model -----------------------
+static uint32_t patternLengthMs(const VibPattern& p) {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < p.count; i++) total += p.steps[i].rampMs + p.steps[i].holdMs;
+  return total;
+}
+
+uint8_t vibDutyAt(const VibPattern& p, uint32_t t, bool& done) {
+  uint32_t len = patternLengthMs(p);
+  uint8_t repeats = p.repeats ? p.repeats : 1;
+  done = (len == 0 || t >= len * repeats);
+  if (done) return 0;
+
+  // Later plays ramp from where the previous play ended
+  uint8_t prev = (t >= len) ? p.steps[p.count - 1].duty : 0;
+  t %= len;
+
+  for (uint8_t i = 0; i < p.count; i++) {
+    const VibStep& s = p.steps[i];
+    if (t < s.rampMs) {
+      int32_t delta = (int32_t)s.duty - prev;
+      return (uint8_t)(prev + delta * (int32_t)t / (int32_t)s.rampMs);
+    }
+    t -= s.rampMs;
+    if (t < s.holdMs) return s.duty;
+    t -= s.holdMs;
+    prev = s.duty;
+  }
+  return prev;
+}
+
+// ----------------------- Engine -----------------------
+static esp_timer_handle_t   vibTimer = nullptr;
+static const VibPattern*    current = nullptr;
+static volatile bool        playing = false;
+static uint32_t             startMs = 0;
+
+static inline void vibWrite(uint8_t duty) {
+  halPwmWrite(VIB_PWM_CH, duty);
+}
+
+static void onTick(void*) {
+  if (!playing) return;
+  bool done;
+  uint8_t duty = vibDutyAt(*current, millis() - startMs, done);
+  vibWrite(duty);
+  if (done) {
+    playing = false;
+    esp_timer_stop(vibTimer);
+  }
+}
+
+void vibBegin(uint8_t pin) {
+  halPwmBegin(pin, VIB_PWM_CH, VIB_PWM_FREQ, VIB_PWM_BITS);
+  vibWrite(0);
+
+  esp_timer_create_args_t args = {};
+  args.callback = onTick;
+  args.name = "vib";
+  esp_timer_create(&args, &vibTimer);
+}
+
+void vibPlay(const VibPattern& pattern) {
+  vibStop();
+  current = &pattern;
+  startMs = millis();
+  playing = true;
+  onTick(nullptr);
+  if (playing) esp_timer_start_periodic(vibTimer, VIB_TICK_MS * 1000);
+}
+
+void vibStop() {
+  playing = false;
+  if (vibTimer) esp_timer_stop(vibTimer);
+  vibWrite(0);
+}
+
+bool vibActive() {
+  return playing;
+}
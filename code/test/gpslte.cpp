@@ -33,7 +33,7 @@
 // #define BUTTON_A_PIN D10
 
 // // Define phone number to send SMS to
-// String phoneNumber = "+6582865626";  // Replace with your actual number
+// String phoneNumber = "+447700900123";  // Replace with your actual number
 
 // // Button state tracking
 // bool lastButtonState = HIGH;
@@ -91,7 +91,7 @@
 HardwareSerial LTEGNSS(0);  // UART0 for SIM7600
 
 #define BUTTON_A_PIN D10
-String phoneNumber = "+6582865626";  // Replace with your number
+String phoneNumber = "+447700900123";  // Replace with your number
 
 bool lastButtonState = HIGH;
 
@@ -3,15 +3,10 @@
 // quartenion and euler (yaw, pitch roll) angles.  Toggle the FAST_MODE define to see other report.  
 // Note sensorValue.status gives calibration accuracy (which improves over time)
 #include <Adafruit_BNO08x.h>
+#include "orientation.h"
 
 #define BNO08X_RESET -1
 
-struct euler_t {
-  float yaw;
-  float pitch;
-  float roll;
-} ypr;
-
 Adafruit_BNO08x  bno08x(BNO08X_RESET);
 sh2_SensorValue_t sensorValue;
 
@@ -54,32 +49,6 @@ void setup(void) {
   delay(100);
 }
 
-void quaternionToEuler(float qr, float qi, float qj, float qk, euler_t* ypr, bool degrees = false) {
-
-    float sqr = sq(qr);
-    float sqi = sq(qi);
-    float sqj = sq(qj);
-    float sqk = sq(qk);
-
-    ypr->yaw = atan2(2.0 * (qi * qj + qk * qr), (sqi - sqj - sqk + sqr));
-    ypr->pitch = asin(-2.0 * (qi * qk - qj * qr) / (sqi + sqj + sqk + sqr));
-    ypr->roll = atan2(2.0 * (qj * qk + qi * qr), (-sqi - sqj + sqk + sqr));
-
-    if (degrees) {
-      ypr->yaw *= RAD_TO_DEG;
-      ypr->pitch *= RAD_TO_DEG;
-      ypr->roll *= RAD_TO_DEG;
-    }
-}
-
-void quaternionToEulerRV(sh2_RotationVectorWAcc_t* rotational_vector, euler_t* ypr, bool degrees = false) {
-    quaternionToEuler(rotational_vector->real, rotational_vector->i, rotational_vector->j, rotational_vector->k, ypr, degrees);
-}
-
-void quaternionToEulerGI(sh2_GyroIntegratedRV_t* rotational_vector, euler_t* ypr, bool degrees = false) {
-    quaternionToEuler(rotational_vector->real, rotational_vector->i, rotational_vector->j, rotational_vector->k, ypr, degrees);
-}
-
 void loop() {
 
   if (bno08x.wasReset()) {
@@ -90,21 +59,29 @@ void loop() {
   if (bno08x.getSensorEvent(&sensorValue)) {
     // in this demo only one report type will be received depending on FAST_MODE define (above)
     switch (sensorValue.sensorId) {
-      case SH2_ARVR_STABILIZED_RV:
-        quaternionToEulerRV(&sensorValue.un.arvrStabilizedRV, &ypr, true);
-      case SH2_GYRO_INTEGRATED_RV:
+      case SH2_ARVR_STABILIZED_RV: {
+        const sh2_RotationVectorWAcc_t& rv = sensorValue.un.arvrStabilizedRV;
+        orientationUpdate(rv.real, rv.i, rv.j, rv.k, sensorValue.status);
+        break;
+      }
+      case SH2_GYRO_INTEGRATED_RV: {
         // faster (more noise?)
-        quaternionToEulerGI(&sensorValue.un.gyroIntegratedRV, &ypr, true);
+        const sh2_GyroIntegratedRV_t& rv = sensorValue.un.gyroIntegratedRV;
+        orientationUpdate(rv.real, rv.i, rv.j, rv.k, sensorValue.status);
         break;
-      
+      }
     }
     static long last = 0;
     long now = micros();
+    // Euler angles are only computed here, when printed
+    const Euler& ypr = orientationEuler();
+    long convertUs = micros() - now;
     Serial.print(now - last);             Serial.print("\t");
     last = now;
+    Serial.print(convertUs);              Serial.print("\t");
     Serial.print(sensorValue.status);     Serial.print("\t");  // This is accuracy in the range of 0 to 3
-    Serial.print(ypr.yaw);                Serial.print("\t");
-    Serial.print(ypr.pitch);              Serial.print("\t");
-    Serial.println(ypr.roll);
+    Serial.print(ypr.yaw * RAD_TO_DEG);   Serial.print("\t");
+    Serial.print(ypr.pitch * RAD_TO_DEG); Serial.print("\t");
+    Serial.println(ypr.roll * RAD_TO_DEG);
   }
-}
\ No newline at end of file
+}
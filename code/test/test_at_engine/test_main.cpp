@@ -0,0 +1,262 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "at_engine.h"
+#include "telemetry.h"
+#include "sim.h"
+
+// ----------------------- AT engine -----------------------
+// Line handling against a scripted serial stand-in, random noise on the
+// line, and one upload against the simulated SIM7600 compared with the
+// fixed delays of the old sendAT().
+
+// Answers each command line written to it with the next scripted reply,
+// due a set time after the command; raw() queues bytes regardless
+class ScriptedPort : public Stream {
+ public:
+  bool echo = false;
+  std::string written;
+
+  void reply(const char* lines, uint32_t afterMs) { script_.push_back({ lines, afterMs }); }
+  void raw(const char* bytes, uint32_t afterMs) { queue(bytes, strlen(bytes), millis() + afterMs); }
+  void reset() {
+    script_.clear();
+    rx_.clear();
+    written.clear();
+    line_.clear();
+    echo = false;
+  }
+
+  int available() override { return !rx_.empty() && rx_.front().dueMs <= millis(); }
+  int peek() override { return available() ? (uint8_t)rx_.front().c : -1; }
+  int read() override {
+    if (!available()) return -1;
+    char c = rx_.front().c;
+    rx_.erase(rx_.begin());
+    return (uint8_t)c;
+  }
+  size_t write(uint8_t c) override {
+    written += (char)c;
+    line_ += (char)c;
+    if (line_.size() < 2 || line_.compare(line_.size() - 2, 2, "\r\n") != 0) return 1;
+    if (echo) queue(line_.data(), line_.size(), millis());
+    if (!script_.empty()) {
+      std::string out;
+      for (const char* p = script_.front().lines; *p; p++) out += *p == '\n' ? std::string("\r\n") : std::string(1, *p);
+      out = "\r\n" + out + "\r\n";
+      queue(out.data(), out.size(), millis() + script_.front().afterMs);
+      script_.erase(script_.begin());
+    }
+    line_.clear();
+    return 1;
+  }
+  using Print::write;
+
+ private:
+  struct Byte { char c; uint32_t dueMs; };
+  struct Reply { const char* lines; uint32_t afterMs; };
+
+  void queue(const char* p, size_t n, uint32_t dueMs) {
+    // Bytes never overtake each other on a UART
+    if (!rx_.empty() && rx_.back().dueMs > dueMs) dueMs = rx_.back().dueMs;
+    for (size_t i = 0; i < n; i++) rx_.push_back({ p[i], dueMs });
+  }
+
+  std::vector<Byte>  rx_;
+  std::vector<Reply> script_;
+  std::string        line_;
+};
+
+static ScriptedPort port;
+static std::vector<std::string> urcs;
+
+static void onCereg(const char* line) {
+  urcs.push_back(line);
+}
+
+void setUp() {
+  port.reset();
+  urcs.clear();
+  atBegin(port);
+  atSetGateHook(nullptr);
+  delay(50);
+  atService();
+}
+
+void tearDown() {}
+
+void test_completes_on_ok_not_timeout() {
+  port.reply("OK", 5);
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT", 1000));
+  TEST_ASSERT_LESS_OR_EQUAL(8, atReply().elapsedMs);
+  TEST_ASSERT_EQUAL_STRING("AT\r\n", port.written.c_str());
+}
+
+void test_error_and_cme_error() {
+  port.reply("ERROR", 3);
+  TEST_ASSERT_EQUAL(AT_ERROR, atCommand("AT+CGPS=0"));
+  port.reply("+CME ERROR: 14", 3);
+  TEST_ASSERT_EQUAL(AT_CME_ERROR, atCommand("AT+CPIN?"));
+  TEST_ASSERT_EQUAL(14, atReply().cmeCode);
+}
+
+void test_final_urc_after_ok() {
+  port.reply("OK", 20);
+  port.raw("\r\n+HTTPACTION: 1,200,2\r\n", 900);
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+HTTPACTION=1", AT_TIMEOUT_HTTP_MS, "+HTTPACTION:"));
+  TEST_ASSERT_GREATER_OR_EQUAL(900, atReply().elapsedMs);
+  TEST_ASSERT_LESS_OR_EQUAL(910, atReply().elapsedMs);
+  TEST_ASSERT_EQUAL_STRING("+HTTPACTION: 1,200,2", atReply().text);
+}
+
+void test_echo_dropped_and_data_kept() {
+  port.echo = true;
+  port.reply("+CSQ: 20,99\nOK", 5);
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+CSQ"));
+  TEST_ASSERT_EQUAL_STRING("+CSQ: 20,99", atReply().text);
+}
+
+void test_urc_routed_unless_it_answers_the_command() {
+  static bool registered = false;
+  if (!registered) registered = atOnUrc("+CEREG:", onCereg);
+
+  port.reply("+CEREG: 5\n+CSQ: 20,99\nOK", 5);      // a URC in the middle of another reply
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+CSQ"));
+  TEST_ASSERT_EQUAL_STRING("+CSQ: 20,99", atReply().text);
+  TEST_ASSERT_EQUAL(1, urcs.size());
+  TEST_ASSERT_EQUAL_STRING("+CEREG: 5", urcs[0].c_str());
+
+  port.reply("+CEREG: 1,1\nOK", 5);                 // the answer to AT+CEREG? is not a URC
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+CEREG?"));
+  TEST_ASSERT_EQUAL_STRING("+CEREG: 1,1", atReply().text);
+  TEST_ASSERT_EQUAL(1, urcs.size());
+
+  port.raw("\r\n+CEREG: 1\r\n", 10);                 // between commands
+  delay(20);
+  atService();
+  TEST_ASSERT_EQUAL(2, urcs.size());
+}
+
+void test_prompt_without_line_end() {
+  port.raw("\r\n> ", 15);
+  TEST_ASSERT_EQUAL(AT_PROMPT, atCommand("AT+CMGS=\"+10000000000\"", 1000, ">"));
+}
+
+void test_timeout_then_late_reply_is_not_misread() {
+  TEST_ASSERT_EQUAL(AT_TIMEOUT, atCommand("AT+CFUN=1", 300));
+  TEST_ASSERT_INT_WITHIN(2, 300, atReply().elapsedMs);
+
+  port.raw("\r\nOK\r\n", 100);                       // the answer, too late
+  delay(200);
+  port.reply("ERROR", 5);
+  TEST_ASSERT_EQUAL(AT_ERROR, atCommand("AT+CGPS=0"));
+}
+
+void test_busy_and_gate() {
+  port.reply("OK", 50);
+  TEST_ASSERT_EQUAL(AT_PENDING, atStart("AT", 1000));
+  TEST_ASSERT_EQUAL(AT_BUSY, atStart("AT+CSQ", 1000));
+  while (atPoll() == AT_PENDING) delay(1);
+  TEST_ASSERT_EQUAL(AT_OK, atReply().result);
+
+  atSetGateHook([](const char*) { return false; });
+  port.written.clear();
+  TEST_ASSERT_EQUAL(AT_ABORTED, atCommand("AT+HTTPINIT"));
+  TEST_ASSERT_EQUAL(0, port.written.size());
+}
+
+void test_long_lines_stay_bounded() {
+  std::string big(3 * AT_REPLY_MAX, 'x');
+  std::string reply = big + "\n" + big + "\nOK";
+  port.reply(reply.c_str(), 5);
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+HTTPREAD=0,6144", 2000));
+  TEST_ASSERT_LESS_THAN(AT_REPLY_MAX, atReply().len);
+  TEST_ASSERT_EQUAL(atReply().len, strlen(atReply().text));
+}
+
+// Random bytes in front of and around each reply: every command ends
+// (result or timeout) and the reply stays NUL-terminated inside its buffer
+void test_fuzz_noise() {
+  static const char BYTES[] = "OKERROR+CME:>DOWNLOAD,0123456789 \r\n\r\n\x1a\xff";
+  uint32_t seed = 7, results[AT_ABORTED + 1] = {};
+  static char noise[400];
+  for (uint32_t i = 0; i < 3000; i++) {
+    size_t n = 0;
+    seed = seed * 1103515245u + 12345u;
+    size_t len = (seed >> 8) % (sizeof(noise) - 1);
+    for (; n < len; n++) {
+      seed = seed * 1103515245u + 12345u;
+      noise[n] = BYTES[(seed >> 8) % (sizeof(BYTES) - 1)];
+    }
+    noise[n] = '\0';
+    port.raw(noise, (seed >> 4) % 20);
+    if (i % 3 == 0) port.reply("OK", 10);
+    AtResult r = atCommand(i % 2 ? "AT+HTTPACTION=1" : "AT", 100, i % 2 ? "+HTTPACTION:" : nullptr);
+    TEST_ASSERT_NOT_EQUAL(AT_PENDING, r);
+    TEST_ASSERT_LESS_THAN(AT_REPLY_MAX, atReply().len);
+    TEST_ASSERT_EQUAL(atReply().len, strlen(atReply().text));
+    results[r]++;
+  }
+  char msg[120];
+  snprintf(msg, sizeof(msg), "3000 commands in noise: %lu OK, %lu ERROR, %lu CME, %lu prompt, %lu timeout",
+           (unsigned long)results[AT_OK], (unsigned long)results[AT_ERROR], (unsigned long)results[AT_CME_ERROR],
+           (unsigned long)results[AT_PROMPT], (unsigned long)results[AT_TIMEOUT]);
+  TEST_MESSAGE(msg);
+}
+
+// ----------------------- Benchmark -----------------------
+// The old uploadGPS() against the simulated modem: same commands, each
+// ending on its result instead of a fixed delay
+static const uint32_t OLD_POST_MS = 300 + 500 + 300 + 300 + 300 + 200 + 400 + 6000 + 800 + 300;
+
+void test_upload_cycle_vs_fixed_delays() {
+  atBegin(simModem());
+  const char json[] = "{\"gps\":{\"lat\":47.376000,\"lon\":8.540000}}";
+  char cmd[48];
+  uint32_t start = millis();
+  atCommand("AT+HTTPTERM");
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+HTTPINIT"));
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+HTTPPARA=\"CID\",1"));
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+HTTPPARA=\"URL\",\"http://ma8w.ddns.net:3000/api/upload/gps\""));
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+HTTPPARA=\"CONTENT\",\"application/json\""));
+  snprintf(cmd, sizeof(cmd), "AT+HTTPDATA=%u,10000", (unsigned)strlen(json));
+  TEST_ASSERT_EQUAL(AT_PROMPT, atCommand(cmd, 1000, "DOWNLOAD"));
+  TEST_ASSERT_EQUAL(AT_OK, atSendData(json, strlen(json), 10000));
+  TEST_ASSERT_EQUAL(AT_OK, atCommand("AT+HTTPACTION=1", AT_TIMEOUT_HTTP_MS, "+HTTPACTION:"));
+  atCommand("AT+HTTPTERM");
+  uint32_t engineMs = millis() - start;
+
+  // Today's cycle: one combined POST on a session kept open
+  static CommandBatch commands;
+  GnssFix fix = {};
+  fix.latE7 = 473760000;
+  fix.lonE7 = 85400000;
+  telemetrySend(&fix, 80, commands);          // opens the session
+  start = millis();
+  TEST_ASSERT_TRUE(telemetrySend(&fix, 79, commands));
+  uint32_t cycleMs = millis() - start;
+
+  TEST_ASSERT_LESS_THAN(OLD_POST_MS, engineMs);
+  char msg[160];
+  snprintf(msg, sizeof(msg), "one POST: fixed delays %lu ms, AT engine %lu ms (%.1fx); combined telemetry POST %lu ms",
+           (unsigned long)OLD_POST_MS, (unsigned long)engineMs, (double)OLD_POST_MS / engineMs,
+           (unsigned long)cycleMs);
+  TEST_MESSAGE(msg);
+}
+
+int main() {
+  simSetLogHook(nullptr, false);
+  UNITY_BEGIN();
+  RUN_TEST(test_completes_on_ok_not_timeout);
+  RUN_TEST(test_error_and_cme_error);
+  RUN_TEST(test_final_urc_after_ok);
+  RUN_TEST(test_echo_dropped_and_data_kept);
+  RUN_TEST(test_urc_routed_unless_it_answers_the_command);
+  RUN_TEST(test_prompt_without_line_end);
+  RUN_TEST(test_timeout_then_late_reply_is_not_misread);
+  RUN_TEST(test_busy_and_gate);
+  RUN_TEST(test_long_lines_stay_bounded);
+  RUN_TEST(test_fuzz_noise);
+  RUN_TEST(test_upload_cycle_vs_fixed_delays);
+  return UNITY_END();
+}
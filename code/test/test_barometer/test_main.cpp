@@ -0,0 +1,175 @@
+#include <unity.h>
+#include <math.h>
+#include "barometer.h"
+#include "hal.h"
+#include "sim.h"
+
+// ----------------------- Barometer -----------------------
+// The BMP390 driver on the simulator's sensor model: floor changes and
+// drops while sampling continuously, and hours of weather drift while the
+// wearer is still and the sensor only wakes for one batch every
+// BARO_IDLE_PERIOD_MS, which must not read as floors.
+// There are no recorded BMP390 traces yet, so the altitude profiles are
+// synthetic: a 3.2 m storey climbed in 15 s, a 1 m drop in 0.3 s, ~3 hPa of
+// weather over a day with the diurnal swing, and the sensor's +/-0.3 Pa
+// noise added by the simulator.
+
+#define GROUND_CM   4500         // the school is 45 m above sea level
+#define STEP_MS     20
+
+typedef float (*Profile)(uint32_t ms);    // altitude over time, cm
+
+struct Seen {
+  uint32_t drops, up, down;
+  int32_t  lastDeltaCm;
+};
+
+static Seen run(Profile profile, uint32_t ms) {
+  Seen seen = {};
+  for (uint32_t t = 0; t < ms; t += STEP_MS) {
+    simSetAltitudeCm(profile(t));
+    delay(STEP_MS);
+    baroPoll();
+    BaroEvent ev;
+    while (baroEvent(ev)) {
+      if (ev.type == BARO_DROP) seen.drops++;
+      if (ev.type == BARO_FLOOR_UP) seen.up++;
+      if (ev.type == BARO_FLOOR_DOWN) seen.down++;
+      seen.lastDeltaCm = ev.deltaCm;
+    }
+  }
+  return seen;
+}
+
+static float ground(uint32_t) {
+  return GROUND_CM;
+}
+
+// Up one storey over 15 s
+static float stairsUp(uint32_t ms) {
+  return GROUND_CM + 320.0f * fminf(ms, 15000) / 15000;
+}
+
+static float stairsDown(uint32_t ms) {
+  return GROUND_CM + 320.0f - 320.0f * fminf(ms, 15000) / 15000;
+}
+
+// A metre down in 0.3 s
+static float drop(uint32_t ms) {
+  return ms < 2000 ? GROUND_CM : GROUND_CM - 100.0f * fminf(ms - 2000, 300) / 300;
+}
+
+// Pressure falling ~3 hPa over a school day as a front comes in (the
+// altitude reading climbs ~25 m), with the diurnal swing on top
+static uint32_t weatherStartMs = 0;
+
+static float weather(uint32_t ms) {
+  float h = (weatherStartMs + ms) / 3600000.0f;
+  return GROUND_CM + 2500.0f * h / 8 + 300.0f * sinf(h * 2 * (float)M_PI / 12);
+}
+
+// Weather drift while sampling continuously, ~2 m an hour
+static float slowDrift(uint32_t ms) {
+  return GROUND_CM + 200.0f * ms / 3600000.0f;
+}
+
+void setUp() {
+  baroSetContinuous(true);
+  run(ground, 10000);
+}
+
+void tearDown() {}
+
+// ----------------------- Continuous -----------------------
+void test_floor_up_and_down() {
+  Seen s = run(stairsUp, 30000);
+  TEST_ASSERT_EQUAL_UINT32(1, s.up);
+  TEST_ASSERT_EQUAL_UINT32(0, s.down);
+  TEST_ASSERT_EQUAL_UINT32(0, s.drops);
+  TEST_ASSERT_INT_WITHIN(30, BARO_FLOOR_CM, s.lastDeltaCm);
+
+  s = run(stairsDown, 30000);
+  TEST_ASSERT_EQUAL_UINT32(0, s.up);
+  TEST_ASSERT_EQUAL_UINT32(1, s.down);
+}
+
+void test_sudden_drop() {
+  Seen s = run(drop, 5000);
+  TEST_ASSERT_EQUAL_UINT32(1, s.drops);
+  TEST_ASSERT_EQUAL_UINT32(0, s.up + s.down);
+  TEST_ASSERT_TRUE(s.lastDeltaCm <= -BARO_DROP_CM);
+}
+
+// The reference follows drift that is slow next to a storey
+void test_continuous_drift_absorbed() {
+  Seen s = run(slowDrift, 3600000);
+  TEST_ASSERT_EQUAL_UINT32(0, s.up + s.down + s.drops);
+}
+
+// INT is on a strapping pin: released between batches, so a reset with the
+// sensor powered still boots from flash
+void test_int_idles_high() {
+  uint32_t samples = baroStats().samples;
+  uint32_t low = 0;
+  for (int i = 0; i < 500; i++) {
+    delay(STEP_MS);
+    baroPoll();
+    low += halPinRead(BARO_INT_PIN) == LOW;
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, low);
+  TEST_ASSERT_UINT32_WITHIN(BARO_WATERMARK, 500 * STEP_MS * BARO_RATE_HZ / 1000, baroStats().samples - samples);
+}
+
+// ----------------------- Duty-cycled -----------------------
+void test_still_day_no_floors() {
+  baroSetContinuous(false);
+  uint32_t samples = baroStats().samples;
+  Seen s = {};
+  weatherStartMs = 0;
+  for (int hour = 0; hour < 8; hour++) {
+    Seen h = run(weather, 3600000);
+    s.up += h.up;
+    s.down += h.down;
+    s.drops += h.drops;
+    weatherStartMs += 3600000;
+  }
+  char msg[120];
+  snprintf(msg, sizeof(msg), "8 h still, ~25 m of pressure drift: %lu floor events, %lu drops, %lu samples",
+           (unsigned long)(s.up + s.down), (unsigned long)s.drops, (unsigned long)(baroStats().samples - samples));
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(0, s.up + s.down + s.drops);
+  // One batch per idle period, not continuous sampling
+  TEST_ASSERT_UINT32_WITHIN(8 * 3600 / (BARO_IDLE_PERIOD_MS / 1000) * BARO_WATERMARK / 10,
+                            8 * 3600 / (BARO_IDLE_PERIOD_MS / 1000) * BARO_WATERMARK,
+                            baroStats().samples - samples);
+}
+
+// Moving again after the still day: the wake is not a floor, the stairs are
+static float weatherThenStairs(uint32_t ms) {
+  return weather(ms) + 320.0f * fminf(ms, 15000) / 15000;
+}
+
+void test_wake_then_floor() {
+  baroSetContinuous(false);
+  weatherStartMs = 0;
+  run(weather, 3 * 3600000);
+  weatherStartMs = 3 * 3600000;
+  baroSetContinuous(true);
+  Seen s = run(weatherThenStairs, 30000);
+  TEST_ASSERT_EQUAL_UINT32(1, s.up);
+  TEST_ASSERT_EQUAL_UINT32(0, s.down + s.drops);
+}
+
+int main() {
+  simSetLogHook(nullptr, false);
+  simSetAltitudeCm(GROUND_CM);
+  UNITY_BEGIN();
+  TEST_ASSERT_TRUE(baroBegin());
+  RUN_TEST(test_floor_up_and_down);
+  RUN_TEST(test_sudden_drop);
+  RUN_TEST(test_continuous_drift_absorbed);
+  RUN_TEST(test_int_idles_high);
+  RUN_TEST(test_still_day_no_floors);
+  RUN_TEST(test_wake_then_floor);
+  return UNITY_END();
+}
@@ -0,0 +1,337 @@
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include "alloc_counter.h"
+#include "commands.h"
+#include "fall_detector.h"
+#include "imu.h"
+#include "motion.h"
+#include "sim.h"
+
+// ----------------------- Remote commands -----------------------
+// The command parser on known bodies, every chunking of a body, the bodies
+// it must refuse, and a mutation fuzzer over bodies cut into random chunks
+// the way AT+HTTPREAD hands them out: nothing out of range comes through,
+// the arena stays inside COMMAND_ARENA_BYTES and the heap is never touched.
+// Then the redelivery rule: an ID is remembered only once its command ran.
+
+#define FUZZ_BODIES 200000
+
+static const char BATCH[] =
+  "{\"commands\":[{\"id\":\"c1\",\"command\":\"vibrate\",\"pattern\":\"pulse\"},"
+  "{\"id\":\"c2\",\"command\":\"stop\"},{\"id\":\"c3\",\"command\":\"locate\"},"
+  "{\"id\":\"c4\",\"command\":\"set_rate\",\"period_s\":30},"
+  "{\"id\":\"c5\",\"command\":\"set_thresholds\",\"free_fall_mg\":350,\"impact_mg\":3000}],"
+  "\"server_time\":1792224900,\"note\":\"fields outside the filter are skipped\"}";
+
+static uint32_t rng = 2463534242u;
+
+static uint32_t next() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static bool parse(const std::string& body, CommandBatch& out) {
+  return commandParseText(body.data(), body.size(), out);
+}
+
+// Hands a body out in pieces of up to maxChunk bytes, random if asked
+struct Chunks {
+  const std::string* body;
+  size_t             pos, maxChunk;
+  bool               random;
+};
+
+static size_t chunkOut(void* ctx, const char*& chunk) {
+  Chunks& c = *(Chunks*)ctx;
+  size_t left = c.body->size() - c.pos;
+  size_t n = c.random ? 1 + next() % c.maxChunk : c.maxChunk;
+  if (n > left) n = left;
+  chunk = c.body->data() + c.pos;
+  c.pos += n;
+  return n;
+}
+
+static bool parseChunked(const std::string& body, size_t maxChunk, bool random, CommandBatch& out) {
+  Chunks c = { &body, 0, maxChunk, random };
+  return commandParse(chunkOut, &c, out);
+}
+
+static bool plainId(const char* id) {
+  size_t n = strlen(id);
+  if (n >= COMMAND_ID_MAX) return false;
+  for (size_t i = 0; i < n; i++) {
+    char c = id[i];
+    if (!isalnum((unsigned char)c) && c != '_' && c != '.' && c != ':' && c != '-') return false;
+  }
+  return true;
+}
+
+// What main.cpp's runCommand() would be allowed to act on
+static void checkSane(const CommandBatch& b) {
+  TEST_ASSERT_TRUE(b.count <= COMMAND_MAX);
+  for (uint8_t i = 0; i < b.count; i++) {
+    const Command& c = b.items[i];
+    TEST_ASSERT_TRUE(c.type <= COMMAND_SET_THRESHOLDS);
+    TEST_ASSERT_TRUE(plainId(c.id));
+    if (!c.valid) continue;
+    if (c.type == COMMAND_VIBRATE) TEST_ASSERT_NOT_NULL(c.pattern);
+    if (c.type == COMMAND_SET_RATE) {
+      TEST_ASSERT_TRUE(c.periodS == 0 || (c.periodS >= MOTION_MIN_PERIOD_MS / 1000 &&
+                                          c.periodS <= MOTION_STILL_PERIOD_MS / 1000));
+    }
+    if (c.type == COMMAND_SET_THRESHOLDS) {
+      TEST_ASSERT_TRUE(c.freeFallMg || c.impactMg);
+      TEST_ASSERT_TRUE(!c.freeFallMg || (c.freeFallMg >= FALL_FREE_FALL_MG_MIN &&
+                                         c.freeFallMg <= FALL_FREE_FALL_MG_MAX));
+      TEST_ASSERT_TRUE(!c.impactMg || (c.impactMg >= FALL_IMPACT_MG_MIN && c.impactMg <= FALL_IMPACT_MG_MAX));
+    }
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ----------------------- Bodies -----------------------
+void test_batch() {
+  static CommandBatch b;
+  TEST_ASSERT_TRUE(parse(BATCH, b));
+  TEST_ASSERT_EQUAL_UINT8(5, b.count);
+  for (uint8_t i = 0; i < b.count; i++) TEST_ASSERT_TRUE(b.items[i].valid);
+  TEST_ASSERT_EQUAL(COMMAND_VIBRATE, b.items[0].type);
+  TEST_ASSERT_EQUAL_STRING("c1", b.items[0].id);
+  TEST_ASSERT_EQUAL_PTR(&VIB_PATTERN_PULSE, b.items[0].pattern);
+  TEST_ASSERT_EQUAL(COMMAND_STOP, b.items[1].type);
+  TEST_ASSERT_EQUAL(COMMAND_LOCATE, b.items[2].type);
+  TEST_ASSERT_EQUAL(COMMAND_SET_RATE, b.items[3].type);
+  TEST_ASSERT_EQUAL_UINT32(30, b.items[3].periodS);
+  TEST_ASSERT_EQUAL(COMMAND_SET_THRESHOLDS, b.items[4].type);
+  TEST_ASSERT_EQUAL_UINT16(350, b.items[4].freeFallMg);
+  TEST_ASSERT_EQUAL_UINT16(3000, b.items[4].impactMg);
+  TEST_ASSERT_EQUAL_STRING("set_thresholds", commandTypeName(b.items[4].type));
+}
+
+void test_single_and_defaults() {
+  static CommandBatch b;
+  TEST_ASSERT_TRUE(parse("{\"id\":7,\"command\":\"vibrate\"}", b));
+  TEST_ASSERT_EQUAL_UINT8(1, b.count);
+  TEST_ASSERT_EQUAL_STRING("7", b.items[0].id);                // numeric IDs go back as text
+  TEST_ASSERT_EQUAL_PTR(&VIB_PATTERN_ALERT, b.items[0].pattern);
+  TEST_ASSERT_TRUE(b.items[0].valid);
+
+  TEST_ASSERT_TRUE(parse("{\"id\":\"r\",\"command\":\"set_rate\",\"period_s\":0}", b));
+  TEST_ASSERT_TRUE(b.items[0].valid);                          // back to the motion schedule
+  TEST_ASSERT_TRUE(parse("{\"server_time\":1792224900}", b));
+  TEST_ASSERT_EQUAL_UINT8(0, b.count);                         // nothing queued
+}
+
+// Parsed, but not to be run: acked "invalid" or "unknown"
+void test_out_of_range() {
+  static const char* const BAD[] = {
+    "{\"id\":\"a\",\"command\":\"vibrate\",\"pattern\":\"siren\"}",
+    "{\"id\":\"a\",\"command\":\"set_rate\",\"period_s\":1}",
+    "{\"id\":\"a\",\"command\":\"set_rate\",\"period_s\":86400}",
+    "{\"id\":\"a\",\"command\":\"set_rate\",\"period_s\":-30}",
+    "{\"id\":\"a\",\"command\":\"set_rate\",\"period_s\":\"30\"}",
+    "{\"id\":\"a\",\"command\":\"set_rate\"}",
+    "{\"id\":\"a\",\"command\":\"set_thresholds\"}",
+    "{\"id\":\"a\",\"command\":\"set_thresholds\",\"free_fall_mg\":50}",
+    "{\"id\":\"a\",\"command\":\"set_thresholds\",\"impact_mg\":90000}",
+    "{\"id\":\"a\",\"command\":\"set_thresholds\",\"free_fall_mg\":350,\"impact_mg\":100}",
+  };
+  static CommandBatch b;
+  for (const char* body : BAD) {
+    TEST_ASSERT_TRUE_MESSAGE(parse(body, b), body);
+    TEST_ASSERT_EQUAL_UINT8(1, b.count);
+    TEST_ASSERT_FALSE_MESSAGE(b.items[0].valid, body);
+  }
+  TEST_ASSERT_TRUE(parse("{\"id\":\"a\",\"command\":\"reboot\"}", b));
+  TEST_ASSERT_EQUAL(COMMAND_UNKNOWN, b.items[0].type);
+}
+
+// IDs are echoed into ack JSON: anything that is not plain is dropped
+void test_ids() {
+  static const char* const DROPPED[] = {
+    "\"a\\\"b\"", "\"a b\"", "\"\"", "\"abcdefghijklmnopqrstuvwxyz\"", "-1", "1.5", "[1]", "{}",
+  };
+  static CommandBatch b;
+  for (const char* id : DROPPED) {
+    std::string body = std::string("{\"id\":") + id + ",\"command\":\"stop\"}";
+    TEST_ASSERT_TRUE_MESSAGE(parse(body, b), id);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("", b.items[0].id, id);
+  }
+  TEST_ASSERT_TRUE(parse("{\"id\":\"job-12:a_b.3\",\"command\":\"stop\"}", b));
+  TEST_ASSERT_EQUAL_STRING("job-12:a_b.3", b.items[0].id);
+}
+
+// Past COMMAND_MAX the rest wait for the next body, unacked
+void test_too_many() {
+  std::string body = "{\"commands\":[";
+  for (int i = 0; i < COMMAND_MAX + 4; i++) {
+    body += (i ? ",{\"id\":\"" : "{\"id\":\"") + std::to_string(i) + "\",\"command\":\"stop\"}";
+  }
+  body += "]}";
+  static CommandBatch b;
+  TEST_ASSERT_TRUE(parse(body, b));
+  TEST_ASSERT_EQUAL_UINT8(COMMAND_MAX, b.count);
+  TEST_ASSERT_EQUAL_STRING(std::to_string(COMMAND_MAX - 1).c_str(), b.items[COMMAND_MAX - 1].id);
+}
+
+// The same commands whatever the chunking, down to a byte at a time
+void test_every_chunking() {
+  static CommandBatch whole, cut;
+  TEST_ASSERT_TRUE(parse(BATCH, whole));
+  std::string body = BATCH;
+  for (size_t n = 1; n <= body.size(); n++) {
+    TEST_ASSERT_TRUE(parseChunked(body, n, false, cut));
+    TEST_ASSERT_EQUAL_UINT8(whole.count, cut.count);
+    TEST_ASSERT_EQUAL_MEMORY(whole.items, cut.items, sizeof(Command) * whole.count);
+  }
+}
+
+// Refused whole: nothing from them runs
+void test_rejected() {
+  std::string deep = "{\"commands\":[{\"id\":\"a\",\"command\":\"stop\",\"x\":[[[[[[1]]]]]]}]}";
+  std::string wide = "{\"commands\":[";
+  for (int i = 0; i < 200; i++) wide += "{\"id\":\"w\",\"command\":\"stop\"},";
+  wide += "{}]}";
+  std::string longId = "{\"id\":\"" + std::string(COMMAND_ARENA_BYTES, 'a') + "\",\"command\":\"stop\"}";
+  const std::string BAD[] = {
+    "", "{", "{\"id\":\"a\",\"command\":\"stop\"", "{\"id\":\"a\",\"command\":\"st", "[1,2", "nul",
+    "{\"commands\":[{\"id\":\"a\",\"command\":\"stop\"},", "\"just a string", deep, wide, longId,
+  };
+  static CommandBatch b;
+  uint32_t rejected = commandStats().rejected;
+  for (const std::string& body : BAD) {
+    TEST_ASSERT_FALSE_MESSAGE(parse(body, b), body.substr(0, 60).c_str());
+    TEST_ASSERT_EQUAL_UINT8(0, b.count);
+  }
+  TEST_ASSERT_EQUAL_UINT32(sizeof(BAD) / sizeof(BAD[0]), commandStats().rejected - rejected);
+}
+
+// ----------------------- Fuzz -----------------------
+static const char* const SEEDS[] = {
+  BATCH,
+  "{\"id\":\"m1\",\"command\":\"locate\"}",
+  "{\"id\":42,\"command\":\"set_thresholds\",\"impact_mg\":2500}",
+  "{\"commands\":[{\"id\":\"a\",\"command\":\"set_rate\",\"period_s\":300},{\"id\":\"b\",\"command\":\"vibrate\","
+  "\"pattern\":\"double\"}]}",
+};
+
+// Bytes that steer the tokenizer: structure, escapes, digits, signs
+static const char TOKENS[] = "{}[]\",:\\-+.0123456789eEtfnu \x00\xff";
+
+static void mutate(std::string& s) {
+  int edits = 1 + next() % 6;
+  for (int e = 0; e < edits && !s.empty(); e++) {
+    size_t at = next() % s.size();
+    switch (next() % 7) {
+      case 0: s[at] = (char)next(); break;
+      case 1: s[at] = TOKENS[next() % (sizeof(TOKENS) - 1)]; break;
+      case 2: s.erase(at, 1 + next() % 8); break;
+      case 3: s.insert(at, 1, TOKENS[next() % (sizeof(TOKENS) - 1)]); break;
+      case 4: s.insert(at, s.substr(next() % s.size(), 1 + next() % 40)); break;   // repeat a piece
+      case 5: s.resize(at); break;
+      default: s.insert(at, std::string(1 + next() % 600, (char)('a' + next() % 26))); break;
+    }
+  }
+}
+
+void test_fuzz() {
+  static CommandBatch b;
+  CommandStats before = commandStats();
+  uint32_t ok = 0, commands = 0, valid = 0;
+  double ns = 0;
+  for (uint32_t i = 0; i < FUZZ_BODIES; i++) {
+    std::string body = SEEDS[next() % (sizeof(SEEDS) / sizeof(SEEDS[0]))];
+    mutate(body);
+    uint32_t allocs = allocCount();
+    auto start = std::chrono::steady_clock::now();
+    bool parsed = parseChunked(body, 240, true, b);
+    ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_EQUAL_UINT32(0, allocCount() - allocs);
+    if (!parsed) {
+      TEST_ASSERT_EQUAL_UINT8(0, b.count);
+      continue;
+    }
+    ok++;
+    commands += b.count;
+    checkSane(b);
+    for (uint8_t k = 0; k < b.count; k++) valid += b.items[k].valid && b.items[k].type != COMMAND_UNKNOWN;
+  }
+  const CommandStats& s = commandStats();
+  char msg[200];
+  snprintf(msg, sizeof(msg), "%d mutated bodies: %lu parsed (%lu commands, %lu runnable), %lu rejected; "
+           "arena peak %lu of %d B, %.0f ns per body", FUZZ_BODIES, (unsigned long)ok,
+           (unsigned long)commands, (unsigned long)valid, (unsigned long)(s.rejected - before.rejected),
+           (unsigned long)s.arenaPeak, COMMAND_ARENA_BYTES, ns / FUZZ_BODIES);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(FUZZ_BODIES, s.bodies - before.bodies + s.rejected - before.rejected);
+  TEST_ASSERT_TRUE(s.arenaPeak <= COMMAND_ARENA_BYTES);
+  TEST_ASSERT_TRUE(ok > 0 && valid > 0);
+}
+
+// ----------------------- Redelivery -----------------------
+// runCommand() in main.cpp, for set_thresholds: skip what ran, record
+// only once it ran
+static const char* run(const Command& c) {
+  if (!c.valid) return "invalid";
+  if (commandSeen(c.id)) return "done";
+  if (!fallSetThresholds(c.freeFallMg, c.impactMg)) return "invalid";
+  commandRecord(c.id);
+  return "done";
+}
+
+void test_failed_command_runs_again() {
+  static CommandBatch b;
+  TEST_ASSERT_TRUE(parse("{\"id\":\"t1\",\"command\":\"set_thresholds\",\"impact_mg\":7000}", b));
+  TEST_ASSERT_TRUE(b.items[0].valid);
+
+  // 7 g is past what a +/-4 g sensor can read: refused, not remembered
+  fallBegin(IMU_RATE_HZ, IMU_FULL_SCALE_MG);
+  TEST_ASSERT_EQUAL_STRING("invalid", run(b.items[0]));
+  TEST_ASSERT_FALSE(commandSeen("t1"));
+
+  // Redelivered after the +/-8 g sensor took over: it runs this time
+  fallBegin(MOTION_ACCEL_HZ, MOTION_ACCEL_FULL_SCALE_MG);
+  TEST_ASSERT_EQUAL_STRING("done", run(b.items[0]));
+  TEST_ASSERT_TRUE(commandSeen("t1"));
+  TEST_ASSERT_TRUE(fallSetThresholds(0, 7000));
+
+  // And once more: acked, not run against the +/-4 g limit again
+  fallBegin(IMU_RATE_HZ, IMU_FULL_SCALE_MG);
+  TEST_ASSERT_EQUAL_STRING("done", run(b.items[0]));
+}
+
+// The last COMMAND_RECENT IDs are kept; recording one twice takes one slot
+void test_recent_ids() {
+  for (int i = 0; i < COMMAND_RECENT; i++) commandRecord(("r" + std::to_string(i)).c_str());
+  commandRecord("r0");
+  TEST_ASSERT_TRUE(commandSeen("r0"));
+  TEST_ASSERT_TRUE(commandSeen(("r" + std::to_string(COMMAND_RECENT - 1)).c_str()));
+  commandRecord("new");
+  TEST_ASSERT_TRUE(commandSeen("new"));
+  TEST_ASSERT_FALSE(commandSeen("r0"));
+  TEST_ASSERT_TRUE(commandSeen("r1"));
+
+  commandRecord("");                   // no ID: never remembered, always runs
+  TEST_ASSERT_FALSE(commandSeen(""));
+}
+
+int main() {
+  simSetLogHook(nullptr, false);
+  UNITY_BEGIN();
+  RUN_TEST(test_batch);
+  RUN_TEST(test_single_and_defaults);
+  RUN_TEST(test_out_of_range);
+  RUN_TEST(test_ids);
+  RUN_TEST(test_too_many);
+  RUN_TEST(test_every_chunking);
+  RUN_TEST(test_rejected);
+  RUN_TEST(test_fuzz);
+  RUN_TEST(test_failed_command_runs_again);
+  RUN_TEST(test_recent_ids);
+  return UNITY_END();
+}
@@ -0,0 +1,273 @@
+#include <unity.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "fall_detector.h"
+#include "imu.h"
+#include "motion.h"
+
+// ----------------------- Fall detection -----------------------
+// The impact threshold against the sensor's full scale, the snapshot
+// around a fall, and a replay of synthetic falls and everyday movement at
+// the LSM6DSL rate: detection rate, false-positive rate and CPU per sample.
+// Traces are clipped to +/-4 g like the real FIFO data.
+
+#define RATE_HZ   IMU_RATE_HZ
+#define CLIP_MG   3997       // 32767 * 0.122 mg
+#define RUNS      200        // of each kind
+
+// ----------------------- Trace building -----------------------
+static uint32_t rng = 12345;
+
+static uint32_t nextRand() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static float uniform(float lo, float hi) {
+  return lo + (hi - lo) * (nextRand() % 10000) / 10000.0f;
+}
+
+struct Vec {
+  float x, y, z;
+};
+
+static Vec randomDir() {
+  for (;;) {
+    Vec v = { uniform(-1, 1), uniform(-1, 1), uniform(-1, 1) };
+    float n = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (n > 0.2f && n <= 1) return { v.x / n, v.y / n, v.z / n };
+  }
+}
+
+static int16_t clip(float mg) {
+  return (int16_t)fmaxf(-CLIP_MG, fminf(CLIP_MG, mg + uniform(-25, 25)));
+}
+
+struct Trace {
+  std::vector<AccelSample> s;
+
+  // mg along dir for ms
+  void hold(const Vec& dir, float mg, uint32_t ms) {
+    for (uint32_t i = 0; i < ms * RATE_HZ / 1000; i++) s.push_back({ clip(dir.x * mg), clip(dir.y * mg), clip(dir.z * mg) });
+  }
+  // Gait: 1 g with a vertical swing of amp mg at hz steps per second
+  void walk(const Vec& up, float amp, float hz, uint32_t ms) {
+    for (uint32_t i = 0; i < ms * RATE_HZ / 1000; i++) {
+      float mg = 1000 + amp * sinf(2 * (float)M_PI * hz * i / RATE_HZ);
+      s.push_back({ clip(up.x * mg), clip(up.y * mg), clip(up.z * mg) });
+    }
+  }
+  void hit(const Vec& dir, float peakMg, uint32_t samples) {
+    for (uint32_t i = 0; i < samples; i++) {
+      float mg = peakMg * (i == samples / 2 ? 1.0f : 0.6f);
+      s.push_back({ clip(dir.x * mg), clip(dir.y * mg), clip(dir.z * mg) });
+    }
+  }
+};
+
+static const Vec UP = { 0, 0, 1 };
+
+// Walking, then a drop of 80-450 ms, a hit of 2-6 g from any side with a
+// bounce or two, then lying still in whatever orientation. Short drops onto
+// something soft land under FALL_IMPACT_MG and are expected to be missed.
+// Returns whether the hit was clearly over the threshold.
+static bool makeFall(Trace& t) {
+  t.walk(UP, uniform(200, 400), uniform(1.6f, 2.2f), 2000);
+  t.hold(randomDir(), uniform(50, 300), (uint32_t)uniform(80, 450));
+  float peak = uniform(2000, 6000);
+  t.hit(randomDir(), peak, 1 + nextRand() % 4);
+  for (uint32_t b = nextRand() % 3; b; b--) {
+    t.hold(randomDir(), uniform(600, 1500), 120);
+    t.hit(randomDir(), uniform(1300, 2000), 2);
+  }
+  t.hold(randomDir(), 1000, (uint32_t)uniform(400, 800));
+  t.hold(randomDir(), 1000, 4000);
+  return peak > FALL_IMPACT_MG + 100;
+}
+
+enum Adl : uint8_t { ADL_JUMP, ADL_JUMP_STAND, ADL_RUN, ADL_STAIRS, ADL_SIT, ADL_STUMBLE, ADL_COUNT };
+static const char* const ADL_NAMES[ADL_COUNT] = { "jump", "jump and stand", "run", "stairs", "sit down hard",
+                                                  "stumble" };
+
+// Everyday movement, some of it with a real free fall and a hard landing
+static void makeAdl(Trace& t, Adl kind) {
+  t.walk(UP, uniform(200, 400), uniform(1.6f, 2.2f), 2000);
+  switch (kind) {
+    case ADL_JUMP:            // off a wall or a step, then carrying on
+      t.hold(UP, uniform(50, 250), (uint32_t)uniform(150, 400));
+      t.hit(UP, uniform(2800, 4500), 3);
+      t.walk(UP, uniform(300, 500), 2.0f, 4000);
+      break;
+    case ADL_JUMP_STAND:      // the same landing, then standing and swaying
+      t.hold(UP, uniform(50, 250), (uint32_t)uniform(150, 400));
+      t.hit(UP, uniform(2800, 4500), 3);
+      t.walk(UP, 300, 2.0f, 1000);
+      t.walk(UP, uniform(100, 400), uniform(0.5f, 1.5f), 4000);
+      break;
+    case ADL_RUN:             // flight phases of ~100 ms and 2.5-3.5 g footfalls
+      for (int i = 0; i < 12; i++) {
+        t.hold(UP, uniform(100, 300), (uint32_t)uniform(80, 140));
+        t.hit(UP, uniform(2500, 3500), 3);
+        t.walk(UP, 300, 3.0f, 150);
+      }
+      t.walk(UP, 300, 2.0f, 2000);
+      break;
+    case ADL_STAIRS:          // running down, never below ~0.5 g
+      for (int i = 0; i < 10; i++) {
+        t.hold(UP, uniform(450, 650), 150);
+        t.hit(UP, uniform(1600, 2200), 3);
+        t.walk(UP, 300, 2.5f, 200);
+      }
+      break;
+    case ADL_SIT:             // drop onto a chair, then sitting still
+      t.hold(UP, uniform(450, 700), 250);
+      t.hit(UP, uniform(1800, 2600), 3);
+      t.hold(randomDir(), 1000, 5000);
+      break;
+    case ADL_STUMBLE:         // a moment of lightness and a hard step, no landing
+      t.hold(UP, uniform(200, 380), (uint32_t)uniform(20, 50));
+      t.hit(UP, uniform(2600, 3500), 2);
+      t.walk(UP, 400, 2.0f, 4000);
+      break;
+    default:
+      break;
+  }
+  t.walk(UP, 300, 2.0f, 1000);
+}
+
+static uint32_t replay(const Trace& t, double& ns) {
+  fallBegin(RATE_HZ, IMU_FULL_SCALE_MG);
+  auto start = std::chrono::steady_clock::now();
+  // In FIFO-sized blocks like imuPoll() hands them over
+  for (size_t i = 0; i < t.s.size(); i += IMU_WATERMARK) {
+    fallFeed(&t.s[i], t.s.size() - i < IMU_WATERMARK ? t.s.size() - i : IMU_WATERMARK);
+  }
+  ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  uint32_t falls = 0;
+  FallEvent ev;
+  while (fallPoll(ev)) falls++;
+  return falls;
+}
+
+void setUp() {
+  fallBegin(RATE_HZ, IMU_FULL_SCALE_MG);
+  fallSetThresholds(FALL_FREE_FALL_MG, FALL_IMPACT_MG);
+}
+
+void tearDown() {}
+
+// ----------------------- Thresholds -----------------------
+void test_impact_threshold_within_full_scale() {
+  TEST_ASSERT_EQUAL_UINT16(IMU_FULL_SCALE_MG - FALL_IMPACT_HEADROOM_MG, fallImpactMaxMg());
+  TEST_ASSERT_FALSE(fallSetThresholds(0, 16000));
+  TEST_ASSERT_FALSE(fallSetThresholds(0, IMU_FULL_SCALE_MG));
+  TEST_ASSERT_TRUE(fallSetThresholds(0, IMU_FULL_SCALE_MG - FALL_IMPACT_HEADROOM_MG));
+
+  // The BNO08x reads +/-8 g; FALL_IMPACT_MG_MAX still caps it
+  fallBegin(MOTION_ACCEL_HZ, MOTION_ACCEL_FULL_SCALE_MG);
+  TEST_ASSERT_EQUAL_UINT16(FALL_IMPACT_MG_MAX, fallImpactMaxMg());
+  TEST_ASSERT_TRUE(fallSetThresholds(0, 7000));
+  TEST_ASSERT_FALSE(fallSetThresholds(350, FALL_IMPACT_MG_MAX + 1));
+}
+
+// A hit that rails one axis still reads over the highest accepted threshold
+void test_clipped_impact_detected() {
+  TEST_ASSERT_TRUE(fallSetThresholds(0, fallImpactMaxMg()));
+  Trace t;
+  t.hold(UP, 1000, 1000);
+  t.hold(UP, 100, 300);
+  t.hit({ 1, 0, 0 }, 9000, 3);       // far past the range
+  t.hold({ 0, 1, 0 }, 1000, 4000);
+  double ns = 0;
+  TEST_ASSERT_EQUAL_UINT32(1, replay(t, ns));
+}
+
+// Oldest first, FALL_POST_IMPACT_MS of samples after the peak
+void test_snapshot_around_impact() {
+  Trace t;
+  t.hold(UP, 1000, 3000);
+  t.hold(UP, 100, 300);
+  t.s.push_back({ 3100, -200, 900 });  // the peak
+  t.hold(UP, 1000, 4000);
+  size_t peakAt = (3000 + 300) * RATE_HZ / 1000;
+
+  fallBegin(RATE_HZ, IMU_FULL_SCALE_MG);
+  fallFeed(t.s.data(), t.s.size());
+  FallEvent ev;
+  TEST_ASSERT_TRUE(fallPoll(ev));
+  TEST_ASSERT_EQUAL_UINT32(peakAt, ev.impactSample);
+  TEST_ASSERT_UINT16_WITHIN(40, 3234, ev.peakMg);
+
+  const AccelSample* snap;
+  size_t n = fallSnapshot(snap);
+  TEST_ASSERT_EQUAL(FALL_RING, n);
+  size_t after = FALL_POST_IMPACT_MS * RATE_HZ / 1000;
+  TEST_ASSERT_EQUAL_INT16(3100, snap[n - 1 - after].x);
+  TEST_ASSERT_EQUAL_INT16(-200, snap[n - 1 - after].y);
+}
+
+// ----------------------- Replay -----------------------
+void test_replay_detection_and_false_positives() {
+  double ns = 0;
+  size_t samples = 0;
+  uint32_t detected = 0, hard = 0, hardDetected = 0, falsePositives = 0;
+  uint32_t adlFp[ADL_COUNT] = {}, adlRuns[ADL_COUNT] = {};
+
+  for (int i = 0; i < RUNS; i++) {
+    Trace t;
+    bool isHard = makeFall(t);
+    samples += t.s.size();
+    bool hit = replay(t, ns) >= 1;
+    if (hit) detected++;
+    if (isHard) {
+      hard++;
+      if (hit) hardDetected++;
+    }
+  }
+  for (int i = 0; i < RUNS; i++) {
+    Adl kind = (Adl)(i % ADL_COUNT);
+    Trace t;
+    makeAdl(t, kind);
+    samples += t.s.size();
+    adlRuns[kind]++;
+    if (replay(t, ns)) {
+      falsePositives++;
+      adlFp[kind]++;
+    }
+  }
+
+  char msg[200];
+  snprintf(msg, sizeof(msg), "%d falls: %lu detected (%.1f %%), %lu of %lu over %u mg (%.1f %%)", RUNS,
+           (unsigned long)detected, 100.0 * detected / RUNS, (unsigned long)hardDetected, (unsigned long)hard,
+           FALL_IMPACT_MG, 100.0 * hardDetected / hard);
+  TEST_MESSAGE(msg);
+  snprintf(msg, sizeof(msg), "%d everyday traces: %lu false alarms (%.1f %%)", RUNS, (unsigned long)falsePositives,
+           100.0 * falsePositives / RUNS);
+  TEST_MESSAGE(msg);
+  for (int k = 0; k < ADL_COUNT; k++) {
+    snprintf(msg, sizeof(msg), "  %-14s %lu of %lu", ADL_NAMES[k], (unsigned long)adlFp[k], (unsigned long)adlRuns[k]);
+    TEST_MESSAGE(msg);
+  }
+  snprintf(msg, sizeof(msg), "%.1f ns per sample on the host over %lu samples", ns / samples, (unsigned long)samples);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_GREATER_OR_EQUAL(hard * 98 / 100, hardDetected);
+  TEST_ASSERT_GREATER_OR_EQUAL(RUNS * 85 / 100, detected);
+  // Standing still after a landing looks like lying still to a magnitude
+  // check; only that case may be mistaken for a fall
+  TEST_ASSERT_EQUAL_UINT32(adlFp[ADL_JUMP_STAND], falsePositives);
+  TEST_ASSERT_LESS_OR_EQUAL(RUNS * 10 / 100, falsePositives);
+  TEST_ASSERT_LESS_THAN(1000, ns / samples);     // a fraction of the 9.6 ms sample period, with room
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_impact_threshold_within_full_scale);
+  RUN_TEST(test_clipped_impact_detected);
+  RUN_TEST(test_snapshot_around_impact);
+  RUN_TEST(test_replay_detection_and_false_positives);
+  return UNITY_END();
+}
@@ -0,0 +1,401 @@
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include "geofence.h"
+
+// ----------------------- Geofences -----------------------
+// Edge cases of the integer containment tests (vertices, edges, concave
+// notches, rays through vertices, circles against the great-circle
+// distance), the text records and their limits, enter/exit events across
+// reloads, the grid index against the brute force, and evaluations per
+// second with a full set of fences on the host.
+
+#define BASE_LAT   473769000     // Zurich, as in the simulator scenarios
+#define BASE_LON   85417000
+#define EARTH_M    6371000.0
+
+static GeofenceSet set;
+static GeofenceEvent evs[GEOFENCE_MAX];
+
+static uint32_t rng = 2463534242u;
+
+static int32_t uniform(int32_t lo, int32_t hi) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return lo + (int32_t)(rng % (uint32_t)(hi - lo + 1));
+}
+
+static bool parse(const char* line) {
+  return geofenceParseLine(set, line, strlen(line));
+}
+
+// Polygon from (lat, lon) offsets to the base point, 1e-7 deg
+static void polygon(const char* name, const int32_t (*v)[2], uint16_t n) {
+  TEST_ASSERT_TRUE(geofenceBeginPolygon(set, name, n));
+  for (uint16_t i = 0; i < n; i++) TEST_ASSERT_TRUE(geofenceAddVertex(set, BASE_LAT + v[i][0], BASE_LON + v[i][1]));
+}
+
+static bool contains(uint8_t fence, int32_t dLat, int32_t dLon) {
+  return geofenceContains(set, fence, BASE_LAT + dLat, BASE_LON + dLon);
+}
+
+void setUp() {
+  geofenceClear(set);
+}
+
+void tearDown() {}
+
+// ----------------------- Polygons -----------------------
+void test_polygon_vertices_and_edges() {
+  const int32_t square[][2] = { { 0, 0 }, { 0, 1000 }, { 1000, 1000 }, { 1000, 0 } };
+  polygon("square", square, 4);
+  geofenceBuildIndex(set);
+
+  for (const auto& v : square) TEST_ASSERT_TRUE(contains(0, v[0], v[1]));
+  TEST_ASSERT_TRUE(contains(0, 0, 500));        // each edge
+  TEST_ASSERT_TRUE(contains(0, 500, 1000));
+  TEST_ASSERT_TRUE(contains(0, 1000, 500));
+  TEST_ASSERT_TRUE(contains(0, 500, 0));
+  TEST_ASSERT_TRUE(contains(0, 500, 500));
+  // One unit (1 cm) outside each edge
+  TEST_ASSERT_FALSE(contains(0, -1, 500));
+  TEST_ASSERT_FALSE(contains(0, 500, 1001));
+  TEST_ASSERT_FALSE(contains(0, 1001, 500));
+  TEST_ASSERT_FALSE(contains(0, 500, -1));
+  // On the line of a horizontal edge but past its end
+  TEST_ASSERT_FALSE(contains(0, 1000, 1001));
+  TEST_ASSERT_FALSE(contains(0, 0, -1));
+}
+
+// A U shape: the notch is outside, the arms either side are inside
+void test_polygon_concave_notch() {
+  const int32_t u[][2] = { { 0, 0 }, { 0, 3000 }, { 3000, 3000 }, { 3000, 2000 },
+                           { 1000, 2000 }, { 1000, 1000 }, { 3000, 1000 }, { 3000, 0 } };
+  polygon("u", u, 8);
+  geofenceBuildIndex(set);
+
+  TEST_ASSERT_FALSE(contains(0, 2000, 1500));   // in the notch
+  TEST_ASSERT_FALSE(contains(0, 1001, 1500));
+  TEST_ASSERT_TRUE(contains(0, 1000, 1500));    // its floor
+  TEST_ASSERT_TRUE(contains(0, 2000, 500));     // left arm
+  TEST_ASSERT_TRUE(contains(0, 2000, 2500));    // right arm
+  TEST_ASSERT_TRUE(contains(0, 2000, 1000));    // notch wall
+  TEST_ASSERT_TRUE(contains(0, 500, 1500));     // below the notch
+}
+
+// The crossing ray runs along +lon; where it passes exactly through a
+// vertex the crossing must count once, not twice or never
+void test_polygon_ray_through_vertex() {
+  const int32_t diamond[][2] = { { 0, 500 }, { 500, 1000 }, { 1000, 500 }, { 500, 0 } };
+  polygon("diamond", diamond, 4);
+  const int32_t tri[][2] = { { 0, 2000 }, { 500, 2600 }, { 0, 3000 } };
+  polygon("tri", tri, 3);
+  geofenceBuildIndex(set);
+
+  TEST_ASSERT_TRUE(contains(0, 500, 200));      // ray through the right vertex
+  TEST_ASSERT_FALSE(contains(0, 500, -100));    // ray through both side vertices
+  TEST_ASSERT_FALSE(contains(0, 500, 1100));
+  TEST_ASSERT_TRUE(contains(0, 500, 0));
+  TEST_ASSERT_TRUE(contains(0, 1000, 500));     // top apex
+  TEST_ASSERT_FALSE(contains(0, 1000, 499));
+  // Ray through an apex that is a local maximum
+  TEST_ASSERT_FALSE(contains(1, 500, 2000));
+  TEST_ASSERT_TRUE(contains(1, 500, 2600));
+  TEST_ASSERT_TRUE(contains(1, 0, 2500));       // bottom edge
+  TEST_ASSERT_TRUE(contains(1, 100, 2500));
+}
+
+// Vertex order does not matter
+void test_polygon_winding() {
+  const int32_t ccw[][2] = { { 0, 0 }, { 0, 1000 }, { 700, 1200 }, { 1000, 0 } };
+  const int32_t cw[][2] = { { 1000, 0 }, { 700, 1200 }, { 0, 1000 }, { 0, 0 } };
+  polygon("ccw", ccw, 4);
+  polygon("cw", cw, 4);
+  geofenceBuildIndex(set);
+  for (int i = 0; i < 20000; i++) {
+    int32_t lat = uniform(-200, 1200), lon = uniform(-200, 1400);
+    TEST_ASSERT_EQUAL(contains(0, lat, lon), contains(1, lat, lon));
+  }
+}
+
+// ----------------------- Circles -----------------------
+// Points 2% inside and outside the radius on every bearing, placed with the
+// spherical destination formula, at the equator, here and in the far north
+void test_circle_against_great_circle() {
+  const double lats[] = { 0.0, 47.3769, 70.0 };
+  const uint32_t radii[] = { 20, 150, 1000, 5000 };
+  uint32_t checked = 0;
+  for (double lat0 : lats) {
+    for (uint32_t r : radii) {
+      geofenceClear(set);
+      int32_t cLat = (int32_t)lrint(lat0 * 1e7);
+      TEST_ASSERT_TRUE(geofenceAddCircle(set, "c", cLat, BASE_LON, r));
+      geofenceBuildIndex(set);
+      double phi1 = lat0 * M_PI / 180;
+      for (int b = 0; b < 360; b += 5) {
+        double bearing = b * M_PI / 180;
+        const double scales[] = { 0.98, 1.02 };
+        for (double scale : scales) {
+          double d = r * scale / EARTH_M;
+          double phi2 = asin(sin(phi1) * cos(d) + cos(phi1) * sin(d) * cos(bearing));
+          double dLon = atan2(sin(bearing) * sin(d) * cos(phi1), cos(d) - sin(phi1) * sin(phi2));
+          int32_t lat = (int32_t)lrint(phi2 * 180 / M_PI * 1e7);
+          int32_t lon = BASE_LON + (int32_t)lrint(dLon * 180 / M_PI * 1e7);
+          TEST_ASSERT_EQUAL(scale < 1, geofenceContains(set, 0, lat, lon));
+          checked++;
+        }
+      }
+    }
+  }
+  char msg[80];
+  snprintf(msg, sizeof(msg), "%lu points at 0.98 r and 1.02 r classified correctly", (unsigned long)checked);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_FALSE(geofenceAddCircle(set, "zero", BASE_LAT, BASE_LON, 0));
+}
+
+// ----------------------- Records -----------------------
+void test_records() {
+  TEST_ASSERT_TRUE(parse("V,42"));
+  TEST_ASSERT_TRUE(parse("C,home,473769000,85417000,100\r"));
+  TEST_ASSERT_TRUE(parse("P,school,3"));
+  TEST_ASSERT_TRUE(parse("473770000,85417000"));
+  TEST_ASSERT_FALSE(parse("C,early,473769000,85417000,100"));   // polygon still open
+  TEST_ASSERT_TRUE(parse("473771000,85418000"));
+  TEST_ASSERT_TRUE(parse(""));
+  TEST_ASSERT_TRUE(parse("473770000,85419000"));
+  TEST_ASSERT_TRUE(parse("C,a-name-longer-than-the-field,473769000,85417000,50"));
+  geofenceBuildIndex(set);
+
+  TEST_ASSERT_EQUAL_UINT32(42, set.version);
+  TEST_ASSERT_EQUAL(3, set.count);
+  TEST_ASSERT_EQUAL(3, set.vertexCount);
+  TEST_ASSERT_EQUAL(GEOFENCE_CIRCLE, set.fences[0].shape);
+  TEST_ASSERT_EQUAL(GEOFENCE_POLYGON, set.fences[1].shape);
+  TEST_ASSERT_EQUAL_STRING("school", set.fences[1].name);
+  TEST_ASSERT_EQUAL(GEOFENCE_NAME_MAX - 1, strlen(set.fences[2].name));
+}
+
+void test_malformed_records() {
+  const char* bad[] = {
+    "X,name,1,2,3",
+    "CC,name,1,2,3",
+    "C,name,47x,85417000,100",
+    "C,name,473769000,85417000",
+    "C,name,473769000,85417000,0",
+    "C,name,473769000,85417000,-5",
+    "C,name,473769000,85417000,1000000",        // 1000 km: past the span limit
+    "C,name,1234567890123456,85417000,100",
+    "P,name,2",
+    "P,name,0",
+    "P,name,600",
+    "V",
+  };
+  for (const char* line : bad) {
+    TEST_ASSERT_FALSE_MESSAGE(parse(line), line);
+    TEST_ASSERT_EQUAL(0, set.count);
+  }
+  TEST_ASSERT_TRUE(parse("P,name,3"));
+  TEST_ASSERT_FALSE(parse("473769000"));
+  TEST_ASSERT_FALSE(parse("473769000,abc"));
+}
+
+void test_limits() {
+  char line[64];
+  for (int i = 0; i < GEOFENCE_MAX; i++) {
+    snprintf(line, sizeof(line), "C,f%d,%d,%d,50", i, BASE_LAT + i * 1000, BASE_LON);
+    TEST_ASSERT_TRUE(parse(line));
+  }
+  TEST_ASSERT_FALSE(parse("C,extra,473769000,85417000,50"));
+  TEST_ASSERT_EQUAL(GEOFENCE_MAX, set.count);
+
+  // The vertex pool is shared by all polygons
+  geofenceClear(set);
+  TEST_ASSERT_TRUE(geofenceBeginPolygon(set, "big", GEOFENCE_VERTEX_MAX - 3));
+  TEST_ASSERT_FALSE(geofenceBeginPolygon(set, "open", 3));
+  for (int i = 0; i < GEOFENCE_VERTEX_MAX - 3; i++) geofenceAddVertex(set, BASE_LAT + i, BASE_LON + i * i);
+  TEST_ASSERT_TRUE(geofenceBeginPolygon(set, "fits", 3));
+  for (int i = 0; i < 3; i++) geofenceAddVertex(set, BASE_LAT + i, BASE_LON - i * i);
+  TEST_ASSERT_FALSE(geofenceBeginPolygon(set, "full", 3));
+  TEST_ASSERT_FALSE(geofenceAddVertex(set, BASE_LAT, BASE_LON));
+
+  // A polygon wider than the span limit is dropped with its vertices
+  geofenceClear(set);
+  const int32_t wide[][2] = { { 0, 0 }, { 0, GEOFENCE_SPAN_MAX_E7 + 1 }, { 1000, 0 } };
+  TEST_ASSERT_TRUE(geofenceBeginPolygon(set, "wide", 3));
+  TEST_ASSERT_TRUE(geofenceAddVertex(set, BASE_LAT + wide[0][0], BASE_LON + wide[0][1]));
+  TEST_ASSERT_TRUE(geofenceAddVertex(set, BASE_LAT + wide[1][0], BASE_LON + wide[1][1]));
+  TEST_ASSERT_FALSE(geofenceAddVertex(set, BASE_LAT + wide[2][0], BASE_LON + wide[2][1]));
+  TEST_ASSERT_EQUAL(0, set.count);
+  TEST_ASSERT_EQUAL(0, set.vertexCount);
+
+  // An unfinished polygon is dropped when the index is built
+  TEST_ASSERT_TRUE(parse("C,home,473769000,85417000,100"));
+  TEST_ASSERT_TRUE(parse("P,cut,4"));
+  TEST_ASSERT_TRUE(parse("473770000,85417000"));
+  geofenceBuildIndex(set);
+  TEST_ASSERT_EQUAL(1, set.count);
+  TEST_ASSERT_EQUAL(0, set.vertexCount);
+  TEST_ASSERT_TRUE(parse("C,next,473769000,85417000,100"));
+}
+
+// ----------------------- Events -----------------------
+void test_enter_exit_events() {
+  geofenceAddCircle(set, "home", BASE_LAT, BASE_LON, 100);
+  const int32_t yard[][2] = { { 0, 0 }, { 0, 3000 }, { 3000, 3000 }, { 3000, 0 } };
+  polygon("yard", yard, 4);
+  geofenceBuildIndex(set);
+
+  // The first fix only primes the flags
+  TEST_ASSERT_EQUAL(0, geofenceEvaluate(set, BASE_LAT + 10, BASE_LON + 10, evs, GEOFENCE_MAX));
+  TEST_ASSERT_TRUE(set.fences[0].inside && set.fences[1].inside);
+  TEST_ASSERT_EQUAL(0, geofenceEvaluate(set, BASE_LAT + 20, BASE_LON + 20, evs, GEOFENCE_MAX));
+
+  // Out of the yard, still home
+  TEST_ASSERT_EQUAL(1, geofenceEvaluate(set, BASE_LAT - 500, BASE_LON, evs, GEOFENCE_MAX));
+  TEST_ASSERT_EQUAL(1, evs[0].fence);
+  TEST_ASSERT_FALSE(evs[0].entered);
+  TEST_ASSERT_EQUAL_STRING("yard", evs[0].name);
+
+  // Leaving both with room for one event: the other follows on the next fix
+  TEST_ASSERT_EQUAL(1, geofenceEvaluate(set, BASE_LAT + 1500, BASE_LON + 1500, evs, GEOFENCE_MAX));
+  TEST_ASSERT_TRUE(evs[0].entered);
+  TEST_ASSERT_EQUAL(1, geofenceEvaluate(set, BASE_LAT + 50000, BASE_LON, evs, 1));
+  TEST_ASSERT_EQUAL(0, evs[0].fence);
+  TEST_ASSERT_EQUAL(1, geofenceEvaluate(set, BASE_LAT + 50000, BASE_LON, evs, 1));
+  TEST_ASSERT_EQUAL(1, evs[0].fence);
+  TEST_ASSERT_EQUAL(0, geofenceEvaluate(set, BASE_LAT + 50000, BASE_LON, evs, 1));
+
+  // Far outside the grid
+  TEST_ASSERT_EQUAL(0, geofenceEvaluate(set, -BASE_LAT, -BASE_LON, evs, GEOFENCE_MAX));
+}
+
+// A reload keeps the state of fences that survive it, by name
+void test_reload_carries_state() {
+  geofenceAddCircle(set, "home", BASE_LAT, BASE_LON, 100);
+  geofenceAddCircle(set, "park", BASE_LAT, BASE_LON + 50000, 100);
+  geofenceBuildIndex(set);
+  geofenceEvaluate(set, BASE_LAT, BASE_LON, evs, GEOFENCE_MAX);
+
+  static GeofenceSet next;
+  geofenceClear(next);
+  geofenceAddCircle(next, "street", BASE_LAT, BASE_LON, 300);
+  geofenceAddCircle(next, "home", BASE_LAT, BASE_LON, 120);
+  geofenceBuildIndex(next);
+  geofenceCarryState(next, set);
+  TEST_ASSERT_TRUE(next.fences[1].inside);
+
+  // Only the new fence is reported, as entered
+  TEST_ASSERT_EQUAL(1, geofenceEvaluate(next, BASE_LAT, BASE_LON, evs, GEOFENCE_MAX));
+  TEST_ASSERT_EQUAL_STRING("street", evs[0].name);
+  TEST_ASSERT_TRUE(evs[0].entered);
+
+  // Nothing to carry before the first fix: the reload primes instead
+  geofenceBuildIndex(set);
+  geofenceBuildIndex(next);
+  geofenceCarryState(next, set);
+  TEST_ASSERT_FALSE(next.primed);
+  TEST_ASSERT_EQUAL(0, geofenceEvaluate(next, BASE_LAT, BASE_LON, evs, GEOFENCE_MAX));
+}
+
+// ----------------------- Index -----------------------
+// Fences of the kinds the server sends, spread over a town
+static void randomFences(uint8_t n) {
+  geofenceClear(set);
+  char name[16];
+  for (uint8_t i = 0; i < n; i++) {
+    snprintf(name, sizeof(name), "f%u", i);
+    int32_t lat = BASE_LAT + uniform(-300000, 300000), lon = BASE_LON + uniform(-400000, 400000);
+    if (i % 3 == 0) {
+      TEST_ASSERT_TRUE(geofenceAddCircle(set, name, lat, lon, uniform(30, 800)));
+      continue;
+    }
+    // Star-shaped polygon: random radius per vertex, so often concave
+    uint16_t count = uniform(4, 12);
+    int32_t size = uniform(2000, 40000);
+    TEST_ASSERT_TRUE(geofenceBeginPolygon(set, name, count));
+    for (uint16_t k = 0; k < count; k++) {
+      double a = 2 * M_PI * k / count;
+      int32_t r = uniform(size / 3, size);
+      TEST_ASSERT_TRUE(geofenceAddVertex(set, lat + (int32_t)(r * sin(a)), lon + (int32_t)(r * cos(a))));
+    }
+  }
+  geofenceBuildIndex(set);
+}
+
+static void randomFix(int32_t& lat, int32_t& lon) {
+  lat = BASE_LAT + uniform(-350000, 350000);
+  lon = BASE_LON + uniform(-450000, 450000);
+}
+
+void test_index_matches_brute_force() {
+  uint32_t insideSeen = 0, events = 0;
+  for (int round = 0; round < 10; round++) {
+    randomFences(GEOFENCE_MAX);
+    for (int i = 0; i < 20000; i++) {
+      int32_t lat, lon;
+      randomFix(lat, lon);
+      events += geofenceEvaluate(set, lat, lon, evs, GEOFENCE_MAX);
+      for (uint8_t f = 0; f < set.count; f++) {
+        bool brute = geofenceContains(set, f, lat, lon);
+        TEST_ASSERT_EQUAL(brute, set.fences[f].inside);
+        insideSeen += brute;
+      }
+    }
+  }
+  char msg[100];
+  snprintf(msg, sizeof(msg), "200000 fixes x %d fences agree with the brute force (%lu inside, %lu events)",
+           GEOFENCE_MAX, (unsigned long)insideSeen, (unsigned long)events);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_GREATER_THAN(1000, insideSeen);
+}
+
+// ----------------------- Benchmark -----------------------
+static int32_t benchLat[4096], benchLon[4096];
+
+void test_benchmark() {
+  randomFences(GEOFENCE_MAX);
+  for (int i = 0; i < 4096; i++) randomFix(benchLat[i], benchLon[i]);
+  const int rounds = 200;
+  volatile uint32_t sink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < 4096; i++) sink = sink + geofenceEvaluate(set, benchLat[i], benchLon[i], evs, GEOFENCE_MAX);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  // Without the grid: every fence's bounding box, then the exact test
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < 4096; i++) {
+      for (uint8_t f = 0; f < set.count; f++) sink = sink + geofenceContains(set, f, benchLat[i], benchLon[i]);
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  const double n = rounds * 4096.0;
+  double indexed = n / std::chrono::duration<double>(t1 - t0).count();
+  double brute = n / std::chrono::duration<double>(t2 - t1).count();
+  char msg[160];
+  snprintf(msg, sizeof(msg), "host, %d fences, %u vertices: %.2fM evaluations/s indexed, %.2fM/s per-fence boxes",
+           GEOFENCE_MAX, set.vertexCount, indexed / 1e6, brute / 1e6);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(indexed > brute);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_polygon_vertices_and_edges);
+  RUN_TEST(test_polygon_concave_notch);
+  RUN_TEST(test_polygon_ray_through_vertex);
+  RUN_TEST(test_polygon_winding);
+  RUN_TEST(test_circle_against_great_circle);
+  RUN_TEST(test_records);
+  RUN_TEST(test_malformed_records);
+  RUN_TEST(test_limits);
+  RUN_TEST(test_enter_exit_events);
+  RUN_TEST(test_reload_carries_state);
+  RUN_TEST(test_index_matches_brute_force);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,207 @@
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include "gnss.h"
+
+// ----------------------- +CGPSINFO parser -----------------------
+// Known lines, corrupt and partial lines, a mutation fuzzer and a
+// microbenchmark against the String-based getGPSCoords() it replaced.
+
+static const char LINE[] = "+CGPSINFO: 4723.140000,N,00830.260000,E,171026,081500.0,408.2,2.5,90.0\r\n";
+
+static GnssParseResult parse(const char* s, GnssFix& fix) {
+  return gnssParseCgpsinfo(s, strlen(s), fix);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_full_fix() {
+  GnssFix fix;
+  TEST_ASSERT_EQUAL(GNSS_OK, parse(LINE, fix));
+  TEST_ASSERT_EQUAL_INT32(473856667, fix.latE7);     // 47 deg 23.14 min
+  TEST_ASSERT_EQUAL_INT32(85043333, fix.lonE7);      // 8 deg 30.26 min
+  TEST_ASSERT_EQUAL_INT32(40820, fix.altCm);
+  TEST_ASSERT_EQUAL_UINT32(129, fix.speedCmS);       // 2.5 kn
+  TEST_ASSERT_EQUAL_UINT16(9000, fix.courseCdeg);
+  TEST_ASSERT_EQUAL(GNSS_HAS_ALT | GNSS_HAS_SPEED | GNSS_HAS_COURSE, fix.flags);
+  TEST_ASSERT_EQUAL(17, fix.day);
+  TEST_ASSERT_EQUAL(10, fix.month);
+  TEST_ASSERT_EQUAL(26, fix.year);
+  TEST_ASSERT_EQUAL(8, fix.hour);
+  TEST_ASSERT_EQUAL(15, fix.minute);
+  TEST_ASSERT_EQUAL(0, fix.second);
+  TEST_ASSERT_EQUAL_UINT32(1792224900, gnssUnixTime(fix));
+}
+
+void test_hemispheres_and_short_degrees() {
+  GnssFix fix;
+  TEST_ASSERT_EQUAL(GNSS_OK, parse("3352.000000,S,15112.000000,W,010126,000000.0,,,", fix));
+  TEST_ASSERT_EQUAL_INT32(-338666667, fix.latE7);
+  TEST_ASSERT_EQUAL_INT32(-1512000000, fix.lonE7);
+  TEST_ASSERT_EQUAL(0, fix.flags);
+
+  // One-digit degrees: fixed 2/3-digit slicing read these wrong
+  TEST_ASSERT_EQUAL(GNSS_OK, parse("523.500000,N,030.000000,E,010126,000000,,,", fix));
+  TEST_ASSERT_EQUAL_INT32(53916667, fix.latE7);
+  TEST_ASSERT_EQUAL_INT32(5000000, fix.lonE7);
+}
+
+void test_no_fix() {
+  GnssFix fix;
+  TEST_ASSERT_EQUAL(GNSS_NO_FIX, parse("+CGPSINFO: ,,,,,,,,\r\n", fix));
+  TEST_ASSERT_EQUAL(GNSS_NO_FIX, parse(",,,,,,,,", fix));
+}
+
+void test_malformed() {
+  static const char* const BAD[] = {
+    "",
+    "+CGPSINFO:",
+    "4723.140000,N,00830.260000,E,171026,081500.0,408.2,2.5",           // eight fields
+    "4723.140000,N,00830.260000,E,171026,081500.0,408.2,2.5,90.0,1",    // ten
+    "4723.140000,X,00830.260000,E,171026,081500.0,,,",                  // hemisphere
+    "4760.000000,N,00830.260000,E,171026,081500.0,,,",                  // minutes >= 60
+    "9100.000000,N,00830.260000,E,171026,081500.0,,,",                  // latitude > 90
+    "9000.000001,N,00830.260000,E,171026,081500.0,,,",
+    "4723.140000,N,18100.000000,E,171026,081500.0,,,",                  // longitude > 180
+    "4723.14.0000,N,00830.260000,E,171026,081500.0,,,",                 // two dots
+    "4723.140000,N,00830.260000,E,321026,081500.0,,,",                  // day 32
+    "4723.140000,N,00830.260000,E,171326,081500.0,,,",                  // month 13
+    "4723.140000,N,00830.260000,E,17102,081500.0,,,",                   // short date
+    "4723.140000,N,00830.260000,E,171026,246000.0,,,",                  // hour 24
+    "4723.140000,N,00830.260000,E,171026,81500.0,,,",                   // short time
+    "4723.140000,N,00830.260000,E,171026,081500.0,abc,,",               // altitude
+    "4723.140000,N,00830.260000,E,171026,081500.0,,-1,",                // negative speed
+    "4723.140000,N,00830.260000,E,171026,081500.0,,,360.01",            // course
+    "4723.1\x01" "40000,N,00830.260000,E,171026,081500.0,,,",           // control byte
+    ",N,00830.260000,E,171026,081500.0,,,",                             // partial
+  };
+  GnssFix fix;
+  memset(&fix, 0xA5, sizeof(fix));
+  GnssFix before = fix;
+  for (const char* s : BAD) {
+    TEST_ASSERT_EQUAL_MESSAGE(GNSS_MALFORMED, parse(s, fix), s);
+  }
+  TEST_ASSERT_EQUAL_MEMORY(&before, &fix, sizeof(fix));   // untouched on failure
+}
+
+// Every prefix of a good line: a line cut short by the UART is never a fix
+void test_truncated_lines() {
+  GnssFix fix;
+  size_t full = strlen(LINE) - 2;   // without CR LF
+  size_t course = strrchr(LINE, ',') - LINE;
+  for (size_t n = 0; n < full; n++) {
+    char* copy = (char*)malloc(n ? n : 1);   // exact size, so overreads show up under ASan
+    memcpy(copy, LINE, n);
+    GnssParseResult r = gnssParseCgpsinfo(copy, n, fix);
+    free(copy);
+    // Cut inside the optional course field it is a fix with a shorter course
+    if (n <= course) TEST_ASSERT_NOT_EQUAL_MESSAGE(GNSS_OK, r, "prefix parsed as a fix");
+  }
+}
+
+// ----------------------- Fuzz -----------------------
+static uint32_t seed = 1;
+static uint32_t rnd(uint32_t below) {
+  seed = seed * 1103515245u + 12345u;
+  return (seed >> 8) % below;
+}
+
+static void checkSane(const GnssFix& fix) {
+  TEST_ASSERT_LESS_OR_EQUAL(900000000, fix.latE7 < 0 ? -fix.latE7 : fix.latE7);
+  TEST_ASSERT_LESS_OR_EQUAL(1800000000, fix.lonE7 < 0 ? -fix.lonE7 : fix.lonE7);
+  TEST_ASSERT_TRUE(fix.day >= 1 && fix.day <= 31 && fix.month >= 1 && fix.month <= 12);
+  TEST_ASSERT_TRUE(fix.hour <= 23 && fix.minute <= 59 && fix.second <= 60 && fix.millis <= 999);
+  TEST_ASSERT_LESS_THAN(36000, fix.courseCdeg);
+}
+
+void test_fuzz() {
+  static const char ALPHABET[] = "0123456789.,-+NSEW \r\n:\x01\xff";
+  uint32_t ok = 0, runs = 200000;
+  for (uint32_t i = 0; i < runs; i++) {
+    char buf[128];
+    size_t n = strlen(LINE);
+    memcpy(buf, LINE, n);
+    for (uint32_t k = rnd(6) + 1; k; k--) {
+      switch (rnd(4)) {
+        case 0: if (n) buf[rnd(n)] = ALPHABET[rnd(sizeof(ALPHABET) - 1)]; break;               // replace
+        case 1: if (n > 1) { size_t at = rnd(n); memmove(buf + at, buf + at + 1, n - at - 1); n--; } break;
+        case 2: if (n < sizeof(buf)) { size_t at = rnd(n + 1); memmove(buf + at + 1, buf + at, n - at);
+                  buf[at] = ALPHABET[rnd(sizeof(ALPHABET) - 1)]; n++; } break;         // insert
+        default: n = rnd(n + 1); break;                                                 // cut
+      }
+    }
+    char* exact = (char*)malloc(n ? n : 1);
+    memcpy(exact, buf, n);
+    GnssFix fix;
+    if (gnssParseCgpsinfo(exact, n, fix) == GNSS_OK) {
+      checkSane(fix);
+      ok++;
+    }
+    free(exact);
+  }
+  char msg[80];
+  snprintf(msg, sizeof(msg), "%lu mutated lines, %lu still parsed as fixes", (unsigned long)runs, (unsigned long)ok);
+  TEST_MESSAGE(msg);
+}
+
+// ----------------------- Benchmark -----------------------
+// getGPSCoords() as it was, with std::string standing in for String
+static bool legacyCoords(const std::string& resp, float& latDec, float& lonDec) {
+  if (resp.find("+CGPSINFO:") == std::string::npos || resp.find(",,,,,,,,") != std::string::npos) return false;
+  std::string gpsData = resp.substr(resp.find(':') + 1);
+  gpsData.erase(0, gpsData.find_first_not_of(" \r\n"));
+  size_t latEnd = gpsData.find(','), nsEnd = gpsData.find(',', latEnd + 1);
+  size_t lonEnd = gpsData.find(',', nsEnd + 1), ewEnd = gpsData.find(',', lonEnd + 1);
+  std::string lat = gpsData.substr(0, latEnd), ns = gpsData.substr(latEnd + 1, nsEnd - latEnd - 1);
+  std::string lon = gpsData.substr(nsEnd + 1, lonEnd - nsEnd - 1), ew = gpsData.substr(lonEnd + 1, ewEnd - lonEnd - 1);
+  if (lat.length() < 3 || lon.length() < 3) return false;
+  latDec = atof(lat.substr(0, 2).c_str()) + atof(lat.substr(2).c_str()) / 60.0f;
+  if (ns == "S") latDec = -latDec;
+  lonDec = atof(lon.substr(0, 3).c_str()) + atof(lon.substr(3).c_str()) / 60.0f;
+  if (ew == "W") lonDec = -lonDec;
+  return true;
+}
+
+void test_benchmark() {
+  const uint32_t runs = 200000;
+  std::string resp(LINE);
+  GnssFix fix;
+  float lat = 0, lon = 0;
+  volatile uint32_t sink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < runs; i++) {
+    gnssParseCgpsinfo(LINE, sizeof(LINE) - 1, fix);
+    sink += fix.latE7;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < runs; i++) {
+    legacyCoords(resp, lat, lon);
+    sink += (uint32_t)lat;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  // Same position; the float version is off by its rounding
+  TEST_ASSERT_FLOAT_WITHIN(2e-5, lat, fix.latE7 / 1e7);
+  TEST_ASSERT_FLOAT_WITHIN(2e-5, lon, fix.lonE7 / 1e7);
+
+  double nsNew = std::chrono::duration<double, std::nano>(t1 - t0).count() / runs;
+  double nsOld = std::chrono::duration<double, std::nano>(t2 - t1).count() / runs;
+  char msg[120];
+  snprintf(msg, sizeof(msg), "%.0f ns per line (all fields), getGPSCoords %.0f ns (lat/lon only), %.1fx", nsNew,
+           nsOld, nsOld / nsNew);
+  TEST_MESSAGE(msg);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_fix);
+  RUN_TEST(test_hemispheres_and_short_degrees);
+  RUN_TEST(test_no_fix);
+  RUN_TEST(test_malformed);
+  RUN_TEST(test_truncated_lines);
+  RUN_TEST(test_fuzz);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
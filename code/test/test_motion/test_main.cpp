@@ -0,0 +1,170 @@
+#include <unity.h>
+#include <math.h>
+#include "motion.h"
+#include "sim.h"
+
+// ----------------------- Motion-gated reporting -----------------------
+// Classifier hold and transitions on the simulated BNO08x, the period
+// rule, and a school-day motion trace replayed against the old fixed
+// 10 s schedule: uploads per hour and distance between the wearer and the
+// last reported point.
+
+#define STATIONARY  2       // SH-2 stability classes
+#define STABLE      3
+#define IN_MOTION   4
+
+static void feel(int cls, uint32_t seconds) {
+  simSetMotionClass(cls);
+  for (uint32_t s = 0; s < seconds; s++) {
+    delay(1000);
+    motionPoll();
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ----------------------- Rules -----------------------
+void test_without_imu_fixed_schedule() {
+  simSetMotionClass(-1);
+  TEST_ASSERT_FALSE(motionBegin());
+  TEST_ASSERT_EQUAL(MOTION_UNKNOWN, motionState());
+  TEST_ASSERT_EQUAL_UINT32(MOTION_FIXED_PERIOD_MS, motionPeriodMs(motionState(), 140));
+}
+
+void test_period_by_speed() {
+  TEST_ASSERT_EQUAL_UINT32(MOTION_STILL_PERIOD_MS, motionPeriodMs(MOTION_STILL, 0));
+  TEST_ASSERT_EQUAL_UINT32(MOTION_MIN_PERIOD_MS, motionPeriodMs(MOTION_MOVING, 0));       // speed unknown
+  TEST_ASSERT_EQUAL_UINT32(MOTION_MAX_PERIOD_MS, motionPeriodMs(MOTION_MOVING, 10));      // shuffling
+  TEST_ASSERT_EQUAL_UINT32(35714, motionPeriodMs(MOTION_MOVING, 140));                    // walking, 50 m apart
+  TEST_ASSERT_EQUAL_UINT32(MOTION_MIN_PERIOD_MS, motionPeriodMs(MOTION_MOVING, 1400));    // car
+}
+
+// Starts on the moving schedule; stops shorter than the hold keep it
+void test_hold_and_transitions() {
+  simSetMotionClass(IN_MOTION);
+  TEST_ASSERT_TRUE(motionBegin());
+  TEST_ASSERT_EQUAL(MOTION_MOVING, motionState());
+
+  feel(STABLE, MOTION_STILL_HOLD_MS / 1000 - 5);      // a long traffic light
+  TEST_ASSERT_EQUAL(MOTION_MOVING, motionState());
+  feel(IN_MOTION, 10);
+  feel(STATIONARY, MOTION_STILL_HOLD_MS / 1000 + 2);
+  TEST_ASSERT_EQUAL(MOTION_STILL, motionState());
+  TEST_ASSERT_FALSE(motionStartedMoving());
+
+  feel(IN_MOTION, 1);
+  TEST_ASSERT_EQUAL(MOTION_MOVING, motionState());
+  TEST_ASSERT_TRUE(motionStartedMoving());
+  TEST_ASSERT_FALSE(motionStartedMoving());          // once per transition
+}
+
+// ----------------------- Trace -----------------------
+struct Segment {
+  const char* what;
+  uint32_t    seconds;
+  int         cls;
+  float       speedMs;
+};
+
+// Night at home, walk to school with a crossing, lessons with fidgeting
+// and a break in the yard, a car ride home, evening at home
+static const Segment DAY[] = {
+  { "home",   3 * 3600, STATIONARY, 0 },
+  { "walk",   600,      IN_MOTION,  1.4f },
+  { "walk",   50,       STABLE,     0 },
+  { "walk",   600,      IN_MOTION,  1.4f },
+  { "school", 5400,     STATIONARY, 0 },
+  { "school", 20,       IN_MOTION,  0.3f },
+  { "school", 1800,     STATIONARY, 0 },
+  { "school", 900,      IN_MOTION,  1.0f },
+  { "school", 5400,     STATIONARY, 0 },
+  { "car",    900,      IN_MOTION,  12.0f },
+  { "home",   2 * 3600, STATIONARY, 0 },
+};
+
+struct Schedule {
+  uint32_t uploads, uploadsMoving;
+  double   errSum, errMax;           // metres, over the seconds spent moving
+  uint32_t movingSeconds;
+  double   reported;                 // position of the last upload along the route
+  uint32_t nextMs;
+};
+
+static void account(Schedule& s, double pos, bool moving) {
+  if (!moving) return;
+  double err = fabs(pos - s.reported);
+  s.errSum += err;
+  if (err > s.errMax) s.errMax = err;
+  s.movingSeconds++;
+}
+
+void test_day_trace() {
+  simSetMotionClass(STATIONARY);
+  motionBegin();
+  Schedule adaptive = {}, fixed = {};
+  double pos = 0;
+  uint32_t speedCmS = 0, seconds = 0, transitionDelayMax = 0, transitionsSeen = 0;
+  int32_t startedAt = -1;
+
+  for (const Segment& seg : DAY) {
+    for (uint32_t i = 0; i < seg.seconds; i++, seconds++) {
+      feel(seg.cls, 1);
+      pos += seg.speedMs;
+      bool moving = seg.speedMs > 0;
+      uint32_t now = seconds * 1000;
+      if (moving && startedAt < 0) startedAt = seconds;
+      if (!moving) startedAt = -1;
+
+      // Firmware: fix-and-send when due or right after starting to move
+      bool started = motionStartedMoving();
+      if (started || now >= adaptive.nextMs) {
+        adaptive.reported = pos;
+        adaptive.uploads++;
+        if (moving) adaptive.uploadsMoving++;
+        speedCmS = (uint32_t)(seg.speedMs * 100);
+        adaptive.nextMs = now + motionPeriodMs(motionState(), speedCmS);
+        if (started && startedAt >= 0) {
+          transitionsSeen++;
+          if ((uint32_t)(seconds - startedAt) > transitionDelayMax) transitionDelayMax = seconds - startedAt;
+        }
+      }
+      if (now >= fixed.nextMs) {
+        fixed.reported = pos;
+        fixed.uploads++;
+        if (moving) fixed.uploadsMoving++;
+        fixed.nextMs = now + MOTION_FIXED_PERIOD_MS;
+      }
+      account(adaptive, pos, moving);
+      account(fixed, pos, moving);
+    }
+  }
+
+  double hours = seconds / 3600.0;
+  char msg[200];
+  snprintf(msg, sizeof(msg), "%.1f h day: adaptive %.1f uploads/h (%lu while moving), fixed 10 s %.1f/h (%lu)",
+           hours, adaptive.uploads / hours, (unsigned long)adaptive.uploadsMoving, fixed.uploads / hours,
+           (unsigned long)fixed.uploadsMoving);
+  TEST_MESSAGE(msg);
+  snprintf(msg, sizeof(msg), "error while moving: adaptive mean %.1f m, max %.1f m; fixed mean %.1f m, max %.1f m; "
+           "first fix %lu s after starting to move", adaptive.errSum / adaptive.movingSeconds, adaptive.errMax,
+           fixed.errSum / fixed.movingSeconds, fixed.errMax, (unsigned long)transitionDelayMax);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_LESS_THAN(fixed.uploads / 5, adaptive.uploads);
+  TEST_ASSERT_GREATER_THAN(0, transitionsSeen);
+  TEST_ASSERT_LESS_OR_EQUAL(1, transitionDelayMax);
+  // Points stay about MOTION_SPACING_CM apart while moving, so the wearer is
+  // never further than that from the last one, walking or in the car
+  TEST_ASSERT_LESS_OR_EQUAL(MOTION_SPACING_CM / 100, adaptive.errMax);
+}
+
+int main() {
+  simSetLogHook(nullptr, false);
+  UNITY_BEGIN();
+  RUN_TEST(test_without_imu_fixed_schedule);
+  RUN_TEST(test_period_by_speed);
+  RUN_TEST(test_hold_and_transitions);
+  RUN_TEST(test_day_trace);
+  return UNITY_END();
+}
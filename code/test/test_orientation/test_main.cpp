@@ -0,0 +1,205 @@
+#include <unity.h>
+#include <math.h>
+#include <chrono>
+#include "orientation.h"
+
+// ----------------------- Orientation -----------------------
+// The float approximations and the lazy Euler conversion against the
+// double-precision libm math of the old quaternionToEuler() in
+// test/imu.cpp, over sweeps and random rotations, and the time per
+// conversion of each on the host.
+
+#define ROTATIONS  200000
+#define GIMBAL_SIN 0.9999       // |sin(pitch)| beyond this leaves yaw and roll undefined
+
+static uint32_t rng = 2463534242u;
+
+static double uniform(double lo, double hi) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return lo + (hi - lo) * (rng / 4294967296.0);
+}
+
+// The old per-sample conversion
+static void referenceEuler(double w, double x, double y, double z, double& yaw, double& pitch, double& roll) {
+  double ww = w * w, xx = x * x, yy = y * y, zz = z * z;
+  yaw   = atan2(2.0 * (x * y + z * w), xx - yy - zz + ww);
+  pitch = asin(-2.0 * (x * z - y * w) / (xx + yy + zz + ww));
+  roll  = atan2(2.0 * (y * z + x * w), -xx - yy + zz + ww);
+}
+
+// Angles either side of +/-pi are the same angle
+static double angleError(double a, double b) {
+  double d = fabs(a - b);
+  return d > M_PI ? 2 * M_PI - d : d;
+}
+
+// Random rotation, with the non-unit norm a filtered stream can have
+static Quat randomQuat() {
+  double w, x, y, z, n;
+  do {
+    w = uniform(-1, 1);
+    x = uniform(-1, 1);
+    y = uniform(-1, 1);
+    z = uniform(-1, 1);
+    n = sqrt(w * w + x * x + y * y + z * z);
+  } while (n < 0.1 || n > 1);
+  double scale = uniform(0.98, 1.02) / n;
+  return { (float)(w * scale), (float)(x * scale), (float)(y * scale), (float)(z * scale) };
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ----------------------- Approximations -----------------------
+void test_atan2_error_bound() {
+  const double radii[] = { 1e-3, 1.0, 1e4 };
+  double worst = 0;
+  for (int i = 0; i <= 72000; i++) {
+    double a = -M_PI + 2 * M_PI * i / 72000;
+    for (double r : radii) {
+      float y = (float)(r * sin(a)), x = (float)(r * cos(a));
+      worst = fmax(worst, angleError(fastAtan2(y, x), atan2((double)y, (double)x)));
+    }
+  }
+  char msg[64];
+  snprintf(msg, sizeof(msg), "fastAtan2 max error %.2e rad", worst);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(worst < 1.2e-5);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, fastAtan2(0.0f, 0.0f));
+}
+
+void test_asin_error_bound() {
+  double worst = 0;
+  for (int i = -100000; i <= 100000; i++) {
+    float x = i / 100000.0f;
+    worst = fmax(worst, fabs(fastAsin(x) - asin((double)x)));
+  }
+  char msg[64];
+  snprintf(msg, sizeof(msg), "fastAsin max error %.2e rad", worst);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(worst < 7.0e-5);
+  // Rounding can push the argument just past 1
+  TEST_ASSERT_EQUAL_FLOAT(1.57079633f, fastAsin(1.0000001f));
+  TEST_ASSERT_EQUAL_FLOAT(-1.57079633f, fastAsin(-1.0000001f));
+}
+
+// ----------------------- Euler -----------------------
+void test_euler_against_reference() {
+  double worst[3] = {}, gimbalPitch = 0;
+  uint32_t gimbal = 0;
+  for (int i = 0; i < ROTATIONS; i++) {
+    Quat q = randomQuat();
+    orientationUpdate(q.w, q.x, q.y, q.z, 3);
+    const Euler& e = orientationEuler();
+    double yaw, pitch, roll;
+    referenceEuler(q.w, q.x, q.y, q.z, yaw, pitch, roll);
+
+    if (fabs(sin(pitch)) > GIMBAL_SIN) {
+      gimbal++;
+      gimbalPitch = fmax(gimbalPitch, fabs(e.pitch - pitch));
+      continue;
+    }
+    worst[0] = fmax(worst[0], angleError(e.yaw, yaw));
+    worst[1] = fmax(worst[1], fabs(e.pitch - pitch));
+    worst[2] = fmax(worst[2], angleError(e.roll, roll));
+  }
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%d rotations: max error yaw %.2e, pitch %.2e, roll %.2e rad "
+           "(%lu near gimbal lock, pitch %.2e)", ROTATIONS, worst[0], worst[1], worst[2], (unsigned long)gimbal,
+           gimbalPitch);
+  TEST_MESSAGE(msg);
+  for (double w : worst) TEST_ASSERT_TRUE(w < 1.2e-4);
+  TEST_ASSERT_TRUE(gimbalPitch < 1.2e-4);
+}
+
+// Axis rotations land on the expected angle, signs included
+void test_euler_axes() {
+  const float h = sqrtf(0.5f);
+  struct Case {
+    Quat  q;
+    float yaw, pitch, roll;
+  } cases[] = {
+    { { 1, 0, 0, 0 }, 0, 0, 0 },
+    { { h, 0, 0, h }, (float)M_PI_2, 0, 0 },
+    { { h, 0, h, 0 }, 0, (float)M_PI_2, 0 },
+    { { h, h, 0, 0 }, 0, 0, (float)M_PI_2 },
+    { { h, -h, 0, 0 }, 0, 0, -(float)M_PI_2 },
+    { { 0, 0, 0, 1 }, (float)M_PI, 0, 0 },
+  };
+  for (const Case& c : cases) {
+    orientationUpdate(c.q.w, c.q.x, c.q.y, c.q.z, 2);
+    const Euler& e = orientationEuler();
+    TEST_ASSERT_TRUE(angleError(e.yaw, c.yaw) < 1.2e-4);
+    TEST_ASSERT_FLOAT_WITHIN(1.2e-4f, c.pitch, e.pitch);
+    TEST_ASSERT_TRUE(angleError(e.roll, c.roll) < 1.2e-4);
+  }
+  TEST_ASSERT_TRUE(orientationValid());
+  TEST_ASSERT_EQUAL(2, orientationAccuracy());
+}
+
+// Converted on the first read after an update only
+void test_euler_lazy() {
+  orientationUpdate(1, 0, 0, 0, 3);
+  const Euler& e = orientationEuler();
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, e.yaw);
+  const float h = sqrtf(0.5f);
+  orientationUpdate(h, 0, 0, h, 3);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, e.yaw);              // stale until asked
+  TEST_ASSERT_FLOAT_WITHIN(1.2e-4f, (float)M_PI_2, orientationEuler().yaw);
+  TEST_ASSERT_EQUAL_PTR(&e, &orientationEuler());
+  TEST_ASSERT_EQUAL_FLOAT(h, orientationQuat().z);
+}
+
+// ----------------------- Benchmark -----------------------
+static Quat benchQuats[1024];
+
+void test_benchmark() {
+  for (Quat& q : benchQuats) q = randomQuat();
+  const int rounds = 500;
+  volatile float sink = 0;
+  volatile double dsink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const Quat& q : benchQuats) {
+      orientationUpdate(q.w, q.x, q.y, q.z, 3);
+      sink = sink + orientationEuler().roll;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const Quat& q : benchQuats) {
+      double yaw, pitch, roll;
+      referenceEuler(q.w, q.x, q.y, q.z, yaw, pitch, roll);
+      dsink = dsink + roll;
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const Quat& q : benchQuats) orientationUpdate(q.w, q.x, q.y, q.z, 3);
+  }
+  auto t3 = std::chrono::steady_clock::now();
+
+  const double n = rounds * 1024.0;
+  double fastNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+  double refNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / n;
+  double updateNs = std::chrono::duration<double, std::nano>(t3 - t2).count() / n;
+  char msg[160];
+  snprintf(msg, sizeof(msg), "host: float Euler %.1f ns, libm double %.1f ns, update alone %.1f ns "
+           "(double has no hardware on the ESP32-C3)", fastNs, refNs, updateNs);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(updateNs < fastNs);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_atan2_error_bound);
+  RUN_TEST(test_asin_error_bound);
+  RUN_TEST(test_euler_against_reference);
+  RUN_TEST(test_euler_axes);
+  RUN_TEST(test_euler_lazy);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,227 @@
+#include <unity.h>
+#include "outbox.h"
+#include "sim.h"
+
+// ----------------------- Outbox -----------------------
+// Slot choice, replay order and power loss at every byte of a write, on
+// the simulator's RAM flash so each case starts from an empty store.
+
+static void fresh() {
+  simFlashRam();
+  TEST_ASSERT_TRUE(outboxBegin());
+}
+
+static void reboot() {
+  simFlashPowerBack();
+  TEST_ASSERT_TRUE(outboxBegin());
+}
+
+static GnssFix fixFor(uint32_t n) {
+  GnssFix fix = {};
+  fix.latE7 = 473856667 + (int32_t)n;
+  fix.lonE7 = 85043333 - (int32_t)n;
+  fix.flags = GNSS_HAS_ALT;
+  return fix;
+}
+
+static bool hasSeq(uint32_t seq) {
+  static OutboxRecord recs[OUTBOX_SLOTS];
+  uint8_t n = outboxPeek(recs, OUTBOX_SLOTS);
+  for (uint8_t i = 0; i < n; i++) {
+    if (recs[i].seq == seq) return true;
+  }
+  return false;
+}
+
+void setUp() {
+  simSetLogHook(nullptr, false);
+}
+
+void tearDown() {}
+
+// ----------------------- Order and payloads -----------------------
+void test_replay_order_sos_first() {
+  fresh();
+  TEST_ASSERT_TRUE(outboxPushFix(fixFor(1), 100));
+  TEST_ASSERT_TRUE(outboxPushBattery(80, 101));
+  TEST_ASSERT_TRUE(outboxPushEvent("SOS Button A Pressed", 102, OUTBOX_PRIO_SOS, 0x2a));
+  TEST_ASSERT_TRUE(outboxPushEvent("Floor Up", 103, OUTBOX_PRIO_NORMAL));
+  TEST_ASSERT_EQUAL(4, outboxCount());
+  TEST_ASSERT_TRUE(outboxHasSos());
+
+  OutboxRecord recs[4];
+  TEST_ASSERT_EQUAL(4, outboxPeek(recs, 4));
+  TEST_ASSERT_EQUAL_STRING("SOS Button A Pressed", outboxEventType(recs[0]));
+  TEST_ASSERT_EQUAL_HEX32(0x2a, outboxEventId(recs[0]));
+  GnssFix fix;
+  TEST_ASSERT_TRUE(outboxFix(recs[1], fix));
+  TEST_ASSERT_EQUAL(fixFor(1).latE7, fix.latE7);
+  TEST_ASSERT_EQUAL_STRING("Floor Up", outboxEventType(recs[2]));
+  TEST_ASSERT_EQUAL(0, outboxEventId(recs[2]));
+  TEST_ASSERT_EQUAL(OUTBOX_BATTERY, recs[3].type);
+  TEST_ASSERT_EQUAL(80, recs[3].payload[0]);
+
+  outboxAck(recs[0].seq);
+  TEST_ASSERT_FALSE(outboxHasSos());
+  TEST_ASSERT_EQUAL(3, outboxCount());
+}
+
+void test_survives_reboot() {
+  fresh();
+  for (uint32_t i = 0; i < 10; i++) TEST_ASSERT_TRUE(outboxPushFix(fixFor(i), 100 + i));
+  outboxAck(3);
+  reboot();
+  TEST_ASSERT_EQUAL(9, outboxCount());
+  TEST_ASSERT_FALSE(hasSeq(3));
+  TEST_ASSERT_TRUE(outboxPushBattery(50, 200));
+  TEST_ASSERT_TRUE(hasSeq(11));    // numbering carries on after the newest
+}
+
+// ----------------------- Slot choice -----------------------
+// Acked slots behind the write position are reused before a live record
+void test_free_slot_before_overwrite() {
+  fresh();
+  for (uint32_t i = 0; i < OUTBOX_SLOTS; i++) TEST_ASSERT_TRUE(outboxPushFix(fixFor(i), i));
+  for (uint32_t seq = OUTBOX_SLOTS / 2; seq <= OUTBOX_SLOTS; seq++) outboxAck(seq);
+  uint16_t live = outboxCount();
+
+  TEST_ASSERT_TRUE(outboxPushBattery(10, 500));
+  TEST_ASSERT_EQUAL(live + 1, outboxCount());
+  for (uint32_t seq = 1; seq < OUTBOX_SLOTS / 2; seq++) TEST_ASSERT_TRUE(hasSeq(seq));
+}
+
+void test_full_drops_oldest_non_sos() {
+  fresh();
+  TEST_ASSERT_TRUE(outboxPushFix(fixFor(0), 0));
+  TEST_ASSERT_TRUE(outboxPushEvent("SOS Button A Pressed", 1, OUTBOX_PRIO_SOS, 1));
+  for (uint32_t i = 2; i < OUTBOX_SLOTS; i++) TEST_ASSERT_TRUE(outboxPushFix(fixFor(i), i));
+  TEST_ASSERT_EQUAL(OUTBOX_SLOTS, outboxCount());
+
+  TEST_ASSERT_TRUE(outboxPushBattery(10, 500));
+  TEST_ASSERT_EQUAL(OUTBOX_SLOTS, outboxCount());
+  TEST_ASSERT_FALSE(hasSeq(1));
+  TEST_ASSERT_TRUE(hasSeq(2));     // the SOS
+
+  TEST_ASSERT_TRUE(outboxPushBattery(11, 501));
+  TEST_ASSERT_TRUE(hasSeq(2));
+  TEST_ASSERT_FALSE(hasSeq(3));
+}
+
+void test_full_of_sos_drops_oldest() {
+  fresh();
+  for (uint32_t i = 0; i < OUTBOX_SLOTS; i++) {
+    TEST_ASSERT_TRUE(outboxPushEvent("SOS Button A Pressed", i, OUTBOX_PRIO_SOS, i + 1));
+  }
+  TEST_ASSERT_TRUE(outboxPushEvent("SOS Button A Pressed", 999, OUTBOX_PRIO_SOS, 999));
+  TEST_ASSERT_EQUAL(OUTBOX_SLOTS, outboxCount());
+  TEST_ASSERT_FALSE(hasSeq(1));
+  TEST_ASSERT_TRUE(hasSeq(2));
+  TEST_ASSERT_TRUE(hasSeq(OUTBOX_SLOTS + 1));
+}
+
+// ----------------------- Power loss -----------------------
+// The power goes at every byte of a push or an ack: after the reboot the
+// records written before are all there, and the one being written is
+// either complete or gone.
+void test_power_loss_during_push() {
+  uint32_t torn = 0, kept = 0;
+  for (uint32_t cut = 0; cut <= OUTBOX_SLOT_SIZE; cut++) {
+    fresh();
+    for (uint32_t i = 0; i < 5; i++) TEST_ASSERT_TRUE(outboxPushFix(fixFor(i), i));
+    outboxAck(2);
+
+    simFlashPowerCut(cut);
+    bool ok = outboxPushEvent("SOS Button B Pressed", 77, OUTBOX_PRIO_SOS, 0x77);
+    TEST_ASSERT_EQUAL(cut == OUTBOX_SLOT_SIZE, ok);
+    reboot();
+
+    for (uint32_t seq = 1; seq <= 5; seq++) TEST_ASSERT_EQUAL(seq != 2, hasSeq(seq));
+    if (outboxHasSos()) {
+      OutboxRecord rec;
+      TEST_ASSERT_EQUAL(1, outboxPeek(&rec, 1));
+      TEST_ASSERT_EQUAL_STRING("SOS Button B Pressed", outboxEventType(rec));
+      TEST_ASSERT_EQUAL_HEX32(0x77, outboxEventId(rec));
+      kept++;
+    } else {
+      TEST_ASSERT_EQUAL(4, outboxCount());
+      torn++;
+    }
+  }
+  TEST_ASSERT_EQUAL(1, kept);
+  TEST_ASSERT_EQUAL(OUTBOX_SLOT_SIZE, torn);
+}
+
+void test_power_loss_during_ack() {
+  for (uint32_t cut = 0; cut <= 2; cut++) {
+    fresh();
+    for (uint32_t i = 0; i < 3; i++) TEST_ASSERT_TRUE(outboxPushFix(fixFor(i), i));
+    simFlashPowerCut(cut);
+    outboxAck(2);
+    reboot();
+    // A lost ack only means the record goes up again
+    TEST_ASSERT_TRUE(hasSeq(1));
+    TEST_ASSERT_TRUE(hasSeq(3));
+    TEST_ASSERT_EQUAL(cut == 0, hasSeq(2));
+  }
+}
+
+// The store is preallocated on first boot; a cut there leaves a short
+// file that the next boot recreates
+void test_power_loss_during_format() {
+  simFlashRam();
+  simFlashPowerCut(OUTBOX_SLOTS * OUTBOX_SLOT_SIZE / 2 + 7);
+  TEST_ASSERT_FALSE(outboxBegin());
+  reboot();
+  TEST_ASSERT_EQUAL(0, outboxCount());
+  TEST_ASSERT_TRUE(outboxPushBattery(42, 1));
+  reboot();
+  TEST_ASSERT_EQUAL(1, outboxCount());
+}
+
+// Random cuts over a run of pushes and acks; nothing acknowledged comes
+// back and nothing pushed successfully before the cut is lost
+void test_power_loss_random() {
+  uint32_t state = 12345;
+  auto rnd = [&](uint32_t n) { state = state * 1103515245 + 12345; return (state >> 8) % n; };
+
+  for (uint32_t round = 0; round < 300; round++) {
+    fresh();
+    uint32_t ops = 5 + rnd(40);
+    uint32_t cutAt = simFlashWritten() + rnd(ops * OUTBOX_SLOT_SIZE);
+    simFlashPowerCut(cutAt - simFlashWritten());
+    bool pushed[256] = { false }, acked[256] = { false }, torn[256] = { false };
+    uint32_t seq = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+      if (seq && rnd(3) == 0) {
+        uint32_t s = 1 + rnd(seq), before = simFlashWritten();
+        outboxAck(s);
+        uint32_t wrote = simFlashWritten() - before;
+        if (wrote == 2) acked[s] = true;   // the whole mark reached flash
+        if (wrote == 1) torn[s] = true;    // half a mark: either way is fine
+      } else if (outboxPushFix(fixFor(i), i)) {
+        pushed[++seq] = true;
+      } else {
+        seq++;
+      }
+    }
+    reboot();
+    for (uint32_t s = 1; s <= seq; s++) {
+      if (acked[s]) TEST_ASSERT_FALSE(hasSeq(s));
+      else if (pushed[s] && !torn[s]) TEST_ASSERT_TRUE(hasSeq(s));
+    }
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_replay_order_sos_first);
+  RUN_TEST(test_survives_reboot);
+  RUN_TEST(test_free_slot_before_overwrite);
+  RUN_TEST(test_full_drops_oldest_non_sos);
+  RUN_TEST(test_full_of_sos_drops_oldest);
+  RUN_TEST(test_power_loss_during_push);
+  RUN_TEST(test_power_loss_during_ack);
+  RUN_TEST(test_power_loss_during_format);
+  RUN_TEST(test_power_loss_random);
+  return UNITY_END();
+}
@@ -0,0 +1,206 @@
+#include <unity.h>
+#include <string>
+#include "alloc_counter.h"
+#include "at_engine.h"
+#include "telemetry.h"
+#include "outbox.h"
+#include "track_codec.h"
+#include "sim.h"
+
+// ----------------------- Telemetry heap use -----------------------
+// Upload cycles against the simulated SIM7600 with the allocation counter
+// on (ALLOC_COUNTER in the native env): payload and AT strings are built
+// in fixed buffers, so a cycle after the first allocates nothing.
+
+#define CYCLES 20
+
+static GnssFix fixAt(uint32_t i) {
+  GnssFix fix = {};
+  fix.latE7 = 473760000 + 50 * (int32_t)i;
+  fix.lonE7 = 85400000 + 20 * (int32_t)i;
+  fix.altCm = 40800;
+  fix.speedCmS = 140;
+  fix.courseCdeg = 9000;
+  fix.day = 17;
+  fix.month = 10;
+  fix.year = 26;
+  fix.flags = GNSS_HAS_ALT | GNSS_HAS_SPEED | GNSS_HAS_COURSE;
+  return fix;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// The counter has to see both C and C++ allocations for a zero to mean anything
+void test_counter_counts() {
+  static void* volatile keep;      // or the compiler drops the pair
+  uint32_t before = allocCount();
+  keep = malloc(16);
+  TEST_ASSERT_EQUAL_UINT32(1, allocCount() - before);
+  free(keep);
+  std::string* volatile s = new std::string("a payload String concatenation would have built");
+  TEST_ASSERT_EQUAL_UINT32(3, allocCount() - before);    // the object and its buffer
+  delete s;
+}
+
+// Fix, battery, events and an ack up; commands down and parsed
+void test_cycle_allocates_nothing() {
+  static CommandBatch commands;
+  GnssFix fix = fixAt(0);
+  TEST_ASSERT_TRUE(telemetrySend(&fix, 80, commands));    // opens the session
+
+  uint32_t before = allocCount(), parsed = 0;
+  for (uint32_t i = 1; i <= CYCLES; i++) {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "{\"id\":\"c%lu\",\"command\":\"vibrate\",\"pattern\":\"tap\"}", (unsigned long)i);
+    simServerCommand(cmd);
+    telemetryQueueEvent("SOS Button A Pressed", 0x1000 + i, OUTBOX_PRIO_SOS);
+    telemetryQueueEvent("Floor Up");
+    fix = fixAt(i);
+    TEST_ASSERT_TRUE(telemetrySend(&fix, 80 - i, commands));
+    for (uint8_t k = 0; k < commands.count; k++) {
+      telemetryAckCommand(commands.items[k].id, "done");
+      parsed++;
+    }
+  }
+  uint32_t allocs = allocCount() - before;
+
+  TEST_ASSERT_GREATER_OR_EQUAL(CYCLES, parsed);
+  TEST_ASSERT_FALSE(telemetryEventsPending());
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%u cycles, %lu commands parsed: %lu allocations", CYCLES, (unsigned long)parsed,
+           (unsigned long)allocs);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(0, allocs);
+}
+
+// Only SOS and fall events call for an immediate cycle, and a queue full of
+// floors and geofences still takes one
+void test_event_priorities() {
+  TelemetryEvent taken[TELEMETRY_MAX_EVENTS];
+  telemetryTakeEvents(taken, TELEMETRY_MAX_EVENTS);
+  for (uint8_t i = 0; i < TELEMETRY_MAX_EVENTS; i++) TEST_ASSERT_TRUE(telemetryQueueEvent("Geofence Exit: Home"));
+  TEST_ASSERT_TRUE(telemetryEventsPending());
+  TEST_ASSERT_FALSE(telemetrySosEventsPending());
+  TEST_ASSERT_FALSE(telemetryQueueEvent("Floor Up"));
+
+  TEST_ASSERT_TRUE(telemetryQueueEvent("Fall Detected", 0x42, OUTBOX_PRIO_SOS));
+  TEST_ASSERT_TRUE(telemetrySosEventsPending());
+  TEST_ASSERT_EQUAL(TELEMETRY_MAX_EVENTS, telemetryTakeEvents(taken, TELEMETRY_MAX_EVENTS));
+  TEST_ASSERT_EQUAL(OUTBOX_PRIO_NORMAL, taken[0].priority);
+  TEST_ASSERT_EQUAL_STRING("Fall Detected", taken[TELEMETRY_MAX_EVENTS - 1].type);
+  TEST_ASSERT_EQUAL(OUTBOX_PRIO_SOS, taken[TELEMETRY_MAX_EVENTS - 1].priority);
+  TEST_ASSERT_FALSE(telemetrySosEventsPending());
+
+  // SOS events are never displaced, not even by another SOS
+  for (uint8_t i = 0; i < TELEMETRY_MAX_EVENTS; i++) {
+    TEST_ASSERT_TRUE(telemetryQueueEvent("SOS Button A Pressed", i + 1, OUTBOX_PRIO_SOS));
+  }
+  TEST_ASSERT_FALSE(telemetryQueueEvent("SOS Button B Pressed", 99, OUTBOX_PRIO_SOS));
+  TEST_ASSERT_EQUAL(TELEMETRY_MAX_EVENTS, telemetryTakeEvents(taken, TELEMETRY_MAX_EVENTS));
+  TEST_ASSERT_EQUAL_UINT32(1, taken[0].id);
+}
+
+// Queued from the AT idle hook while the POST is out, as main.cpp does
+static const char* const* duringPost = nullptr;
+static bool               duringPostQueued[3];
+
+static void queueDuringPost() {
+  if (!duringPost) return;
+  duringPostQueued[0] = telemetryQueueEvent(duringPost[0]);
+  duringPostQueued[1] = telemetryQueueEvent(duringPost[1]);
+  duringPostQueued[2] = telemetryQueueEvent(duringPost[2], 0x51, OUTBOX_PRIO_SOS);
+  duringPost = nullptr;
+}
+
+// An SOS queued while a POST is out never displaces an event in that POST:
+// those are dropped from the front once it succeeds
+void test_sos_during_post() {
+  static CommandBatch commands;
+  TelemetryEvent taken[TELEMETRY_MAX_EVENTS];
+  telemetryTakeEvents(taken, TELEMETRY_MAX_EVENTS);
+  atSetIdleHook(queueDuringPost);
+
+  // Room behind the POST: the SOS pushes out the oldest event queued after it
+  static const char* const LATE[] = { "Floor Up", "Floor Down" };
+  static const char* const TWO_LATE[] = { LATE[0], LATE[1], nullptr };
+  for (uint8_t i = 0; i < TELEMETRY_MAX_EVENTS - 2; i++) TEST_ASSERT_TRUE(telemetryQueueEvent("Geofence Exit: Home"));
+  duringPost = TWO_LATE;
+  TEST_ASSERT_TRUE(telemetrySend(nullptr, -1, commands));
+  TEST_ASSERT_TRUE(duringPostQueued[0] && duringPostQueued[1] && duringPostQueued[2]);
+  TEST_ASSERT_EQUAL(2, telemetryTakeEvents(taken, TELEMETRY_MAX_EVENTS));
+  TEST_ASSERT_EQUAL_STRING("Floor Down", taken[0].type);
+  TEST_ASSERT_EQUAL_UINT32(0x51, taken[1].id);
+
+  // Every event in the POST: the SOS is refused, so the caller can keep it
+  for (uint8_t i = 0; i < TELEMETRY_MAX_EVENTS - 2; i++) TEST_ASSERT_TRUE(telemetryQueueEvent("Geofence Exit: Home"));
+  duringPost = TWO_LATE;
+  TEST_ASSERT_TRUE(telemetryQueueEvent(LATE[0]));
+  TEST_ASSERT_TRUE(telemetryQueueEvent(LATE[1]));
+  TEST_ASSERT_TRUE(telemetrySend(nullptr, -1, commands));
+  TEST_ASSERT_FALSE(duringPostQueued[0] || duringPostQueued[1] || duringPostQueued[2]);
+  TEST_ASSERT_FALSE(telemetryEventsPending());
+
+  // Once the POST is done the whole queue is fair game again
+  for (uint8_t i = 0; i < TELEMETRY_MAX_EVENTS; i++) TEST_ASSERT_TRUE(telemetryQueueEvent("Geofence Exit: Home"));
+  TEST_ASSERT_TRUE(telemetryQueueEvent("SOS Button A Pressed", 0x52, OUTBOX_PRIO_SOS));
+  TEST_ASSERT_EQUAL(TELEMETRY_MAX_EVENTS, telemetryTakeEvents(taken, TELEMETRY_MAX_EVENTS));
+  atSetIdleHook(nullptr);
+}
+
+// A buffer is in use by pointer, until the event is taken or sent
+void test_event_buffer_in_use() {
+  static CommandBatch commands;
+  static char a[TRACK_EVENT_MAX] = "Geofence Exit: A", b[TRACK_EVENT_MAX] = "Geofence Exit: A";
+  TEST_ASSERT_TRUE(telemetryQueueEvent(a));
+  TEST_ASSERT_TRUE(telemetryEventQueued(a));
+  TEST_ASSERT_FALSE(telemetryEventQueued(b));
+  TEST_ASSERT_TRUE(telemetrySend(nullptr, -1, commands));
+  TEST_ASSERT_FALSE(telemetryEventQueued(a));
+}
+
+// Geofence names go into the event text; the server refuses a POST that
+// isn't JSON, and the event would stay queued
+void test_event_text_escaped() {
+  static CommandBatch commands;
+  uint32_t malformed = simStats().telemetryMalformed;
+  TEST_ASSERT_TRUE(telemetryQueueEvent("Geofence Enter: Bob's \"yard\" \\ \t"));
+  TEST_ASSERT_TRUE(telemetrySend(nullptr, -1, commands));
+  TEST_ASSERT_FALSE(telemetryEventsPending());
+  TEST_ASSERT_EQUAL_UINT32(malformed, simStats().telemetryMalformed);
+}
+
+// Outbox replay: peek, encode and POST the batch
+void test_replay_allocates_nothing() {
+  simFlashRam();
+  TEST_ASSERT_TRUE(outboxBegin());
+  for (uint32_t i = 0; i < TELEMETRY_BATCH_MAX; i++) {
+    GnssFix fix = fixAt(i);
+    TEST_ASSERT_TRUE(i % 8 ? outboxPushFix(fix, 1792224900 + i) : outboxPushEvent("Fall Detected", 1792224900 + i));
+  }
+  static OutboxRecord recs[TELEMETRY_BATCH_MAX];
+
+  uint32_t before = allocCount();
+  uint8_t n = outboxPeek(recs, TELEMETRY_BATCH_MAX);
+  uint8_t sent = telemetrySendBatch(recs, n);
+  for (uint8_t i = 0; i < sent; i++) outboxAck(recs[i].seq);
+  uint32_t allocs = allocCount() - before;
+
+  TEST_ASSERT_EQUAL(TELEMETRY_BATCH_MAX, sent);
+  TEST_ASSERT_EQUAL(0, outboxCount());
+  TEST_ASSERT_EQUAL_UINT32(0, allocs);
+}
+
+int main() {
+  simSetLogHook(nullptr, false);
+  atBegin(simModem());
+  UNITY_BEGIN();
+  RUN_TEST(test_counter_counts);
+  RUN_TEST(test_cycle_allocates_nothing);
+  RUN_TEST(test_event_priorities);
+  RUN_TEST(test_sos_during_post);
+  RUN_TEST(test_event_buffer_in_use);
+  RUN_TEST(test_event_text_escaped);
+  RUN_TEST(test_replay_allocates_nothing);
+  return UNITY_END();
+}
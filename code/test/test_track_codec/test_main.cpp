@@ -0,0 +1,345 @@
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "track_codec.h"
+#include "gnss.h"
+
+// ----------------------- Track codec -----------------------
+// Encode/decode round trips, a fixed vector shared with the server's
+// decoder (server/track.test.js), corrupt and cut-short streams, and bytes
+// and CPU per fix against the JSON the live path sends.
+
+static uint32_t rngState = 1;
+static uint32_t rnd(uint32_t n) {
+  rngState = rngState * 1103515245 + 12345;
+  return n ? (rngState >> 8) % n : 0;
+}
+
+static TrackRecord fixRecord(uint32_t seq, uint32_t utc, int32_t lat, int32_t lon, int32_t alt, uint32_t speed,
+                             uint16_t course, uint8_t flags) {
+  TrackRecord r = {};
+  r.type = TRACK_FIX;
+  r.flags = flags;
+  r.seq = seq;
+  r.utc = utc;
+  r.latE7 = lat;
+  r.lonE7 = lon;
+  r.altCm = alt;
+  r.speedCmS = speed;
+  r.courseCdeg = course;
+  return r;
+}
+
+static TrackRecord eventRecord(uint32_t seq, uint32_t utc, const char* text, uint32_t id) {
+  TrackRecord r = {};
+  r.type = TRACK_EVENT;
+  r.seq = seq;
+  r.utc = utc;
+  snprintf(r.event, sizeof(r.event), "%s", text);
+  r.eventId = id;
+  if (id) r.flags = TRACK_EVENT_HAS_ID;
+  return r;
+}
+
+static TrackRecord batteryRecord(uint32_t seq, uint32_t utc, uint8_t pct) {
+  TrackRecord r = {};
+  r.type = TRACK_BATTERY;
+  r.seq = seq;
+  r.utc = utc;
+  r.pct = pct;
+  return r;
+}
+
+// Fields the format carries for this record's type and flags
+static void assertSame(const TrackRecord& a, const TrackRecord& b) {
+  TEST_ASSERT_EQUAL(a.type, b.type);
+  TEST_ASSERT_EQUAL(a.flags, b.flags);
+  TEST_ASSERT_EQUAL_UINT32(a.seq, b.seq);
+  TEST_ASSERT_EQUAL_UINT32(a.utc, b.utc);
+  if (a.type == TRACK_FIX) {
+    TEST_ASSERT_EQUAL_INT32(a.latE7, b.latE7);
+    TEST_ASSERT_EQUAL_INT32(a.lonE7, b.lonE7);
+    if (a.flags & GNSS_HAS_ALT) TEST_ASSERT_EQUAL_INT32(a.altCm, b.altCm);
+    if (a.flags & GNSS_HAS_SPEED) TEST_ASSERT_EQUAL_UINT32(a.speedCmS, b.speedCmS);
+    if (a.flags & GNSS_HAS_COURSE) TEST_ASSERT_EQUAL_UINT16(a.courseCdeg, b.courseCdeg);
+  } else if (a.type == TRACK_BATTERY) {
+    TEST_ASSERT_EQUAL(a.pct, b.pct);
+  } else {
+    TEST_ASSERT_EQUAL_STRING(a.event, b.event);
+    if (a.flags & TRACK_EVENT_HAS_ID) TEST_ASSERT_EQUAL_UINT32(a.eventId, b.eventId);
+  }
+}
+
+static size_t encodeAll(const std::vector<TrackRecord>& recs, std::vector<uint8_t>& buf) {
+  buf.assign(TRACK_HEADER_LEN + recs.size() * 64, 0);
+  TrackEncoder enc;
+  TEST_ASSERT_TRUE(trackEncodeBegin(enc, buf.data(), buf.size()));
+  for (const TrackRecord& r : recs) TEST_ASSERT_TRUE(trackEncode(enc, r));
+  buf.resize(enc.len);
+  return enc.len;
+}
+
+static std::vector<TrackRecord> decodeAll(const uint8_t* buf, size_t len, TrackResult& last) {
+  std::vector<TrackRecord> out;
+  TrackDecoder dec;
+  last = trackDecodeBegin(dec, buf, len);
+  if (last != TRACK_OK) return out;
+  TrackRecord r;
+  while ((last = trackDecodeNext(dec, r)) == TRACK_OK) out.push_back(r);
+  return out;
+}
+
+// The fixed vector: a short walk with an SOS in the middle
+static std::vector<TrackRecord> vectorRecords() {
+  return {
+    fixRecord(1, 1792224900, 473856667, 85043333, 40820, 129, 9000,
+              GNSS_HAS_ALT | GNSS_HAS_SPEED | GNSS_HAS_COURSE),
+    fixRecord(2, 1792224905, 473856700, 85043290, 40810, 140, 9150,
+              GNSS_HAS_ALT | GNSS_HAS_SPEED | GNSS_HAS_COURSE),
+    eventRecord(3, 1792224906, "SOS Button A Pressed", 0x6b8b4567),
+    batteryRecord(4, 1792224910, 87),
+    fixRecord(5, 1792224920, -338666667, -1512000000, 0, 0, 0, 0),
+    eventRecord(6, 1792224930, "Floor Up", 0),
+  };
+}
+
+static const char VECTOR_HEX[] =
+    "544302710288ba99ad0db6eaf3c3038aa28d51e8fd04"
+    "8101a84671020a4255138c01be4713020214534f5320427574746f6e20412050726573736564e78a"
+    "addc0602020857010214cdfdf08606b3c987f30b0302"
+    "1408466c6f6f72205570";
+
+static std::vector<uint8_t> fromHex(const char* hex) {
+  std::vector<uint8_t> out;
+  for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+    unsigned v;
+    sscanf(hex + i, "%2x", &v);
+    out.push_back((uint8_t)v);
+  }
+  return out;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ----------------------- Round trips -----------------------
+void test_vector() {
+  std::vector<TrackRecord> recs = vectorRecords();
+  std::vector<uint8_t> buf;
+  encodeAll(recs, buf);
+
+  char hex[512] = "";
+  for (size_t i = 0; i < buf.size() && i * 2 + 2 < sizeof(hex); i++) snprintf(hex + i * 2, 3, "%02x", buf[i]);
+  TEST_ASSERT_EQUAL_STRING(VECTOR_HEX, hex);
+
+  TrackResult last;
+  std::vector<TrackRecord> back = decodeAll(buf.data(), buf.size(), last);
+  TEST_ASSERT_EQUAL(TRACK_END, last);
+  TEST_ASSERT_EQUAL(recs.size(), back.size());
+  for (size_t i = 0; i < recs.size(); i++) assertSame(recs[i], back[i]);
+}
+
+// Random walks with jumps, wraps and every flag combination
+void test_round_trip_random() {
+  rngState = 7;
+  for (uint32_t round = 0; round < 200; round++) {
+    std::vector<TrackRecord> recs;
+    uint32_t seq = rnd(1000), utc = 1700000000 + rnd(100000);
+    int32_t lat = (int32_t)rnd(1800000001) - 900000000, lon = (int32_t)rnd(3600000001u) - 1800000000;
+    int32_t alt = (int32_t)rnd(1000000) - 50000;
+    uint32_t n = 1 + rnd(60);
+    for (uint32_t i = 0; i < n; i++) {
+      seq += rnd(8) == 0 ? rnd(0xFFFFFFFF) : 1;    // gaps and wraps
+      utc += rnd(8) == 0 ? 0u - rnd(100) : rnd(30);
+      switch (rnd(4)) {
+        case 0: recs.push_back(batteryRecord(seq, utc, rnd(101))); break;
+        case 1: {
+          char text[TRACK_EVENT_MAX];
+          size_t len = rnd(TRACK_EVENT_MAX);
+          for (size_t k = 0; k < len; k++) text[k] = 1 + rnd(255);
+          text[len] = '\0';
+          recs.push_back(eventRecord(seq, utc, text, rnd(2) ? rnd(0xFFFFFFFF) : 0));
+          break;
+        }
+        default:
+          lat = std::max(-900000000, std::min(900000000, lat + (int32_t)rnd(2001) - 1000));
+          lon = std::max(-1800000000, std::min(1800000000, lon + (int32_t)rnd(2001) - 1000));
+          if (rnd(10) == 0) lat = -lat;           // jumps half the globe
+          if (rnd(10) == 0) lon = -lon;
+          alt += (int32_t)rnd(201) - 100;
+          recs.push_back(fixRecord(seq, utc, lat, lon, alt, rnd(5000), rnd(36000), rnd(8)));
+      }
+    }
+    std::vector<uint8_t> buf;
+    encodeAll(recs, buf);
+    TrackResult last;
+    std::vector<TrackRecord> back = decodeAll(buf.data(), buf.size(), last);
+    TEST_ASSERT_EQUAL(TRACK_END, last);
+    TEST_ASSERT_EQUAL(recs.size(), back.size());
+    for (size_t i = 0; i < recs.size(); i++) assertSame(recs[i], back[i]);
+  }
+}
+
+// A record that does not fit leaves the buffer as it was
+void test_encoder_full() {
+  uint8_t buf[40];
+  TrackEncoder enc;
+  TEST_ASSERT_FALSE(trackEncodeBegin(enc, buf, 2));
+  TEST_ASSERT_TRUE(trackEncodeBegin(enc, buf, sizeof(buf)));
+  std::vector<TrackRecord> recs = vectorRecords();
+  TEST_ASSERT_TRUE(trackEncode(enc, recs[0]));
+  size_t len = enc.len;
+  TEST_ASSERT_FALSE(trackEncode(enc, recs[2]));      // 20-character event
+  TEST_ASSERT_EQUAL(len, enc.len);
+  TEST_ASSERT_TRUE(trackEncode(enc, recs[3]));       // the delta state was not advanced
+
+  TrackResult last;
+  std::vector<TrackRecord> back = decodeAll(buf, enc.len, last);
+  TEST_ASSERT_EQUAL(TRACK_END, last);
+  TEST_ASSERT_EQUAL(2, back.size());
+  assertSame(recs[3], back[1]);
+}
+
+// ----------------------- Bad streams -----------------------
+void test_headers() {
+  TrackDecoder dec;
+  const uint8_t v1[] = { 'T', 'C', 1, 0x03, 0x02, 0x00, 0x02, 'h', 'i' };
+  TEST_ASSERT_EQUAL(TRACK_OK, trackDecodeBegin(dec, v1, sizeof(v1)));
+  TrackRecord r;
+  TEST_ASSERT_EQUAL(TRACK_OK, trackDecodeNext(dec, r));
+  TEST_ASSERT_EQUAL_STRING("hi", r.event);
+  TEST_ASSERT_EQUAL(TRACK_END, trackDecodeNext(dec, r));
+
+  const uint8_t v3[] = { 'T', 'C', TRACK_VERSION + 1 };
+  const uint8_t v0[] = { 'T', 'C', 0 };
+  const uint8_t json[] = { '{', '}', '\n' };
+  TEST_ASSERT_EQUAL(TRACK_BAD_VERSION, trackDecodeBegin(dec, v3, sizeof(v3)));
+  TEST_ASSERT_EQUAL(TRACK_BAD_VERSION, trackDecodeBegin(dec, v0, sizeof(v0)));
+  TEST_ASSERT_EQUAL(TRACK_MALFORMED, trackDecodeBegin(dec, json, sizeof(json)));
+  TEST_ASSERT_EQUAL(TRACK_MALFORMED, trackDecodeBegin(dec, v1, 2));
+}
+
+// Every prefix: whole records come back unchanged, then END or MALFORMED
+void test_truncated() {
+  std::vector<uint8_t> buf = fromHex(VECTOR_HEX);
+  std::vector<TrackRecord> recs = vectorRecords();
+  for (size_t cut = TRACK_HEADER_LEN; cut < buf.size(); cut++) {
+    std::vector<uint8_t> part(buf.begin(), buf.begin() + cut);   // exact size, so ASan sees overreads
+    TrackResult last;
+    std::vector<TrackRecord> back = decodeAll(part.data(), part.size(), last);
+    TEST_ASSERT_TRUE(last == TRACK_END || last == TRACK_MALFORMED);
+    TEST_ASSERT_TRUE(back.size() < recs.size() || last == TRACK_MALFORMED);
+    for (size_t i = 0; i < back.size(); i++) assertSame(recs[i], back[i]);
+  }
+}
+
+void test_fuzz() {
+  std::vector<uint8_t> base = fromHex(VECTOR_HEX);
+  rngState = 99;
+  uint32_t clean = 0;
+  for (uint32_t i = 0; i < 200000; i++) {
+    std::vector<uint8_t> buf = base;
+    for (uint32_t m = 1 + rnd(4); m; m--) {
+      size_t at = TRACK_HEADER_LEN + rnd(buf.size() - TRACK_HEADER_LEN);
+      switch (rnd(3)) {
+        case 0: buf[at] = rnd(256); break;
+        case 1: buf.erase(buf.begin() + at); break;
+        default: buf.insert(buf.begin() + at, rnd(256));
+      }
+      if (buf.size() <= TRACK_HEADER_LEN) break;
+    }
+    TrackResult last;
+    std::vector<TrackRecord> back = decodeAll(buf.data(), buf.size(), last);
+    for (const TrackRecord& r : back) {
+      TEST_ASSERT_TRUE(r.type >= TRACK_FIX && r.type <= TRACK_EVENT);
+      if (r.type == TRACK_FIX) {
+        TEST_ASSERT_TRUE(r.latE7 >= -900000000 && r.latE7 <= 900000000);
+        TEST_ASSERT_TRUE(r.lonE7 >= -1800000000 && r.lonE7 <= 1800000000);
+        TEST_ASSERT_TRUE(r.courseCdeg < 36000);
+      }
+      if (r.type == TRACK_BATTERY) TEST_ASSERT_TRUE(r.pct <= 100);
+      if (r.type == TRACK_EVENT) TEST_ASSERT_TRUE(strlen(r.event) < TRACK_EVENT_MAX);
+    }
+    if (last == TRACK_END) clean++;
+  }
+  char msg[80];
+  snprintf(msg, sizeof(msg), "%lu of 200000 mutated streams still decode to the end", (unsigned long)clean);
+  TEST_MESSAGE(msg);
+}
+
+// ----------------------- Size and CPU -----------------------
+// Same "gps" object telemetry.cpp builds for the live path
+static size_t fixJson(char* out, size_t size, const TrackRecord& r) {
+  uint32_t alat = r.latE7 < 0 ? -(int64_t)r.latE7 : r.latE7, alon = r.lonE7 < 0 ? -(int64_t)r.lonE7 : r.lonE7;
+  return snprintf(out, size, "{\"lat\":%s%lu.%07lu,\"lon\":%s%lu.%07lu,\"utc\":\"2026-10-17T08:15:%02luZ\","
+                  "\"alt_cm\":%ld,\"speed_cms\":%lu,\"course_cdeg\":%u}",
+                  r.latE7 < 0 ? "-" : "", (unsigned long)(alat / 10000000), (unsigned long)(alat % 10000000),
+                  r.lonE7 < 0 ? "-" : "", (unsigned long)(alon / 10000000), (unsigned long)(alon % 10000000),
+                  (unsigned long)(r.utc % 60), (long)r.altCm, (unsigned long)r.speedCmS, r.courseCdeg);
+}
+
+void test_size_and_cpu() {
+  // Ten minutes of walking at one fix every 5 s, all fields
+  std::vector<TrackRecord> recs;
+  rngState = 3;
+  int32_t lat = 473856667, lon = 85043333, alt = 40820;
+  for (uint32_t i = 0; i < 120; i++) {
+    lat += 60 + (int32_t)rnd(21) - 10;       // ~7 m per 5 s
+    lon += 30 + (int32_t)rnd(21) - 10;
+    alt += (int32_t)rnd(41) - 20;
+    recs.push_back(fixRecord(1 + i, 1792224900 + 5 * i, lat, lon, alt, 130 + rnd(20), 2600 + rnd(300),
+                             GNSS_HAS_ALT | GNSS_HAS_SPEED | GNSS_HAS_COURSE));
+  }
+  std::vector<uint8_t> buf;
+  size_t binary = encodeAll(recs, buf);
+  char json[160];
+  size_t jsonBytes = 0;
+  for (const TrackRecord& r : recs) jsonBytes += fixJson(json, sizeof(json), r) + 1;   // plus the comma
+
+  const uint32_t runs = 2000;
+  volatile uint32_t sink = 0;
+  std::vector<uint8_t> scratch(buf.size() + 64);
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < runs; k++) {
+    TrackEncoder enc;
+    trackEncodeBegin(enc, scratch.data(), scratch.size());
+    for (const TrackRecord& r : recs) trackEncode(enc, r);
+    sink += enc.len;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < runs; k++) {
+    TrackDecoder dec;
+    TrackRecord r;
+    trackDecodeBegin(dec, buf.data(), buf.size());
+    while (trackDecodeNext(dec, r) == TRACK_OK) sink += r.latE7;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < runs; k++) {
+    for (const TrackRecord& r : recs) sink += fixJson(json, sizeof(json), r);
+  }
+  auto t3 = std::chrono::steady_clock::now();
+
+  double per = (double)runs * recs.size();
+  double encNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / per;
+  double decNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / per;
+  double jsonNs = std::chrono::duration<double, std::nano>(t3 - t2).count() / per;
+  char msg[200];
+  snprintf(msg, sizeof(msg), "walk: %.1f B per fix vs %.1f B JSON (%.1fx smaller); encode %.0f ns, decode %.0f ns, "
+           "JSON format %.0f ns per fix", (double)(binary - TRACK_HEADER_LEN) / recs.size(),
+           (double)jsonBytes / recs.size(), (double)jsonBytes / binary, encNs, decNs, jsonNs);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_LESS_THAN(jsonBytes / 5, binary);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_vector);
+  RUN_TEST(test_round_trip_random);
+  RUN_TEST(test_encoder_full);
+  RUN_TEST(test_headers);
+  RUN_TEST(test_truncated);
+  RUN_TEST(test_fuzz);
+  RUN_TEST(test_size_and_cpu);
+  return UNITY_END();
+}
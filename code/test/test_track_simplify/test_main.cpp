@@ -0,0 +1,228 @@
+#include <unity.h>
+#include <math.h>
+#include <vector>
+#include "track_simplify.h"
+
+// ----------------------- Track simplification -----------------------
+// The simplifier's rules on hand-made tracks, then a walk and a drive
+// through town: 5 s fixes of a known route with correlated GNSS noise, run
+// through the simplifier at several tolerances. Reported per trace: how
+// many fewer points go out, and the largest distance from any fix, and
+// from the true route, to the line through the kept points.
+
+#define BASE_LAT     473769000      // Zurich, as in the simulator scenarios
+#define BASE_LON     85417000
+#define FIX_PERIOD_S 5
+
+struct Point {
+  float x, y;       // metres east and north of the base point
+};
+
+struct Waypoint {
+  float    x, y;
+  float    speedMs;     // on the way there
+  uint32_t stopS;       // standing still once there
+};
+
+struct Trace {
+  std::vector<Point>   truth;
+  std::vector<GnssFix> fixes;
+};
+
+static uint32_t rng = 2463534242u;
+
+static float uniform() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return (rng + 0.5f) / 4294967296.0f;
+}
+
+static float gauss() {
+  return sqrtf(-2.0f * logf(uniform())) * cosf(2.0f * (float)M_PI * uniform());
+}
+
+static GnssFix fixAt(float x, float y) {
+  GnssFix f = {};
+  double lat = BASE_LAT + y * 1e7 / 111320.0;
+  f.latE7 = (int32_t)lrint(lat);
+  f.lonE7 = BASE_LON + (int32_t)lrint(x * 1e7 / (111320.0 * cos(lat * M_PI / 180 / 1e7)));
+  return f;
+}
+
+// Fixes along the route every FIX_PERIOD_S, with GNSS error that drifts
+// (first-order, sigmaM standard deviation) rather than jumping per fix
+static Trace travel(const std::vector<Waypoint>& route, float sigmaM) {
+  std::vector<Point> seconds;
+  Point at = { 0, 0 };
+  for (const Waypoint& w : route) {
+    float dx = w.x - at.x, dy = w.y - at.y;
+    uint32_t steps = (uint32_t)ceilf(sqrtf(dx * dx + dy * dy) / w.speedMs);
+    for (uint32_t i = 1; i <= steps; i++) seconds.push_back({ at.x + dx * i / steps, at.y + dy * i / steps });
+    at = { w.x, w.y };
+    for (uint32_t i = 0; i < w.stopS; i++) seconds.push_back(at);
+  }
+
+  Trace t;
+  float nx = 0, ny = 0;
+  const float keep = 0.9f, kick = sqrtf(1 - keep * keep) * sigmaM;
+  for (size_t s = 0; s < seconds.size(); s += FIX_PERIOD_S) {
+    nx = keep * nx + kick * gauss();
+    ny = keep * ny + kick * gauss();
+    t.truth.push_back(seconds[s]);
+    t.fixes.push_back(fixAt(seconds[s].x + nx, seconds[s].y + ny));
+  }
+  return t;
+}
+
+// 15-degree steps around a circle, from angle a0 to a1 (degrees)
+static void arc(std::vector<Waypoint>& route, float cx, float cy, float r, float a0, float a1, float speedMs) {
+  int steps = (int)fabsf(a1 - a0) / 15;
+  for (int i = 1; i <= steps; i++) {
+    float a = (a0 + (a1 - a0) * i / steps) * (float)M_PI / 180;
+    route.push_back({ cx + r * cosf(a), cy + r * sinf(a), speedMs, 0 });
+  }
+}
+
+struct Result {
+  std::vector<GnssFix> kept;
+  float ratio, fixErrM, routeErrM;
+};
+
+static float distanceToTrack(const std::vector<GnssFix>& kept, const GnssFix& p) {
+  uint32_t best = trackSegmentDistanceCm(kept[0], kept[0], p);
+  for (size_t i = 1; i < kept.size(); i++) {
+    uint32_t d = trackSegmentDistanceCm(kept[i - 1], kept[i], p);
+    if (d < best) best = d;
+  }
+  return best / 100.0f;
+}
+
+static Result simplify(const Trace& t, uint32_t toleranceCm, uint32_t deadbandCm = TRACK_DEADBAND_CM) {
+  static TrackSimplifier s;
+  trackSimplifyBegin(s, toleranceCm, deadbandCm);
+  Result r = {};
+  GnssFix out;
+  for (const GnssFix& f : t.fixes) {
+    if (trackSimplifyPush(s, f, out)) r.kept.push_back(out);
+  }
+  if (trackSimplifyFlush(s, out)) r.kept.push_back(out);
+  TEST_ASSERT_EQUAL_UINT32(t.fixes.size(), s.stats.in);
+  TEST_ASSERT_EQUAL_UINT32(r.kept.size(), s.stats.kept);
+
+  r.ratio = (float)t.fixes.size() / r.kept.size();
+  for (const GnssFix& f : t.fixes) r.fixErrM = fmaxf(r.fixErrM, distanceToTrack(r.kept, f));
+  for (const Point& p : t.truth) r.routeErrM = fmaxf(r.routeErrM, distanceToTrack(r.kept, fixAt(p.x, p.y)));
+  return r;
+}
+
+// Every fix is within tolerance + dead-band of the kept line
+static void report(const char* what, const Trace& t) {
+  const uint32_t tolerances[] = { 500, TRACK_TOLERANCE_CM, 3000 };
+  for (uint32_t tol : tolerances) {
+    Result r = simplify(t, tol);
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s, %u fixes, %lu m tolerance: %u kept (%.1fx), max error %.1f m to fixes, "
+             "%.1f m to the route", what, (unsigned)t.fixes.size(), (unsigned long)(tol / 100),
+             (unsigned)r.kept.size(), r.ratio, r.fixErrM, r.routeErrM);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(r.fixErrM <= (tol + TRACK_DEADBAND_CM) / 100.0f + 0.05f);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ----------------------- Rules -----------------------
+void test_distance_to_segment() {
+  GnssFix a = fixAt(0, 0), b = fixAt(100, 0);
+  TEST_ASSERT_UINT32_WITHIN(2, 1000, trackSegmentDistanceCm(a, b, fixAt(50, 10)));
+  TEST_ASSERT_UINT32_WITHIN(2, 500, trackSegmentDistanceCm(a, b, fixAt(-3, 4)));    // past an end
+  TEST_ASSERT_UINT32_WITHIN(2, 2500, trackSegmentDistanceCm(a, a, fixAt(15, 20)));  // a point
+}
+
+// The first fix goes out at once; a straight line keeps only the ends
+// and one point per full window
+void test_straight_line() {
+  static TrackSimplifier s;
+  trackSimplifyBegin(s);
+  GnssFix out;
+  TEST_ASSERT_TRUE(trackSimplifyPush(s, fixAt(0, 0), out));
+  uint32_t kept = 1;
+  for (int i = 1; i <= 3 * TRACK_SIMPLIFY_WINDOW; i++) kept += trackSimplifyPush(s, fixAt(i * 20.0f, 0), out);
+  TEST_ASSERT_EQUAL_UINT32(1 + 2, kept);
+  TEST_ASSERT_TRUE(trackSimplifyFlush(s, out));
+  TEST_ASSERT_UINT32_WITHIN(2, 0, trackSegmentDistanceCm(out, out, fixAt(3 * TRACK_SIMPLIFY_WINDOW * 20.0f, 0)));
+  TEST_ASSERT_FALSE(trackSimplifyFlush(s, out));
+}
+
+// A corner is kept; the fix before it, not the one after
+void test_corner_kept() {
+  static TrackSimplifier s;
+  trackSimplifyBegin(s);
+  GnssFix out;
+  trackSimplifyPush(s, fixAt(0, 0), out);
+  for (int i = 1; i <= 10; i++) TEST_ASSERT_FALSE(trackSimplifyPush(s, fixAt(0, i * 20.0f), out));
+  TEST_ASSERT_TRUE(trackSimplifyPush(s, fixAt(20, 200), out));
+  TEST_ASSERT_UINT32_WITHIN(2, 0, trackSegmentDistanceCm(out, out, fixAt(0, 200)));
+}
+
+// An hour standing still with 3 m jitter: the dead-band keeps it to a
+// handful of points, all close to where the wearer is
+void test_still_jitter() {
+  std::vector<Waypoint> route = { { 0, 0, 1, 3600 } };
+  Trace t = travel(route, 3.0f);
+  Result r = simplify(t, TRACK_TOLERANCE_CM);
+  char msg[100];
+  snprintf(msg, sizeof(msg), "1 h still, %u fixes: %u kept, all within %.1f m", (unsigned)t.fixes.size(),
+           (unsigned)r.kept.size(), r.routeErrM);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_LESS_OR_EQUAL(10, r.kept.size());
+  for (const GnssFix& k : r.kept) TEST_ASSERT_LESS_OR_EQUAL(1500, trackSegmentDistanceCm(k, k, fixAt(0, 0)));
+}
+
+// ----------------------- Traces -----------------------
+// Home to the shops and back: street corners, a wait at a crossing, ten
+// minutes in a shop, a diagonal across the park
+void test_walk() {
+  std::vector<Waypoint> route = {
+    { 0, 180, 1.4f, 0 },      { 250, 180, 1.4f, 45 },   { 250, 420, 1.3f, 0 },
+    { 520, 600, 1.4f, 0 },    { 520, 700, 1.2f, 600 },  { 300, 700, 1.4f, 20 },
+    { 300, 520, 1.4f, 0 },    { 0, 0, 1.5f, 0 },
+  };
+  Trace t = travel(route, 3.0f);
+  report("walk", t);
+  Result r = simplify(t, TRACK_TOLERANCE_CM);
+  TEST_ASSERT_TRUE(r.ratio > 8);
+  TEST_ASSERT_TRUE(r.routeErrM < 30);
+}
+
+// Across town by car: blocks, a light, a turn, a roundabout, a long bend
+// onto the ring road
+void test_drive() {
+  std::vector<Waypoint> route = { { 0, 600, 13, 40 } };
+  arc(route, 15, 600, 15, 180, 90, 6);
+  route.push_back({ 400, 615, 13, 0 });
+  route.push_back({ 400, 980, 12, 30 });
+  arc(route, 400, 1000, 20, 270, 0, 7);              // roundabout, third exit
+  route.push_back({ 420, 1400, 14, 0 });
+  arc(route, 720, 1400, 300, 180, 90, 16);            // bend onto the ring road
+  route.push_back({ 2800, 1700, 22, 0 });
+  route.push_back({ 2800, 2300, 14, 60 });
+  Trace t = travel(route, 4.0f);
+  report("drive", t);
+  Result r = simplify(t, TRACK_TOLERANCE_CM);
+  TEST_ASSERT_TRUE(r.ratio > 4);
+  TEST_ASSERT_TRUE(r.routeErrM < 30);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_distance_to_segment);
+  RUN_TEST(test_straight_line);
+  RUN_TEST(test_corner_kept);
+  RUN_TEST(test_still_jitter);
+  RUN_TEST(test_walk);
+  RUN_TEST(test_drive);
+  return UNITY_END();
+}
@@ -0,0 +1,147 @@
+#include <unity.h>
+#include <algorithm>
+#include "vibration.h"
+#include "sim.h"
+
+// ----------------------- Haptic engine -----------------------
+// The timing model on its own, then the engine on the simulator's timer
+// and LEDC while a stand-in loop() keeps running, against the old
+// vibrateContinuous_ms() that held loop() in delay() for the whole alert.
+
+#define LOOP_WORK_MS  5      // what one loop() pass costs in the stand-in
+
+static bool done;
+
+void setUp() {
+  vibStop();
+}
+
+void tearDown() {}
+
+// ----------------------- Timing model -----------------------
+void test_tap_ramp_and_hold() {
+  TEST_ASSERT_EQUAL(0, vibDutyAt(VIB_PATTERN_TAP, 0, done));
+  TEST_ASSERT_FALSE(done);
+  TEST_ASSERT_EQUAL(VIB_TAP_DUTY / 2, vibDutyAt(VIB_PATTERN_TAP, VIB_TAP_RAMP / 2, done));
+  TEST_ASSERT_EQUAL(VIB_TAP_DUTY, vibDutyAt(VIB_PATTERN_TAP, VIB_TAP_RAMP, done));
+  TEST_ASSERT_EQUAL(VIB_TAP_DUTY, vibDutyAt(VIB_PATTERN_TAP, 199, done));
+  TEST_ASSERT_FALSE(done);
+  TEST_ASSERT_EQUAL(0, vibDutyAt(VIB_PATTERN_TAP, 200, done));
+  TEST_ASSERT_TRUE(done);
+}
+
+void test_ramp_is_monotonic() {
+  uint8_t last = 0;
+  for (uint32_t t = 0; t < VIB_RAMP_MS; t++) {
+    uint8_t duty = vibDutyAt(VIB_PATTERN_ALERT, t, done);
+    TEST_ASSERT_TRUE(duty >= last);
+    TEST_ASSERT_TRUE(duty <= VIB_DUTY);
+    last = duty;
+  }
+  TEST_ASSERT_EQUAL(VIB_DUTY, vibDutyAt(VIB_PATTERN_ALERT, VIB_RAMP_MS, done));
+}
+
+// Each repeat of the pulse starts from the off step, so there is no jump
+void test_pulse_repeats() {
+  const uint32_t len = VIB_RAMP_MS + 600 + 100 + 400;
+  for (uint32_t k = 0; k < VIB_PATTERN_PULSE.repeats; k++) {
+    TEST_ASSERT_EQUAL(0, vibDutyAt(VIB_PATTERN_PULSE, k * len, done));
+    TEST_ASSERT_EQUAL(VIB_DUTY, vibDutyAt(VIB_PATTERN_PULSE, k * len + VIB_RAMP_MS + 300, done));
+    TEST_ASSERT_EQUAL(VIB_DUTY / 2, vibDutyAt(VIB_PATTERN_PULSE, k * len + VIB_RAMP_MS + 600 + 50, done));
+    TEST_ASSERT_FALSE(done);
+  }
+  vibDutyAt(VIB_PATTERN_PULSE, VIB_PATTERN_PULSE.repeats * len, done);
+  TEST_ASSERT_TRUE(done);
+}
+
+// ----------------------- Engine -----------------------
+// The LEDC follows the model within one tick while loop() runs at its own pace
+void test_plays_in_background() {
+  vibPlay(VIB_PATTERN_DOUBLE_TAP);
+  uint32_t start = millis(), passes = 0, worstGap = 0, last = start;
+  while (vibActive() && millis() - start < 2000) {
+    delay(LOOP_WORK_MS);
+    uint32_t now = millis();
+    worstGap = std::max(worstGap, now - last);
+    last = now;
+    passes++;
+
+    uint32_t t = now - start;
+    uint8_t lo = 255, hi = 0;
+    for (uint32_t back = 0; back <= VIB_TICK_MS && back <= t; back++) {
+      uint8_t d = vibDutyAt(VIB_PATTERN_DOUBLE_TAP, t - back, done);
+      lo = std::min(lo, d);
+      hi = std::max(hi, d);
+    }
+    uint32_t duty = simPwmDuty(VIB_PWM_CH);
+    TEST_ASSERT_TRUE(duty >= lo && duty <= hi);
+  }
+  TEST_ASSERT_FALSE(vibActive());
+  TEST_ASSERT_EQUAL(0, simPwmDuty(VIB_PWM_CH));
+  TEST_ASSERT_UINT32_WITHIN(VIB_TICK_MS, 60 + 120 + 120 + 60 + 120, millis() - start);
+  TEST_ASSERT_EQUAL(LOOP_WORK_MS, worstGap);
+  TEST_ASSERT_GREATER_OR_EQUAL(80, passes);
+}
+
+// The server's "stop" cuts the motor at once, mid-ramp or mid-hold
+void test_stop_mid_pattern() {
+  const uint32_t cuts[] = { VIB_RAMP_MS / 2, VIB_RAMP_MS + 5000 };
+  for (uint32_t cut : cuts) {
+    vibPlay(VIB_PATTERN_ALERT);
+    delay(cut);
+    TEST_ASSERT_TRUE(vibActive());
+    TEST_ASSERT_NOT_EQUAL(0, simPwmDuty(VIB_PWM_CH));
+    vibStop();
+    TEST_ASSERT_FALSE(vibActive());
+    TEST_ASSERT_EQUAL(0, simPwmDuty(VIB_PWM_CH));
+    delay(1000);
+    TEST_ASSERT_EQUAL(0, simPwmDuty(VIB_PWM_CH));
+  }
+}
+
+// A tap while the alert plays replaces it instead of queueing behind it
+void test_new_pattern_replaces_current() {
+  vibPlay(VIB_PATTERN_ALERT);
+  delay(3000);
+  vibPlay(VIB_PATTERN_TAP);
+  uint32_t start = millis();
+  while (vibActive()) delay(1);
+  TEST_ASSERT_UINT32_WITHIN(VIB_TICK_MS, 200, millis() - start);
+  TEST_ASSERT_EQUAL(0, simPwmDuty(VIB_PWM_CH));
+}
+
+// Loop cadence over the whole 60 s remote alert
+void test_loop_cadence_during_alert() {
+  vibPlay(VIB_PATTERN_ALERT);
+  uint32_t start = millis(), passes = 0, worstGap = 0, last = start;
+  while (vibActive()) {
+    delay(LOOP_WORK_MS);
+    uint32_t now = millis();
+    worstGap = std::max(worstGap, now - last);
+    last = now;
+    passes++;
+  }
+  uint32_t playedMs = millis() - start;
+  TEST_ASSERT_UINT32_WITHIN(VIB_TICK_MS + LOOP_WORK_MS, VIB_RAMP_MS + 60000, playedMs);
+  TEST_ASSERT_EQUAL(LOOP_WORK_MS, worstGap);
+
+  char msg[160];
+  snprintf(msg, sizeof(msg), "60 s alert: loop() ran %lu times, longest gap %lu ms "
+           "(vibrateContinuous_ms(): once, %lu ms gap)", (unsigned long)passes, (unsigned long)worstGap,
+           (unsigned long)playedMs);
+  TEST_MESSAGE(msg);
+}
+
+int main() {
+  simSetLogHook(nullptr, false);
+  vibBegin(3);
+  UNITY_BEGIN();
+  RUN_TEST(test_tap_ramp_and_hold);
+  RUN_TEST(test_ramp_is_monotonic);
+  RUN_TEST(test_pulse_repeats);
+  RUN_TEST(test_plays_in_background);
+  RUN_TEST(test_stop_mid_pattern);
+  RUN_TEST(test_new_pattern_replaces_current);
+  RUN_TEST(test_loop_cadence_during_alert);
+  return UNITY_END();
+}
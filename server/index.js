@@ -1,6 +1,8 @@
 const express = require('express');
 const cors = require('cors');
 const fs = require('fs');
+const { MqttClient } = require('./mqtt');
+const { decodeTrack } = require('./track');
 
 const app = express();
 const PORT = 3000;
@@ -8,6 +10,10 @@ const PORT = 3000;
 // --- Config ---
 const COMMAND_TTL_MS = 5 * 60 * 1000; // 5 minutes
 const MAX_QUEUE_LEN = 5;              // keep latest 5 for gps/batt/geofence
+// Command push over MQTT (code/include/mqtt_link.h); an empty URL turns it off.
+// DEVICE_IMEI lists the devices to publish to, comma-separated.
+const MQTT_BROKER_URL = process.env.MQTT_BROKER_URL ?? 'tcp://ma8w.ddns.net:1883';
+const DEVICE_IMEIS = (process.env.DEVICE_IMEI || '').split(',').map(s => s.trim()).filter(Boolean);
 
 // --- Enable CORS for all origins ---
 app.use(cors({
@@ -32,9 +38,12 @@ function logWithTime(...args) {
 let queues = {
   gps: [],
   commands: [],
+  commandAcks: [],
   battPercentage: [],
   geofencingData: [],
-  events: []
+  events: [],
+  fallSnapshots: [],
+  diagnostics: []
 };
 
 try {
@@ -63,10 +72,151 @@ function pruneOldCommands() {
   }
 }
 
+// Commands go to the device with an ID and stay queued until it acks that
+// ID (code/include/commands.h). Only the fields the device reads are sent.
+const COMMAND_FIELDS = ['pattern', 'period_s', 'free_fall_mg', 'impact_mg'];
+const MAX_ACK_LEN = 50;
+const MAX_COMMANDS_PER_POST = 8;   // COMMAND_MAX on the device
+let commandSeq = 0;
+
+function newCommand(body) {
+  const command = { id: `c${Date.now().toString(36)}${(commandSeq++).toString(36)}`, command: String(body.command) };
+  for (const f of COMMAND_FIELDS) {
+    if (body[f] === undefined || body[f] === '') continue;
+    const n = Number(body[f]);
+    command[f] = f === 'pattern' ? String(body[f]) : n;
+  }
+  command.timestamp = new Date().toISOString();
+  return command;
+}
+
+function deviceCommand(c) {
+  const out = { id: c.id, command: c.command };
+  for (const f of COMMAND_FIELDS) if (c[f] !== undefined) out[f] = c[f];
+  return out;
+}
+
+// First hand-out on either channel; send-to-ack latency runs from here
+function markSent(c) {
+  if (!c.sentAt) c.sentAt = new Date().toISOString();
+}
+
+// Drops acked commands; returns how many matched
+function ackCommands(acks, channel) {
+  let matched = 0;
+  for (const ack of Array.isArray(acks) ? acks : []) {
+    if (!ack || ack.id === undefined) continue;
+    const i = queues.commands.findIndex(c => c.id === String(ack.id));
+    if (i < 0) continue;
+    const [c] = queues.commands.splice(i, 1);
+    const now = Date.now();
+    const latencyMs = now - new Date(c.timestamp).getTime();
+    const sendToAckMs = c.sentAt ? now - new Date(c.sentAt).getTime() : null;
+    const execMs = Number.isFinite(ack.exec_ms) ? ack.exec_ms : null;
+    queues.commandAcks = queues.commandAcks || [];
+    queues.commandAcks.push({ id: c.id, command: c.command, status: ack.status || null, channel, latencyMs,
+                              sendToAckMs, execMs, timestamp: new Date(now).toISOString() });
+    keepLastN(queues.commandAcks, MAX_ACK_LEN);
+    logWithTime(`Command ${c.id} (${c.command}) acked via ${channel}: ${ack.status}, ${latencyMs} ms after upload,` +
+                ` ${sendToAckMs} ms after send`);
+    matched++;
+  }
+  return matched;
+}
+
+// --- MQTT command push ---
+// Commands go out on tripcharm/<imei>/cmd as soon as they are uploaded and
+// again on every reconnect; acks come back on tripcharm/<imei>/ack. The
+// device runs an ID once, so one also handed out over HTTP is harmless.
+const deviceImeis = new Set(DEVICE_IMEIS);
+let mqtt = null;
+
+function publishCommand(c) {
+  if (!mqtt || !mqtt.connected) return;
+  const payload = JSON.stringify(deviceCommand(c));
+  let sent = false;
+  for (const imei of deviceImeis) sent = mqtt.publish(`tripcharm/${imei}/cmd`, payload) > 0 || sent;
+  if (sent) markSent(c);
+}
+
+function startMqtt() {
+  if (!MQTT_BROKER_URL) return;
+  mqtt = new MqttClient(MQTT_BROKER_URL, { subscriptions: ['tripcharm/+/ack'] });
+  mqtt.on('connect', () => {
+    logWithTime(`MQTT connected to ${MQTT_BROKER_URL}, ${deviceImeis.size} device(s)`);
+    pruneOldCommands();
+    queues.commands.forEach(publishCommand);
+    saveQueues();
+  });
+  mqtt.on('close', () => logWithTime("MQTT connection lost"));
+  mqtt.on('message', (topic, payload) => {
+    const m = /^tripcharm\/([^/]+)\/ack$/.exec(topic);
+    if (!m) return;
+    deviceImeis.add(m[1]);
+    let ack;
+    try {
+      ack = JSON.parse(payload.toString());
+    } catch (e) {
+      logWithTime(`MQTT ack from ${m[1]} is not JSON`);
+      return;
+    }
+    if (ackCommands([ack], 'mqtt')) saveQueues();
+  });
+  mqtt.start();
+}
+
 function keepLastN(arr, n) {
   if (arr.length > n) arr.splice(0, arr.length - n);
 }
 
+// --- Device events ---
+// A fall's accelerometer snapshot comes in its own POST and is attached to
+// the event with the same id, whichever of the two arrives first
+const MAX_PENDING_SNAPSHOTS = 8;
+
+// An event with an id is stored once. Every SOS event of one alert carries
+// the same id, and one event can arrive live, again from the outbox when
+// the response was lost, or through /api/upload/event (e.g. the guardian's
+// text forwarded by an SMS gateway). Later copies only add their channel
+// and count as repeats. Returns false for such a copy.
+function addEvent(event, channel) {
+  if (event.id) {
+    const seen = queues.events.findLast(e => e.id === event.id);
+    if (seen) {
+      seen.channels = seen.channels || [];
+      if (!seen.channels.includes(channel)) seen.channels.push(channel);
+      seen.repeats = (seen.repeats || 0) + 1;
+      if (!seen.gps && event.gps) seen.gps = event.gps;
+      return false;
+    }
+    event.channels = [channel];
+  }
+  queues.fallSnapshots = queues.fallSnapshots || [];
+  const i = event.id ? queues.fallSnapshots.findIndex(s => s.id === event.id) : -1;
+  if (i >= 0) event.snapshot = queues.fallSnapshots.splice(i, 1)[0];
+  queues.events.push(event);
+  return true;
+}
+
+// 'F' 'S' <version 1> <id u32> <rate u16> <peak u16> <free fall u16> <count u16>,
+// then int16 x, y, z milli-g per sample, all little-endian. null if malformed.
+function decodeFallSnapshot(buf) {
+  if (!Buffer.isBuffer(buf) || buf.length < 15 || buf[0] !== 0x46 || buf[1] !== 0x53 || buf[2] !== 1) return null;
+  const count = buf.readUInt16LE(13);
+  if (buf.length !== 15 + count * 6) return null;
+  const samples = [];
+  for (let i = 0, p = 15; i < count; i++, p += 6) {
+    samples.push([buf.readInt16LE(p), buf.readInt16LE(p + 2), buf.readInt16LE(p + 4)]);
+  }
+  return {
+    id: buf.readUInt32LE(3).toString(16).padStart(8, '0'),
+    rateHz: buf.readUInt16LE(7),
+    peakMg: buf.readUInt16LE(9),
+    freeFallMs: buf.readUInt16LE(11),
+    samples
+  };
+}
+
 function pruneSizedQueues() {
   const before = {
     gps: queues.gps.length,
@@ -125,9 +275,11 @@ app.post('/api/upload/command', (req, res) => {
   }
 
   pruneOldCommands();
-  queues.commands.push({ command, timestamp: new Date().toISOString() });
+  const queued = newCommand(req.body);
+  queues.commands.push(queued);
+  publishCommand(queued);
   saveQueues();
-  logWithTime("Command uploaded:", command);
+  logWithTime("Command uploaded:", JSON.stringify(deviceCommand(queued)));
   res.send("Command uploaded");
 });
 
@@ -159,15 +311,120 @@ app.post('/api/upload/geofencing-data', (req, res) => {
   }
 });
 
-// Event upload (unchanged behavior)
+// Device diagnostics record (code/include/diag.h), keep the last day
+const MAX_DIAG_LEN = 24;
+app.post('/api/upload/diagnostics', (req, res) => {
+  if (!req.body || typeof req.body !== 'object' || req.body.v === undefined) {
+    return res.status(400).send("No diagnostics record provided");
+  }
+  queues.diagnostics = queues.diagnostics || [];
+  queues.diagnostics.push({ record: req.body, timestamp: new Date().toISOString() });
+  keepLastN(queues.diagnostics, MAX_DIAG_LEN);
+  saveQueues();
+  logWithTime("Diagnostics uploaded:", JSON.stringify(req.body).slice(0, 200));
+  res.send("Diagnostics uploaded");
+});
+
+// Combined device POST (code/include/telemetry.h), once per reporting
+// period: fix, battery, events and acks for earlier commands. The response
+// holds every command not acked yet; {} when there are none.
+app.post('/api/upload/telemetry', (req, res) => {
+  const body = req.body;
+  if (!body || typeof body !== 'object') return res.status(400).send("No telemetry provided");
+  const timestamp = new Date().toISOString();
+  const gps = body.gps || null;
+
+  if (gps) {
+    queues.gps.push({ gps, timestamp });
+    keepLastN(queues.gps, MAX_QUEUE_LEN);
+  }
+  if (body.percentage !== undefined) {
+    queues.battPercentage.push({ percentage: body.percentage, timestamp });
+    keepLastN(queues.battPercentage, MAX_QUEUE_LEN);
+  }
+  for (const ev of Array.isArray(body.events) ? body.events : []) {
+    if (!ev || !ev.type) continue;
+    const fresh = addEvent({ type: ev.type, id: ev.id || null, gps, timestamp }, 'telemetry');
+    logWithTime(fresh ? "Event uploaded:" : "Event repeated:", JSON.stringify(ev));
+  }
+  ackCommands(body.acks, 'http');
+  pruneOldCommands();
+
+  const out = queues.commands.slice(0, MAX_COMMANDS_PER_POST);
+  out.forEach(markSent);
+  saveQueues();
+  const commands = out.map(deviceCommand);
+  logWithTime(`Telemetry: ${gps ? 'fix, ' : ''}${(body.events || []).length} event(s), ` +
+              `${(body.acks || []).length} ack(s), ${commands.length} command(s) out`);
+  res.json(commands.length ? { commands } : {});
+});
+
+// Outbox replay after a gap in coverage (code/include/track_codec.h):
+// fixes, battery samples and events in one binary batch, oldest first.
+// Records before a malformed one are kept; 400 only when nothing is readable.
+app.post('/api/upload/track', express.raw({ type: 'application/octet-stream', limit: '64kb' }), (req, res) => {
+  if (!Buffer.isBuffer(req.body)) return res.status(400).send("No track provided");
+  const { version, records, error } = decodeTrack(req.body);
+  if (error && !records.length) {
+    logWithTime(`Track upload rejected: ${error}`);
+    return res.status(400).send(error);
+  }
+
+  const timestamp = new Date().toISOString();
+  let gps = null;
+  for (const r of records) {
+    const utc = r.utc ? new Date(r.utc * 1000).toISOString().replace('.000', '') : null;
+    if (r.type === 'fix') {
+      gps = { lat: r.latE7 / 1e7, lon: r.lonE7 / 1e7, utc };
+      if (r.altCm !== undefined) gps.alt_cm = r.altCm;
+      if (r.speedCmS !== undefined) gps.speed_cms = r.speedCmS;
+      if (r.courseCdeg !== undefined) gps.course_cdeg = r.courseCdeg;
+      queues.gps.push({ gps, timestamp, replayed: true });
+    } else if (r.type === 'battery') {
+      queues.battPercentage.push({ percentage: r.pct, timestamp, replayed: true });
+    } else {
+      const fresh = addEvent({ type: r.event, id: r.eventId || null, gps, utc, timestamp, replayed: true }, 'replay');
+      logWithTime(fresh ? "Event replayed:" : "Event repeated:", JSON.stringify({ type: r.event, id: r.eventId, utc }));
+    }
+  }
+  keepLastN(queues.gps, MAX_QUEUE_LEN);
+  keepLastN(queues.battPercentage, MAX_QUEUE_LEN);
+  saveQueues();
+  logWithTime(`Track v${version}: ${records.length} record(s) in ${req.body.length} B` + (error ? `, then ${error}` : ''));
+  res.json({});
+});
+
+// Samples around a fall (code/include/telemetry.h), sent after the event
+app.post('/api/upload/fall', express.raw({ type: 'application/octet-stream', limit: '16kb' }), (req, res) => {
+  const snap = decodeFallSnapshot(req.body);
+  if (!snap) return res.status(400).send("No fall snapshot provided");
+  const event = queues.events.findLast(e => e.id === snap.id);
+  if (event) {
+    event.snapshot = snap;
+  } else {
+    queues.fallSnapshots = queues.fallSnapshots || [];
+    queues.fallSnapshots.push(snap);
+    keepLastN(queues.fallSnapshots, MAX_PENDING_SNAPSHOTS);
+  }
+  saveQueues();
+  logWithTime(`Fall snapshot ${snap.id}: ${snap.samples.length} samples at ${snap.rateHz} Hz, peak ${snap.peakMg} mg` +
+              (event ? '' : ', event not seen yet'));
+  res.json({});
+});
+
+// Single event. With an id (8 hex digits, as in the device's events and in
+// the "SOS <id>:" text) it is folded into an earlier copy; channel names
+// the path it came by, "http" unless given.
 app.post('/api/upload/event', (req, res) => {
-  const { type, gps } = req.body;
+  const { type, gps, id, channel } = req.body;
   if (!type) return res.status(400).send("No event type provided");
-  const event = { type, gps: gps || null, timestamp: new Date().toISOString() };
-  queues.events.push(event);
+  if (id !== undefined && !/^[0-9a-f]{1,8}$/i.test(String(id))) return res.status(400).send("Invalid event id");
+  const event = { type, id: id !== undefined ? String(id).toLowerCase().padStart(8, '0') : null, gps: gps || null,
+                  timestamp: new Date().toISOString() };
+  const fresh = addEvent(event, typeof channel === 'string' && channel ? channel : 'http');
   saveQueues();
-  logWithTime("Event uploaded:", JSON.stringify(event));
-  res.send("Event uploaded");
+  logWithTime(fresh ? "Event uploaded:" : "Event repeated:", JSON.stringify(event));
+  res.send(fresh ? "Event uploaded" : "Event already received");
 });
 
 // ---------- DOWNLOAD ROUTES ----------
@@ -187,6 +444,12 @@ app.get('/api/download/command', (req, res) => {
   res.json(queues.commands);
 });
 
+// Acks from the device with channel and upload-to-ack latency
+app.get('/api/download/command-acks', (req, res) => {
+  logWithTime("Command acks downloaded");
+  res.json(queues.commandAcks || []);
+});
+
 // Battery percentage download (ensure only last 5)
 app.get('/api/download/batt-percentage', (req, res) => {
   keepLastN(queues.battPercentage, MAX_QUEUE_LEN);
@@ -203,6 +466,36 @@ app.get('/api/download/geofencing-data', (req, res) => {
   res.json(queues.geofencingData);
 });
 
+// Compact record format for the device (code/include/geofence.h). Only the
+// version record is returned when the device already has that version.
+app.get('/api/download/geofencing-data/device', (req, res) => {
+  const latest = queues.geofencingData[queues.geofencingData.length - 1];
+  const data = latest?.data || {};
+  const version = Math.floor(new Date(data.updatedAt || latest?.timestamp || 0).getTime() / 1000) || 0;
+  const lines = [`V,${version}`];
+  if (String(version) !== String(req.query.since)) {
+    const e7 = v => Math.round(Number(v) * 1e7);
+    // Printable ASCII only, without the record separators or what JSON
+    // would need escaped: the device puts the name in its event text
+    const name = g => String(g.name || g.id || '').replace(/[^ -~]|[,;"\\]/g, ' ').slice(0, 23);
+    for (const g of Array.isArray(data.geofences) ? data.geofences : []) {
+      if (g.type === 'circle' && g.center && g.radius > 0) {
+        lines.push(`C,${name(g)},${e7(g.center.lat)},${e7(g.center.lon)},${Math.round(g.radius)}`);
+      } else if (g.type === 'polygon' && Array.isArray(g.polygonPoints) && g.polygonPoints.length > 2) {
+        lines.push(`P,${name(g)},${g.polygonPoints.length}`);
+        for (const p of g.polygonPoints) lines.push(`${e7(p.lat)},${e7(p.lon)}`);
+      }
+    }
+  }
+  logWithTime(`Geofences for device: ${lines.length - 1} line(s), version ${version}`);
+  res.type('text/plain').send(lines.map(l => l + ';\n').join(''));
+});
+
+app.get('/api/download/diagnostics', (req, res) => {
+  logWithTime("Diagnostics downloaded");
+  res.json(queues.diagnostics || []);
+});
+
 // Events download (unchanged)
 app.get('/api/download/events', (req, res) => {
   logWithTime("Events downloaded");
@@ -212,4 +505,5 @@ app.get('/api/download/events', (req, res) => {
 // ---------- START SERVER ----------
 app.listen(PORT, () => {
   logWithTime(`API server running at http://localhost:${PORT}`);
+  startMqtt();
 });
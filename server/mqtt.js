@@ -0,0 +1,159 @@
+const net = require('net');
+const { EventEmitter } = require('events');
+
+// Minimal MQTT 3.1.1 client for the device command channel
+// (code/include/mqtt_link.h): one broker over plain TCP, QoS 1 publish and
+// subscribe, keepalive pings and reconnect with backoff. Events:
+// 'connect', 'close', 'message' (topic, payload Buffer), 'puback' (packetId).
+
+const BACKOFF_MIN_MS = 2000;
+const BACKOFF_MAX_MS = 300000;
+
+function encodeLength(n) {
+  const out = [];
+  do {
+    let b = n % 128;
+    n = Math.floor(n / 128);
+    if (n > 0) b |= 0x80;
+    out.push(b);
+  } while (n > 0);
+  return Buffer.from(out);
+}
+
+function packet(type, body) {
+  return Buffer.concat([Buffer.from([type]), encodeLength(body.length), body]);
+}
+
+function mqttString(s) {
+  const b = Buffer.from(s);
+  return Buffer.concat([Buffer.from([b.length >> 8, b.length & 0xff]), b]);
+}
+
+function u16(n) {
+  return Buffer.from([n >> 8, n & 0xff]);
+}
+
+class MqttClient extends EventEmitter {
+  constructor(url, { clientId, keepaliveS = 60, subscriptions = [] } = {}) {
+    super();
+    const u = new URL(url);
+    this.host = u.hostname;
+    this.port = Number(u.port) || 1883;
+    this.clientId = clientId || `tripcharm-server-${process.pid}`;
+    this.keepaliveS = keepaliveS;
+    this.subscriptions = subscriptions;
+    this.connected = false;
+    this.nextId = 1;
+    this.backoffMs = BACKOFF_MIN_MS;
+    this.rx = Buffer.alloc(0);
+    this.stopped = false;
+  }
+
+  start() {
+    this.stopped = false;
+    this._connect();
+  }
+
+  stop() {
+    this.stopped = true;
+    clearTimeout(this.retryTimer);
+    if (this.socket) this.socket.destroy();
+  }
+
+  // QoS 1; returns the packet ID, or 0 when not connected
+  publish(topic, payload) {
+    if (!this.connected) return 0;
+    const id = this._packetId();
+    const body = Buffer.concat([mqttString(topic), u16(id), Buffer.from(payload)]);
+    this.socket.write(packet(0x32, body));
+    return id;
+  }
+
+  _packetId() {
+    const id = this.nextId;
+    this.nextId = this.nextId === 0xffff ? 1 : this.nextId + 1;
+    return id;
+  }
+
+  _connect() {
+    this.rx = Buffer.alloc(0);
+    this.socket = net.connect(this.port, this.host);
+    this.socket.setNoDelay(true);
+    this.socket.on('connect', () => {
+      const body = Buffer.concat([
+        mqttString('MQTT'), Buffer.from([4, 0x02]), u16(this.keepaliveS),   // 3.1.1, clean session
+        mqttString(this.clientId)
+      ]);
+      this.socket.write(packet(0x10, body));
+    });
+    this.socket.on('data', data => this._onData(data));
+    this.socket.on('error', () => {});
+    this.socket.on('close', () => this._onClose());
+  }
+
+  _onClose() {
+    clearInterval(this.pingTimer);
+    const was = this.connected;
+    this.connected = false;
+    if (was) this.emit('close');
+    if (this.stopped) return;
+    this.retryTimer = setTimeout(() => this._connect(), this.backoffMs);
+    this.backoffMs = Math.min(this.backoffMs * 2, BACKOFF_MAX_MS);
+  }
+
+  _onData(data) {
+    this.rx = Buffer.concat([this.rx, data]);
+    for (;;) {
+      // Fixed header: type byte, then 1-4 length bytes
+      let len = 0, mul = 1, i = 1;
+      for (; i < this.rx.length && i <= 4; i++) {
+        len += (this.rx[i] & 0x7f) * mul;
+        mul *= 128;
+        if (!(this.rx[i] & 0x80)) break;
+      }
+      if (i >= this.rx.length || this.rx.length < i + 1 + len) return;
+      const type = this.rx[0];
+      const body = this.rx.subarray(i + 1, i + 1 + len);
+      this.rx = this.rx.subarray(i + 1 + len);
+      this._onPacket(type, body);
+    }
+  }
+
+  _onPacket(type, body) {
+    switch (type >> 4) {
+      case 2:   // CONNACK
+        if (body[1] !== 0) {
+          this.socket.destroy();
+          return;
+        }
+        this.connected = true;
+        this.backoffMs = BACKOFF_MIN_MS;
+        for (const topic of this.subscriptions) {
+          this.socket.write(packet(0x82, Buffer.concat([u16(this._packetId()), mqttString(topic), Buffer.from([1])])));
+        }
+        this.pingTimer = setInterval(() => this.socket.write(Buffer.from([0xc0, 0])), this.keepaliveS * 1000 / 2);
+        this.emit('connect');
+        break;
+      case 3: {  // PUBLISH
+        const qos = (type >> 1) & 3;
+        const topicLen = body.readUInt16BE(0);
+        const topic = body.subarray(2, 2 + topicLen).toString();
+        let offset = 2 + topicLen;
+        if (qos > 0) {
+          const id = body.readUInt16BE(offset);
+          offset += 2;
+          this.socket.write(Buffer.from([0x40, 2, id >> 8, id & 0xff]));
+        }
+        this.emit('message', topic, body.subarray(offset));
+        break;
+      }
+      case 4:   // PUBACK
+        this.emit('puback', body.readUInt16BE(0));
+        break;
+      default:  // SUBACK, PINGRESP
+        break;
+    }
+  }
+}
+
+module.exports = { MqttClient };
@@ -0,0 +1,101 @@
+// Decoder for the device's compact track batches (code/include/track_codec.h):
+// 'T' 'C' <version>, then records of <tag> <dseq> <dutc> <body> with LEB128
+// varints and zigzag deltas against the previous record.
+
+const TRACK_VERSION = 2;
+const TRACK_EVENT_MAX = 44;        // including the NUL on the device
+
+const TRACK_FIX = 1;
+const TRACK_BATTERY = 2;
+const TRACK_EVENT = 3;
+
+const GNSS_HAS_ALT = 0x01;
+const GNSS_HAS_SPEED = 0x02;
+const GNSS_HAS_COURSE = 0x04;
+const TRACK_EVENT_HAS_ID = 0x01;
+
+class Malformed extends Error {}
+
+// Decodes buf into { version, records, error }. Records before a malformed
+// one are returned; error is null for a clean stream.
+function decodeTrack(buf) {
+  if (buf.length < 3 || buf[0] !== 0x54 || buf[1] !== 0x43) return { version: 0, records: [], error: 'not a track' };
+  const version = buf[2];
+  if (version === 0 || version > TRACK_VERSION) return { version, records: [], error: 'unsupported version' };
+
+  let pos = 3;
+  const prev = { seq: 0, utc: 0, lat: 0, lon: 0, alt: 0 };
+  const records = [];
+
+  const byte = () => {
+    if (pos >= buf.length) throw new Malformed('truncated');
+    return buf[pos++];
+  };
+  const varint = () => {
+    let v = 0;
+    for (let shift = 0; shift < 35; shift += 7) {
+      const b = byte();
+      if (shift === 28 && b > 0x0f) throw new Malformed('varint over 32 bits');
+      v += (b & 0x7f) * 2 ** shift;
+      if (!(b & 0x80)) return v;
+    }
+    throw new Malformed('varint too long');
+  };
+  const unzigzag = v => (v % 2 ? -(v + 1) / 2 : v / 2);
+  // Deltas wrap like the device's uint32 arithmetic
+  const u32 = (p, v) => (p + unzigzag(v)) >>> 0;
+  const i32 = (p, v) => (p + unzigzag(v)) | 0;
+
+  try {
+    while (pos < buf.length) {
+      const tag = byte();
+      const type = tag & 0x0f, flags = tag >> 4;
+      const seq = u32(prev.seq, varint());
+      const utc = u32(prev.utc, varint());
+      const rec = { type, seq, utc };
+
+      if (type === TRACK_FIX) {
+        if (flags & ~(GNSS_HAS_ALT | GNSS_HAS_SPEED | GNSS_HAS_COURSE)) throw new Malformed('fix flags');
+        const lat = i32(prev.lat, varint());
+        const lon = i32(prev.lon, varint());
+        if (lat < -900000000 || lat > 900000000 || lon < -1800000000 || lon > 1800000000) {
+          throw new Malformed('position out of range');
+        }
+        prev.lat = lat;
+        prev.lon = lon;
+        rec.type = 'fix';
+        rec.latE7 = lat;
+        rec.lonE7 = lon;
+        if (flags & GNSS_HAS_ALT) rec.altCm = prev.alt = i32(prev.alt, varint());
+        if (flags & GNSS_HAS_SPEED) rec.speedCmS = varint();
+        if (flags & GNSS_HAS_COURSE) {
+          rec.courseCdeg = varint();
+          if (rec.courseCdeg >= 36000) throw new Malformed('course out of range');
+        }
+      } else if (type === TRACK_BATTERY) {
+        rec.type = 'battery';
+        rec.pct = byte();
+        if (flags || rec.pct > 100) throw new Malformed('battery');
+      } else if (type === TRACK_EVENT) {
+        if (flags & ~TRACK_EVENT_HAS_ID) throw new Malformed('event flags');
+        const n = varint();
+        if (n >= TRACK_EVENT_MAX || n > buf.length - pos) throw new Malformed('event text');
+        rec.type = 'event';
+        rec.event = buf.subarray(pos, pos + n).toString('latin1');
+        pos += n;
+        if (flags & TRACK_EVENT_HAS_ID) rec.eventId = varint().toString(16).padStart(8, '0');
+      } else {
+        throw new Malformed(`unknown type ${type}`);
+      }
+      prev.seq = seq;
+      prev.utc = utc;
+      records.push(rec);
+    }
+  } catch (e) {
+    if (!(e instanceof Malformed)) throw e;
+    return { version, records, error: e.message };
+  }
+  return { version, records, error: null };
+}
+
+module.exports = { decodeTrack };
@@ -0,0 +1,40 @@
+// Decoder check against the vector the firmware's encoder produces
+// (code/test/test_track_codec): run with `npm test`.
+const assert = require('assert');
+const { decodeTrack } = require('./track');
+
+const VECTOR_HEX =
+  '544302710288ba99ad0db6eaf3c3038aa28d51e8fd04' +
+  '8101a84671020a4255138c01be4713020214534f5320427574746f6e20412050726573736564e78a' +
+  'addc0602020857010214cdfdf08606b3c987f30b' +
+  '03021408466c6f6f72205570';
+
+const buf = Buffer.from(VECTOR_HEX, 'hex');
+const { version, records, error } = decodeTrack(buf);
+assert.strictEqual(error, null);
+assert.strictEqual(version, 2);
+assert.deepStrictEqual(records, [
+  { type: 'fix', seq: 1, utc: 1792224900, latE7: 473856667, lonE7: 85043333, altCm: 40820, speedCmS: 129,
+    courseCdeg: 9000 },
+  { type: 'fix', seq: 2, utc: 1792224905, latE7: 473856700, lonE7: 85043290, altCm: 40810, speedCmS: 140,
+    courseCdeg: 9150 },
+  { type: 'event', seq: 3, utc: 1792224906, event: 'SOS Button A Pressed', eventId: '6b8b4567' },
+  { type: 'battery', seq: 4, utc: 1792224910, pct: 87 },
+  { type: 'fix', seq: 5, utc: 1792224920, latE7: -338666667, lonE7: -1512000000 },
+  { type: 'event', seq: 6, utc: 1792224930, event: 'Floor Up' }
+]);
+
+// Cut short anywhere: the whole records before the cut, never a throw
+for (let cut = 3; cut < buf.length; cut++) {
+  const part = decodeTrack(buf.subarray(0, cut));
+  assert.ok(part.records.length < records.length || part.error);
+  part.records.forEach((r, i) => assert.deepStrictEqual(r, records[i]));
+}
+assert.strictEqual(decodeTrack(Buffer.from('{}')).error, 'not a track');
+assert.strictEqual(decodeTrack(Buffer.from([0x54, 0x43, 3])).error, 'unsupported version');
+
+const runs = 20000;
+const t0 = process.hrtime.bigint();
+for (let i = 0; i < runs; i++) decodeTrack(buf);
+const ns = Number(process.hrtime.bigint() - t0) / runs / records.length;
+console.log(`track decoder: ${records.length} records in ${buf.length} B, ${ns.toFixed(0)} ns per record`);